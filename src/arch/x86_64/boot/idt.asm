@@ -409,6 +409,14 @@ LoadIDT:
     ret
     GLOBAL LoadIDT
 
+[extern irq10_handler]
+irq10:
+    PUSHALL
+    call irq10_handler
+    POPALL
+    iretq
+GLOBAL irq10
+
 [extern irq11_handler]
 irq11:
     PUSHALL
@@ -130,7 +130,7 @@ enable_paging:
     wrmsr
 
     mov eax, cr0
-    or eax, 1 << 31 | 1    ;set the PG-bit | PE
+    or eax, 1 << 31 | 1 << 16 | 1    ;set the PG-bit | WP | PE
     mov cr0, eax
 
     ret
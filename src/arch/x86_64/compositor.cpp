@@ -0,0 +1,85 @@
+#include "compositor.h"
+#include "framebuffer.h"
+#include "window.h"
+#include "task.h"
+#include "device/timer.h"
+
+static pt::uint32_t    compositor_tid = 0xFFFFFFFF;
+static CompositorStats stats = {};
+
+// Set (with interrupts off) right before the task blocks for lack of
+// damage; compositor_wake() clears it and makes the task READY.
+static volatile bool   waiting = false;
+static pt::uint64_t    wake_us = 0;   // when the last wake-up arrived
+
+void compositor_wake()
+{
+    if (!waiting) return;
+    waiting = false;
+    wake_us = get_microseconds();
+    stats.wakeups++;
+    TaskScheduler::wake_task(compositor_tid);
+}
+
+const CompositorStats& compositor_stats() { return stats; }
+
+static void compositor_main()
+{
+    Framebuffer* fb = Framebuffer::get_instance();
+    pt::uint64_t last_frame = 0;
+
+    while (true) {
+        // Block until there is damage.  TASK_BLOCKED is set before sti, so a
+        // wake that lands between sti and the yield is not lost: the timer
+        // IRQ switches away and wake_task() makes us READY again.
+        pt::uint64_t due;
+        asm volatile("cli" ::: "memory");
+        if (!fb->has_damage()) {
+            waiting = true;
+            TaskScheduler::get_current_task()->state = TASK_BLOCKED;
+            asm volatile("sti" ::: "memory");
+            TaskScheduler::task_yield();
+            due = wake_us;
+        } else {
+            asm volatile("sti" ::: "memory");
+            due = last_frame + COMPOSITOR_FRAME_US;
+        }
+
+        // Frame cap.  Sleeps are whole timer ticks, so the wait rounds up to
+        // the next tick; the damage list keeps merging in the meantime.
+        pt::uint64_t now = get_microseconds();
+        while (last_frame && now - last_frame < COMPOSITOR_FRAME_US) {
+            TaskScheduler::sleep_task(1);
+            now = get_microseconds();
+        }
+        if (due < last_frame + COMPOSITOR_FRAME_US)
+            due = last_frame + COMPOSITOR_FRAME_US;
+
+        last_frame = now;
+        // Presented frames become visible in this frame and no earlier:
+        // their buffers are freed and stamped only once it is out.
+        WindowManager::latch_frames();
+        fb->Flush();
+        WindowManager::frames_shown();
+
+        now = get_microseconds();
+        if (now > due) stats.dropped += (now - due) / COMPOSITOR_FRAME_US;
+    }
+}
+
+void compositor_start()
+{
+    compositor_tid = TaskScheduler::create_task(&compositor_main, TaskScheduler::TASK_STACK_SIZE,
+                                                false, true);
+    Task* t = TaskScheduler::get_task(compositor_tid);
+    if (!t) {
+        klog("[COMPOSITOR] Failed to create task\n");
+        return;
+    }
+    // Same level as the kernel shell: ahead of every user task.
+    t->priority = 0;
+    const char name[] = "compositor";
+    for (pt::size_t i = 0; i < sizeof(name); i++) t->name[i] = name[i];
+    t->state = TASK_READY;
+    klog("[COMPOSITOR] Task %d, capped at %d Hz\n", compositor_tid, (int)COMPOSITOR_HZ);
+}
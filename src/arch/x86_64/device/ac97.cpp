@@ -3,6 +3,10 @@
 #include "virtual.h"
 #include "kernel.h"
 #include "device/pci.h"
+#include "simd.h"
+#include "task.h"
+#include "device/pic.h"
+#include "device/timer.h"
 
 // Declared in pci.cpp - direct PCI config space access
 extern pt::uint32_t pciConfigReadDWord(const pt::uint8_t bus, const pt::uint8_t slot,
@@ -26,6 +30,11 @@ pt::int32_t  AC97::owner_task_id  = -1;
 pt::uint8_t  AC97::ring_head      = 0;
 bool         AC97::dma_running    = false;
 pt::uint8_t  AC97::audio_channels = 2;
+pt::uint8_t  AC97::pci_irq        = 0xFF;
+bool         AC97::use_irq        = false;
+pt::int32_t  AC97::waiter         = -1;
+pt::uint64_t AC97::irq_stamp_us   = 0;
+AudioStats   AC97::audio_stats    = {};
 
 // ---------------------------------------------------------------------------
 // PCI config helpers
@@ -257,6 +266,19 @@ bool AC97::initialize() {
     ring_head   = 0;
     dma_running = false;
 
+    // --- Interrupt line ---
+    // Only IRQ 10 and 11 have stubs (SeaBIOS routes PCI INTx there); on any
+    // other line the driver stays polled and blocked writers re-check every
+    // timer tick.
+    pci_irq = static_cast<pt::uint8_t>(pci_read_dword(0x3C) & 0xFF);
+    if (pci_irq == 10 || pci_irq == 11) {
+        use_irq = true;
+        PIC::unmask_irq(pci_irq);
+        klog("[AC97] Using IRQ %d\n", pci_irq);
+    } else {
+        klog("[AC97] IRQ %d not wired, polling\n", pci_irq);
+    }
+
     initialized = true;
     klog("[AC97] Ready (%d x %d KB DMA buffers)\n",
          AC97_MAX_BDL_ENTRIES, AC97_DMA_BUFFER_BYTES / 1024);
@@ -295,7 +317,7 @@ void AC97::set_volume(pt::uint8_t percent) {
 
 // ---------------------------------------------------------------------------
 // clear_bdl_contents: zero num_samples/flags on every BDL entry so any stale
-// data left over from play_pcm/play_beep can't leak into the new stream.
+// data left over from an earlier stream can't leak into the new one.
 // We deliberately keep phys_addr intact (set once at initialize()).
 // ---------------------------------------------------------------------------
 static inline void clear_bdl_contents(AC97_BDL_Entry* bdl) {
@@ -315,7 +337,7 @@ bool AC97::open(pt::uint32_t rate, pt::uint8_t channels, pt::uint8_t format) {
     audio_channels = channels;
 
     // Put the channel in a known state and wipe any previous BDL contents
-    // (the boot sound from play_pcm, a prior player session, etc.). Leaving
+    // (a prior session, a one-shot buffer list, etc.). Leaving
     // stale num_samples on entries 4..31 was the cause of the "1s of music
     // then the boot sound" artifact.
     reset_channel();
@@ -335,6 +357,10 @@ void AC97::close() {
     ring_head     = 0;
     dma_running   = false;
     owner_task_id = -1;
+    if (waiter >= 0) {
+        TaskScheduler::wake_task(static_cast<pt::uint32_t>(waiter));
+        waiter = -1;
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -347,7 +373,9 @@ void AC97::poll_dma() {
     if (status & AC97_STS_DCH) {
         // Hardware halted — either we finished cleanly or we under-ran.
         // Drop out of running state so the next queue_pcm() restarts cleanly.
+        // If the mixer still owns the ring it fell behind.
         dma_running = false;
+        if (owner_task_id >= 0) audio_stats.underruns++;
         // W1C the latched interrupt/error bits.
         nabm_write_word(AC97_NABM_PCM_OUT_STATUS,
                         AC97_STS_LVBCI | AC97_STS_BCIS | AC97_STS_FIFOE);
@@ -407,11 +435,15 @@ pt::uint32_t AC97::queue_pcm(const pt::uint8_t* data, pt::uint32_t length) {
 
     if (length > AC97_DMA_BUFFER_BYTES) length = AC97_DMA_BUFFER_BYTES;
 
-    // Copy PCM into the target DMA buffer.
-    pt::uint8_t* dst = dma_buf[ring_head];
-    for (pt::uint32_t i = 0; i < length; i++) dst[i] = data[i];
+    // Copy PCM into the target DMA buffer.  Only the codec reads it, so
+    // bypass the cache.
+    kernel_fpu_begin();
+    simd_stream_copy(dma_buf[ring_head], data, length);
+    kernel_fpu_end();
 
-    // Only num_samples changes — phys_addr was set at initialize().
+    // Only num_samples changes — phys_addr was set at initialize().  IOC on
+    // every entry: BCIS fires as each buffer completes, which is what wakes
+    // queue_pcm_wait() while the rest of the ring is still playing.
     bdl[ring_head].num_samples = static_cast<pt::uint16_t>(length / 2);
     bdl[ring_head].flags       = AC97_BDL_FLAG_IOC;
 
@@ -428,7 +460,10 @@ pt::uint32_t AC97::queue_pcm(const pt::uint8_t* data, pt::uint32_t length) {
         nabm_write_byte(AC97_NABM_PCM_OUT_LVI, new_lvi);
         nabm_write_word(AC97_NABM_PCM_OUT_STATUS,
                         AC97_STS_LVBCI | AC97_STS_BCIS | AC97_STS_FIFOE);
-        nabm_write_byte(AC97_NABM_PCM_OUT_CTL, AC97_CTL_RPBM);
+        nabm_write_byte(AC97_NABM_PCM_OUT_CTL,
+                        use_irq ? (AC97_CTL_RPBM | AC97_CTL_IOCE |
+                                   AC97_CTL_LVBIE | AC97_CTL_FEIE)
+                                : AC97_CTL_RPBM);
         dma_running = true;
     } else {
         // Hot path: just advance LVI so the hardware keeps walking. This
@@ -436,143 +471,103 @@ pt::uint32_t AC97::queue_pcm(const pt::uint8_t* data, pt::uint32_t length) {
         nabm_write_byte(AC97_NABM_PCM_OUT_LVI, new_lvi);
     }
 
+    audio_stats.writes++;
     return length;
 }
 
 // ---------------------------------------------------------------------------
-// start_dma: fill BDL and kick off the PCM-Out DMA engine
-// ---------------------------------------------------------------------------
-bool AC97::start_dma(const pt::uint8_t* data, pt::uint32_t length) {
-    // Reset the channel first
-    reset_channel();
-
-    // Fill BDL entries from contiguous data
-    pt::uint32_t remaining = length;
-    pt::uint8_t  n_entries = 0;
-
-    while (remaining > 0 && n_entries < AC97_MAX_BDL_ENTRIES) {
-        pt::uint32_t chunk = remaining < AC97_DMA_BUFFER_BYTES
-                           ? remaining : AC97_DMA_BUFFER_BYTES;
-
-        // Copy chunk into DMA buffer
-        const pt::uint8_t* src = data + (pt::uint32_t)n_entries * AC97_DMA_BUFFER_BYTES;
-        pt::uint8_t* dst = dma_buf[n_entries];
-        for (pt::uint32_t b = 0; b < chunk; b++) dst[b] = src[b];
-
-        // Physical address (identity-mapped kernel)
-        pt::uint32_t phys = static_cast<pt::uint32_t>(
-            VMM::virt_to_phys(dma_buf[n_entries]));
-
-        // Samples: 1 sample = 2 bytes (16-bit); stereo means 4 bytes per frame.
-        // AC97 sample_count field = total 16-bit words in the buffer.
-        pt::uint16_t num_samples = static_cast<pt::uint16_t>(chunk / 2);
-
-        bdl[n_entries].phys_addr   = phys;
-        bdl[n_entries].num_samples = num_samples;
-        bdl[n_entries].flags       = 0;
+// queue_pcm_wait: queue_pcm that sleeps on a full ring.
+//
+// The data is copied straight into the DMA slot, so there is nothing for the
+// interrupt handler to refill; it only wakes the writer, which then does the
+// copy in its own context.  The slot check and the block happen with
+// interrupts off so a completion between them cannot be missed.
+// ---------------------------------------------------------------------------
+pt::uint32_t AC97::queue_pcm_wait(const pt::uint8_t* data, pt::uint32_t length) {
+    Task* t = TaskScheduler::get_current_task();
+    if (!t) return 0;
+
+    bool waited = false;
+    while (owner_task_id == static_cast<pt::int32_t>(t->id)) {
+        pt::uint32_t n = queue_pcm(data, length);
+        if (n) {
+            if (waited) audio_stats.blocked++;
+            return n;
+        }
+        if (!initialized || !data || length == 0) return 0;
 
-        remaining -= chunk;
-        n_entries++;
+        asm volatile("cli");
+        if (has_free_slot()) {
+            asm volatile("sti");
+            continue;
+        }
+        waited = true;
+        waiter = static_cast<pt::int32_t>(t->id);
+        t->sleep_deadline = get_ticks() + (use_irq ? AC97_WAIT_TICKS : 1);
+        t->state = TASK_BLOCKED;
+        asm volatile("sti");
+        TaskScheduler::task_yield();
+
+        asm volatile("cli");
+        t->sleep_deadline = 0;
+        if (waiter == static_cast<pt::int32_t>(t->id)) {
+            waiter = -1;                    // timed out or polled
+        } else if (use_irq) {
+            pt::uint64_t lat = get_microseconds() - irq_stamp_us;
+            audio_stats.wakeups++;
+            audio_stats.wake_us += lat;
+            if (lat > audio_stats.wake_max_us) audio_stats.wake_max_us = lat;
+        }
+        asm volatile("sti");
     }
-
-    // Mark the last entry
-    bdl[n_entries - 1].flags = AC97_BDL_FLAG_LAST | AC97_BDL_FLAG_IOC;
-
-    // Memory fence so the CPU writes reach RAM before the DMA controller reads them
-    asm volatile("mfence" ::: "memory");
-
-    // Program BDL base address
-    pt::uint32_t bdl_phys = static_cast<pt::uint32_t>(VMM::virt_to_phys(bdl));
-    nabm_write_dword(AC97_NABM_PCM_OUT_BDL_BASE, bdl_phys);
-
-    // Set Last Valid Index (0-based)
-    nabm_write_byte(AC97_NABM_PCM_OUT_LVI, n_entries - 1);
-
-    // Start DMA: RPBM = 1
-    nabm_write_byte(AC97_NABM_PCM_OUT_CTL, AC97_CTL_RPBM);
-
-    return true;
+    return 0;
 }
 
 // ---------------------------------------------------------------------------
-// play_pcm
+// handle_irq: buffer completion / last valid buffer / FIFO error.
 // ---------------------------------------------------------------------------
-bool AC97::play_pcm(const pt::uint8_t* data, pt::uint32_t length, pt::uint32_t rate) {
-    if (!initialized) { klog("[AC97] Not initialized\n"); return false; }
-    if (!data || length == 0) { klog("[AC97] Invalid data\n"); return false; }
+bool AC97::handle_irq() {
+    if (!initialized || !use_irq) return false;
 
-    stop();
-    set_sample_rate(rate);
-    return start_dma(data, length);
+    pt::uint16_t status = nabm_read_word(AC97_NABM_PCM_OUT_STATUS);
+    pt::uint16_t pending = status & (AC97_STS_BCIS | AC97_STS_LVBCI | AC97_STS_FIFOE);
+    if (!pending) return false;
+
+    // W1C — the line is level-triggered and stays asserted until cleared.
+    nabm_write_word(AC97_NABM_PCM_OUT_STATUS, pending);
+    audio_stats.interrupts++;
+
+    if (waiter >= 0) {
+        irq_stamp_us = get_microseconds();
+        TaskScheduler::wake_task(static_cast<pt::uint32_t>(waiter));
+        waiter = -1;
+    }
+    return true;
 }
 
 // ---------------------------------------------------------------------------
-// play_beep: generate square wave in DMA buffer 0 and play it
+// queued_us: PICB counts the 16-bit samples left in the current buffer;
+// the entries after it up to LVI are still untouched.
 // ---------------------------------------------------------------------------
-bool AC97::play_beep(pt::uint32_t frequency_hz, pt::uint32_t duration_ms) {
-    if (!initialized) { klog("[AC97] Not initialized\n"); return false; }
-
-    // Use a fixed 48 kHz sample rate
-    constexpr pt::uint32_t RATE = 48000;
-
-    // Number of frames (stereo) we can fit in one DMA buffer
-    // One frame = 4 bytes (2 × 16-bit samples)
-    constexpr pt::uint32_t MAX_FRAMES = AC97_DMA_BUFFER_BYTES / 4;
-
-    // Requested frames
-    pt::uint32_t total_frames = (RATE * duration_ms) / 1000;
-    if (total_frames > MAX_FRAMES) total_frames = MAX_FRAMES;
-
-    // Frames per half-period of the square wave
-    pt::uint32_t half_period = RATE / (frequency_hz * 2);
-    if (half_period == 0) half_period = 1;
+pt::uint64_t AC97::queued_us() {
+    if (!initialized || !dma_running || cached_sample_rate == 0) return 0;
+    if (nabm_read_word(AC97_NABM_PCM_OUT_STATUS) & AC97_STS_DCH) return 0;
 
-    constexpr pt::int16_t AMPLITUDE = 16000;  // ~50% of full scale
-
-    pt::uint8_t* buf  = dma_buf[0];
-    pt::uint32_t phase = 0;
-
-    for (pt::uint32_t f = 0; f < total_frames; f++) {
-        pt::int16_t s = (phase < half_period) ? AMPLITUDE : -AMPLITUDE;
-        phase++;
-        if (phase >= half_period * 2) phase = 0;
-
-        // Left channel (little-endian 16-bit)
-        buf[f * 4 + 0] = static_cast<pt::uint8_t>(s & 0xFF);
-        buf[f * 4 + 1] = static_cast<pt::uint8_t>((s >> 8) & 0xFF);
-        // Right channel (same)
-        buf[f * 4 + 2] = buf[f * 4 + 0];
-        buf[f * 4 + 3] = buf[f * 4 + 1];
+    pt::uint8_t  civ     = nabm_read_byte(AC97_NABM_PCM_OUT_CIV) & 0x1F;
+    pt::uint8_t  lvi     = nabm_read_byte(AC97_NABM_PCM_OUT_LVI) & 0x1F;
+    pt::uint64_t samples = nabm_read_word(AC97_NABM_PCM_OUT_SAMPLES);
+    for (pt::uint8_t i = civ; i != lvi; ) {
+        i = (i + 1) & (AC97_MAX_BDL_ENTRIES - 1);
+        samples += bdl[i].num_samples;
     }
-
-    pt::uint32_t byte_count = total_frames * 4;
-    klog("[AC97] play_beep: %d Hz, %d ms, %d bytes\n",
-         frequency_hz, duration_ms, byte_count);
-
-    stop();
-    set_sample_rate(RATE);
-
-    // Setup single BDL entry directly (already in dma_buf[0])
-    reset_channel();
-
-    pt::uint32_t phys = static_cast<pt::uint32_t>(VMM::virt_to_phys(dma_buf[0]));
-
-    bdl[0].phys_addr   = phys;
-    bdl[0].num_samples = static_cast<pt::uint16_t>(byte_count / 2);
-    bdl[0].flags       = AC97_BDL_FLAG_LAST | AC97_BDL_FLAG_IOC;
-
-    asm volatile("mfence" ::: "memory");
-
-    pt::uint32_t bdl_phys = static_cast<pt::uint32_t>(VMM::virt_to_phys(bdl));
-    nabm_write_dword(AC97_NABM_PCM_OUT_BDL_BASE, bdl_phys);
-    nabm_write_byte(AC97_NABM_PCM_OUT_LVI, 0);
-    nabm_write_byte(AC97_NABM_PCM_OUT_CTL, AC97_CTL_RPBM);
-
-    klog("[AC97] Beep DMA started (BDL@%x, samples=%d)\n",
-         bdl_phys, bdl[0].num_samples);
-    return true;
+    pt::uint64_t frames = samples / (audio_channels ? audio_channels : 2);
+    return frames * 1000000ull / cached_sample_rate;
 }
 
+pt::uint8_t AC97::irq_line() { return pci_irq; }
+bool AC97::irq_enabled() { return use_irq; }
+const AudioStats& AC97::stats() { return audio_stats; }
+
 // ---------------------------------------------------------------------------
 // stop
 // ---------------------------------------------------------------------------
@@ -587,12 +582,3 @@ void AC97::stop() {
         IO::io_wait();
     }
 }
-
-// ---------------------------------------------------------------------------
-// is_playing
-// ---------------------------------------------------------------------------
-bool AC97::is_playing() {
-    if (!initialized) return false;
-    // DMA Controller Halted bit is 0 while playing
-    return !(nabm_read_word(AC97_NABM_PCM_OUT_STATUS) & AC97_STS_DCH);
-}
@@ -0,0 +1,86 @@
+#include "device/bga.h"
+#include "io.h"
+#include "virtual.h"
+#include "kernel.h"
+#include "device/pci.h"
+
+// Declared in pci.cpp - direct PCI config space access
+extern pt::uint32_t pciConfigReadDWord(const pt::uint8_t bus, const pt::uint8_t slot,
+                                       const pt::uint8_t func, const pt::uint8_t offset);
+
+bool       BGA::initialized = false;
+pt::size_t BGA::vram_bytes  = 0;
+
+pt::uint16_t BGA::read(pt::uint16_t index) {
+    IO::outw(BGA_IOPORT_INDEX, index);
+    return IO::inw(BGA_IOPORT_DATA);
+}
+
+void BGA::write(pt::uint16_t index, pt::uint16_t value) {
+    IO::outw(BGA_IOPORT_INDEX, index);
+    IO::outw(BGA_IOPORT_DATA, value);
+}
+
+bool BGA::initialize(pt::uintptr_t lfb, pt::uint32_t width, pt::uint32_t height,
+                     pt::uint32_t bpp, pt::uint32_t stride) {
+    // --- Find device on PCI bus ---
+    bool found = false;
+    pt::uint32_t bar0 = 0;
+    pci_device* devices = pci::enumerate();
+    for (pci_device* d = devices; d && d->vendor_id != 0xFFFF; d++) {
+        if (d->vendor_id == BGA_VENDOR_ID && d->device_id == BGA_DEVICE_ID) {
+            bar0 = pciConfigReadDWord(static_cast<pt::uint8_t>(d->bus), d->device, 0, 0x10);
+            found = true;
+            break;
+        }
+    }
+    VMM::Instance()->kfree(devices);
+    if (!found) return false;
+
+    // --- Is it the adapter the bootloader handed us, in that mode? ---
+    const pt::uint16_t id = read(BGA_INDEX_ID);
+    if (id < BGA_ID_MIN || id > BGA_ID_MAX) {
+        klog("[BGA] Unsupported dispi ID %x\n", id);
+        return false;
+    }
+    if ((bar0 & ~0xFu) != lfb) {
+        klog("[BGA] LFB %lx is not BAR0 %x\n", lfb, bar0);
+        return false;
+    }
+    if (!(read(BGA_INDEX_ENABLE) & BGA_ENABLED) ||
+        read(BGA_INDEX_XRES) != width || read(BGA_INDEX_YRES) != height ||
+        read(BGA_INDEX_BPP) != bpp || stride != width * (bpp / 8)) {
+        klog("[BGA] Mode is not %dx%dx%d packed\n", width, height, bpp);
+        return false;
+    }
+
+    // --- Room for two pages? ---
+    vram_bytes = (pt::size_t)read(BGA_INDEX_VIDEO_MEMORY_64K) * 0x10000;
+    if (vram_bytes < 2 * (pt::size_t)stride * height) {
+        klog("[BGA] %d KB of VRAM: no room for a second page\n", (int)(vram_bytes / 1024));
+        return false;
+    }
+    write(BGA_INDEX_VIRT_WIDTH, static_cast<pt::uint16_t>(width));
+    write(BGA_INDEX_VIRT_HEIGHT, static_cast<pt::uint16_t>(2 * height));
+    write(BGA_INDEX_X_OFFSET, 0);
+    write(BGA_INDEX_Y_OFFSET, 0);
+    // The adapter clamps the virtual size to what fits; check it took.
+    if (read(BGA_INDEX_VIRT_HEIGHT) < 2 * height) {
+        klog("[BGA] Virtual height stuck at %d\n", read(BGA_INDEX_VIRT_HEIGHT));
+        write(BGA_INDEX_VIRT_HEIGHT, static_cast<pt::uint16_t>(height));
+        return false;
+    }
+
+    initialized = true;
+    klog("[BGA] dispi %x, %d KB VRAM, two %dx%d pages\n", id,
+         (int)(vram_bytes / 1024), width, height);
+    return true;
+}
+
+bool BGA::is_present() { return initialized; }
+
+pt::size_t BGA::vram_size() { return initialized ? vram_bytes : 0; }
+
+void BGA::set_y_offset(pt::uint32_t y) {
+    write(BGA_INDEX_Y_OFFSET, static_cast<pt::uint16_t>(y));
+}
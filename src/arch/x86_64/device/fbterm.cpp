@@ -20,6 +20,14 @@ bool FbTerm::init(const pt::uint8_t* psf_data, pt::size_t psf_size, Framebuffer*
     m_cols    = m_term_w / PSF1_GLYPH_WIDTH;
     m_rows    = fb->get_height() / m_glyph_h;
 
+    // Allocated once, before m_ready: kmalloc logs, and klog output comes
+    // back here.
+    m_atlas_px = static_cast<pt::uint32_t*>(vmm.kmalloc(
+        (pt::size_t)ATLAS_SLOTS * ATLAS_GLYPHS * PSF1_GLYPH_WIDTH * m_glyph_h * 4));
+    if (!m_atlas_px) return false;
+    for (pt::uint32_t i = 0; i < ATLAS_SLOTS; i++) m_atlas[i].valid = false;
+    m_atlas_next = 0;
+
     m_cur_col         = 0;
     m_cur_row         = 0;
     m_ready           = true;
@@ -30,23 +38,74 @@ bool FbTerm::init(const pt::uint8_t* psf_data, pt::size_t psf_size, Framebuffer*
     return true;
 }
 
-void FbTerm::draw_glyph(char c, pt::uint32_t px, pt::uint32_t py)
+const pt::uint32_t* FbTerm::atlas_for(pt::uint32_t fg, pt::uint32_t bg)
 {
-    pt::uint8_t ch = static_cast<pt::uint8_t>(c);
-    if (ch > 127) ch = '?';
+    const pt::size_t slot_px = (pt::size_t)ATLAS_GLYPHS * PSF1_GLYPH_WIDTH * m_glyph_h;
+    for (pt::uint32_t i = 0; i < ATLAS_SLOTS; i++)
+        if (m_atlas[i].valid && m_atlas[i].fg == fg && m_atlas[i].bg == bg)
+            return m_atlas_px + i * slot_px;
 
-    const pt::uint8_t* glyph = m_glyphs + ch * m_glyph_h;
+    const pt::uint32_t slot = m_atlas_next;
+    m_atlas_next = (m_atlas_next + 1) % ATLAS_SLOTS;
+    pt::uint32_t* dst = m_atlas_px + slot * slot_px;
+    for (pt::uint32_t ch = 0; ch < ATLAS_GLYPHS; ch++) {
+        const pt::uint8_t* glyph = m_glyphs + ch * m_glyph_h;
+        for (pt::uint32_t row = 0; row < m_glyph_h; row++) {
+            const pt::uint8_t bits = glyph[row];
+            for (pt::uint32_t col = 0; col < PSF1_GLYPH_WIDTH; col++)
+                *dst++ = (bits & (0x80 >> col)) ? fg : bg;
+        }
+    }
+    m_atlas[slot] = { fg, bg, true };
+    return m_atlas_px + slot * slot_px;
+}
 
-    for (pt::uint32_t row = 0; row < m_glyph_h; row++) {
-        pt::uint8_t bits = glyph[row];
-        for (pt::uint32_t col = 0; col < PSF1_GLYPH_WIDTH; col++) {
-            pt::uint32_t color = (bits & (0x80 >> col)) ? m_fg : m_bg;
-            m_fb->FillRect(px + col, py + row, 1, 1,
-                           static_cast<pt::uint8_t>((color >> 16) & 0xFF),
-                           static_cast<pt::uint8_t>((color >>  8) & 0xFF),
-                           static_cast<pt::uint8_t>( color        & 0xFF));
+void FbTerm::draw_text(const char* str, pt::uint32_t n, pt::uint32_t* buf,
+                       pt::uint32_t pitch, const DamageRect& clip,
+                       pt::uint32_t px, pt::uint32_t py,
+                       pt::uint32_t fg, pt::uint32_t bg)
+{
+    if (!m_ready || !buf || n == 0) return;
+    constexpr pt::uint32_t gw = PSF1_GLYPH_WIDTH;
+    const pt::uint32_t gh = m_glyph_h;
+    const pt::uint32_t y0 = py < clip.y0 ? clip.y0 : py;
+    const pt::uint32_t y1 = py + gh > clip.y1 ? clip.y1 : py + gh;
+    if (y0 >= y1 || px >= clip.x1) return;
+
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    const pt::uint32_t* atlas = atlas_for(fg, bg);
+    for (pt::uint32_t i = 0; i < n; i++) {
+        const pt::uint32_t gx = px + i * gw;
+        if (gx >= clip.x1) break;
+        if (gx + gw <= clip.x0) continue;
+        const pt::uint32_t c0 = gx < clip.x0 ? clip.x0 - gx : 0;
+        const pt::uint32_t c1 = gx + gw > clip.x1 ? clip.x1 - gx : gw;
+        pt::uint8_t ch = static_cast<pt::uint8_t>(str[i]);
+        if (ch >= ATLAS_GLYPHS) ch = '?';
+        const pt::uint32_t* glyph = atlas + (pt::size_t)ch * gw * gh + (y0 - py) * gw;
+        pt::uint32_t* row = buf + (pt::size_t)y0 * pitch + gx;
+        for (pt::uint32_t y = y0; y < y1; y++, glyph += gw, row += pitch) {
+            if (c0 == 0 && c1 == gw) {
+                // Whole glyph row: four 64-bit moves.
+                auto* d = reinterpret_cast<pt::uint64_t*>(row);
+                auto* s = reinterpret_cast<const pt::uint64_t*>(glyph);
+                d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+            } else {
+                for (pt::uint32_t c = c0; c < c1; c++) row[c] = glyph[c];
+            }
         }
     }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+void FbTerm::draw_glyph(char c, pt::uint32_t px, pt::uint32_t py,
+                        pt::uint32_t fg, pt::uint32_t bg, Framebuffer* fb)
+{
+    if (!fb) fb = m_fb;
+    pt::uintptr_t target = fb->get_back() ? fb->get_back() : fb->get_vram();
+    draw_text(&c, 1, reinterpret_cast<pt::uint32_t*>(target), fb->get_stride() / 4,
+              fb->get_clip(), px, py, fg, bg);
 }
 
 void FbTerm::newline()
@@ -209,7 +268,7 @@ void FbTerm::put_char(char c)
         return;
     }
 
-    draw_glyph(c, m_cur_col * PSF1_GLYPH_WIDTH, m_cur_row * m_glyph_h);
+    draw_glyph(c, m_cur_col * PSF1_GLYPH_WIDTH, m_cur_row * m_glyph_h, m_fg, m_bg);
     m_cur_col++;
     if (m_cur_col >= m_cols)
         newline();
@@ -221,26 +280,22 @@ void FbTerm::print(const char* str)
 }
 
 void FbTerm::draw_at(pt::uint32_t px, pt::uint32_t py, const char* str,
-                     pt::uint32_t fg, pt::uint32_t bg)
+                     pt::uint32_t fg, pt::uint32_t bg, Framebuffer* target)
 {
     if (!m_ready) return;
-    pt::uint32_t saved_fg = m_fg, saved_bg = m_bg;
-    m_fg = fg; m_bg = bg;
-    while (*str) {
-        draw_glyph(*str++, px, py);
-        px += PSF1_GLYPH_WIDTH;
-    }
-    m_fg = saved_fg; m_bg = saved_bg;
+    if (!target) target = m_fb;
+    pt::uint32_t n = 0;
+    while (str[n]) n++;
+    pt::uintptr_t dst = target->get_back() ? target->get_back() : target->get_vram();
+    draw_text(str, n, reinterpret_cast<pt::uint32_t*>(dst), target->get_stride() / 4,
+              target->get_clip(), px, py, fg, bg);
 }
 
 void FbTerm::put_char_at(char c, pt::uint32_t px, pt::uint32_t py,
                          pt::uint32_t fg, pt::uint32_t bg)
 {
     if (!m_ready) return;
-    pt::uint32_t saved_fg = m_fg, saved_bg = m_bg;
-    m_fg = fg; m_bg = bg;
-    draw_glyph(c, px, py);
-    m_fg = saved_fg; m_bg = saved_bg;
+    draw_glyph(c, px, py, fg, bg);
 }
 
 void FbTerm::scroll_region(pt::uint32_t x, pt::uint32_t y,
@@ -256,19 +311,7 @@ void FbTerm::render_glyph_to_buf(char c, pt::uint32_t* buf,
                                   pt::uint32_t px, pt::uint32_t py,
                                   pt::uint32_t fg, pt::uint32_t bg)
 {
-    if (!m_ready || !buf) return;
-    pt::uint8_t ch = static_cast<pt::uint8_t>(c);
-    if (ch > 127) ch = '?';
-    const pt::uint8_t* glyph = m_glyphs + ch * m_glyph_h;
-    for (pt::uint32_t row = 0; row < m_glyph_h; row++) {
-        if (py + row >= buf_h) break;
-        pt::uint8_t bits = glyph[row];
-        for (pt::uint32_t col = 0; col < PSF1_GLYPH_WIDTH; col++) {
-            if (px + col >= buf_w) break;
-            pt::uint32_t color = (bits & (0x80 >> col)) ? fg : bg;
-            buf[(py + row) * buf_w + (px + col)] = color;
-        }
-    }
+    draw_text(&c, 1, buf, buf_w, DamageRect{ 0, 0, buf_w, buf_h }, px, py, fg, bg);
 }
 
 void fbterm_putchar(char c)
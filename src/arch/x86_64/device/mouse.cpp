@@ -98,10 +98,37 @@ static int mouse_write_pos = 0;
 static int mouse_read_pos  = 0;
 
 bool get_mouse_event(MouseEvent* out) {
-    if (mouse_read_pos == mouse_write_pos) return false;
-    *out = mouse_event_buf[mouse_read_pos % MOUSE_BUF_SIZE];
-    mouse_read_pos++;
-    return true;
+    // The IRQ may rewrite the unread tail (see queue_mouse_event), so pop
+    // with interrupts off.
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    bool got = mouse_read_pos != mouse_write_pos;
+    if (got) {
+        *out = mouse_event_buf[mouse_read_pos % MOUSE_BUF_SIZE];
+        mouse_read_pos++;
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    return got;
+}
+
+// Append a packet, merging it into the newest unread event when the buttons
+// have not changed and the summed deltas still fit in a byte: readers see
+// the same total motion in fewer events.
+static void queue_mouse_event(const MouseEvent& ev)
+{
+    if (mouse_write_pos != mouse_read_pos) {
+        MouseEvent& tail = mouse_event_buf[(mouse_write_pos - 1) % MOUSE_BUF_SIZE];
+        int sx = tail.dx + ev.dx;
+        int sy = tail.dy + ev.dy;
+        if (tail.left_button == ev.left_button && tail.right_button == ev.right_button &&
+            sx >= -128 && sx <= 127 && sy >= -128 && sy <= 127) {
+            tail.dx = (pt::int8_t)sx;
+            tail.dy = (pt::int8_t)sy;
+            return;
+        }
+    }
+    mouse_event_buf[mouse_write_pos % MOUSE_BUF_SIZE] = ev;
+    mouse_write_pos++;
 }
 
 static bool prev_left_button = false;
@@ -122,8 +149,7 @@ void mouse_routine(const pt::int8_t mouse_byte[])
     ev.dy           = mouse_y;  // PS/2 convention: positive = up
     ev.left_button  = left_button_pressed;
     ev.right_button = right_button_pressed;
-    mouse_event_buf[mouse_write_pos % MOUSE_BUF_SIZE] = ev;
-    mouse_write_pos++;
+    queue_mouse_event(ev);
 
     pt::int16_t newPosX = mouse.pos_x + mouse_x;
     if (newPosX < -(CURSOR_WIDTH - MIN_CURSOR_VISIBLE))
@@ -168,4 +194,8 @@ void mouse_routine(const pt::int8_t mouse_byte[])
         pt::int32_t ny = mouse.pos_y - drag_off_y;
         WindowManager::move_window(drag_wid, nx, ny);
     }
+
+    // After the click-to-focus above, so the press lands in the window it
+    // focused.
+    WindowManager::push_mouse_event(mouse_x, mouse_y, left_button_pressed, right_button_pressed);
 }
\ No newline at end of file
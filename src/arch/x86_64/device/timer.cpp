@@ -3,19 +3,21 @@
 #include "io.h"
 #include "virtual.h"
 #include "vterm.h"
-#include "framebuffer.h"
 
 extern VMM vmm;
 
 static Timer* timer_list = nullptr;
 static pt::uint64_t next_timer_id = 1;
 pt::uint64_t ticks;
+static pt::uint32_t pit_divisor = 0;
+static TickLatency  tick_latency = {};
 
 void init_timer(const pt::uint32_t freq)
 {
 	klog("[TIMER] Register for %d freq\n", freq);
 
 	const pt::uint32_t divisor = 1193180 / freq;
+	pit_divisor = divisor;
 
 	const auto low = static_cast<pt::uint8_t>(divisor & 0xFF);
 	const auto high = static_cast<pt::uint8_t>(divisor >> 8 & 0xFF);
@@ -133,19 +135,26 @@ void check_timers()
 	}
 }
 
-static bool fb_flush_enabled = false;
-
-void enable_fb_flush() { fb_flush_enabled = true; }
+const TickLatency& timer_tick_latency() { return tick_latency; }
 
 void timer_tick()
 {
+	// How long ago the PIT fired.  Channel 0 runs in mode 3: after the IRQ
+	// edge the count falls from the divisor by 2 per PIT clock, so this is
+	// exact for delays under half a tick (10 ms).
+	IO::outb(ModeCommandRegister, 0x00);
+	pt::uint32_t count  = IO::inb(Channel0DataPort);
+	count |= (pt::uint32_t)IO::inb(Channel0DataPort) << 8;
+	if (count > pit_divisor) count = pit_divisor;
+	const pt::uint64_t lat_us = (pt::uint64_t)(pit_divisor - count) / 2 * 1000000 / 1193180;
+	tick_latency.samples++;
+	tick_latency.total_us += lat_us;
+	tick_latency.last_us   = lat_us;
+	if (lat_us > tick_latency.max_us) tick_latency.max_us = lat_us;
+
 	ticks++;
 	check_timers();
-	// Flush back buffer to VRAM (composites cursor on top)
-	if (fb_flush_enabled) {
-		Framebuffer* fb = Framebuffer::get_instance();
-		if (fb) fb->Flush();
-	}
+	// Compositing runs in its own task (compositor.cpp), not here.
 	// Scheduling is handled by irq0_schedule in idt.cpp, not here.
 }
 
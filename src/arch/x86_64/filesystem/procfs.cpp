@@ -1,11 +1,16 @@
 #include "fs/procfs.h"
 #include "fs/fat32.h"
 #include "task.h"
+#include "text_cache.h"
 #include "virtual.h"
 #include "vterm.h"
 #include "device/timer.h"
 #include "device/disk.h"
 #include "kernel.h"
+#include "framebuffer.h"
+#include "compositor.h"
+#include "device/ac97.h"
+#include "mixer.h"
 
 // ── Minimal buffer-builder (no snprintf in kernel) ───────────────────────────
 
@@ -75,6 +80,9 @@ int ProcFS::gen_meminfo(char* buf, int cap) {
     p = pb_str(buf, p, cap, "MemFree:  ");
     p = pb_uint(buf, p, cap, free / 1024);
     p = pb_str(buf, p, cap, " kB\n");
+    p = pb_str(buf, p, cap, "Text:     ");
+    p = pb_uint(buf, p, cap, TextCache::resident_pages() * 4);
+    p = pb_str(buf, p, cap, " kB\n");
     return p;
 }
 
@@ -92,6 +100,97 @@ int ProcFS::gen_uptime(char* buf, int cap) {
     return p;
 }
 
+// Compositor cost: how often Flush had work, how much it moved, how long it took.
+int ProcFS::gen_fbstat(char* buf, int cap) {
+    const FrameStats& s = Framebuffer::get_instance()->frame_stats();
+    int p = 0;
+    p = pb_str(buf, p, cap, "Frames:     ");
+    p = pb_uint(buf, p, cap, s.frames);
+    p = pb_str(buf, p, cap, "\nIdle:       ");
+    p = pb_uint(buf, p, cap, s.idle);
+    p = pb_str(buf, p, cap, "\nPixels:     ");
+    p = pb_uint(buf, p, cap, s.pixels);
+    p = pb_str(buf, p, cap, "\nLastPixels: ");
+    p = pb_uint(buf, p, cap, s.last_pixels);
+    p = pb_str(buf, p, cap, "\nAvgUs:      ");
+    p = pb_uint(buf, p, cap, s.frames ? s.total_us / s.frames : 0);
+    p = pb_str(buf, p, cap, "\nLastUs:     ");
+    p = pb_uint(buf, p, cap, s.last_us);
+    p = pb_str(buf, p, cap, "\nMaxUs:      ");
+    p = pb_uint(buf, p, cap, s.max_us);
+    p = pb_str(buf, p, cap, "\nUploadUs:   ");
+    p = pb_uint(buf, p, cap, s.frames ? s.upload_us / s.frames : 0);
+    p = pb_str(buf, p, cap, "\nFlips:      ");
+    p = pb_uint(buf, p, cap, s.flips);
+    p = pb_str(buf, p, cap, "\nReplayPx:   ");
+    p = pb_uint(buf, p, cap, s.replay_pixels);
+    p = pb_str(buf, p, cap, "\nCursorMoves:");
+    p = pb_uint(buf, p, cap, s.cursor_moves);
+    p = pb_str(buf, p, cap, "\nCursorBytes:");
+    p = pb_uint(buf, p, cap, s.cursor_moves ? s.cursor_bytes / s.cursor_moves : 0);
+    p = pb_str(buf, p, cap, "\nCursorLatUs:");
+    p = pb_uint(buf, p, cap, s.cursor_shown ? s.cursor_lat_us / s.cursor_shown : 0);
+    p = pb_str(buf, p, cap, "\nCursorMax:  ");
+    p = pb_uint(buf, p, cap, s.cursor_lat_max);
+    static const char* const mappings[] = { "uncached", "wc-pat", "wc-mtrr" };
+    p = pb_str(buf, p, cap, "\nVram:       ");
+    p = pb_str(buf, p, cap, mappings[(int)Framebuffer::get_instance()->get_mapping()]);
+    const CompositorStats& c = compositor_stats();
+    p = pb_str(buf, p, cap, "\nWakeups:    ");
+    p = pb_uint(buf, p, cap, c.wakeups);
+    p = pb_str(buf, p, cap, "\nDropped:    ");
+    p = pb_uint(buf, p, cap, c.dropped);
+    const TickLatency& t = timer_tick_latency();
+    p = pb_str(buf, p, cap, "\nTickLatUs:  ");
+    p = pb_uint(buf, p, cap, t.samples ? t.total_us / t.samples : 0);
+    p = pb_str(buf, p, cap, "\nTickLatMax: ");
+    p = pb_uint(buf, p, cap, t.max_us);
+    p = pb_nl(buf, p, cap);
+    return p;
+}
+
+// Audio path: interrupt line, how far ahead of the DAC the ring is, the
+// mixer's load, and how the blocking write behaves.
+int ProcFS::gen_audio(char* buf, int cap) {
+    int p = 0;
+    if (!AC97::is_present()) {
+        p = pb_str(buf, p, cap, "Device:     none");
+        p = pb_nl(buf, p, cap);
+        return p;
+    }
+    const AudioStats& s = AC97::stats();
+    p = pb_str(buf, p, cap, "Irq:        ");
+    if (AC97::irq_enabled()) p = pb_uint(buf, p, cap, AC97::irq_line());
+    else                     p = pb_str(buf, p, cap, "polled");
+    p = pb_str(buf, p, cap, "\nQueuedUs:   ");
+    p = pb_uint(buf, p, cap, AC97::queued_us());
+    const MixerStats& m = mixer_stats();
+    p = pb_str(buf, p, cap, "\nStreams:    ");
+    p = pb_uint(buf, p, cap, mixer_stream_count());
+    p = pb_str(buf, p, cap, "\nPeriods:    ");
+    p = pb_uint(buf, p, cap, m.periods);
+    p = pb_str(buf, p, cap, "\nMixUs:      ");
+    p = pb_uint(buf, p, cap, m.periods ? m.mix_us / m.periods : 0);
+    p = pb_str(buf, p, cap, "\nMixMaxUs:   ");
+    p = pb_uint(buf, p, cap, m.max_us);
+    p = pb_str(buf, p, cap, "\nStarved:    ");
+    p = pb_uint(buf, p, cap, m.starved);
+    p = pb_str(buf, p, cap, "\nInterrupts: ");
+    p = pb_uint(buf, p, cap, s.interrupts);
+    p = pb_str(buf, p, cap, "\nWrites:     ");
+    p = pb_uint(buf, p, cap, s.writes);
+    p = pb_str(buf, p, cap, "\nBlocked:    ");
+    p = pb_uint(buf, p, cap, s.blocked);
+    p = pb_str(buf, p, cap, "\nUnderruns:  ");
+    p = pb_uint(buf, p, cap, s.underruns);
+    p = pb_str(buf, p, cap, "\nWakeLatUs:  ");
+    p = pb_uint(buf, p, cap, s.wakeups ? s.wake_us / s.wakeups : 0);
+    p = pb_str(buf, p, cap, "\nWakeLatMax: ");
+    p = pb_uint(buf, p, cap, s.wake_max_us);
+    p = pb_nl(buf, p, cap);
+    return p;
+}
+
 // State code: TASK_READY=0, TASK_RUNNING=1, TASK_BLOCKED=2, TASK_DEAD=3, TASK_ZOMBIE=4
 static const char state_char[] = { 'R', 'R', 'B', 'D', 'Z' };
 
@@ -118,6 +217,15 @@ int ProcFS::gen_status(pt::uint32_t pid, char* buf, int cap) {
     p = pb_str(buf, p, cap, "User:  ");
     p = pb_str(buf, p, cap, t->user_mode ? "yes" : "no");
     p = pb_nl(buf, p, cap);
+    if (t->user_mode) {
+        pt::size_t shared, priv;
+        TaskScheduler::count_user_pages(t, &shared, &priv);
+        p = pb_str(buf, p, cap, "Pages: ");
+        p = pb_uint(buf, p, cap, shared);
+        p = pb_str(buf, p, cap, " shared, ");
+        p = pb_uint(buf, p, cap, priv);
+        p = pb_str(buf, p, cap, " private\n");
+    }
     return p;
 }
 
@@ -126,15 +234,22 @@ int ProcFS::gen_maps(pt::uint32_t pid, char* buf, int cap) {
     if (!t || t->state == TASK_DEAD) return 0;
     int p = 0;
     if (t->user_mode) {
+        Task* owner = TaskScheduler::address_space_owner(t);
         p = pb_str(buf, p, cap, "code:      ");
         p = pb_hex(buf, p, cap, TaskScheduler::USER_CODE_BASE);
         p = pb_nl(buf, p, cap);
+        p = pb_str(buf, p, cap, "image_end: ");
+        p = pb_hex(buf, p, cap, owner->user_image_end);
+        p = pb_nl(buf, p, cap);
         p = pb_str(buf, p, cap, "heap_top:  ");
-        p = pb_hex(buf, p, cap, t->user_heap_top);
+        p = pb_hex(buf, p, cap, owner->user_heap_top);
         p = pb_nl(buf, p, cap);
         p = pb_str(buf, p, cap, "stack_top: ");
         p = pb_hex(buf, p, cap, TaskScheduler::USER_STACK_TOP);
         p = pb_nl(buf, p, cap);
+        p = pb_str(buf, p, cap, "va_top:    ");
+        p = pb_hex(buf, p, cap, TaskScheduler::USER_VA_TOP);
+        p = pb_nl(buf, p, cap);
     } else {
         p = pb_str(buf, p, cap, "kernel task (no user address space)\n");
     }
@@ -143,12 +258,13 @@ int ProcFS::gen_maps(pt::uint32_t pid, char* buf, int cap) {
 
 int ProcFS::gen_syscalls(pt::uint32_t pid, char* buf, int cap) {
     int p = 0;
-    if (!g_perf_data) {
-        p = pb_str(buf, p, cap, "(perf not active; run 'perf record' first)\n");
+    Task* t = TaskScheduler::get_task(pid);
+    if (!t) return 0;
+    if (!t->perf) {
+        p = pb_str(buf, p, cap, "(no samples; run 'perf record' first)\n");
         return p;
     }
-    if (pid >= TaskScheduler::MAX_TASKS) return 0;
-    SyscallPerfData& pd = g_perf_data[pid];
+    SyscallPerfData& pd = *t->perf;
     for (pt::size_t i = 0; i < NUM_SYSCALLS; i++) {
         if (pd.counts[i] == 0) continue;
         p = pb_str(buf, p, cap, g_syscall_names[i]);
@@ -200,7 +316,7 @@ bool ProcFS::install_content(File* file, const char* buf, int len) {
 
 bool ProcFS::open_file(const char* path, File* file) {
     // path arrives already stripped of leading "proc/" by VFS.
-    // Possible values: "version", "meminfo", "uptime",
+    // Possible values: "version", "meminfo", "uptime", "fbstat", "audio",
     //                  "<pid>/status", "<pid>/maps", "<pid>/syscalls"
 
     // Set filename to the proc path (truncated to fit the 13-byte field).
@@ -223,6 +339,10 @@ bool ProcFS::open_file(const char* path, File* file) {
         len = gen_meminfo(buf, CAP);
     } else if (eq(path, "uptime")) {
         len = gen_uptime(buf, CAP);
+    } else if (eq(path, "fbstat")) {
+        len = gen_fbstat(buf, CAP);
+    } else if (eq(path, "audio")) {
+        len = gen_audio(buf, CAP);
     } else {
         pt::uint32_t pid = 0;
         const char* leaf = parse_pid_path(path, &pid);
@@ -315,8 +435,8 @@ int ProcFS::readdir_ex(const char* path, int idx,
 
     // ── proc root ──────────────────────────────────────────────────────────
     if (is_empty(path)) {
-        const char* sys_files[] = { "version", "meminfo", "uptime" };
-        constexpr int SYS_COUNT = 3;
+        const char* sys_files[] = { "version", "meminfo", "uptime", "fbstat", "audio" };
+        constexpr int SYS_COUNT = 5;
 
         if (idx < SYS_COUNT) {
             const char* name = sys_files[idx];
@@ -329,9 +449,9 @@ int ProcFS::readdir_ex(const char* path, int idx,
 
         int task_idx = idx - SYS_COUNT;
         int found = 0;
-        for (pt::uint32_t i = 0; i < TaskScheduler::MAX_TASKS; i++) {
-            Task* t = TaskScheduler::get_task(i);
-            if (!t || t->state == TASK_DEAD || t->state == TASK_ZOMBIE) continue;
+        for (pt::uint32_t i = 0; i < TaskScheduler::slot_count(); i++) {
+            Task* t = TaskScheduler::slot(i);
+            if (t->state == TASK_DEAD || t->state == TASK_ZOMBIE) continue;
             if (found == task_idx) {
                 pt::uint32_t pid = t->id;
                 char tmp[12]; int n = 0;
@@ -0,0 +1,58 @@
+#include "simd.h"
+#include "task.h"
+
+// kernel_fpu_begin/end — see simd.h.  Built like the rest of the kernel
+// (-mgeneral-regs-only): only the inline FXSAVE/FXRSTOR touch SSE state.
+
+static constexpr pt::uint64_t RFLAGS_IF     = 1u << 9;
+static constexpr pt::uint32_t MXCSR_DEFAULT = 0x1F80;  // all exceptions masked, RN
+
+// Save area for sections entered with interrupts disabled.  Those cannot
+// be interleaved with each other, so one area plus a depth count suffices.
+static pt::uint8_t  atomic_fpu_save[512] __attribute__((aligned(16)));
+static pt::uint32_t atomic_fpu_depth = 0;
+
+static inline void fpu_enter(pt::uint8_t* area)
+{
+    static const pt::uint32_t mxcsr = MXCSR_DEFAULT;
+    asm volatile("fxsave %0" : "=m"(*(pt::uint8_t(*)[512])area) :: "memory");
+    // The interrupted code may have unmasked SSE exceptions.
+    asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+}
+
+static inline void fpu_leave(pt::uint8_t* area)
+{
+    asm volatile("fxrstor %0" :: "m"(*(pt::uint8_t(*)[512])area) : "memory");
+}
+
+void kernel_fpu_begin()
+{
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+
+    Task* t = TaskScheduler::get_current_task();
+    if ((flags & RFLAGS_IF) && t) {
+        if (t->kfpu_depth++ == 0) fpu_enter(t->kfpu_save);
+    } else {
+        if (atomic_fpu_depth++ == 0) fpu_enter(atomic_fpu_save);
+    }
+
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+void kernel_fpu_end()
+{
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+
+    // An atomic section keeps IF clear from begin to end, so while one is
+    // open nothing else can be running: it must be the one ending.
+    if (atomic_fpu_depth > 0) {
+        if (--atomic_fpu_depth == 0) fpu_leave(atomic_fpu_save);
+    } else {
+        Task* t = TaskScheduler::get_current_task();
+        if (t && t->kfpu_depth > 0 && --t->kfpu_depth == 0) fpu_leave(t->kfpu_save);
+    }
+
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
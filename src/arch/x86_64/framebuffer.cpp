@@ -2,6 +2,11 @@
 #include "window.h"
 #include "vterm.h"
 #include "device/fbterm.h"
+#include "simd.h"
+#include "device/timer.h"
+#include "compositor.h"
+#include "syscall.h"
+#include "device/bga.h"
 
 Framebuffer buffer;
 
@@ -17,31 +22,92 @@ void Framebuffer::InitBackBuffer() {
     pt::size_t size = (pt::size_t)m_stride * m_height;
     void* buf = vmm.kmalloc(size);
     if (!buf) kernel_panic("Can't allocate back buffer!", NotAbleToAllocateMemory);
-    m_back = reinterpret_cast<pt::uintptr_t>(buf);
+    m_back = m_back_ram = reinterpret_cast<pt::uintptr_t>(buf);
     // Copy current VRAM contents to back buffer so we start in sync
     pt::uint64_t* dst = reinterpret_cast<pt::uint64_t*>(m_back);
     pt::uint64_t* src = reinterpret_cast<pt::uint64_t*>(m_addr);
     pt::size_t qwords = size / 8;
     for (pt::size_t i = 0; i < qwords; i++)
         dst[i] = src[i];
-    m_dirty = false;
+}
+
+void Framebuffer::InitWriteCombining() {
+    if (!m_addr) return;
+    const pt::size_t size = (pt::size_t)m_stride * m_height * (can_flip() ? 2 : 1);
+    if (VMM::init_pat() && VMM::set_memory_type(m_addr, size, MemType::WriteCombining)) {
+        m_mapping = VramMapping::PatWC;
+        klog("[FB] VRAM %lx write-combining (PAT)\n", m_addr);
+    } else if (VMM::mtrr_set_wc(m_addr, size)) {
+        m_mapping = VramMapping::MtrrWC;
+        klog("[FB] VRAM %lx write-combining (MTRR)\n", m_addr);
+    } else {
+        klog("[FB] VRAM %lx left uncached\n", m_addr);
+    }
+}
+
+void Framebuffer::InitPageFlip() {
+    if (!m_addr || !BGA::initialize(m_addr, m_width, m_height, m_bpp, m_stride)) {
+        klog("[FB] No page flipping; uploading from the back buffer\n");
+        return;
+    }
+    m_pages[0] = m_addr;
+    m_pages[1] = m_addr + (pt::size_t)m_stride * m_height;
+    m_flip_want = true;
+}
+
+bool Framebuffer::SetPageFlip(bool on) {
+    if (on && !can_flip()) return false;
+    m_flip_want = on;
+    damage_all();   // wake the compositor so it switches now
+    return true;
+}
+
+// Called by Flush (compositor task) only, so it never races a frame.
+void Framebuffer::SwitchFlipMode() {
+    m_flip = m_flip_want;
+    m_front = 0;
+    if (m_flip) {
+        // Page 1 holds whatever the firmware left there.
+        m_back = m_pages[1];
+        m_prev[0] = { 0, 0, m_width, m_height };
+        m_prev_count = 1;
+    } else {
+        // Back to page 0; the RAM copy went stale while flipping.
+        m_back = m_back_ram;
+        m_prev_count = 0;
+        damage_all();
+    }
+    BGA::set_y_offset(0);
+    klog("[FB] Page flipping %s\n", m_flip ? "on" : "off");
 }
 
 void Framebuffer::Draw(const pt::uint8_t* what,
                        const pt::uint32_t x_pos,
                        const pt::uint32_t y_pos,
                        const pt::uint32_t width,
-                       const pt::uint32_t height) {
+                       const pt::uint32_t height,
+                       const pt::uint32_t format,
+                       pt::uint32_t stride) {
+    const pt::uint32_t bpp = pixfmt_bytes(format);
+    if (bpp == 0 || format == PIXFMT_INDEX8) return;  // no palette here
+    if (stride == 0) stride = width * bpp;
     for (pt::uint32_t y = y_pos; y < y_pos + height; y++)
     {
         for (pt::uint32_t x = x_pos; x < x_pos + width ; x++)
         {
             const pt::uint32_t src_x = x - x_pos;
             const pt::uint32_t src_y = y - y_pos;
-            const pt::uint32_t pos = src_y * 3 * width + src_x * 3;
-            const pt::uint32_t c =  what[pos] << 16
-                        | what[pos + 1] << 8
-                        | what[pos + 2];
+            const pt::uint8_t* p = what + src_y * stride + src_x * bpp;
+            pt::uint32_t c;
+            if (bpp == 4) {
+                c = *reinterpret_cast<const pt::uint32_t*>(p) & 0xFFFFFF;
+            } else if (bpp == 2) {
+                pt::uint32_t v = p[0] | p[1] << 8;
+                pt::uint32_t r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+                c = ((r << 3) | (r >> 2)) << 16 | ((g << 2) | (g >> 4)) << 8 | ((b << 3) | (b >> 2));
+            } else {
+                c = p[0] << 16 | p[1] << 8 | p[2];
+            }
             this->PutPixel(x, y, c);
         }
     }
@@ -51,12 +117,11 @@ void Framebuffer::PutPixel(
     const pt::uint32_t x,
     const pt::uint32_t y,
     const pt::uint32_t color) {
-        if (x >= m_width || y >= m_height) return;
+        if (x < m_clip.x0 || x >= m_clip.x1 || y < m_clip.y0 || y >= m_clip.y1) return;
         const pt::uintptr_t fb_addr = m_back ? m_back : m_addr;
         const pt::uint32_t  fb_stride = this->m_stride;
         const pt::uint8_t   fb_bytes  = this->m_bpp / 8;
         *reinterpret_cast<pt::uint32_t *>(fb_addr + x * fb_bytes + y * fb_stride) = color;
-        m_dirty = true;
 }
 
 pt::uint32_t Framebuffer::GetPixel(
@@ -95,6 +160,7 @@ void Framebuffer::InitWallpaper() {
     void* buf = vmm.kcalloc(size);
     if (!buf) kernel_panic("Can't allocate wallpaper buffer!", NotAbleToAllocateMemory);
     m_wallpaper = reinterpret_cast<pt::uintptr_t>(buf);
+    damage_all();
 }
 
 void Framebuffer::DrawToWallpaper(const pt::uint8_t* data,
@@ -114,6 +180,7 @@ void Framebuffer::DrawToWallpaper(const pt::uint8_t* data,
             *reinterpret_cast<pt::uint32_t*>(m_wallpaper + py * m_stride + px * fb_bytes) = color;
         }
     }
+    add_damage((pt::int32_t)x_pos, (pt::int32_t)y_pos, width, height);
 }
 
 void Framebuffer::ClearWallpaper(pt::uint8_t r, pt::uint8_t g, pt::uint8_t b) {
@@ -123,78 +190,324 @@ void Framebuffer::ClearWallpaper(pt::uint8_t r, pt::uint8_t g, pt::uint8_t b) {
     for (pt::uint32_t y = 0; y < m_height; y++)
         for (pt::uint32_t x = 0; x < m_width; x++)
             *reinterpret_cast<pt::uint32_t*>(m_wallpaper + y * m_stride + x * fb_bytes) = color;
+    damage_all();
 }
 
 void Framebuffer::set_cursor_pos(pt::int16_t x, pt::int16_t y, bool visible) {
-    m_cursor_x = x;
-    m_cursor_y = y;
-    m_cursor_visible = visible;
-    m_dirty = true;
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    if (x != m_cursor_x || y != m_cursor_y || visible != m_cursor_visible) {
+        m_cursor_x = x;
+        m_cursor_y = y;
+        m_cursor_visible = visible;
+        if (!m_cursor_dirty) {
+            m_cursor_dirty = true;
+            m_cursor_req_us = get_microseconds();
+        }
+        if (this == &buffer) compositor_wake();
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
 }
 
-void Framebuffer::Flush() {
-    if (!m_back || !m_addr || !m_width) return;
+// Put back the pixels the sprite covers on `page`.  Only the sprite's
+// opaque pixels were changed, so only those are written.
+pt::uint64_t Framebuffer::EraseCursor(pt::uint32_t page) {
+    CursorSave& s = m_under[page];
+    if (!s.drawn) return 0;
+    s.drawn = false;
+    const pt::uintptr_t dst = page_addr(page);
+    pt::uint64_t bytes = 0;
+    for (pt::int32_t i = 0; i < CURSOR_PX; i++) {
+        const pt::int32_t py = s.y + i;
+        if (py < 0 || py >= (pt::int32_t)m_height) continue;
+        auto* row = reinterpret_cast<pt::uint32_t*>(dst + (pt::size_t)py * m_stride);
+        for (pt::int32_t j = 0; j < CURSOR_PX; j++) {
+            const pt::int32_t px = s.x + j;
+            if (px < 0 || px >= (pt::int32_t)m_width) continue;
+            if (normal_cursor_mask[i * cursor_width + j] == 0) continue;
+            row[px] = s.under[i * CURSOR_PX + j];
+            bytes += 4;
+        }
+    }
+    return bytes;
+}
+
+// Save what lies under the sprite at the wanted position (from `src`, laid
+// out like the screen) and draw it on `page`.
+pt::uint64_t Framebuffer::DrawCursor(pt::uint32_t page, pt::uintptr_t src) {
+    CursorSave& s = m_under[page];
+    if (!m_cursor_visible) return 0;
+    s.x = m_cursor_x;
+    s.y = m_cursor_y;
+    s.drawn = true;
+    const pt::uintptr_t dst = page_addr(page);
+    pt::uint64_t bytes = 0;
+    for (pt::int32_t i = 0; i < CURSOR_PX; i++) {
+        const pt::int32_t py = s.y + i;
+        if (py < 0 || py >= (pt::int32_t)m_height) continue;
+        auto* row = reinterpret_cast<pt::uint32_t*>(dst + (pt::size_t)py * m_stride);
+        auto* under = reinterpret_cast<const pt::uint32_t*>(src + (pt::size_t)py * m_stride);
+        for (pt::int32_t j = 0; j < CURSOR_PX; j++) {
+            const pt::int32_t px = s.x + j;
+            if (px < 0 || px >= (pt::int32_t)m_width) continue;
+            const pt::uint8_t m = normal_cursor_mask[i * cursor_width + j];
+            if (m == 0) continue;
+            s.under[i * CURSOR_PX + j] = under[px];
+            row[px] = m == 1 ? 0xffffff : 0x808080;
+            bytes += 4;
+        }
+    }
+    return bytes;
+}
+
+// Add `n` to a damage list.  It absorbs every rect it overlaps or touches;
+// a merge can make it reach rects already passed, so the scan repeats until
+// nothing changes.  A full list folds it into whichever entry grows least.
+void Framebuffer::MergeDamage(DamageRect* list, pt::uint32_t& count, DamageRect n) {
+    auto area = [](const DamageRect& r) {
+        return (pt::uint64_t)(r.x1 - r.x0) * (r.y1 - r.y0);
+    };
+    auto unite = [](const DamageRect& a, const DamageRect& b) {
+        return DamageRect{ a.x0 < b.x0 ? a.x0 : b.x0, a.y0 < b.y0 ? a.y0 : b.y0,
+                           a.x1 > b.x1 ? a.x1 : b.x1, a.y1 > b.y1 ? a.y1 : b.y1 };
+    };
+
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (pt::uint32_t i = 0; i < count; i++) {
+            const DamageRect& r = list[i];
+            if (r.x0 <= n.x1 && n.x0 <= r.x1 && r.y0 <= n.y1 && n.y0 <= r.y1) {
+                n = unite(n, r);
+                list[i] = list[--count];
+                merged = true;
+                break;
+            }
+        }
+    }
+    if (count < DAMAGE_MAX) {
+        list[count++] = n;
+    } else {
+        pt::uint32_t best = 0;
+        pt::uint64_t best_growth = ~(pt::uint64_t)0;
+        for (pt::uint32_t i = 0; i < count; i++) {
+            pt::uint64_t growth = area(unite(list[i], n)) - area(list[i]);
+            if (growth < best_growth) { best_growth = growth; best = i; }
+        }
+        list[best] = unite(list[best], n);
+    }
+}
+
+void Framebuffer::add_damage(pt::int32_t x, pt::int32_t y, pt::uint32_t w, pt::uint32_t h) {
+    // Clip to the screen in 64-bit so large w/h cannot wrap.
+    pt::int64_t x0 = x, y0 = y;
+    pt::int64_t x1 = x0 + (pt::int64_t)w, y1 = y0 + (pt::int64_t)h;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > (pt::int64_t)m_width)  x1 = m_width;
+    if (y1 > (pt::int64_t)m_height) y1 = m_height;
+    if (x0 >= x1 || y0 >= y1) return;
+    DamageRect n = { (pt::uint32_t)x0, (pt::uint32_t)y0, (pt::uint32_t)x1, (pt::uint32_t)y1 };
 
+    // Callers include IRQ handlers; Flush consumes the list.
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    MergeDamage(m_damage, m_damage_count, n);
+    if (this == &buffer) compositor_wake();  // not for offscreen targets
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+void Framebuffer::damage_all() {
+    add_damage(0, 0, m_width, m_height);
+}
+
+// Rebuild one damaged rect of the back buffer from scratch: wallpaper, then
+// the active VTerm's cells, then windows and their chrome.  Every layer is
+// clipped to the rect (blits explicitly, everything else through m_clip),
+// so the back buffer outside it is left untouched.
+void Framebuffer::RebuildRect(const DamageRect& r) {
     const pt::uint32_t fb_bytes = m_bpp / 8;
-    const pt::size_t fb_size = (pt::size_t)m_stride * m_height;
-    const pt::size_t qwords = fb_size / 8;
+    const pt::uint32_t w = r.x1 - r.x0;
 
-    // Layer 0: Copy wallpaper → back buffer (reset to clean state every frame)
+    // Layer 0: wallpaper
     if (m_wallpaper) {
-        pt::uint64_t* dst = reinterpret_cast<pt::uint64_t*>(m_back);
-        pt::uint64_t* src = reinterpret_cast<pt::uint64_t*>(m_wallpaper);
-        for (pt::size_t i = 0; i < qwords; i++)
-            dst[i] = src[i];
+        for (pt::uint32_t y = r.y0; y < r.y1; y++) {
+            const pt::size_t off = (pt::size_t)y * m_stride + (pt::size_t)r.x0 * fb_bytes;
+            simd_copy32(reinterpret_cast<pt::uint32_t*>(m_back + off),
+                        reinterpret_cast<const pt::uint32_t*>(m_wallpaper + off), w);
+        }
     }
 
-    // Layer 1: Render active VTerm cells onto back buffer
-    {
-        VTerm* vt = vterm_active();
-        if (vt && fbterm.is_ready()) {
-            const VTermCell* cells = vt->get_cells();
-            pt::uint32_t cols = vt->get_cols();
-            pt::uint32_t rows = vt->get_rows();
-            pt::uint32_t gw = fbterm.glyph_w();
-            pt::uint32_t gh = fbterm.glyph_h();
-            for (pt::uint32_t r = 0; r < rows; r++)
-                for (pt::uint32_t c = 0; c < cols; c++) {
-                    const VTermCell& cell = cells[r * cols + c];
-                    // Skip transparent cells (space with black bg) so wallpaper shows
-                    if (cell.ch == ' ' && cell.bg == 0x000000) continue;
-                    fbterm.put_char_at(cell.ch, c * gw, r * gh, cell.fg, cell.bg);
+    // Layer 1: active VTerm cells overlapping the rect
+    VTerm* vt = vterm_active();
+    if (vt && fbterm.is_ready()) {
+        const VTermCell* cells = vt->get_cells();
+        const pt::uint32_t cols = vt->get_cols();
+        const pt::uint32_t rows = vt->get_rows();
+        const pt::uint32_t gw = fbterm.glyph_w();
+        const pt::uint32_t gh = fbterm.glyph_h();
+        pt::uint32_t c1 = (r.x1 + gw - 1) / gw;
+        pt::uint32_t r1 = (r.y1 + gh - 1) / gh;
+        if (c1 > cols) c1 = cols;
+        if (r1 > rows) r1 = rows;
+        auto* target = reinterpret_cast<pt::uint32_t*>(m_back);
+        for (pt::uint32_t row = r.y0 / gh; row < r1; row++) {
+            // Runs of cells in one colour pair go out as one draw_text.
+            // Transparent cells (space with black bg) end a run and are
+            // skipped so the wallpaper shows.
+            const VTermCell* line = &cells[row * cols];
+            pt::uint32_t c = r.x0 / gw;
+            while (c < c1) {
+                const VTermCell& first = line[c];
+                if (first.ch == ' ' && first.bg == 0x000000) { c++; continue; }
+                char run[VTERM_MAX_COLS];
+                const pt::uint32_t start = c;
+                pt::uint32_t n = 0;
+                for (; c < c1; c++) {
+                    const VTermCell& cell = line[c];
+                    if (cell.ch == ' ' && cell.bg == 0x000000) break;
+                    if (cell.fg != first.fg || cell.bg != first.bg) break;
+                    run[n++] = cell.ch;
                 }
+                fbterm.draw_text(run, n, target, m_stride / 4, m_clip,
+                                 start * gw, row * gh, first.fg, first.bg);
+            }
         }
     }
 
-    // Layer 2+: Composite windows + chrome onto back buffer
-    WindowManager::composite(this);
+    // Layer 2+: windows + chrome
+    WindowManager::composite(this, r);
+}
 
-    m_dirty = false;
+void Framebuffer::Flush() {
+    if (!m_back || !m_addr || !m_width) return;
+    if (m_flip != m_flip_want) SwitchFlipMode();
 
-    // Flip: copy back buffer → VRAM
+    // Take the damage list; anything added from here on is the next frame's.
+    DamageRect damage[DAMAGE_MAX];
+    pt::uint32_t count;
+    bool cursor_moved;
+    pt::uint64_t cursor_req_us;
     {
-        pt::uint64_t* src = reinterpret_cast<pt::uint64_t*>(m_back);
-        pt::uint64_t* dst = reinterpret_cast<pt::uint64_t*>(m_addr);
-        for (pt::size_t i = 0; i < qwords; i++)
-            dst[i] = src[i];
+        pt::uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        count = m_damage_count;
+        for (pt::uint32_t i = 0; i < count; i++) damage[i] = m_damage[i];
+        m_damage_count = 0;
+        cursor_moved  = m_cursor_dirty;
+        cursor_req_us = m_cursor_req_us;
+        m_cursor_dirty = false;
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    }
+    if (count == 0 && !cursor_moved) {
+        m_stats.idle++;
+        return;
     }
 
-    // Top layer: cursor on VRAM (not in back buffer)
-    if (m_cursor_visible) {
-        for (pt::uint8_t i = 0; i < cursor_width; i++) {
-            for (pt::uint8_t j = 0; j < cursor_width; j++) {
-                pt::int32_t px = (pt::int32_t)m_cursor_x + j;
-                pt::int32_t py = (pt::int32_t)m_cursor_y + i;
-                if (px < 0 || py < 0) continue;
-                if ((pt::uint32_t)px >= m_width || (pt::uint32_t)py >= m_height) continue;
-                const int pos = i * cursor_width + j;
-                if (normal_cursor_mask[pos] != 0) {
-                    pt::uint32_t color = normal_cursor_mask[pos] == 1 ? 0xffffff : 0x808080;
-                    *reinterpret_cast<pt::uint32_t*>(m_addr + (pt::uint32_t)px * fb_bytes + (pt::uint32_t)py * m_stride) = color;
-                }
+    const pt::uint64_t t0 = get_microseconds();
+    // The page the cursor goes on this frame: the one being shown when
+    // only the cursor moved, else the one about to be.
+    const pt::uint32_t cursor_page = m_flip ? (count ? m_front ^ 1 : m_front) : 0;
+
+    if (count == 0) {
+        // Cursor only: the old and new sprite rects, nothing recomposited.
+        // The save-under comes from the RAM back buffer, which matches VRAM
+        // after every Flush, or from the shown page itself when flipping.
+        pt::uint64_t bytes = EraseCursor(cursor_page);
+        bytes += DrawCursor(cursor_page, m_flip ? page_addr(cursor_page) : m_back);
+        const pt::uint64_t now = get_microseconds();
+        m_stats.cursor_moves++;
+        m_stats.cursor_bytes += bytes;
+        m_stats.cursor_us    += now - t0;
+        m_stats.cursor_shown++;
+        m_stats.cursor_lat_us += now - cursor_req_us;
+        if (now - cursor_req_us > m_stats.cursor_lat_max)
+            m_stats.cursor_lat_max = now - cursor_req_us;
+        return;
+    }
+
+    const pt::uint32_t fb_bytes = m_bpp / 8;
+    pt::uint64_t pixels = 0, upload_us = 0, own = 0;
+
+    // Take the sprite off the page first, so what gets rebuilt or uploaded
+    // around it is not mixed with a stale save-under later.
+    EraseCursor(cursor_page);
+
+    // The hidden page missed the previous frame: redraw its damage too.
+    if (m_flip) {
+        DamageRect prev[DAMAGE_MAX];
+        const pt::uint32_t prev_count = m_prev_count;
+        for (pt::uint32_t i = 0; i < prev_count; i++) prev[i] = m_prev[i];
+        for (pt::uint32_t i = 0; i < count; i++) {
+            m_prev[i] = damage[i];
+            own += (pt::uint64_t)(damage[i].x1 - damage[i].x0) * (damage[i].y1 - damage[i].y0);
+        }
+        m_prev_count = count;
+        for (pt::uint32_t i = 0; i < prev_count; i++) MergeDamage(damage, count, prev[i]);
+    }
+
+    // Wallpaper copies and window blits use SSE2.
+    kernel_fpu_begin();
+
+    for (pt::uint32_t i = 0; i < count; i++) {
+        const DamageRect& r = damage[i];
+        m_clip = r;
+        RebuildRect(r);
+        const pt::uint32_t w = r.x1 - r.x0;
+        pixels += (pt::uint64_t)w * (r.y1 - r.y0);
+        if (m_flip) continue;   // drawn in place
+
+        // Upload just this rect: back buffer → VRAM, non-temporal so the
+        // write-combining buffers go out as whole bursts and the frame does
+        // not pass through the cache.  Full-width rows of a packed screen
+        // are one contiguous run.
+        const pt::uint64_t u0 = get_microseconds();
+        const pt::size_t row0 = (pt::size_t)r.y0 * m_stride + (pt::size_t)r.x0 * fb_bytes;
+        if (w == m_width && m_stride == m_width * fb_bytes) {
+            simd_stream_copy32(reinterpret_cast<pt::uint32_t*>(m_addr + row0),
+                               reinterpret_cast<const pt::uint32_t*>(m_back + row0),
+                               (pt::size_t)w * (r.y1 - r.y0));
+        } else {
+            for (pt::uint32_t y = r.y0; y < r.y1; y++) {
+                const pt::size_t off = row0 + (pt::size_t)(y - r.y0) * m_stride;
+                simd_stream_copy32(reinterpret_cast<pt::uint32_t*>(m_addr + off),
+                                   reinterpret_cast<const pt::uint32_t*>(m_back + off), w);
             }
         }
+        upload_us += get_microseconds() - u0;
+    }
+    m_clip = { 0, 0, m_width, m_height };
+    // One fence for the whole frame, before the cursor lands on top.
+    simd_store_fence();
+
+    kernel_fpu_end();
+
+    // Top layer: the cursor overlay, on the page about to be shown (VRAM
+    // when copying).  m_back is cursor-free either way.
+    DrawCursor(cursor_page, m_back);
+    if (cursor_moved) {
+        const pt::uint64_t lat = get_microseconds() - cursor_req_us;
+        m_stats.cursor_shown++;
+        m_stats.cursor_lat_us += lat;
+        if (lat > m_stats.cursor_lat_max) m_stats.cursor_lat_max = lat;
     }
+
+    if (m_flip) {
+        m_front ^= 1;
+        BGA::set_y_offset(m_front * m_height);
+        m_back = m_pages[m_front ^ 1];
+        m_stats.flips++;
+        m_stats.replay_pixels += pixels - own;
+    }
+
+    const pt::uint64_t us = get_microseconds() - t0;
+    m_stats.frames++;
+    m_stats.upload_us  += upload_us;
+    m_stats.pixels     += pixels;
+    m_stats.last_pixels = pixels;
+    m_stats.total_us   += us;
+    m_stats.last_us     = us;
+    if (us > m_stats.max_us) m_stats.max_us = us;
 }
 
 void Framebuffer::ScrollRegionUp(const pt::uint32_t x, const pt::uint32_t y,
@@ -223,13 +536,19 @@ void Framebuffer::FillRect(const pt::uint32_t x, const pt::uint32_t y,
     const pt::uint32_t color = static_cast<pt::uint32_t>(r) << 16
                              | static_cast<pt::uint32_t>(g) << 8
                              | static_cast<pt::uint32_t>(b);
-    for (pt::uint32_t row = y; row < y + h && row < m_height; row++)
-        for (pt::uint32_t col = x; col < x + w && col < m_width; col++)
+    // Iterate only the part inside the clip rect (64-bit ends so a rect
+    // that hangs off the left edge — x wrapped — stays empty, as before).
+    pt::uint64_t x1 = (pt::uint64_t)x + w, y1 = (pt::uint64_t)y + h;
+    if (x1 > m_clip.x1) x1 = m_clip.x1;
+    if (y1 > m_clip.y1) y1 = m_clip.y1;
+    const pt::uint32_t x0 = x > m_clip.x0 ? x : m_clip.x0;
+    const pt::uint32_t y0 = y > m_clip.y0 ? y : m_clip.y0;
+    for (pt::uint32_t row = y0; row < y1; row++)
+        for (pt::uint32_t col = x0; col < x1; col++)
             this->PutPixel(col, row, color);
 }
 
 void Framebuffer::Clear(const pt::uint8_t r, const pt::uint8_t g, const pt::uint8_t b) {
     // Clear the wallpaper — compositor will repaint from it next frame
     ClearWallpaper(r, g, b);
-    m_dirty = true;
 }
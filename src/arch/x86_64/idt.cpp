@@ -37,6 +37,7 @@ extern pt::uint64_t isr30;
 extern pt::uint64_t isr31;
 extern pt::uint64_t irq0;
 extern pt::uint64_t irq1;
+extern pt::uint64_t irq10;
 extern pt::uint64_t irq11;
 extern pt::uint64_t irq12;
 extern pt::uint64_t irq14;
@@ -98,6 +99,7 @@ void IDT::initialize()
 
 	init_idt_entry(32, irq0);
 	init_idt_entry(33, irq1);
+	init_idt_entry(42, irq10);   // IRQ10 → vector 42 — AC97 when routed there
 	init_idt_entry(43, irq11);   // IRQ11 → vector 43 (32 + 11) — RTL8139 NIC
 	init_idt_entry(44, irq12);
 	init_idt_entry(46, irq14);
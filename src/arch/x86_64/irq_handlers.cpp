@@ -4,6 +4,7 @@
 #include "device/pic.h"
 #include "device/timer.h"
 #include "device/ahci.h"
+#include "device/ac97.h"
 #include "task.h"
 #include "net/net.h"
 
@@ -55,11 +56,18 @@ ASMCALL void irq12_handler()
 	PIC::irq_ack(12);
 }
 
+ASMCALL void irq10_handler()
+{
+	AC97::handle_irq();
+	PIC::irq_ack(10);
+}
+
 ASMCALL void irq11_handler()
 {
-	// Shared IRQ — RTL8139 and AHCI may both be on this line
+	// Shared IRQ — RTL8139, AHCI and AC97 may all be on this line
 	RTL8139::handle_irq();
 	AHCI::check_irq();
+	AC97::handle_irq();
 	PIC::irq_ack(11);
 }
 
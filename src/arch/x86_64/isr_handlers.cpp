@@ -155,6 +155,16 @@ ASMCALL void isr14_handler(pt::uintptr_t frame)
 		return;
 	}
 
+	// CR0.WP makes ring 0 honour read-only user pages, so a syscall handed
+	// a buffer inside shared text faults here.  Blame the caller, not the
+	// kernel: present + write, user half, current task is a user task.
+	if ((err_code & 0x3) == 0x3 && cr2 < TaskScheduler::USER_VA_TOP &&
+	    TaskScheduler::get_current_task()->user_mode) {
+		klog("[PAGE FAULT] Kernel write to read-only user page — killing task\n");
+		TaskScheduler::task_exit(139);
+		return;
+	}
+
 	kernel_panic("Page fault", 14);
 }
 
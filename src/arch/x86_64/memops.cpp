@@ -0,0 +1,178 @@
+#include "virtual.h"
+#include "task.h"
+
+// Kernel memory primitives.  Everything is built with -mgeneral-regs-only,
+// so bulk copies go through the string instructions rather than SSE:
+//   * n <= 16  : two overlapping loads/stores of the widest fitting size
+//   * n <= 64  : 16-byte steps plus one overlapping 16-byte tail
+//   * larger   : rep movsb/stosb when the CPU has ERMS (fast for any size
+//                past ~128 B) or FSRM (fast even for short counts),
+//                otherwise rep movsq/stosq plus a byte tail.
+
+bool g_mem_erms = false;
+bool g_mem_fsrm = false;
+
+// Unaligned 2/4/8-byte accesses; may_alias keeps the compiler from
+// assuming the copied objects' types.
+typedef pt::uint16_t __attribute__((may_alias, aligned(1))) u16u;
+typedef pt::uint32_t __attribute__((may_alias, aligned(1))) u32u;
+typedef pt::uint64_t __attribute__((may_alias, aligned(1))) u64u;
+
+void mem_init()
+{
+    pt::uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+    if (eax < 7) return;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+    g_mem_erms = (ebx >> 9) & 1;   // CPUID.(7,0):EBX[9]  enhanced rep movsb/stosb
+    g_mem_fsrm = (edx >> 4) & 1;   // CPUID.(7,0):EDX[4]  fast short rep movsb
+    klog("[MEM] rep movsb: ERMS=%d FSRM=%d\n", (int)g_mem_erms, (int)g_mem_fsrm);
+}
+
+// 0..16 bytes.  All loads happen before any store, so this is also safe
+// for overlapping buffers in either direction.
+static inline void copy_small(pt::uint8_t* d, const pt::uint8_t* s, pt::size_t n)
+{
+    if (n >= 8) {
+        pt::uint64_t a = *(const u64u*)s, b = *(const u64u*)(s + n - 8);
+        *(u64u*)d = a; *(u64u*)(d + n - 8) = b;
+    } else if (n >= 4) {
+        pt::uint32_t a = *(const u32u*)s, b = *(const u32u*)(s + n - 4);
+        *(u32u*)d = a; *(u32u*)(d + n - 4) = b;
+    } else if (n >= 2) {
+        pt::uint16_t a = *(const u16u*)s, b = *(const u16u*)(s + n - 2);
+        *(u16u*)d = a; *(u16u*)(d + n - 2) = b;
+    } else if (n == 1) {
+        *d = *s;
+    }
+}
+
+// Forward bulk copy.  Byte-by-byte semantics, so it is also correct for
+// overlapping buffers with d < s.
+static inline void copy_rep(pt::uint8_t* d, const pt::uint8_t* s, pt::size_t len)
+{
+    // Counts are widened so the full RCX is defined (pt::size_t is 32-bit).
+    pt::uint64_t n = len;
+    if (g_mem_erms || g_mem_fsrm) {
+        asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) :: "memory");
+        return;
+    }
+    pt::uint64_t q = n >> 3, r = n & 7;
+    asm volatile("rep movsq" : "+D"(d), "+S"(s), "+c"(q) :: "memory");
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(r) :: "memory");
+}
+
+void* memcpy(void* dest, const void* src, pt::size_t n)
+{
+    auto* d = static_cast<pt::uint8_t*>(dest);
+    auto* s = static_cast<const pt::uint8_t*>(src);
+
+    if (n <= 16) {
+        copy_small(d, s, n);
+    } else if (n <= 64 && !g_mem_fsrm) {
+        pt::uint64_t t0 = *(const u64u*)(s + n - 16), t1 = *(const u64u*)(s + n - 8);
+        for (pt::size_t i = 0; i + 16 <= n; i += 16) {
+            pt::uint64_t a = *(const u64u*)(s + i), b = *(const u64u*)(s + i + 8);
+            *(u64u*)(d + i) = a; *(u64u*)(d + i + 8) = b;
+        }
+        *(u64u*)(d + n - 16) = t0; *(u64u*)(d + n - 8) = t1;
+    } else {
+        copy_rep(d, s, n);
+    }
+    return dest;
+}
+
+void* memmove(void* dest, const void* src, pt::size_t n)
+{
+    auto* d = static_cast<pt::uint8_t*>(dest);
+    auto* s = static_cast<const pt::uint8_t*>(src);
+
+    if (d == s || n == 0) return dest;
+    if (n <= 16) {
+        copy_small(d, s, n);
+    } else if (d < s || d >= s + n) {
+        copy_rep(d, s, n);
+    } else {
+        // dst overlaps the tail of src: copy backwards.  Backward rep
+        // strings miss the fast-string microcode, so move qwords (8x fewer
+        // iterations) and finish the unaligned head with one small copy.
+        // Interrupt handlers assume DF=0, so keep them out while it is set.
+        pt::uint64_t q = n >> 3;
+        pt::size_t head = n & 7;
+        pt::uint8_t head_buf[8];
+        for (pt::size_t i = 0; i < head; i++) head_buf[i] = s[i];
+        const pt::uint8_t* sq = s + n - 8;
+        pt::uint8_t* dq = d + n - 8;
+        pt::uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        asm volatile("std\n\trep movsq\n\tcld"
+                     : "+D"(dq), "+S"(sq), "+c"(q) :: "memory", "cc");
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+        for (pt::size_t i = 0; i < head; i++) d[i] = head_buf[i];
+    }
+    return dest;
+}
+
+void memset(void* dst, pt::uint64_t value, const pt::size_t size)
+{
+    auto* d = static_cast<pt::uint8_t*>(dst);
+    const pt::uint8_t fill_byte = (pt::uint8_t)value;
+
+    // Build an 8-byte pattern from the single fill byte.
+    pt::uint64_t pattern = fill_byte * 0x0101010101010101ULL;
+
+    if (size <= 16) {
+        if (size >= 8) {
+            *(u64u*)d = pattern; *(u64u*)(d + size - 8) = pattern;
+        } else if (size >= 4) {
+            *(u32u*)d = (pt::uint32_t)pattern; *(u32u*)(d + size - 4) = (pt::uint32_t)pattern;
+        } else {
+            for (pt::size_t i = 0; i < size; i++) d[i] = fill_byte;
+        }
+        return;
+    }
+    if (size <= 64 && !g_mem_fsrm) {
+        for (pt::size_t i = 0; i + 8 <= size; i += 8)
+            *(u64u*)(d + i) = pattern;
+        *(u64u*)(d + size - 8) = pattern;
+        return;
+    }
+    pt::uint64_t n = size;
+    if (g_mem_erms) {
+        asm volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(fill_byte) : "memory");
+        return;
+    }
+    pt::uint64_t q = n >> 3, r = n & 7;
+    asm volatile("rep stosq" : "+D"(d), "+c"(q) : "a"(pattern) : "memory");
+    asm volatile("rep stosb" : "+D"(d), "+c"(r) : "a"(pattern) : "memory");
+}
+
+// ── User copies ─────────────────────────────────────────────────────────────
+// User memory is reachable directly through the task's CR3, so these only
+// check that the range lies in one of the user windows (image/heap/stack
+// below USER_STACK_TOP, or the high heap) and not in the kernel-only
+// identity map around them.  They do not recover from faults on unmapped
+// user pages.
+
+bool user_range_ok(pt::uintptr_t addr, pt::uint64_t n)
+{
+    pt::uintptr_t end = addr + n;
+    if (end < addr) return false;
+    if (addr >= TaskScheduler::USER_CODE_BASE && end <= TaskScheduler::USER_STACK_TOP)
+        return true;
+    return addr >= TaskScheduler::USER_HIGH_BASE && end <= TaskScheduler::USER_VA_TOP;
+}
+
+bool copy_to_user(void* user_dst, const void* src, pt::size_t n)
+{
+    if (!user_range_ok((pt::uintptr_t)user_dst, n)) return false;
+    memcpy(user_dst, src, n);
+    return true;
+}
+
+bool copy_from_user(void* dst, const void* user_src, pt::size_t n)
+{
+    if (!user_range_ok((pt::uintptr_t)user_src, n)) return false;
+    memcpy(dst, user_src, n);
+    return true;
+}
@@ -0,0 +1,630 @@
+#include "mixer.h"
+#include "device/ac97.h"
+#include "device/timer.h"
+#include "syscall.h"
+#include "task.h"
+#include "virtual.h"
+#include "kernel.h"
+
+namespace {
+
+// RESERVED: claimed by alloc_stream(), being set up; not mixed or reaped.
+enum StreamState : pt::uint8_t { STREAM_FREE, STREAM_RESERVED, STREAM_OPEN, STREAM_CLOSING };
+
+constexpr pt::int32_t KERNEL_OWNER = -2;   // clips belong to no task
+
+struct Stream {
+    StreamState  state;
+    bool         clip;          // plays slot[0] once, then closes itself
+    bool         clip_owned;    // ... and kfree()s it
+    bool         primed;        // prev/next hold source frames
+    pt::int32_t  owner;         // task id, or KERNEL_OWNER
+    pt::int32_t  waiter;        // owner blocked in mixer_write(), -1 = none
+    pt::uint8_t  channels;      // 1 or 2
+    pt::uint8_t  format;        // AUDIO_FMT_*
+    pt::uint8_t  frame_bytes;
+    pt::uint32_t rate;
+    pt::uint32_t volume;        // 0..256, 256 = unity
+    pt::uint32_t step;          // source frames per output frame, 16.16
+    pt::uint32_t frac;          // position between prev and next, 16.16
+    pt::int32_t  prev[2];
+    pt::int32_t  next[2];
+
+    // Slots [head, head + count) hold queued chunks; rd is the read offset
+    // into slot[head].  The writer fills slot[(head + count) % SLOTS] and
+    // only then bumps count, so the mixer never sees a half-copied chunk.
+    pt::uint8_t*          slot[STREAM_SLOTS];
+    pt::uint32_t          len[STREAM_SLOTS];
+    pt::uint32_t          head;
+    volatile pt::uint32_t count;
+    pt::uint32_t          rd;
+
+    // Mapped ring (mixer_map_ring), which replaces the slots.  The client
+    // can scribble over the shared header at any time, so the mixer keeps
+    // its own read position, size and a bounded snapshot of `write`.
+    AudioRing*            ring;
+    void*                 ring_alloc;
+    pt::uint32_t          ring_size;
+    pt::uint32_t          ring_want;    // free bytes the waiter is after
+    pt::uint64_t          ring_rd;
+    pt::uint64_t          ring_end;     // `write` as of this period
+    pt::uintptr_t         ring_va;
+    pt::uintptr_t         ring_pdpt;    // 0: not mapped (any more)
+};
+
+Stream             streams[MIXER_MAX_STREAMS];
+pt::uint32_t       mixer_tid = 0xFFFFFFFF;
+MixerStats         stats = {};
+volatile bool      waiting = false;   // mixer task blocked with no streams
+pt::int32_t        accum[MIXER_PERIOD_FRAMES * 2];
+pt::int16_t        period_buf[MIXER_PERIOD_FRAMES * 2];
+
+void mixer_wake()
+{
+    if (!waiting) return;
+    waiting = false;
+    TaskScheduler::wake_task(mixer_tid);
+}
+
+Stream* find_stream(pt::uint32_t task)
+{
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++)
+        if (streams[i].state == STREAM_OPEN && streams[i].owner == (pt::int32_t)task)
+            return &streams[i];
+    return nullptr;
+}
+
+bool valid_config(pt::uint32_t rate, pt::uint8_t channels, pt::uint8_t format)
+{
+    return rate >= 1000 && rate <= 192000 &&
+           (channels == 1 || channels == 2) &&
+           (format == AUDIO_FMT_S16 || format == AUDIO_FMT_U8);
+}
+
+// Claim a free stream.  Interrupts are off so two openers cannot race.
+Stream* alloc_stream(pt::int32_t owner, pt::uint32_t rate, pt::uint8_t channels,
+                     pt::uint8_t format)
+{
+    Stream* s = nullptr;
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++) {
+        if (streams[i].state == STREAM_FREE) {
+            s = &streams[i];
+            s->state = STREAM_RESERVED;
+            break;
+        }
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    if (!s) return nullptr;
+
+    s->clip        = false;
+    s->clip_owned  = false;
+    s->primed      = false;
+    s->owner       = owner;
+    s->waiter      = -1;
+    s->channels    = channels;
+    s->format      = format;
+    s->frame_bytes = static_cast<pt::uint8_t>(channels * (format == AUDIO_FMT_U8 ? 1 : 2));
+    s->rate        = rate;
+    s->volume      = 256;
+    s->step        = static_cast<pt::uint32_t>(((pt::uint64_t)rate << 16) / MIXER_RATE);
+    s->frac        = 0;
+    s->head        = 0;
+    s->count       = 0;
+    s->rd          = 0;
+    for (pt::uint32_t i = 0; i < STREAM_SLOTS; i++) {
+        s->slot[i] = nullptr;
+        s->len[i]  = 0;
+    }
+    s->ring        = nullptr;
+    s->ring_alloc  = nullptr;
+    s->ring_size   = 0;
+    s->ring_want   = 0;
+    s->ring_rd     = 0;
+    s->ring_end    = 0;
+    s->ring_va     = 0;
+    s->ring_pdpt   = 0;
+    return s;
+}
+
+// Free the buffers of streams that were closed.  Runs in the mixer task
+// between periods, so nothing is still reading them.
+void reap_streams()
+{
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++) {
+        Stream& s = streams[i];
+        if (s.state != STREAM_CLOSING) continue;
+        if (!s.clip || s.clip_owned)
+            VMM::Instance()->kfree(s.slot[0]);
+        if (s.ring_alloc)
+            VMM::Instance()->kfree(s.ring_alloc);
+        s.slot[0]    = nullptr;
+        s.ring       = nullptr;
+        s.ring_alloc = nullptr;
+        s.owner      = -1;
+        s.state   = STREAM_FREE;
+    }
+}
+
+void close_stream(Stream* s)
+{
+    // Take a mapped ring away from the client before the mixer can reap it.
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    pt::uintptr_t pdpt = s->ring_pdpt;
+    s->ring_pdpt = 0;
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    if (pdpt)
+        TaskScheduler::unmap_borrowed_pages(pdpt, s->ring_va, AUDIO_RING_DATA + s->ring_size);
+
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    s->state = STREAM_CLOSING;
+    if (s->waiter >= 0) {
+        TaskScheduler::wake_task(static_cast<pt::uint32_t>(s->waiter));
+        s->waiter = -1;
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    mixer_wake();
+}
+
+// Drop the chunk at head and let a blocked writer refill it.
+void pop_slot(Stream& s)
+{
+    asm volatile("cli" ::: "memory");
+    s.head = (s.head + 1) % STREAM_SLOTS;
+    s.count--;
+    s.rd = 0;
+    if (s.waiter >= 0) {
+        TaskScheduler::wake_task(static_cast<pt::uint32_t>(s.waiter));
+        s.waiter = -1;
+    }
+    asm volatile("sti" ::: "memory");
+}
+
+// Free bytes in a ring stream.  A client that moved `write` backwards or
+// past the mixer sees none.
+pt::uint32_t ring_room(const Stream& s)
+{
+    pt::uint64_t used = s.ring->write - s.ring_rd;
+    return used >= s.ring_size ? 0 : s.ring_size - static_cast<pt::uint32_t>(used);
+}
+
+bool pending(const Stream& s)
+{
+    return s.ring ? s.ring_end - s.ring_rd >= s.frame_bytes : s.count != 0;
+}
+
+// One source frame at p as a stereo pair in 16-bit range.
+void decode(const Stream& s, const pt::uint8_t* p, pt::int32_t* f)
+{
+    if (s.format == AUDIO_FMT_U8) {
+        f[0] = ((pt::int32_t)p[0] - 128) << 8;
+        f[1] = s.channels == 2 ? ((pt::int32_t)p[1] - 128) << 8 : f[0];
+    } else {
+        const pt::int16_t* q = reinterpret_cast<const pt::int16_t*>(p);
+        f[0] = q[0];
+        f[1] = s.channels == 2 ? q[1] : f[0];
+    }
+}
+
+// Next source frame as a stereo pair in 16-bit range.  A trailing partial
+// frame in a chunk is skipped.  Ring positions stay frame-aligned (the size
+// is a power of two of at least a page), so a frame never wraps.
+bool fetch(Stream& s, pt::int32_t* f)
+{
+    if (s.ring) {
+        if (!pending(s)) return false;
+        decode(s, reinterpret_cast<const pt::uint8_t*>(s.ring) + AUDIO_RING_DATA +
+                  (s.ring_rd & (s.ring_size - 1)), f);
+        s.ring_rd += s.frame_bytes;
+        return true;
+    }
+    while (s.count) {
+        if (s.rd + s.frame_bytes <= s.len[s.head]) {
+            decode(s, s.slot[s.head] + s.rd, f);
+            s.rd += s.frame_bytes;
+            return true;
+        }
+        if (s.clip) {
+            s.count = 0;
+            return false;
+        }
+        pop_slot(s);
+    }
+    return false;
+}
+
+// Resample and add up to `frames` output frames of `s` into `acc`.  Returns
+// how many frames it produced before the stream ran dry.
+pt::uint32_t mix_stream(Stream& s, pt::int32_t* acc, pt::uint32_t frames)
+{
+    if (!s.primed) {
+        if (!fetch(s, s.prev)) return 0;
+        if (!fetch(s, s.next)) {
+            s.next[0] = s.prev[0];
+            s.next[1] = s.prev[1];
+        }
+        s.frac   = 0;
+        s.primed = true;
+    }
+
+    const pt::int32_t vol = static_cast<pt::int32_t>(s.volume);
+    for (pt::uint32_t i = 0; i < frames; i++) {
+        pt::int32_t l = s.prev[0] +
+            static_cast<pt::int32_t>(((pt::int64_t)(s.next[0] - s.prev[0]) * s.frac) >> 16);
+        pt::int32_t r = s.prev[1] +
+            static_cast<pt::int32_t>(((pt::int64_t)(s.next[1] - s.prev[1]) * s.frac) >> 16);
+        acc[i * 2]     += (l * vol) >> 8;
+        acc[i * 2 + 1] += (r * vol) >> 8;
+
+        s.frac += s.step;
+        while (s.frac >= 0x10000) {
+            s.frac -= 0x10000;
+            s.prev[0] = s.next[0];
+            s.prev[1] = s.next[1];
+            if (!fetch(s, s.next)) {
+                s.primed = false;
+                return i + 1;
+            }
+        }
+    }
+    return frames;
+}
+
+// Take in what the client has written since the last period.  The samples
+// are read only after `write`, and never more than a ring's worth.
+void snapshot_ring(Stream& s)
+{
+    pt::uint64_t end = s.ring->write;
+    asm volatile("" ::: "memory");
+    if (end - s.ring_rd > s.ring_size) end = s.ring_rd + s.ring_size;
+    s.ring_end = end;
+}
+
+// Tell the client how far the mixer got, and wake it if it waits for room.
+void publish_ring(Stream& s, bool starved, pt::uint64_t now, pt::uint32_t delay_us)
+{
+    AudioRing* r = s.ring;
+    r->read     = s.ring_rd;
+    r->delay_us = delay_us;
+    r->stamp_us = now;
+    if (starved) r->starved = r->starved + 1;
+    asm volatile("cli" ::: "memory");
+    if (s.waiter >= 0 && ring_room(s) >= s.ring_want) {
+        TaskScheduler::wake_task(static_cast<pt::uint32_t>(s.waiter));
+        s.waiter = -1;
+    }
+    asm volatile("sti" ::: "memory");
+}
+
+// One period of every open stream into period_buf.  False if there is no
+// stream left to play.  `now` and `delay_us` (the audio already queued
+// ahead of this period) go to the ring streams.
+bool mix_period(pt::uint64_t now, pt::uint32_t delay_us)
+{
+    for (pt::uint32_t i = 0; i < MIXER_PERIOD_FRAMES * 2; i++) accum[i] = 0;
+
+    bool any = false;
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++) {
+        Stream& s = streams[i];
+        if (s.state != STREAM_OPEN) continue;
+        any = true;
+        if (s.ring) snapshot_ring(s);
+        bool had = s.primed || pending(s);
+        pt::uint32_t n = mix_stream(s, accum, MIXER_PERIOD_FRAMES);
+        bool starved = had && n < MIXER_PERIOD_FRAMES;
+        if (s.clip && !s.primed && !s.count) {
+            s.state = STREAM_CLOSING;   // played out
+        } else if (starved) {
+            stats.starved++;
+        }
+        if (s.ring) publish_ring(s, starved, now, delay_us);
+    }
+
+    for (pt::uint32_t i = 0; i < MIXER_PERIOD_FRAMES * 2; i++) {
+        pt::int32_t v = accum[i];
+        if (v > 32767) v = 32767;
+        else if (v < -32768) v = -32768;
+        period_buf[i] = static_cast<pt::int16_t>(v);
+    }
+    return any;
+}
+
+bool have_streams()
+{
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++)
+        if (streams[i].state == STREAM_OPEN || streams[i].state == STREAM_CLOSING)
+            return true;
+    return false;
+}
+
+void mixer_main()
+{
+    Task* self = TaskScheduler::get_current_task();
+    while (true) {
+        reap_streams();
+
+        // Nothing open: give the ring back and sleep.  The hardware plays
+        // out what is queued and halts; the next period cold-starts it.
+        asm volatile("cli" ::: "memory");
+        if (!have_streams()) {
+            AC97::owner_task_id = -1;
+            waiting = true;
+            self->state = TASK_BLOCKED;
+            asm volatile("sti" ::: "memory");
+            TaskScheduler::task_yield();
+            continue;
+        }
+        asm volatile("sti" ::: "memory");
+
+        pt::uint64_t t0 = get_microseconds();
+        // Everything queued on the AC97 plays before this period.
+        bool any = mix_period(t0, static_cast<pt::uint32_t>(AC97::queued_us()));
+        pt::uint64_t us = get_microseconds() - t0;
+        if (!any) continue;   // only closed streams left; reap them
+
+        stats.periods++;
+        stats.mix_us += us;
+        if (us > stats.max_us) stats.max_us = us;
+
+        if (AC97::owner_task_id != static_cast<pt::int32_t>(self->id)) {
+            // Back from idle: retire the halt of the drained ring first so
+            // it is not counted as an underrun.
+            AC97::poll_dma();
+            AC97::owner_task_id = static_cast<pt::int32_t>(self->id);
+        }
+        AC97::queue_pcm_wait(reinterpret_cast<const pt::uint8_t*>(period_buf),
+                             sizeof(period_buf));
+    }
+}
+
+} // namespace
+
+void mixer_start()
+{
+    if (!AC97::open(MIXER_RATE, 2, AUDIO_FMT_S16)) return;
+    mixer_tid = TaskScheduler::create_task(&mixer_main, TaskScheduler::TASK_STACK_SIZE,
+                                           false, true);
+    Task* t = TaskScheduler::get_task(mixer_tid);
+    if (!t) {
+        klog("[MIXER] Failed to create task\n");
+        mixer_tid = 0xFFFFFFFF;
+        return;
+    }
+    // With the compositor: a late period is an audible gap.
+    t->priority = 0;
+    const char name[] = "mixer";
+    for (pt::size_t i = 0; i < sizeof(name); i++) t->name[i] = name[i];
+    t->state = TASK_READY;
+    klog("[MIXER] Task %d, %d streams, %d-frame periods at %d Hz\n", mixer_tid,
+         (int)MIXER_MAX_STREAMS, (int)MIXER_PERIOD_FRAMES, (int)MIXER_RATE);
+}
+
+bool mixer_running() { return mixer_tid != 0xFFFFFFFF; }
+
+bool mixer_open(pt::uint32_t task, pt::uint32_t rate, pt::uint8_t channels, pt::uint8_t format)
+{
+    if (!mixer_running() || !valid_config(rate, channels, format)) return false;
+    if (Stream* old = find_stream(task)) close_stream(old);
+
+    pt::uint8_t* buf = static_cast<pt::uint8_t*>(
+        VMM::Instance()->kmalloc(STREAM_SLOTS * STREAM_SLOT_BYTES));
+    if (!buf) return false;
+    Stream* s = alloc_stream(static_cast<pt::int32_t>(task), rate, channels, format);
+    if (!s) {
+        VMM::Instance()->kfree(buf);
+        return false;
+    }
+    for (pt::uint32_t i = 0; i < STREAM_SLOTS; i++)
+        s->slot[i] = buf + i * STREAM_SLOT_BYTES;
+    s->state = STREAM_OPEN;
+    mixer_wake();
+    return true;
+}
+
+bool mixer_close(pt::uint32_t task)
+{
+    Stream* s = find_stream(task);
+    if (!s) return false;
+    close_stream(s);
+    return true;
+}
+
+bool mixer_has_stream(pt::uint32_t task) { return find_stream(task) != nullptr; }
+
+bool mixer_can_write(pt::uint32_t task)
+{
+    Stream* s = find_stream(task);
+    if (!s) return false;
+    return s->ring ? ring_room(*s) != 0 : s->count < STREAM_SLOTS;
+}
+
+bool mixer_set_volume(pt::uint32_t task, pt::uint32_t percent)
+{
+    Stream* s = find_stream(task);
+    if (!s) return false;
+    if (percent > 100) percent = 100;
+    s->volume = percent * 256 / 100;
+    return true;
+}
+
+pt::uint32_t mixer_write(pt::uint32_t task, const pt::uint8_t* data, pt::uint32_t bytes,
+                         bool block)
+{
+    if (!data || bytes == 0) return 0;
+    if (bytes > STREAM_SLOT_BYTES) bytes = STREAM_SLOT_BYTES;
+    Task* t = TaskScheduler::get_current_task();
+
+    while (true) {
+        Stream* s = find_stream(task);
+        if (!s || s->ring) return 0;
+
+        asm volatile("cli" ::: "memory");
+        if (s->count < STREAM_SLOTS) {
+            asm volatile("sti" ::: "memory");
+            // Only this task writes the stream and the slot is outside
+            // [head, head + count), so the copy needs no lock.
+            pt::uint32_t idx = (s->head + s->count) % STREAM_SLOTS;
+            if (!copy_from_user(s->slot[idx], data, bytes)) return 0;
+            s->len[idx] = bytes;
+            asm volatile("cli" ::: "memory");
+            if (s->state == STREAM_OPEN) s->count++;
+            asm volatile("sti" ::: "memory");
+            mixer_wake();
+            return bytes;
+        }
+        if (!block || !t) {
+            asm volatile("sti" ::: "memory");
+            return 0;
+        }
+        // Same block as AC97::queue_pcm_wait(); the mixer wakes us when it
+        // finishes a chunk, about once a period.
+        s->waiter = static_cast<pt::int32_t>(t->id);
+        t->sleep_deadline = get_ticks() + AC97_WAIT_TICKS;
+        t->state = TASK_BLOCKED;
+        asm volatile("sti" ::: "memory");
+        TaskScheduler::task_yield();
+        asm volatile("cli" ::: "memory");
+        t->sleep_deadline = 0;
+        if (s->waiter == static_cast<pt::int32_t>(t->id)) s->waiter = -1;
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+pt::uintptr_t mixer_map_ring(pt::uint32_t task, Task* t, pt::uint32_t bytes)
+{
+    Stream* s = find_stream(task);
+    if (!s || !t) return 0;
+    Task* owner = TaskScheduler::address_space_owner(t);
+    if (s->ring) return s->ring_pdpt == owner->user_pdpt ? s->ring_va : 0;
+
+    pt::uint32_t size = AUDIO_RING_MIN;
+    while (size < bytes && size < AUDIO_RING_MAX) size <<= 1;
+    // Whole pages, page-aligned and physically contiguous, as for window
+    // surfaces (WindowManager::alloc_pixels).
+    void* block = VMM::Instance()->kcalloc(AUDIO_RING_DATA + size + 4095);
+    if (!block) return 0;
+    AudioRing* r = reinterpret_cast<AudioRing*>(
+        ((pt::uintptr_t)block + 4095) & ~(pt::uintptr_t)4095);
+    pt::uintptr_t va = TaskScheduler::map_borrowed_pages(
+        t, VMM::virt_to_phys(r), AUDIO_RING_DATA + size);
+    if (!va) {
+        VMM::Instance()->kfree(block);
+        return 0;
+    }
+    r->size        = size;
+    r->frame_bytes = s->frame_bytes;
+    r->rate        = s->rate;
+
+    // Chunks still queued are dropped; the ring plays from the next period.
+    asm volatile("cli" ::: "memory");
+    s->ring_alloc = block;
+    s->ring_size  = size;
+    s->ring_rd    = 0;
+    s->ring_end   = 0;
+    s->ring_va    = va;
+    s->ring_pdpt  = owner->user_pdpt;
+    s->head       = 0;
+    s->count      = 0;
+    s->rd         = 0;
+    s->ring       = r;
+    if (s->waiter >= 0) {
+        TaskScheduler::wake_task(static_cast<pt::uint32_t>(s->waiter));
+        s->waiter = -1;
+    }
+    asm volatile("sti" ::: "memory");
+    return va;
+}
+
+pt::int64_t mixer_ring_wait(pt::uint32_t task, pt::uint32_t want, pt::uint64_t timeout_ms)
+{
+    Task* t = TaskScheduler::get_current_task();
+    pt::uint64_t deadline = get_ticks() + (timeout_ms + 19) / 20;   // 50 Hz
+
+    while (true) {
+        Stream* s = find_stream(task);
+        if (!s || !s->ring) return -1;
+        if (want > s->ring_size) want = s->ring_size;
+
+        asm volatile("cli" ::: "memory");
+        pt::uint32_t room = ring_room(*s);
+        if (room >= want || !t || timeout_ms == 0 || get_ticks() >= deadline) {
+            asm volatile("sti" ::: "memory");
+            return room;
+        }
+        // publish_ring() wakes us once a period has made enough room.
+        s->waiter    = static_cast<pt::int32_t>(t->id);
+        s->ring_want = want;
+        t->sleep_deadline = deadline;
+        t->state = TASK_BLOCKED;
+        asm volatile("sti" ::: "memory");
+        TaskScheduler::task_yield();
+        asm volatile("cli" ::: "memory");
+        t->sleep_deadline = 0;
+        if (s->waiter == static_cast<pt::int32_t>(t->id)) s->waiter = -1;
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+void mixer_forget_rings(pt::uintptr_t pdpt)
+{
+    if (!pdpt) return;
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++) {
+        Stream& s = streams[i];
+        if (s.ring_pdpt != pdpt) continue;
+        s.ring_pdpt = 0;   // the page tables are about to go
+        if (s.state == STREAM_OPEN) close_stream(&s);
+    }
+}
+
+pt::int32_t mixer_play_clip(const pt::uint8_t* data, pt::uint32_t bytes, pt::uint32_t rate,
+                            pt::uint8_t channels, pt::uint8_t format, bool take)
+{
+    if (!mixer_running() || !data || bytes == 0 || !valid_config(rate, channels, format))
+        return -1;
+    Stream* s = alloc_stream(KERNEL_OWNER, rate, channels, format);
+    if (!s) return -1;
+    s->clip       = true;
+    s->clip_owned = take;
+    s->slot[0]    = const_cast<pt::uint8_t*>(data);
+    s->len[0]     = bytes;
+    s->count      = 1;
+    s->state      = STREAM_OPEN;
+    mixer_wake();
+    return static_cast<pt::int32_t>(s - streams);
+}
+
+bool mixer_clip_playing(pt::int32_t id)
+{
+    if (id < 0 || id >= (pt::int32_t)MIXER_MAX_STREAMS) return false;
+    const Stream& s = streams[id];
+    return s.clip && s.state != STREAM_FREE;
+}
+
+void mixer_beep(pt::uint32_t frequency_hz, pt::uint32_t duration_ms)
+{
+    constexpr pt::int16_t AMPLITUDE = 16000;   // ~50% of full scale
+    pt::uint32_t frames = MIXER_RATE / 1000 * duration_ms;
+    pt::uint32_t half   = frequency_hz ? MIXER_RATE / (frequency_hz * 2) : 0;
+    if (frames == 0) return;
+    if (half == 0) half = 1;
+
+    pt::int16_t* pcm = static_cast<pt::int16_t*>(VMM::Instance()->kmalloc(frames * 2));
+    if (!pcm) return;
+    for (pt::uint32_t f = 0; f < frames; f++)
+        pcm[f] = (f / half) & 1 ? -AMPLITUDE : AMPLITUDE;
+    if (mixer_play_clip(reinterpret_cast<pt::uint8_t*>(pcm), frames * 2, MIXER_RATE, 1,
+                        AUDIO_FMT_S16, true) < 0)
+        VMM::Instance()->kfree(pcm);
+}
+
+pt::uint32_t mixer_stream_count()
+{
+    pt::uint32_t n = 0;
+    for (pt::uint32_t i = 0; i < MIXER_MAX_STREAMS; i++)
+        if (streams[i].state == STREAM_OPEN) n++;
+    return n;
+}
+
+const MixerStats& mixer_stats() { return stats; }
@@ -0,0 +1,229 @@
+#include "simd.h"
+#include <emmintrin.h>
+
+// SSE2 kernels.  This is the one translation unit built without
+// -mgeneral-regs-only (see SIMD_OBJECTS in the Makefile); it is also built
+// at -O2, since intrinsics at -O0 spill every vector to the stack, and
+// with -mstackrealign because kernel stacks are not kept 16-byte aligned.
+// Everything here must run inside kernel_fpu_begin()/kernel_fpu_end().
+
+void simd_copy32(pt::uint32_t* dst, const pt::uint32_t* src, pt::size_t count)
+{
+    pt::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 4));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 12));
+        _mm_storeu_si128((__m128i*)(dst + i), a);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), b);
+        _mm_storeu_si128((__m128i*)(dst + i + 8), c);
+        _mm_storeu_si128((__m128i*)(dst + i + 12), d);
+    }
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+    for (; i < count; i++)
+        dst[i] = src[i];
+}
+
+// Four pixels per step.  One 16-byte load holds pixels 0..3 (12 bytes);
+// byte shifts line each pixel up at the bottom of a register, the unpacks
+// gather those dwords into one vector, and a mask/shift/or pass swaps R
+// and B and clears the top byte.  SSE2 has no pshufb, hence the shifts.
+void simd_rgb24_to_xrgb(pt::uint32_t* dst, const pt::uint8_t* src, pt::size_t count)
+{
+    const __m128i g_mask  = _mm_set1_epi32(0x0000FF00);
+    const __m128i lo_mask = _mm_set1_epi32(0x000000FF);
+    pt::size_t i = 0;
+    // The load reads 16 bytes; stop while 6+ pixels (18 bytes) remain so
+    // it never runs past the source.
+    for (; i + 6 <= count; i += 4) {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(src + i * 3));
+        __m128i p1 = _mm_srli_si128(v, 3);
+        __m128i p2 = _mm_srli_si128(v, 6);
+        __m128i p3 = _mm_srli_si128(v, 9);
+        __m128i px = _mm_unpacklo_epi64(_mm_unpacklo_epi32(v, p1),
+                                        _mm_unpacklo_epi32(p2, p3));
+        // Each dword is now 0xXXBBGGRR; produce 0x00RRGGBB.
+        __m128i r = _mm_slli_epi32(_mm_and_si128(px, lo_mask), 16);
+        __m128i g = _mm_and_si128(px, g_mask);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(px, 16), lo_mask);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_or_si128(r, g), b));
+    }
+    for (; i < count; i++) {
+        const pt::uint8_t* p = src + i * 3;
+        dst[i] = (pt::uint32_t)p[0] << 16 | (pt::uint32_t)p[1] << 8 | p[2];
+    }
+}
+
+// Four zero-extended RGB565 pixels (one per dword) to 0x00RRGGBB.
+static inline __m128i expand565(__m128i p)
+{
+    const __m128i m5 = _mm_set1_epi32(0x1F);
+    const __m128i m6 = _mm_set1_epi32(0x3F);
+    __m128i r = _mm_srli_epi32(p, 11);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), m6);
+    __m128i b = _mm_and_si128(p, m5);
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+}
+
+void simd_rgb565_to_xrgb(pt::uint32_t* dst, const pt::uint16_t* src, pt::size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    pt::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i),     expand565(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), expand565(_mm_unpackhi_epi16(v, zero)));
+    }
+    for (; i < count; i++) {
+        pt::uint32_t p = src[i];
+        pt::uint32_t r = p >> 11, g = (p >> 5) & 0x3F, b = p & 0x1F;
+        dst[i] = ((r << 3) | (r >> 2)) << 16 | ((g << 2) | (g >> 4)) << 8 | ((b << 3) | (b >> 2));
+    }
+}
+
+// SSE2 has no gather: four scalar lookups are packed into one 16-byte store.
+void simd_index8_to_xrgb(pt::uint32_t* dst, const pt::uint8_t* src,
+                         const pt::uint32_t* palette, pt::size_t count)
+{
+    pt::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_set_epi32((int)palette[src[i + 3]], (int)palette[src[i + 2]],
+                                  (int)palette[src[i + 1]], (int)palette[src[i]]);
+        __m128i b = _mm_set_epi32((int)palette[src[i + 7]], (int)palette[src[i + 6]],
+                                  (int)palette[src[i + 5]], (int)palette[src[i + 4]]);
+        _mm_storeu_si128((__m128i*)(dst + i), a);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), b);
+    }
+    for (; i < count; i++)
+        dst[i] = palette[src[i]];
+}
+
+void simd_scale_int(pt::uint32_t* dst, const pt::uint32_t* src, pt::uint32_t k,
+                    pt::uint32_t phase, pt::size_t count)
+{
+    pt::size_t i = 0;
+    // Finish the source pixel the row starts inside of.
+    for (; phase && i < count; i++) {
+        dst[i] = *src;
+        if (++phase == k) { phase = 0; src++; }
+    }
+    // Then whole groups: four source pixels at a time for the common
+    // factors, a broadcast per source pixel for larger ones.
+    if (k == 1) {
+        simd_copy32(dst + i, src, count - i);
+        return;
+    } else if (k == 2) {
+        for (; i + 8 <= count; i += 8, src += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            _mm_storeu_si128((__m128i*)(dst + i),     _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi32(v, v));
+        }
+    } else if (k == 3) {
+        for (; i + 12 <= count; i += 12, src += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            _mm_storeu_si128((__m128i*)(dst + i),     _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+            _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+            _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+        }
+    } else {
+        for (; i + k <= count; i += k, src++) {
+            __m128i v = _mm_set1_epi32((int)*src);
+            pt::uint32_t j = 0;
+            for (; j + 4 <= k; j += 4)
+                _mm_storeu_si128((__m128i*)(dst + i + j), v);
+            for (; j < k; j++)
+                dst[i + j] = *src;
+        }
+    }
+    for (pt::uint32_t p = 0; i < count; i++) {
+        dst[i] = *src;
+        if (++p == k) { p = 0; src++; }
+    }
+}
+
+void simd_scale_nearest(pt::uint32_t* dst, const pt::uint32_t* src, pt::uint32_t pos,
+                        pt::uint32_t step, pt::size_t count)
+{
+    pt::size_t i = 0;
+    for (; i + 4 <= count; i += 4, pos += 4 * step) {
+        __m128i v = _mm_set_epi32((int)src[(pos + 3 * step) >> 16], (int)src[(pos + 2 * step) >> 16],
+                                  (int)src[(pos + step) >> 16],     (int)src[pos >> 16]);
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+    for (; i < count; i++, pos += step)
+        dst[i] = src[pos >> 16];
+}
+
+// One output pixel per step.  The two neighbours in each source row are
+// one 8-byte load, widened to 16-bit channels; the rows are blended by wy,
+// then the halves of the register by wx.  Weights go up to 256 and
+// channels to 255, so every product fits an unsigned 16-bit lane.
+void simd_scale_bilinear(pt::uint32_t* dst, const pt::uint32_t* row0,
+                         const pt::uint32_t* row1, pt::int32_t pos, pt::uint32_t step,
+                         pt::uint32_t last, pt::uint32_t wy, pt::size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w1 = _mm_set1_epi16((short)wy);
+    const __m128i w0 = _mm_set1_epi16((short)(256 - wy));
+    for (pt::size_t i = 0; i < count; i++, pos += (pt::int32_t)step) {
+        pt::uint32_t sx = 0, wx = 0;
+        if (pos > 0) {
+            sx = (pt::uint32_t)pos >> 16;
+            wx = ((pt::uint32_t)pos >> 8) & 0xFF;
+            if (sx >= last) { sx = last - 1; wx = 256; }
+        }
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row0 + sx)), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row1 + sx)), zero);
+        __m128i v = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, w0),
+                                                 _mm_mullo_epi16(b, w1)), 8);
+        short r = (short)wx, l = (short)(256 - wx);
+        __m128i h = _mm_mullo_epi16(v, _mm_set_epi16(r, r, r, r, l, l, l, l));
+        h = _mm_srli_epi16(_mm_add_epi16(h, _mm_srli_si128(h, 8)), 8);
+        dst[i] = (pt::uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+    }
+}
+
+static void stream_bytes(void* dst, const void* src, pt::size_t n)
+{
+    auto* d = static_cast<pt::uint8_t*>(dst);
+    auto* s = static_cast<const pt::uint8_t*>(src);
+
+    // movntdq needs a 16-byte aligned destination.
+    while (n && ((pt::uintptr_t)d & 15)) { *d++ = *s++; n--; }
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+        _mm_stream_si128((__m128i*)d, a);
+        _mm_stream_si128((__m128i*)(d + 16), b);
+        _mm_stream_si128((__m128i*)(d + 32), c);
+        _mm_stream_si128((__m128i*)(d + 48), e);
+    }
+    for (; n >= 16; n -= 16, d += 16, s += 16)
+        _mm_stream_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+    while (n--) *d++ = *s++;
+}
+
+void simd_stream_copy(void* dst, const void* src, pt::size_t n)
+{
+    stream_bytes(dst, src, n);
+    // Non-temporal stores are weakly ordered: drain them before the caller
+    // hands the buffer to the device.
+    _mm_sfence();
+}
+
+void simd_stream_copy32(pt::uint32_t* dst, const pt::uint32_t* src, pt::size_t count)
+{
+    stream_bytes(dst, src, count * 4);
+}
+
+void simd_store_fence()
+{
+    _mm_sfence();
+}
@@ -1,4 +1,4 @@
-#include "device/ac97.h"
+#include "mixer.h"
 #include "device/com.h"
 #include "device/mouse.h"
 #include "pipe.h"
@@ -43,11 +43,14 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 {
 	switch (nr) {
 		case SYS_WRITE: {
-			int fd = (int)(pt::int8_t)arg1;
+			int fd = (int)(pt::int32_t)arg1;
 			const char* buf = reinterpret_cast<const char*>(arg2);
 			pt::uint32_t n  = (pt::uint32_t)arg3;
-			if (fd == 1 || fd == 2) {
-				Task* wt = TaskScheduler::get_current_task();
+			Task* t = TaskScheduler::get_current_task();
+			// fd 1/2 are implicit unless a spawn file action put a real
+			// file or pipe in the slot.
+			if ((fd == 1 || fd == 2) && !(t && fd_get(t->fd_table, fd))) {
+				Task* wt = t;
 				// Text-mode windows (WF_TEXT: e.g. the shell, the Lua REPL)
 				// render stdout/stderr into the window itself. Graphical
 				// windows (Doom/Quake/ScummVM) deliberately do NOT — their
@@ -57,8 +60,7 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 				if (wt && wt->owns_window && wt->window_id != INVALID_WID) {
 					Window* w = WindowManager::get_window(wt->window_id);
 					if (w && w->text_mode) {
-						for (pt::uint32_t i = 0; i < n; i++)
-							WindowManager::put_char(wt->window_id, buf[i]);
+						WindowManager::write_text(wt->window_id, buf, n);
 						return (pt::uint64_t)n;
 					}
 				}
@@ -74,11 +76,9 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 				}
 				return (pt::uint64_t)n;
 			}
-			Task* t = TaskScheduler::get_current_task();
-			if (fd < 0 || fd >= (int)Task::MAX_FDS || !t->fd_table->fds[fd].open)
-				return (pt::uint64_t)-1;
 			{
-				File* f = &t->fd_table->fds[fd];
+				File* f = fd_get(t->fd_table, fd);
+				if (!f) return (pt::uint64_t)-1;
 				if (f->type == FdType::FILE)
 					return (pt::uint64_t)VFS::write_file(f, buf, n);
 				if (f->type == FdType::PIPE_WR) {
@@ -87,9 +87,14 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 					while (written < n) {
 						pt::uint32_t used = pipe->write_pos - pipe->read_pos;
 						if (used < PipeBuffer::CAPACITY) {
-							pipe->data[pipe->write_pos % PipeBuffer::CAPACITY] =
-								(pt::uint8_t)buf[written++];
-							pipe->write_pos++;
+							// Largest run that fits without wrapping the ring.
+							pt::uint32_t off = pipe->write_pos % PipeBuffer::CAPACITY;
+							pt::uint32_t run = PipeBuffer::CAPACITY - used;
+							if (run > PipeBuffer::CAPACITY - off) run = PipeBuffer::CAPACITY - off;
+							if (run > n - written) run = n - written;
+							memcpy(pipe->data + off, buf + written, run);
+							pipe->write_pos += run;
+							written += run;
 						} else if (pipe->ref_count <= 1) {
 							break;  // reader gone (broken pipe) — stop writing
 						} else {
@@ -115,6 +120,7 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			if (wt && wt->window_id != INVALID_WID) {
 				pt::uint64_t ev = WindowManager::poll_event(wt->window_id);
 				if (ev == 0) return (pt::uint64_t)-1;   // queue empty
+				if (ev & WEV_MOUSE_BIT) return (pt::uint64_t)-1;
 				bool pressed = (ev & 0x100) != 0;
 				if (!pressed) return (pt::uint64_t)-1;  // skip key-release events
 				pt::uint8_t sc = (pt::uint8_t)(ev & 0xFF);
@@ -136,31 +142,27 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		case SYS_OPEN: {
 			const char* filename = reinterpret_cast<const char*>(arg1);
 			Task* t = TaskScheduler::get_current_task();
-			// Find a free fd slot; 0/1/2 are reserved for stdin/stdout/stderr.
-			int fd = -1;
-			for (int i = 3; i < (int)Task::MAX_FDS; i++) {
-				if (!t->fd_table->fds[i].open) { fd = i; break; }
-			}
+			// Lowest free fd; 0/1/2 are reserved for stdin/stdout/stderr.
+			int fd = fd_table_alloc(t->fd_table);
 			if (fd == -1) {
 				sclog("syscall: SYS_OPEN: no free fd (task %d '%s')\n", t->id, t->name);
 				return (pt::uint64_t)-1;
 			}
-			if (!VFS::open_file(filename, &t->fd_table->fds[fd])) {
+			if (!VFS::open_file(filename, fd_slot(t->fd_table, fd))) {
 				sclog("syscall: SYS_OPEN: '%s' not found (task %d '%s')\n", filename, t->id, t->name);
 				return (pt::uint64_t)-1;
 			}
-			t->fd_table->fds[fd].type = FdType::FILE;
+			fd_slot(t->fd_table, fd)->type = FdType::FILE;
 			sclog("syscall: SYS_OPEN: '%s' -> fd %d\n", filename, fd);
 			return (pt::uint64_t)fd;
 		}
 		case SYS_READ: {
-			int fd = (int)(pt::int8_t)arg1;  // treat as signed to catch negative fds
+			int fd = (int)(pt::int32_t)arg1;  // treat as signed to catch negative fds
 			void* buf        = reinterpret_cast<void*>(arg2);
 			pt::uint32_t count = (pt::uint32_t)arg3;
 			Task* t = TaskScheduler::get_current_task();
-			if (fd < 0 || fd >= (int)Task::MAX_FDS || !t->fd_table->fds[fd].open)
-				return (pt::uint64_t)-1;
-			File* f = &t->fd_table->fds[fd];
+			File* f = fd_get(t->fd_table, fd);
+			if (!f) return (pt::uint64_t)-1;
 			if (f->type == FdType::FILE)
 				return (pt::uint64_t)VFS::read_file(f, buf, count);
 			if (f->type == FdType::PIPE_RD) {
@@ -169,8 +171,14 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 				pt::uint8_t* dst   = reinterpret_cast<pt::uint8_t*>(buf);
 				while (nread < count) {
 					if (pipe->write_pos != pipe->read_pos) {
-						dst[nread++] = pipe->data[pipe->read_pos % PipeBuffer::CAPACITY];
-						pipe->read_pos++;
+						// Largest buffered run that does not wrap the ring.
+						pt::uint32_t off = pipe->read_pos % PipeBuffer::CAPACITY;
+						pt::uint32_t run = pipe->write_pos - pipe->read_pos;
+						if (run > PipeBuffer::CAPACITY - off) run = PipeBuffer::CAPACITY - off;
+						if (run > count - nread) run = count - nread;
+						memcpy(dst + nread, pipe->data + off, run);
+						pipe->read_pos += run;
+						nread += run;
 					} else if (pipe->writer_closed || pipe->ref_count <= 1) {
 						break;  // EOF: writer closed or all writers gone
 					} else {
@@ -186,11 +194,10 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			return (pt::uint64_t)-1;
 		}
 		case SYS_CLOSE: {
-			int fd = (int)(pt::int8_t)arg1;
+			int fd = (int)(pt::int32_t)arg1;
 			Task* t = TaskScheduler::get_current_task();
-			if (fd < 0 || fd >= (int)Task::MAX_FDS || !t->fd_table->fds[fd].open)
-				return (pt::uint64_t)-1;
-			File* f = &t->fd_table->fds[fd];
+			File* f = fd_get(t->fd_table, fd);
+			if (!f) return (pt::uint64_t)-1;
 			if (f->type == FdType::FILE) {
 				VFS::close_file(f);
 			} else if (f->type == FdType::TCP_SOCK) {
@@ -202,46 +209,33 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			} else {
 				// PIPE_RD or PIPE_WR
 				PipeBuffer* pipe = pipe_get_buf(f->fs_data);
-				if (f->type == FdType::PIPE_WR)
+				if (f->type == FdType::PIPE_WR && --pipe->writers == 0)
 					pipe->writer_closed = true;
 				pipe->ref_count--;
 				if (pipe->ref_count == 0)
 					vmm.kfree(pipe);
 				f->open = false;
 			}
+			fd_table_released(t->fd_table, fd);
 			sclog("syscall: SYS_CLOSE: fd %d\n", fd);
 			return 0;
 		}
 		case SYS_MMAP: {
 			Task* ct = TaskScheduler::get_current_task();
-			pt::size_t size = ((pt::size_t)arg1 + 4095) & ~(pt::size_t)4095;
-			if (!ct || size == 0) return (pt::uint64_t)-1;
-			pt::uintptr_t va = ct->user_heap_top;
-			TaskScheduler::map_user_pages(ct, va, size);
-			ct->user_heap_top += size;
-			sclog("syscall: SYS_MMAP size=%d -> va=%lx\n", (int)size, va);
+			// 64-bit throughout: pt::size_t would truncate requests of 4 GB+.
+			if (!ct || arg1 == 0 || arg1 > TaskScheduler::USER_VA_TOP) return (pt::uint64_t)-1;
+			pt::uint64_t size = (arg1 + 4095) & ~(pt::uint64_t)4095;
+			pt::uintptr_t va = TaskScheduler::alloc_user_heap(ct, size);
+			sclog("syscall: SYS_MMAP size=%lx -> va=%lx\n", size, va);
+			if (!va) return (pt::uint64_t)-1;
 			return va;
 		}
 		case SYS_MUNMAP: {
 			Task* ct = TaskScheduler::get_current_task();
 			pt::uintptr_t va = (pt::uintptr_t)arg1;
-			pt::size_t size = ((pt::size_t)arg2 + 4095) & ~(pt::size_t)4095;
-			if (!ct || !ct->user_pd || va < TaskScheduler::USER_HEAP_BASE || size == 0)
-				return (pt::uint64_t)-1;
-			pt::uint64_t* upd = (pt::uint64_t*)(KERNEL_OFFSET + ct->user_pd);
-			for (pt::uintptr_t addr = va; addr < va + size; addr += 4096) {
-				pt::size_t pd_idx = (addr >> 21) & 0x1FF;
-				pt::size_t pt_idx = (addr >> 12) & 0x1FF;
-				if (!(upd[pd_idx] & 0x01) || (upd[pd_idx] & 0x80)) continue;
-				static constexpr pt::uintptr_t PTE_ADDR_MASK = 0x000FFFFFFFFFF000ULL;
-				pt::uint64_t* pt = (pt::uint64_t*)(KERNEL_OFFSET + (upd[pd_idx] & PTE_ADDR_MASK));
-				if (pt[pt_idx] & 0x01) {
-					vmm.free_frame(pt[pt_idx] & PTE_ADDR_MASK);
-					pt[pt_idx] = 0;
-					asm volatile("invlpg [%0]" : : "r"(addr) : "memory");
-				}
-			}
-			return 0;
+			if (!ct || (va & 0xFFF) || arg2 > TaskScheduler::USER_VA_TOP) return (pt::uint64_t)-1;
+			pt::uint64_t size = (arg2 + 4095) & ~(pt::uint64_t)4095;
+			return (pt::uint64_t)(pt::int64_t)TaskScheduler::unmap_user_pages(ct, va, size);
 		}
 		case SYS_YIELD:
 			TaskScheduler::task_yield();
@@ -300,7 +294,7 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			Task* ct = TaskScheduler::get_current_task();
 			if (ct && ct->window_id != INVALID_WID) {
 				Window* cw = WindowManager::get_window(ct->window_id);
-				if (cw) return (pt::uint64_t)cw->client_w;
+				if (cw) return (pt::uint64_t)cw->buf_w;
 			}
 			Framebuffer* fb = Framebuffer::get_instance();
 			pt::uint64_t w = fb ? (pt::uint64_t)fb->get_width() : 0;
@@ -322,6 +316,22 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 				exec_argc, exec_argv);
 		}
 
+		case SYS_SPAWN: {
+			pt::uint32_t sid = TaskScheduler::spawn_task(
+				reinterpret_cast<const char*>(arg1),
+				reinterpret_cast<const char* const*>(arg2),
+				reinterpret_cast<const char* const*>(arg3),
+				reinterpret_cast<const SpawnFileAction*>(arg4),
+				reinterpret_cast<const char*>(arg5));
+			return sid == 0xFFFFFFFF ? (pt::uint64_t)-1 : (pt::uint64_t)sid;
+		}
+
+		case SYS_VFORK: {
+			Task* ct = TaskScheduler::get_current_task();
+			return (pt::uint64_t)TaskScheduler::vfork_task(
+				ct ? ct->syscall_frame_rsp : g_syscall_rsp);
+		}
+
 		case SYS_WAITPID: {
 			pt::uint64_t wr = TaskScheduler::waitpid_task(
 				(pt::uint32_t)arg1,
@@ -340,53 +350,65 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		case SYS_PIPE: {
 			int* pipefd = reinterpret_cast<int*>(arg1);
 			Task* t = TaskScheduler::get_current_task();
-			// Find two free fd slots; 0/1/2 are reserved for stdin/stdout/stderr.
-			int rd_fd = -1, wr_fd = -1;
-			for (int i = 3; i < (int)Task::MAX_FDS && (rd_fd == -1 || wr_fd == -1); i++) {
-				if (!t->fd_table->fds[i].open) {
-					if (rd_fd == -1) rd_fd = i;
-					else             wr_fd = i;
-				}
+			// Two free fd slots; 0/1/2 are reserved for stdin/stdout/stderr.
+			// The read end is claimed before looking for the write end.
+			int rd_fd = fd_table_alloc(t->fd_table);
+			if (rd_fd == -1) {
+				sclog("syscall: SYS_PIPE: no free fd slots\n");
+				return (pt::uint64_t)-1;
 			}
-			if (rd_fd == -1 || wr_fd == -1) {
+			fd_slot(t->fd_table, rd_fd)->open = true;
+			int wr_fd = fd_table_alloc(t->fd_table);
+			if (wr_fd == -1) {
+				fd_slot(t->fd_table, rd_fd)->open = false;
+				fd_table_released(t->fd_table, rd_fd);
 				sclog("syscall: SYS_PIPE: no free fd slots\n");
 				return (pt::uint64_t)-1;
 			}
 			// Allocate and zero-init a PipeBuffer.
 			PipeBuffer* pipe = reinterpret_cast<PipeBuffer*>(vmm.kcalloc(sizeof(PipeBuffer)));
 			if (!pipe) {
+				fd_slot(t->fd_table, rd_fd)->open = false;
+				fd_table_released(t->fd_table, rd_fd);
 				sclog("syscall: SYS_PIPE: out of memory\n");
 				return (pt::uint64_t)-1;
 			}
 			pipe->ref_count     = 2;
+			pipe->writers       = 1;
 			pipe->writer_closed = false;
 			pipe->read_pos      = 0;
 			pipe->write_pos     = 0;
 			// Set up read end.
-			File* rd = &t->fd_table->fds[rd_fd];
+			File* rd = fd_slot(t->fd_table, rd_fd);
 			rd->open = true;
 			rd->type = FdType::PIPE_RD;
 			pipe_set_buf(rd->fs_data, pipe);
 			// Set up write end.
-			File* wr = &t->fd_table->fds[wr_fd];
+			File* wr = fd_slot(t->fd_table, wr_fd);
 			wr->open = true;
 			wr->type = FdType::PIPE_WR;
 			pipe_set_buf(wr->fs_data, pipe);
 			// Return fds to caller.
-			pipefd[0] = rd_fd;
-			pipefd[1] = wr_fd;
+			int out[2] = { rd_fd, wr_fd };
+			if (!copy_to_user(pipefd, out, sizeof(out))) {
+				rd->open = false;
+				wr->open = false;
+				fd_table_released(t->fd_table, rd_fd);
+				fd_table_released(t->fd_table, wr_fd);
+				vmm.kfree(pipe);
+				return (pt::uint64_t)-1;
+			}
 			sclog("syscall: SYS_PIPE: rd=%d wr=%d\n", rd_fd, wr_fd);
 			return 0;
 		}
 
 		case SYS_LSEEK: {
-			int fd = (int)(pt::int8_t)arg1;
+			int fd = (int)(pt::int32_t)arg1;
 			pt::int32_t offset = (pt::int32_t)(pt::int64_t)arg2;
 			int whence = (int)arg3;
 			Task* t = TaskScheduler::get_current_task();
-			if (fd < 0 || fd >= (int)Task::MAX_FDS || !t->fd_table->fds[fd].open)
-				return (pt::uint64_t)-1;
-			File* f = &t->fd_table->fds[fd];
+			File* f = fd_get(t->fd_table, fd);
+			if (!f) return (pt::uint64_t)-1;
 			if (f->type != FdType::FILE) return (pt::uint64_t)-1;
 			return (pt::uint64_t)VFS::seek_file(f, offset, whence);
 		}
@@ -395,7 +417,7 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			Task* ct = TaskScheduler::get_current_task();
 			if (ct && ct->window_id != INVALID_WID) {
 				Window* cw = WindowManager::get_window(ct->window_id);
-				if (cw) return (pt::uint64_t)cw->client_h;
+				if (cw) return (pt::uint64_t)cw->buf_h;
 			}
 			Framebuffer* fb = Framebuffer::get_instance();
 			return fb ? (pt::uint64_t)fb->get_height() : 0;
@@ -403,19 +425,26 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 
 		case SYS_DRAW_PIXELS: {
 			const pt::uint8_t* buf = reinterpret_cast<const pt::uint8_t*>(arg1);
+			// Format and stride ride in the high halves of w and h.
+			pt::uint32_t w      = (pt::uint32_t)arg4;
+			pt::uint32_t h      = (pt::uint32_t)arg5;
+			pt::uint32_t format = (pt::uint32_t)(arg4 >> 32) & 0xFF;
+			pt::uint32_t stride = (pt::uint32_t)(arg5 >> 32);
+			if (format >= PIXFMT_COUNT) return (pt::uint64_t)-1;
+			if (!WindowManager::user_pixels_ok(buf, w, h, format, stride)) return (pt::uint64_t)-1;
 			{
 				Task* t = TaskScheduler::get_current_task();
 				if (t && t->window_id != INVALID_WID) {
 					WindowManager::win_draw_pixels(t->window_id, buf,
 					    (pt::uint32_t)arg2, (pt::uint32_t)arg3,
-					    (pt::uint32_t)arg4, (pt::uint32_t)arg5);
+					    w, h, format, stride);
 					return 0;
 				}
 			}
 			Framebuffer* fb = Framebuffer::get_instance();
 			if (!fb) return (pt::uint64_t)-1;
 			fb->Draw(buf, (pt::uint32_t)arg2, (pt::uint32_t)arg3,
-			         (pt::uint32_t)arg4, (pt::uint32_t)arg5);
+			         w, h, format, stride);
 			return 0;
 		}
 
@@ -436,20 +465,17 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		case SYS_CREATE: {
 			const char* filename = reinterpret_cast<const char*>(arg1);
 			Task* t = TaskScheduler::get_current_task();
-			// Find a free fd slot; 0/1/2 are reserved for stdin/stdout/stderr.
-			int fd = -1;
-			for (int i = 3; i < (int)Task::MAX_FDS; i++) {
-				if (!t->fd_table->fds[i].open) { fd = i; break; }
-			}
+			// Lowest free fd; 0/1/2 are reserved for stdin/stdout/stderr.
+			int fd = fd_table_alloc(t->fd_table);
 			if (fd == -1) {
 				sclog("syscall: SYS_CREATE: no free fd (task %d '%s')\n", t->id, t->name);
 				return (pt::uint64_t)-1;
 			}
-			if (!VFS::open_file_write(filename, &t->fd_table->fds[fd])) {
+			if (!VFS::open_file_write(filename, fd_slot(t->fd_table, fd))) {
 				sclog("syscall: SYS_CREATE: '%s' failed\n", filename);
 				return (pt::uint64_t)-1;
 			}
-			t->fd_table->fds[fd].type = FdType::FILE;
+			fd_slot(t->fd_table, fd)->type = FdType::FILE;
 			sclog("syscall: SYS_CREATE: '%s' -> fd %d\n", filename, fd);
 			return (pt::uint64_t)fd;
 		}
@@ -485,6 +511,36 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			if (!t || !w || w->owner_task_id != t->id) return 0;
 			return WindowManager::poll_event((pt::uint32_t)arg1);
 		}
+		case SYS_GET_WINDOW_EVENTS: {
+			// Batched and optionally blocking form of SYS_GET_WINDOW_EVENT:
+			// one call drains what a frame's worth of input left in the ring.
+			Task* t = TaskScheduler::get_current_task();
+			pt::uint32_t wid = (pt::uint32_t)arg1;
+			Window* w = WindowManager::get_window(wid);
+			if (!t || !w || w->owner_task_id != t->id) return (pt::uint64_t)-1;
+			pt::uint64_t* out = reinterpret_cast<pt::uint64_t*>(arg2);
+			pt::uint32_t max = arg3 > WEV_BATCH_MAX ? WEV_BATCH_MAX : (pt::uint32_t)arg3;
+			// Check the whole buffer before popping anything, so a bad one
+			// fails without losing events from the ring.
+			if (max && !user_range_ok((pt::uintptr_t)out, (pt::size_t)max * 8))
+				return (pt::uint64_t)-1;
+			if (arg5 & WEVF_MOUSE) w->want_mouse = true;
+			pt::uint32_t pending = WindowManager::wait_events(wid, arg4);
+			if (pending == 0 || max == 0) return pending;
+			// Pop into a kernel buffer with interrupts off, then copy out
+			// with them on: the user page may still have to be faulted in.
+			pt::uint64_t tmp[32];
+			pt::uint32_t got = 0;
+			while (got < max) {
+				pt::uint32_t want = max - got > 32 ? 32 : max - got;
+				pt::uint32_t n = WindowManager::poll_events(wid, tmp, want);
+				if (!copy_to_user(out + got, tmp, (pt::size_t)n * 8))
+					return (pt::uint64_t)-1;
+				got += n;
+				if (n < want) break;
+			}
+			return got;
+		}
 
 		case SYS_READDIR: {
 			int idx          = (int)arg1;
@@ -510,13 +566,11 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			pt::uint32_t dst_ip   = (pt::uint32_t)arg1;
 			pt::uint16_t dst_port = (pt::uint16_t)arg2;
 			Task* t = TaskScheduler::get_current_task();
-			int fd = -1;
-			for (int i = 3; i < (int)Task::MAX_FDS; i++)
-				if (!t->fd_table->fds[i].open) { fd = i; break; }
+			int fd = fd_table_alloc(t->fd_table);
 			if (fd == -1) return (pt::uint64_t)-1;
 			TcpSocket* sock = tcp_connect(dst_ip, dst_port, 250);
 			if (!sock) return (pt::uint64_t)-1;
-			File* f  = &t->fd_table->fds[fd];
+			File* f  = fd_slot(t->fd_table, fd);
 			f->open  = true;
 			f->type  = FdType::TCP_SOCK;
 			tcp_sock_set(f->fs_data, sock);
@@ -541,28 +595,27 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			return get_microseconds();
 
 		case SYS_AUDIO_WRITE: {
-			if (!AC97::is_present()) return (pt::uint64_t)-1;
+			if (!mixer_running()) return (pt::uint64_t)-1;
 			const pt::uint8_t* data = reinterpret_cast<const pt::uint8_t*>(arg1);
 			pt::uint32_t bytes = static_cast<pt::uint32_t>(arg2);
-			if (!data || bytes == 0) return (pt::uint64_t)-1;
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || !data || bytes == 0) return (pt::uint64_t)-1;
 
 			// Auto-open for backward compatibility (Doom passes rate as arg3)
-			if (AC97::owner_task_id < 0) {
-				Task* t = TaskScheduler::get_current_task();
-				if (!t) return (pt::uint64_t)-1;
+			if (!mixer_has_stream(t->id)) {
 				pt::uint32_t rate = static_cast<pt::uint32_t>(arg3);
 				if (rate == 0) rate = 48000;
-				if (!AC97::open(rate, 2, 0)) return (pt::uint64_t)-1;
-				AC97::owner_task_id = (pt::int32_t)t->id;
+				if (!mixer_open(t->id, rate, 2, AUDIO_FMT_S16)) return (pt::uint64_t)-1;
 			}
 
-			return (pt::uint64_t)AC97::queue_pcm(data, bytes);
+			return (pt::uint64_t)mixer_write(t->id, data, bytes,
+			                                 (arg3 & AUDIO_WRITE_BLOCK) != 0);
 		}
 
 		case SYS_AUDIO_PLAYING: {
-			if (!AC97::is_present()) return (pt::uint64_t)-1;
-			AC97::poll_dma();
-			if (AC97::owner_task_id >= 0 && !AC97::has_free_slot())
+			if (!mixer_running()) return (pt::uint64_t)-1;
+			Task* t = TaskScheduler::get_current_task();
+			if (t && mixer_has_stream(t->id) && !mixer_can_write(t->id))
 				return 1;
 			return 0;
 		}
@@ -583,7 +636,7 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			int i = 0;
 			for (; i < 31 && src[i]; ++i) w->title[i] = src[i];
 			w->title[i] = '\0';
-			// Chrome (including title) is redrawn by the compositor each frame.
+			WindowManager::damage_window((pt::uint32_t)arg1);
 			return 0;
 		}
 
@@ -605,7 +658,9 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			const char* filename = reinterpret_cast<const char*>(arg1);
 			StatResult* buf = reinterpret_cast<StatResult*>(arg2);
 			if (!filename || !buf) return (pt::uint64_t)-1;
-			return VFS::stat_file(filename, buf) ? 0 : (pt::uint64_t)-1;
+			StatResult st;
+			if (!VFS::stat_file(filename, &st)) return (pt::uint64_t)-1;
+			return copy_to_user(buf, &st, sizeof(st)) ? 0 : (pt::uint64_t)-1;
 		}
 
 		case SYS_MPROTECT: {
@@ -649,6 +704,103 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 			return ok ? 0 : (pt::uint64_t)-1;
 		}
 
+		case SYS_MAP_WINDOW_SURFACE: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			pt::uintptr_t va = WindowManager::map_surface(t->window_id, t);
+			return va ? (pt::uint64_t)va : (pt::uint64_t)-1;
+		}
+
+		case SYS_COMMIT_WINDOW: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			pt::uint32_t count = (pt::uint32_t)arg2;
+			if (count > SURFACE_MAX_RECTS) count = SURFACE_MAX_RECTS;
+			SurfaceRect rects[SURFACE_MAX_RECTS];
+			if (count && !copy_from_user(rects, reinterpret_cast<const void*>(arg1),
+			                             count * sizeof(SurfaceRect)))
+				return (pt::uint64_t)-1;
+			WindowManager::commit_surface(t->window_id, rects, count);
+			return 0;
+		}
+
+		case SYS_SET_WINDOW_PALETTE: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			pt::uint32_t first = (pt::uint32_t)arg2, count = (pt::uint32_t)arg3;
+			if (first >= 256 || count > 256 - first) return (pt::uint64_t)-1;
+			pt::uint32_t colors[256];
+			if (!copy_from_user(colors, reinterpret_cast<const void*>(arg1),
+			                    count * sizeof(pt::uint32_t)))
+				return (pt::uint64_t)-1;
+			return WindowManager::win_set_palette(t->window_id, colors, first, count)
+			    ? 0 : (pt::uint64_t)-1;
+		}
+
+		case SYS_SET_WINDOW_SOURCE: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			if (arg3 > WSCALE_BILINEAR) return (pt::uint64_t)-1;
+			return WindowManager::set_source_size(t->window_id, (pt::uint32_t)arg1,
+			                                      (pt::uint32_t)arg2, arg3 == WSCALE_BILINEAR)
+			    ? 0 : (pt::uint64_t)-1;
+		}
+
+		case SYS_CREATE_SWAPCHAIN: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			pt::uint32_t count = (pt::uint32_t)arg1;
+			if (count > SWAP_MAX || (count && !arg2)) return (pt::uint64_t)-1;
+			pt::uintptr_t vas[SWAP_MAX];
+			if (!WindowManager::create_swapchain(t->window_id, t, count, vas))
+				return (pt::uint64_t)-1;
+			if (count && !copy_to_user(reinterpret_cast<void*>(arg2), vas, count * sizeof(vas[0]))) {
+				WindowManager::create_swapchain(t->window_id, t, 0, vas);
+				return (pt::uint64_t)-1;
+			}
+			return 0;
+		}
+
+		case SYS_PRESENT: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			PresentInfo info;
+			pt::int64_t next = WindowManager::present(t->window_id, (pt::uint32_t)arg1, &info);
+			if (next < 0) return (pt::uint64_t)-1;
+			if (arg2) copy_to_user(reinterpret_cast<void*>(arg2), &info, sizeof(info));
+			return (pt::uint64_t)next;
+		}
+
+		case SYS_DRAW_BATCH: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
+			return (pt::uint64_t)WindowManager::draw_batch(t->window_id,
+			    reinterpret_cast<const pt::uint8_t*>(arg1), (pt::size_t)arg2);
+		}
+
+		case SYS_AUDIO_VOLUME: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t || !mixer_set_volume(t->id, (pt::uint32_t)arg1))
+				return (pt::uint64_t)-1;
+			return 0;
+		}
+
+		case SYS_AUDIO_MAP_RING: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t) return (pt::uint64_t)-1;
+			pt::uintptr_t va = mixer_map_ring(t->id, t, (pt::uint32_t)arg1);
+			if (!va) return (pt::uint64_t)-1;
+			sclog("syscall: SYS_AUDIO_MAP_RING: %d bytes -> va=%lx by task %d\n",
+			      (int)arg1, va, t->id);
+			return va;
+		}
+
+		case SYS_AUDIO_RING_WAIT: {
+			Task* t = TaskScheduler::get_current_task();
+			if (!t) return (pt::uint64_t)-1;
+			return (pt::uint64_t)mixer_ring_wait(t->id, (pt::uint32_t)arg1, arg2);
+		}
+
 		case SYS_GET_WINDOW_POS: {
 			Task* t = TaskScheduler::get_current_task();
 			if (!t || t->window_id == INVALID_WID) return (pt::uint64_t)-1;
@@ -679,41 +831,34 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		case SYS_OPEN_RW: {
 			const char* filename = reinterpret_cast<const char*>(arg1);
 			Task* t = TaskScheduler::get_current_task();
-			int fd = -1;
-			for (int i = 3; i < (int)Task::MAX_FDS; i++) {
-				if (!t->fd_table->fds[i].open) { fd = i; break; }
-			}
+			int fd = fd_table_alloc(t->fd_table);
 			if (fd == -1) return (pt::uint64_t)-1;
-			if (!VFS::open_file_readwrite(filename, &t->fd_table->fds[fd])) {
+			if (!VFS::open_file_readwrite(filename, fd_slot(t->fd_table, fd))) {
 				sclog("syscall: SYS_OPEN_RW: '%s' not found\n", filename);
 				return (pt::uint64_t)-1;
 			}
-			t->fd_table->fds[fd].type = FdType::FILE;
+			fd_slot(t->fd_table, fd)->type = FdType::FILE;
 			sclog("syscall: SYS_OPEN_RW: '%s' -> fd %d\n", filename, fd);
 			return (pt::uint64_t)fd;
 		}
 
 		case SYS_AUDIO_OPEN: {
-			if (!AC97::is_present()) return (pt::uint64_t)-1;
+			if (!mixer_running()) return (pt::uint64_t)-1;
 			Task* t = TaskScheduler::get_current_task();
 			if (!t) return (pt::uint64_t)-1;
-			if (AC97::owner_task_id >= 0 && AC97::owner_task_id != (pt::int32_t)t->id)
-				return (pt::uint64_t)-1;
 			pt::uint32_t rate     = (pt::uint32_t)arg1;
 			pt::uint8_t  channels = (pt::uint8_t)arg2;
 			pt::uint8_t  format   = (pt::uint8_t)arg3;
-			if (!AC97::open(rate, channels, format))
+			if (!mixer_open(t->id, rate, channels, format))
 				return (pt::uint64_t)-1;
-			AC97::owner_task_id = (pt::int32_t)t->id;
 			sclog("syscall: SYS_AUDIO_OPEN: rate=%d ch=%d by task %d\n", rate, channels, t->id);
 			return 0;
 		}
 
 		case SYS_AUDIO_CLOSE: {
 			Task* t = TaskScheduler::get_current_task();
-			if (!t || AC97::owner_task_id != (pt::int32_t)t->id)
+			if (!t || !mixer_close(t->id))
 				return (pt::uint64_t)-1;
-			AC97::close();
 			sclog("syscall: SYS_AUDIO_CLOSE: by task %d\n", t->id);
 			return 0;
 		}
@@ -721,13 +866,11 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		case SYS_UDP_OPEN: {
 			pt::uint16_t port = (pt::uint16_t)arg1;
 			Task* t = TaskScheduler::get_current_task();
-			int fd = -1;
-			for (int i = 3; i < (int)Task::MAX_FDS; i++)
-				if (!t->fd_table->fds[i].open) { fd = i; break; }
+			int fd = fd_table_alloc(t->fd_table);
 			if (fd == -1) return (pt::uint64_t)-1;
 			UdpSocket* sock = udp_user_open(port);
 			if (!sock) return (pt::uint64_t)-1;
-			File* f = &t->fd_table->fds[fd];
+			File* f = fd_slot(t->fd_table, fd);
 			f->open = true;
 			f->type = FdType::UDP_SOCK;
 			udp_sock_set(f->fs_data, sock);
@@ -736,15 +879,14 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		}
 
 		case SYS_UDP_SENDTO: {
-			int fd = (int)(pt::int8_t)arg1;
+			int fd = (int)(pt::int32_t)arg1;
 			const pt::uint8_t* buf = reinterpret_cast<const pt::uint8_t*>(arg2);
 			pt::uint32_t len = (pt::uint32_t)arg3;
 			pt::uint32_t dst_ip = (pt::uint32_t)arg4;
 			pt::uint16_t dst_port = (pt::uint16_t)arg5;
 			Task* t = TaskScheduler::get_current_task();
-			if (fd < 0 || fd >= (int)Task::MAX_FDS || !t->fd_table->fds[fd].open)
-				return (pt::uint64_t)-1;
-			File* f = &t->fd_table->fds[fd];
+			File* f = fd_get(t->fd_table, fd);
+			if (!f) return (pt::uint64_t)-1;
 			if (f->type != FdType::UDP_SOCK) return (pt::uint64_t)-1;
 			UdpSocket* sock = udp_sock_get(f->fs_data);
 			int n = udp_user_sendto(sock, buf, len, dst_ip, dst_port);
@@ -752,15 +894,14 @@ static pt::uint64_t syscall_dispatch(pt::uint64_t nr, pt::uint64_t arg1,
 		}
 
 		case SYS_UDP_RECVFROM: {
-			int fd = (int)(pt::int8_t)arg1;
+			int fd = (int)(pt::int32_t)arg1;
 			pt::uint8_t* buf = reinterpret_cast<pt::uint8_t*>(arg2);
 			pt::uint32_t len = (pt::uint32_t)arg3;
 			pt::uint64_t* out_peer = reinterpret_cast<pt::uint64_t*>(arg4);
 			pt::int64_t timeout = (pt::int64_t)arg5;
 			Task* t = TaskScheduler::get_current_task();
-			if (fd < 0 || fd >= (int)Task::MAX_FDS || !t->fd_table->fds[fd].open)
-				return (pt::uint64_t)-1;
-			File* f = &t->fd_table->fds[fd];
+			File* f = fd_get(t->fd_table, fd);
+			if (!f) return (pt::uint64_t)-1;
 			if (f->type != FdType::UDP_SOCK) return (pt::uint64_t)-1;
 			UdpSocket* sock = udp_sock_get(f->fs_data);
 			pt::uint32_t ip = 0;
@@ -878,12 +1019,14 @@ ASMCALL pt::uint64_t syscall_handler(pt::uint64_t nr, pt::uint64_t arg1,
 	pt::uint64_t result = syscall_dispatch(nr, arg1, arg2, arg3, arg4, arg5);
 
 	if (t0) {
-		extern SyscallPerfData* g_perf_data;
-		if (g_perf_data) {
+		// Counters are allocated on the task's first recorded call.
+		if (!ct->perf)
+			ct->perf = static_cast<SyscallPerfData*>(vmm.kcalloc(sizeof(SyscallPerfData)));
+		if (ct->perf) {
 			pt::uint64_t t1 = get_microseconds();
 			if (t1 > t0) {
-				g_perf_data[ct->id].counts[nr]++;
-				g_perf_data[ct->id].usec[nr] += t1 - t0;
+				ct->perf->counts[nr]++;
+				ct->perf->usec[nr] += t1 - t0;
 			}
 		}
 	}
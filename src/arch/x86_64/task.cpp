@@ -6,10 +6,11 @@
 #include "pipe.h"
 #include "elf.h"
 #include "elf_loader.h"
+#include "text_cache.h"
 #include "device/timer.h"
 #include "device/keyboard.h"
 #include "window.h"
-#include "device/ac97.h"
+#include "mixer.h"
 #include "vterm.h"
 #include "syscall.h"
 
@@ -28,7 +29,7 @@ static void close_fd(File* f)
     } else {
         // PIPE_RD or PIPE_WR
         PipeBuffer* pipe = pipe_get_buf(f->fs_data);
-        if (f->type == FdType::PIPE_WR)
+        if (f->type == FdType::PIPE_WR && --pipe->writers == 0)
             pipe->writer_closed = true;
         pipe->ref_count--;
         if (pipe->ref_count == 0)
@@ -37,77 +38,153 @@ static void close_fd(File* f)
     }
 }
 
-// Free all user-space page-table frames and their mapped physical frames.
-// Covers code PTs (priv_pt[]), stack PT (stack_pt), heap PTs (user_pd entries),
-// and the user_pd / user_pdpt frames themselves.
-//
-// Uses KERNEL_OFFSET + PA for all frame accesses so it works under both
-// the kernel CR3 (identity map via PML4[0]) and a task CR3 (ring-0 uses
-// the kernel half at PML4[256] which maps KERNEL_OFFSET + PA).
-static void free_user_pagetables(Task* t)
+// Copy an open fd into another slot (fork / spawn inheritance, dup2).
+// Pipe ends gain a reference so each copy closes independently; the reader
+// sees EOF only once every copy of the write end is closed.
+static void dup_fd(File* dst, const File* src)
 {
-    pt::size_t num_code_pts = t->num_priv_pts;
+    *dst = *src;
+    if (dst->open && (dst->type == FdType::PIPE_RD || dst->type == FdType::PIPE_WR)) {
+        PipeBuffer* pipe = pipe_get_buf(dst->fs_data);
+        pipe->ref_count++;
+        if (dst->type == FdType::PIPE_WR) pipe->writers++;
+    }
+}
 
-    // 1. Free code PT frames and their mapped code frames.
-    for (pt::size_t k = 0; k < num_code_pts; k++) {
-        if (!t->priv_pt[k]) continue;
-        pt::uint64_t* cpt = reinterpret_cast<pt::uint64_t*>(
-            KERNEL_OFFSET + t->priv_pt[k]);
-        for (int j = 0; j < 512; j++) {
-            if (cpt[j] & 0x01)
-                vmm.free_frame(cpt[j] & PTE_ADDR_MASK);
-        }
-        vmm.free_frame(t->priv_pt[k]);
-        t->priv_pt[k] = 0;
-    }
-    t->num_priv_pts = 0;
-
-    // 2. Free stack PT frame and all stack frames it maps.
-    if (t->stack_pt) {
-        pt::uint64_t* spt = reinterpret_cast<pt::uint64_t*>(
-            KERNEL_OFFSET + t->stack_pt);
-        for (int j = 0; j < 512; j++) {
-            if (spt[j] & 0x01)
-                vmm.free_frame(spt[j] & PTE_ADDR_MASK);
-        }
-        vmm.free_frame(t->stack_pt);
-        t->stack_pt = 0;
-    }
-
-    // 3. Free heap PT frames and heap frames (user_pd[heap_start..USER_STACK_PD_IDX-1]).
-    if (t->user_pd) {
-        pt::uint64_t* upd = reinterpret_cast<pt::uint64_t*>(
-            KERNEL_OFFSET + t->user_pd);
-        pt::size_t heap_start = TaskScheduler::USER_CODE_PD_IDX + num_code_pts;
-        for (pt::size_t i = heap_start; i < TaskScheduler::USER_STACK_PD_IDX; i++) {
-            if (!(upd[i] & 0x01)) continue;
-            if (upd[i] & 0x80) continue;  // 2MB huge page (boot identity entry) — not a PT
-            pt::uint64_t* hpt = reinterpret_cast<pt::uint64_t*>(
-                KERNEL_OFFSET + (upd[i] & PTE_ADDR_MASK));
-            for (int j = 0; j < 512; j++) {
-                if (hpt[j] & 0x01)
-                    vmm.free_frame(hpt[j] & PTE_ADDR_MASK);
+// ── File-descriptor tables ──────────────────────────────────────────────────
+
+FdTable* fd_table_create()
+{
+    FdTable* t = static_cast<FdTable*>(vmm.kcalloc(sizeof(FdTable)));
+    if (!t) return nullptr;
+    t->refcount  = 1;
+    t->free_hint = 3;
+    if (!fd_table_reserve(t, 0)) {
+        vmm.kfree(t);
+        return nullptr;
+    }
+    return t;
+}
+
+File* fd_table_reserve(FdTable* t, int fd)
+{
+    if (fd < 0 || (pt::size_t)fd >= TASK_MAX_FDS) return nullptr;
+    if ((pt::uint32_t)fd >= t->capacity) {
+        // Grow the chunk directory to cover fd, doubling to keep the number
+        // of reallocations logarithmic in the table size.
+        pt::size_t have = t->capacity / FdTable::CHUNK;
+        pt::size_t need = (pt::size_t)fd / FdTable::CHUNK + 1;
+        pt::size_t want = have ? have * 2 : 1;
+        if (want < need) want = need;
+        if (want > TASK_MAX_FDS / FdTable::CHUNK) want = TASK_MAX_FDS / FdTable::CHUNK;
+        File** dir = static_cast<File**>(vmm.krealloc(t->chunks,
+            have * sizeof(File*), want * sizeof(File*)));
+        if (!dir) return nullptr;
+        t->chunks = dir;
+        for (pt::size_t c = have; c < want; c++) {
+            dir[c] = static_cast<File*>(vmm.kcalloc(FdTable::CHUNK * sizeof(File)));
+            if (!dir[c]) {
+                t->capacity = (pt::uint32_t)(c * FdTable::CHUNK);
+                return fd_slot(t, fd);
             }
-            vmm.free_frame(upd[i] & PTE_ADDR_MASK);
         }
-        vmm.free_frame(t->user_pd);
-        t->user_pd = 0;
+        t->capacity = (pt::uint32_t)(want * FdTable::CHUNK);
     }
+    return fd_slot(t, fd);
+}
 
-    // 4. Free user PDPT frame.
-    if (t->user_pdpt) {
-        vmm.free_frame(t->user_pdpt);
-        t->user_pdpt = 0;
+int fd_table_alloc(FdTable* t)
+{
+    for (pt::uint32_t fd = t->free_hint < 3 ? 3 : t->free_hint; ; fd++) {
+        File* f = fd_table_reserve(t, (int)fd);
+        if (!f) return -1;
+        if (!f->open) {
+            t->free_hint = fd;
+            return (int)fd;
+        }
     }
+}
+
+// New FdTable (refcount=1) holding a copy of every fd in src.
+static FdTable* copy_fd_table(const FdTable* src)
+{
+    FdTable* t = fd_table_create();
+    if (!t || !src) return t;
+    // Only slots up to the last open fd need backing in the copy.
+    int last = -1;
+    for (pt::uint32_t i = 0; i < src->capacity; i++)
+        if (fd_slot(src, i)->open) last = (int)i;
+    if (last >= 0 && !fd_table_reserve(t, last)) return t;
+    for (int i = 0; i <= last; i++)
+        dup_fd(fd_slot(t, i), fd_slot(src, i));
+    t->free_hint = src->free_hint;
+    return t;
+}
+
+// Close every fd of an FdTable whose last reference is gone and free it.
+static void free_fd_table(FdTable* t)
+{
+    for (pt::uint32_t i = 0; i < t->capacity; i++)
+        close_fd(fd_slot(t, i));
+    for (pt::uint32_t c = 0; c < t->capacity / FdTable::CHUNK; c++)
+        vmm.kfree(t->chunks[c]);
+    vmm.kfree(t->chunks);
+    vmm.kfree(t);
+}
+
+// Drop one reference to a task's FdTable, freeing it with the last one.
+static void release_fd_table(Task* t)
+{
+    if (!t->fd_table) return;
+    if (--t->fd_table->refcount == 0)
+        free_fd_table(t->fd_table);
+    t->fd_table = nullptr;
+}
 
-    t->user_heap_top = 0;
+static inline bool is_socket(const File* f)
+{
+    return f->open && (f->type == FdType::TCP_SOCK || f->type == FdType::UDP_SOCK);
+}
+
+// Apply a SYS_SPAWN file-action list to a child's fd table.  Only files
+// and pipes can be closed or duplicated (close_fd has no socket path).
+// Returns false on a bad fd, an unknown op or an unterminated list.
+static bool apply_file_actions(FdTable* t, const SpawnFileAction* actions)
+{
+    if (!actions) return true;
+    // A full list is SPAWN_MAX_ACTIONS actions followed by its END entry.
+    for (pt::size_t i = 0; i <= SPAWN_MAX_ACTIONS; i++) {
+        const SpawnFileAction& a = actions[i];
+        if (a.op == SPAWN_FA_END) return true;
+        File* src = fd_slot(t, a.fd);
+        if (a.op == SPAWN_FA_CLOSE) {
+            if (!src || is_socket(src)) return false;
+            close_fd(src);
+            fd_table_released(t, a.fd);
+        } else if (a.op == SPAWN_FA_DUP2) {
+            if (!src || !src->open || is_socket(src)) return false;
+            if (a.newfd == a.fd) continue;
+            File* dst = fd_table_reserve(t, a.newfd);
+            if (!dst || is_socket(dst)) return false;
+            src = fd_slot(t, a.fd);
+            close_fd(dst);
+            dup_fd(dst, src);
+        } else {
+            return false;
+        }
+    }
+    return false;
 }
 
 // Static member initialization
-Task TaskScheduler::tasks[MAX_TASKS];
+Task** TaskScheduler::tasks = nullptr;
+pt::uint32_t TaskScheduler::task_capacity = 0;
 pt::uint32_t TaskScheduler::task_count = 0;
-pt::uint32_t TaskScheduler::current_task_id = 0;
+pt::uint32_t TaskScheduler::current_slot = 0;
 pt::uint64_t TaskScheduler::scheduler_ticks = 0;
+bool TaskScheduler::need_resched = false;
+pt::uint32_t TaskScheduler::next_pid = 1;
+Task* TaskScheduler::pid_hash[PID_HASH_SIZE];
 static pt::uintptr_t kernel_cr3 = 0;  // Boot PML4 physical address
 
 // FXSAVE template captured once at scheduler init (after fninit in enable_sse).
@@ -124,56 +201,390 @@ pt::uintptr_t g_syscall_rsp = 0;
 // task's CR3.  0 = no switch pending.
 pt::uintptr_t g_next_cr3 = 0;
 
+// ── User address-space helpers ──────────────────────────────────────────────
+//
+// A user address space is rooted at a per-task PDPT wired into PML4[0].
+// PDPT[0] starts as a private PD seeded with the boot PD0 entries (2 MB
+// identity pages, U/S cleared) and PDPT[1..3] mirror the boot identity map of
+// 1..4 GB (kernel-only) so ring-0 keeps reaching device MMIO such as the
+// framebuffer while a task CR3 is active.  Every other PD/PT is allocated on
+// demand by user_pte().
+//
+// All table accesses use KERNEL_OFFSET + PA so the helpers work under both
+// the kernel CR3 and any task CR3.
+
+static inline pt::uint64_t* pa_table(pt::uintptr_t pa)
+{
+    return reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + pa);
+}
+
+// Software PTE bit: the frame belongs to a kernel object lent to the process
+// (a window surface or audio ring, see map_borrowed_pages).  Unmapping or tearing down the
+// address space only drops the mapping; fork does not carry it over.
+static constexpr pt::uint64_t PTE_BORROWED = 1ULL << 10;
+
+// Allocate a zeroed frame for a page-table level (or a fresh user page).
+static pt::uintptr_t alloc_zeroed_frame()
+{
+    pt::uintptr_t frame = vmm.allocate_frame();
+    memset(reinterpret_cast<void*>(KERNEL_OFFSET + frame), 0, 4096);
+    return frame;
+}
+
+// PDPT slots 1..3 are the shared kernel-only identity map of 1..4 GB.
+static inline bool is_kernel_pdpt_slot(pt::size_t i)
+{
+    return i >= 1 && i < 4;
+}
+
+// Return a pointer to the leaf PTE for user VA `va` in the address space
+// rooted at pdpt_pa.  With alloc=true, missing PD/PT levels are allocated
+// (zeroed) and a boot 2 MB identity entry covering `va` is replaced by a
+// private PT.  Returns nullptr if the walk fails or `va` falls in the
+// kernel-only identity window.
+static pt::uint64_t* user_pte(pt::uintptr_t pdpt_pa, pt::uintptr_t va, bool alloc)
+{
+    if (va >= TaskScheduler::USER_VA_TOP) return nullptr;
+    pt::size_t pdpt_idx = (va >> 30) & 0x1FF;
+    pt::size_t pd_idx   = (va >> 21) & 0x1FF;
+    pt::size_t pt_idx   = (va >> 12) & 0x1FF;
+    if (is_kernel_pdpt_slot(pdpt_idx)) return nullptr;
+
+    pt::uint64_t* pdpt = pa_table(pdpt_pa);
+    if (!(pdpt[pdpt_idx] & 0x01)) {
+        if (!alloc) return nullptr;
+        pdpt[pdpt_idx] = alloc_zeroed_frame() | 0x07;
+    }
+
+    pt::uint64_t* pd = pa_table(pdpt[pdpt_idx] & PTE_ADDR_MASK);
+    if (!(pd[pd_idx] & 0x01) || (pd[pd_idx] & 0x80)) {
+        if (!alloc) return nullptr;
+        pd[pd_idx] = alloc_zeroed_frame() | 0x07;
+    }
+
+    pt::uint64_t* pt = pa_table(pd[pd_idx] & PTE_ADDR_MASK);
+    return &pt[pt_idx];
+}
+
+// Build an empty user address space; returns the PA of its PDPT.
+static pt::uintptr_t new_user_space()
+{
+    pt::uint64_t* boot_pml4 = pa_table(kernel_cr3);
+    pt::uint64_t* boot_pdpt = pa_table(boot_pml4[0] & PTE_ADDR_MASK);
+    pt::uint64_t* boot_pd   = pa_table(boot_pdpt[0] & PTE_ADDR_MASK);
+
+    pt::uintptr_t pdpt_frame = alloc_zeroed_frame();
+    pt::uintptr_t pd_frame   = vmm.allocate_frame();
+    pt::uint64_t* pdpt = pa_table(pdpt_frame);
+    pt::uint64_t* pd   = pa_table(pd_frame);
+
+    for (int i = 0; i < 512; i++)
+        pd[i] = boot_pd[i] & ~(pt::uint64_t)0x04;
+    pdpt[0] = pd_frame | 0x07;
+    for (int i = 1; i < 4; i++)
+        pdpt[i] = boot_pdpt[i] & ~(pt::uint64_t)0x04;
+    return pdpt_frame;
+}
+
+// Free every user frame, PT, PD and the PDPT of an address space.
+// Boot 2 MB identity entries and the kernel-only PDPT slots are skipped;
+// shared text pages drop their text-cache reference instead, and borrowed
+// window surfaces and audio rings stay with their owner.
+static void free_user_space(pt::uintptr_t pdpt_pa)
+{
+    if (!pdpt_pa) return;
+    WindowManager::forget_surfaces(pdpt_pa);
+    mixer_forget_rings(pdpt_pa);
+    pt::uint64_t* pdpt = pa_table(pdpt_pa);
+    for (pt::size_t i = 0; i < 512; i++) {
+        if (is_kernel_pdpt_slot(i) || !(pdpt[i] & 0x01)) continue;
+        pt::uint64_t* pd = pa_table(pdpt[i] & PTE_ADDR_MASK);
+        for (pt::size_t j = 0; j < 512; j++) {
+            if (!(pd[j] & 0x01) || (pd[j] & 0x80)) continue;
+            pt::uint64_t* pt = pa_table(pd[j] & PTE_ADDR_MASK);
+            for (pt::size_t k = 0; k < 512; k++) {
+                if (!(pt[k] & 0x01) || (pt[k] & PTE_BORROWED)) continue;
+                if (pt[k] & PTE_SHARED)
+                    TextCache::put_page(pt[k]);
+                else
+                    vmm.free_frame(pt[k] & PTE_ADDR_MASK);
+            }
+            vmm.free_frame(pd[j] & PTE_ADDR_MASK);
+        }
+        vmm.free_frame(pdpt[i] & PTE_ADDR_MASK);
+    }
+    vmm.free_frame(pdpt_pa);
+}
+
+// Deep-copy an address space (fork).  Every present user page gets a new
+// frame with the same contents and PTE flags; shared text pages, boot
+// identity entries and the kernel-only PDPT slots are shared as-is.
+// Borrowed window surfaces stay with the parent (the child sees a hole).
+static pt::uintptr_t clone_user_space(pt::uintptr_t src_pdpt_pa)
+{
+    pt::uintptr_t dst_pdpt_pa = vmm.allocate_frame();
+    pt::uint64_t* src_pdpt = pa_table(src_pdpt_pa);
+    pt::uint64_t* dst_pdpt = pa_table(dst_pdpt_pa);
+    memcpy(dst_pdpt, src_pdpt, 4096);
+
+    for (pt::size_t i = 0; i < 512; i++) {
+        if (is_kernel_pdpt_slot(i) || !(src_pdpt[i] & 0x01)) continue;
+        pt::uintptr_t dst_pd_pa = vmm.allocate_frame();
+        pt::uint64_t* src_pd = pa_table(src_pdpt[i] & PTE_ADDR_MASK);
+        pt::uint64_t* dst_pd = pa_table(dst_pd_pa);
+        memcpy(dst_pd, src_pd, 4096);
+
+        for (pt::size_t j = 0; j < 512; j++) {
+            if (!(src_pd[j] & 0x01) || (src_pd[j] & 0x80)) continue;
+            pt::uintptr_t dst_pt_pa = vmm.allocate_frame();
+            pt::uint64_t* src_pt = pa_table(src_pd[j] & PTE_ADDR_MASK);
+            pt::uint64_t* dst_pt = pa_table(dst_pt_pa);
+            for (pt::size_t k = 0; k < 512; k++) {
+                if ((src_pt[k] & 0x01) && (src_pt[k] & PTE_SHARED)) {
+                    TextCache::get_page(src_pt[k]);
+                    dst_pt[k] = src_pt[k];
+                } else if ((src_pt[k] & 0x01) && !(src_pt[k] & PTE_BORROWED)) {
+                    pt::uintptr_t src = src_pt[k] & PTE_ADDR_MASK;
+                    pt::uint64_t  pte_flags = src_pt[k] & 0x8000000000000FFFULL; // preserve NX + low flags
+                    pt::uintptr_t dst = vmm.allocate_frame();
+                    memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + dst),
+                           reinterpret_cast<void*>(KERNEL_OFFSET + src), 4096);
+                    dst_pt[k] = dst | pte_flags;
+                } else {
+                    dst_pt[k] = 0;
+                }
+            }
+            dst_pd[j] = dst_pt_pa | 0x07;
+        }
+        dst_pdpt[i] = dst_pd_pa | 0x07;
+    }
+    return dst_pdpt_pa;
+}
+
+// Copy `len` bytes from kernel memory into user VA `va` of an address space
+// whose pages are already mapped.  Returns false if a page is missing.
+static bool write_user_space(pt::uintptr_t pdpt_pa, pt::uintptr_t va,
+                             const void* src, pt::size_t len)
+{
+    const pt::uint8_t* s = static_cast<const pt::uint8_t*>(src);
+    while (len > 0) {
+        pt::uint64_t* pte = user_pte(pdpt_pa, va, false);
+        if (!pte || !(*pte & 0x01)) return false;
+        pt::size_t off   = va & 0xFFF;
+        pt::size_t chunk = 4096 - off;
+        if (chunk > len) chunk = len;
+        memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + (*pte & PTE_ADDR_MASK) + off),
+               s, chunk);
+        va += chunk; s += chunk; len -= chunk;
+    }
+    return true;
+}
+
+// Release a task's user address space and reset the layout fields.
+static void free_user_pagetables(Task* t)
+{
+    free_user_space(t->user_pdpt);
+    t->user_pdpt      = 0;
+    t->user_image_end = 0;
+    t->user_heap_top  = 0;
+}
+
+// Fill a never-used or freshly recycled Task with the dead-slot defaults.
+static void reset_task(Task* t)
+{
+    t->id                = 0xFFFFFFFF;
+    t->pid_next          = nullptr;
+    t->state             = TASK_DEAD;
+    t->ticks_alive       = 0;
+    t->kernel_stack_base = 0;
+    t->kernel_stack_size = 0;
+    t->preempt_rsp       = 0;
+    t->kfpu_depth        = 0;
+    t->cr3               = 0;
+    t->user_mode         = false;
+    t->user_stack_base   = 0;
+    t->user_pdpt         = 0;
+    t->user_image_end    = 0;
+    t->user_heap_top     = 0;
+    t->parent_id         = 0xFFFFFFFF;
+    t->waiting_for       = 0xFFFFFFFF;
+    t->exit_code         = 0;
+    t->vfork_parent      = 0xFFFFFFFF;
+    t->sleep_deadline    = 0;
+    t->syscall_frame_rsp = 0;
+    t->window_id         = INVALID_WID;
+    t->owns_window       = false;
+    t->vterm_id          = INVALID_VT;
+    t->name[0]           = '\0';
+    t->env_buf           = nullptr;
+    t->env_buf_len       = 0;
+    t->fd_table          = nullptr;
+    t->owns_page_tables  = true;
+    t->join_tid          = INVALID_TID;
+    t->thread_result     = nullptr;
+    t->fs_base           = 0;
+    t->perf              = nullptr;
+}
+
+// Replace t's environment with a copy of env (env_len bytes, double-NUL
+// terminated).  Oversized blocks are dropped rather than truncated mid-entry.
+static void set_task_env(Task* t, const char* env, pt::size_t env_len)
+{
+    if (t->env_buf) vmm.kfree(t->env_buf);
+    t->env_buf     = nullptr;
+    t->env_buf_len = 0;
+    if (!env || env_len == 0 || env_len > Task::ENV_MAX_SIZE) return;
+    t->env_buf = static_cast<char*>(vmm.kmalloc(env_len));
+    if (!t->env_buf) return;
+    memcpy(t->env_buf, env, env_len);
+    t->env_buf_len = env_len;
+}
+
+// The first TABLE_GROW slots are static: initialize() runs before the
+// kernel heap exists.
+static Task  boot_tasks[TaskScheduler::TABLE_GROW];
+static Task* boot_task_dir[TaskScheduler::TABLE_GROW];
+
+bool TaskScheduler::grow_table()
+{
+    if (task_capacity >= MAX_TASKS) return false;
+    if (task_capacity == 0) {
+        for (pt::uint32_t i = 0; i < TABLE_GROW; i++) {
+            reset_task(&boot_tasks[i]);
+            boot_task_dir[i] = &boot_tasks[i];
+        }
+        tasks = boot_task_dir;
+        task_capacity = TABLE_GROW;
+        return true;
+    }
+    pt::uint32_t add = task_capacity;
+    if (task_capacity + add > MAX_TASKS) add = MAX_TASKS - task_capacity;
+
+    // One block of Tasks, 16-byte aligned for fxsave_area (kmalloc only
+    // guarantees 8).  sizeof(Task) is a multiple of 16 for the same reason.
+    void* raw = vmm.kmalloc(add * sizeof(Task) + 15);
+    if (!raw) return false;
+    Task* block = reinterpret_cast<Task*>(((pt::uintptr_t)raw + 15) & ~(pt::uintptr_t)15);
+
+    Task** dir;
+    if (tasks == boot_task_dir) {
+        dir = static_cast<Task**>(vmm.kmalloc((task_capacity + add) * sizeof(Task*)));
+        if (dir) memcpy(dir, boot_task_dir, sizeof(boot_task_dir));
+    } else {
+        dir = static_cast<Task**>(vmm.krealloc(tasks,
+            task_capacity * sizeof(Task*), (task_capacity + add) * sizeof(Task*)));
+    }
+    if (!dir) {
+        vmm.kfree(raw);
+        return false;
+    }
+    for (pt::uint32_t i = 0; i < add; i++) {
+        reset_task(&block[i]);
+        dir[task_capacity + i] = &block[i];
+    }
+    tasks = dir;
+    task_capacity += add;
+    klog("[SCHEDULER] Task table grown to %d slots\n", task_capacity);
+    return true;
+}
+
+Task* TaskScheduler::find_task(pt::uint32_t id)
+{
+    for (Task* t = pid_hash[id & (PID_HASH_SIZE - 1)]; t; t = t->pid_next)
+        if (t->id == id) return t;
+    return nullptr;
+}
+
+static void pid_hash_remove(Task** bucket, Task* t)
+{
+    for (Task** pp = bucket; *pp; pp = &(*pp)->pid_next) {
+        if (*pp == t) {
+            *pp = t->pid_next;
+            t->pid_next = nullptr;
+            return;
+        }
+    }
+}
+
+Task* TaskScheduler::alloc_slot()
+{
+    // Task creation can run with interrupts on (kernel shell); keep the
+    // slot claim and a possible table grow atomic w.r.t. the scheduler.
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+
+    Task* t = nullptr;
+    if (task_count < MAX_TASKS) {
+        for (pt::uint32_t i = 0; i < task_capacity; i++) {
+            if (tasks[i]->state == TASK_DEAD) { t = tasks[i]; break; }
+        }
+        if (!t) {
+            pt::uint32_t first_new = task_capacity;
+            if (grow_table()) t = tasks[first_new];
+        }
+    }
+    if (!t) {
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+        klog("[SCHEDULER] No free task slot (%d live)\n", task_count);
+        return nullptr;
+    }
+
+    // Lazy cleanup from a previous task_exit on this slot.  Threads and
+    // vfork children zero their borrowed cr3 on exit, so a non-zero cr3
+    // here is always the previous occupant's own PML4.
+    if (t->kernel_stack_base != 0)
+        vmm.kfree((void*)t->kernel_stack_base);
+    if (t->user_stack_base != 0)
+        vmm.kfree((void*)t->user_stack_base);
+    if (t->cr3 != 0 && t->cr3 != kernel_cr3)
+        vmm.free_frame(t->cr3);
+    free_user_pagetables(t);
+    if (t->env_buf) vmm.kfree(t->env_buf);
+    if (t->perf) vmm.kfree(t->perf);
+    if (t->id != 0xFFFFFFFF)
+        pid_hash_remove(&pid_hash[t->id & (PID_HASH_SIZE - 1)], t);
+    reset_task(t);
+
+    // Next free PID; after a wrap skip any still held by a (dead) task.
+    pt::uint32_t pid;
+    do {
+        pid = next_pid;
+        next_pid = (next_pid >= PID_MAX) ? 1 : next_pid + 1;
+    } while (find_task(pid));
+    t->id       = pid;
+    t->pid_next = pid_hash[pid & (PID_HASH_SIZE - 1)];
+    pid_hash[pid & (PID_HASH_SIZE - 1)] = t;
+    t->state    = TASK_BLOCKED;  // reserved; the caller makes it READY
+    t->priority = 1;
+    t->remaining_ticks = SCHEDULER_QUANTUM;
+
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    return t;
+}
+
 void TaskScheduler::initialize()
 {
-    klog("[SCHEDULER] Initializing task scheduler (max %d tasks)\n", MAX_TASKS);
+    klog("[SCHEDULER] Initializing task scheduler (up to %d tasks)\n", MAX_TASKS);
 
     // Read the current CR3 (boot PML4 physical address) before anything else.
     asm volatile("mov %0, cr3" : "=r"(kernel_cr3));
 
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++)
-    {
-        tasks[i].id = 0xFFFFFFFF;
-        tasks[i].state = TASK_DEAD;
-        tasks[i].ticks_alive = 0;
-        tasks[i].kernel_stack_base = 0;
-        tasks[i].kernel_stack_size = 0;
-        tasks[i].preempt_rsp = 0;
-        tasks[i].cr3 = 0;
-        tasks[i].user_mode = false;
-        tasks[i].user_stack_base = 0;
-        tasks[i].user_pdpt    = 0;
-        tasks[i].user_pd      = 0;
-        for (pt::size_t j = 0; j < Task::MAX_PRIV_PTS; j++) tasks[i].priv_pt[j] = 0;
-        tasks[i].num_priv_pts = 0;
-        tasks[i].stack_pt     = 0;
-        tasks[i].user_heap_top = 0;
-        tasks[i].parent_id        = 0xFFFFFFFF;
-        tasks[i].waiting_for      = 0xFFFFFFFF;
-        tasks[i].exit_code        = 0;
-        tasks[i].sleep_deadline   = 0;
-        tasks[i].syscall_frame_rsp = 0;
-        tasks[i].window_id        = INVALID_WID;
-        tasks[i].owns_window      = false;
-        tasks[i].vterm_id         = INVALID_VT;
-        tasks[i].fd_table         = nullptr;
-        tasks[i].owns_page_tables = true;
-        tasks[i].join_tid         = INVALID_TID;
-        tasks[i].thread_result    = nullptr;
-        tasks[i].fs_base          = 0;
-    }
+    grow_table();  // static boot slots; cannot fail
 
     // Kernel is task 0; it has no allocated stack (uses the boot stack).
     // Its preempt_rsp is filled in the first time irq0 fires.
-    tasks[0].id = 0;
-    tasks[0].state = TASK_RUNNING;
-    tasks[0].cr3 = kernel_cr3;
-    tasks[0].user_mode = false;
-    tasks[0].priority = 0;  // kernel shell = highest priority
-    tasks[0].remaining_ticks = SCHEDULER_QUANTUM;
+    Task* kernel = tasks[0];
+    kernel->id = 0;
+    kernel->state = TASK_RUNNING;
+    kernel->cr3 = kernel_cr3;
+    kernel->user_mode = false;
+    kernel->priority = 0;  // kernel shell = highest priority
+    kernel->remaining_ticks = SCHEDULER_QUANTUM;
+    pid_hash[0] = kernel;
 
     task_count = 1;
-    current_task_id = 0;
+    current_slot = 0;
+    next_pid = 1;
     scheduler_ticks = 0;
 
     // Reset x87 and SSE to known-good defaults right before capturing the
@@ -195,105 +606,47 @@ void TaskScheduler::initialize()
 
 pt::uint32_t TaskScheduler::create_task(void (*entry_fn)(), pt::size_t stack_size, bool user_mode, bool start_blocked)
 {
-    if (task_count >= MAX_TASKS)
-    {
-        klog("[SCHEDULER] Max tasks reached\n");
-        return 0xFFFFFFFF;
-    }
-
-    // Find free task slot
-    Task* new_task = nullptr;
-    pt::uint32_t task_id = 0;
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++)
-    {
-        if (tasks[i].state == TASK_DEAD)
-        {
-            new_task = &tasks[i];
-            task_id = i;
-            break;
-        }
-    }
-
+    // Claim a slot and PID (the previous occupant is cleaned up there).
+    Task* new_task = alloc_slot();
     if (new_task == nullptr)
         return 0xFFFFFFFF;
-
-    // Lazy cleanup from a previous task_exit on this slot.
-    if (new_task->kernel_stack_base != 0)
-    {
-        vmm.kfree((void*)new_task->kernel_stack_base);
-        new_task->kernel_stack_base = 0;
-    }
-    if (new_task->user_stack_base != 0)
-    {
-        vmm.kfree((void*)new_task->user_stack_base);
-        new_task->user_stack_base = 0;
-    }
-    if (new_task->cr3 != 0 && new_task->cr3 != kernel_cr3)
-    {
-        vmm.free_frame(new_task->cr3);
-        new_task->cr3 = 0;
-    }
-
-    // Lazy cleanup of user page tables from a previous create_elf_task.
-    free_user_pagetables(new_task);
-
-    new_task->sleep_deadline = 0;
-    new_task->window_id      = INVALID_WID;
-    new_task->owns_window    = false;
-    new_task->vterm_id       = INVALID_VT;
-    new_task->name[0]        = '\0';
-    new_task->priority       = 1;  // normal priority by default
-    new_task->remaining_ticks = SCHEDULER_QUANTUM;
+    pt::uint32_t task_id = new_task->id;
 
     // Allocate ref-counted file descriptor table on the heap.
-    new_task->fd_table = static_cast<FdTable*>(vmm.kcalloc(sizeof(FdTable)));
-    new_task->fd_table->refcount = 1;
-    new_task->owns_page_tables = true;
-    new_task->join_tid         = INVALID_TID;
-    new_task->thread_result    = nullptr;
-    new_task->fs_base          = 0;
+    new_task->fd_table = fd_table_create();
 
     // Give the new task a clean FPU/SSE state (copy of post-fninit snapshot).
     memcpy(new_task->fxsave_area, default_fxsave, 512);
 
     void* stack_mem = vmm.kmalloc(stack_size);
-    if (stack_mem == nullptr)
+    if (stack_mem == nullptr || new_task->fd_table == nullptr)
     {
         klog("[SCHEDULER] Failed to allocate stack for task\n");
+        if (stack_mem) vmm.kfree(stack_mem);
+        release_fd_table(new_task);
+        new_task->state = TASK_DEAD;
         return 0xFFFFFFFF;
     }
 
-    // Clone the boot PML4 for this task.  Physical frames < 4GB are accessible
-    // at their identity-mapped virtual address (boot tables map phys x → virt x).
+    // Clone the boot PML4 for this task.  Accessed via KERNEL_OFFSET + PA so
+    // this also works when called under a task CR3, whose PML4[0] maps user
+    // pages rather than the full identity range.
     pt::uintptr_t pml4_frame = vmm.allocate_frame();
     klog("[TASK] Per-task PML4 frame: phys=%lx (kernel_cr3=%lx)\n", pml4_frame, kernel_cr3);
-    memcpy(reinterpret_cast<void*>(pml4_frame),
-           reinterpret_cast<void*>(kernel_cr3),
+    memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + pml4_frame),
+           reinterpret_cast<void*>(KERNEL_OFFSET + kernel_cr3),
            4096);
 
     // Verify the copy: PML4[0] covers VA 0x0-0x7FFFFFFF (identity map, user-accessible)
     // PML4[256] covers VA 0xFFFF800000000000+ (higher-half kernel alias)
-    pt::uint64_t* pml4 = reinterpret_cast<pt::uint64_t*>(pml4_frame);
+    pt::uint64_t* pml4 = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + pml4_frame);
     klog("[TASK] Cloned PML4[0]=%lx PML4[256]=%lx\n", pml4[0], pml4[256]);
 
-    new_task->id = task_id;
     new_task->state = TASK_BLOCKED;  // not schedulable until preempt_rsp is set
     new_task->kernel_stack_base = (pt::uintptr_t)stack_mem;
     new_task->kernel_stack_size = stack_size;
-    new_task->ticks_alive = 0;
     new_task->cr3 = pml4_frame;
     new_task->user_mode = user_mode;
-    new_task->user_stack_base = 0;
-    new_task->user_pdpt    = 0;
-    new_task->user_pd      = 0;
-    for (pt::size_t j = 0; j < Task::MAX_PRIV_PTS; j++) new_task->priv_pt[j] = 0;
-    new_task->num_priv_pts = 0;
-    new_task->stack_pt     = 0;
-    new_task->user_heap_top = 0;
-    new_task->parent_id        = 0xFFFFFFFF;
-    new_task->waiting_for      = 0xFFFFFFFF;
-    new_task->exit_code        = 0;
-    new_task->syscall_frame_rsp = 0;
 
     // For ring-3 tasks, the user execution stack is mapped at USER_STACK_BOT..USER_STACK_TOP
     // by create_elf_task() after we return.  Set initial RSP to USER_STACK_TOP - 16 so
@@ -360,29 +713,28 @@ pt::uint32_t TaskScheduler::create_task(void (*entry_fn)(), pt::size_t stack_siz
 
 Task* TaskScheduler::get_current_task()
 {
-    return &tasks[current_task_id];
+    return tasks[current_slot];
 }
 
 Task* TaskScheduler::get_task(pt::uint32_t id)
 {
-    if (id >= MAX_TASKS) return nullptr;
-    if (tasks[id].state == TASK_DEAD) return nullptr;
-    return &tasks[id];
+    Task* t = find_task(id);
+    if (!t || t->state == TASK_DEAD) return nullptr;
+    return t;
 }
 
 const char* TaskScheduler::get_task_name(pt::uint32_t id)
 {
-    if (id >= MAX_TASKS) return nullptr;
-    if (tasks[id].state == TASK_DEAD) return nullptr;
-    return tasks[id].name;
+    Task* t = get_task(id);
+    return t ? t->name : nullptr;
 }
 
 pt::uint32_t TaskScheduler::list_tasks(TaskListEntry* buf, pt::uint32_t max_entries)
 {
     if (!buf || max_entries == 0) return 0;
     pt::uint32_t count = 0;
-    for (pt::uint32_t i = 0; i < MAX_TASKS && count < max_entries; i++) {
-        const Task& t = tasks[i];
+    for (pt::uint32_t i = 0; i < task_capacity && count < max_entries; i++) {
+        const Task& t = *tasks[i];
         if (t.state == TASK_DEAD) continue;
         buf[count].id       = t.id;
         buf[count].state    = (pt::uint8_t)t.state;
@@ -403,24 +755,24 @@ pt::uint32_t TaskScheduler::list_tasks(TaskListEntry* buf, pt::uint32_t max_entr
 // Returns the RSP to load (unchanged if no switch happened).
 pt::uintptr_t TaskScheduler::do_switch_to_next(pt::uintptr_t current_rsp)
 {
-    pt::uint32_t old_id  = current_task_id;
+    pt::uint32_t old_id  = current_slot;
 
     // Pass 1: find the best (lowest) priority among runnable tasks OTHER
     // than the current one.  The whole point of switching is to give
     // someone else a turn; including ourselves would let a high-priority
     // task that just yielded immediately win back the CPU.
     pt::uint8_t best_prio = 255;
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        if (i == current_task_id) continue;
-        if ((tasks[i].state == TASK_READY || tasks[i].state == TASK_RUNNING) &&
-            tasks[i].priority < best_prio)
-            best_prio = tasks[i].priority;
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        if (i == current_slot) continue;
+        if ((tasks[i]->state == TASK_READY || tasks[i]->state == TASK_RUNNING) &&
+            tasks[i]->priority < best_prio)
+            best_prio = tasks[i]->priority;
     }
 
     if (best_prio == 255) {
         // No other runnable task at all — keep running current.
-        if (tasks[current_task_id].state == TASK_READY)
-            tasks[current_task_id].state = TASK_RUNNING;
+        if (tasks[current_slot]->state == TASK_READY)
+            tasks[current_slot]->state = TASK_RUNNING;
         return current_rsp;
     }
 
@@ -433,12 +785,12 @@ pt::uintptr_t TaskScheduler::do_switch_to_next(pt::uintptr_t current_rsp)
     pt::uint8_t prio_idx = best_prio < NUM_PRIOS ? best_prio : NUM_PRIOS - 1;
     pt::uint32_t next_id = 0;
     bool found = false;
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        pt::uint32_t candidate = (rr_next[prio_idx] + i) % MAX_TASKS;
-        if (candidate == current_task_id) continue;
-        if ((tasks[candidate].state == TASK_READY ||
-             tasks[candidate].state == TASK_RUNNING) &&
-            tasks[candidate].priority == best_prio) {
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        pt::uint32_t candidate = (rr_next[prio_idx] + i) % task_capacity;
+        if (candidate == current_slot) continue;
+        if ((tasks[candidate]->state == TASK_READY ||
+             tasks[candidate]->state == TASK_RUNNING) &&
+            tasks[candidate]->priority == best_prio) {
             next_id = candidate;
             found = true;
             break;
@@ -447,58 +799,59 @@ pt::uintptr_t TaskScheduler::do_switch_to_next(pt::uintptr_t current_rsp)
 
     if (!found) {
         // Pass 1 guaranteed something exists, but be safe.
-        if (tasks[current_task_id].state == TASK_READY)
-            tasks[current_task_id].state = TASK_RUNNING;
+        if (tasks[current_slot]->state == TASK_READY)
+            tasks[current_slot]->state = TASK_RUNNING;
         return current_rsp;
     }
 
     // Advance the cursor past the task we just picked.
-    rr_next[prio_idx] = (next_id + 1) % MAX_TASKS;
+    rr_next[prio_idx] = (next_id + 1) % task_capacity;
 
 #ifdef SCHEDULER_DEBUG
-    klog("[SCHEDULER] Switching from task %d to task %d\n", current_task_id, next_id);
+    klog("[SCHEDULER] Switching from task %d to task %d\n",
+         tasks[current_slot]->id, tasks[next_id]->id);
 #endif
 
-    if (tasks[current_task_id].state == TASK_RUNNING)
-        tasks[current_task_id].state = TASK_READY;
-    tasks[next_id].state = TASK_RUNNING;
-    current_task_id = next_id;
-    tasks[next_id].ticks_alive++;
-    tasks[next_id].remaining_ticks = SCHEDULER_QUANTUM;
+    if (tasks[current_slot]->state == TASK_RUNNING)
+        tasks[current_slot]->state = TASK_READY;
+    tasks[next_id]->state = TASK_RUNNING;
+    current_slot = next_id;
+    tasks[next_id]->ticks_alive++;
+    tasks[next_id]->remaining_ticks = SCHEDULER_QUANTUM;
 
     // For user-mode tasks, update TSS.RSP0 to this task's kernel stack top.
     // The CPU reads RSP0 on every ring-3 → ring-0 privilege switch and uses
     // it as the initial kernel RSP before pushing the interrupt frame.
-    if (tasks[next_id].user_mode && tasks[next_id].kernel_stack_base != 0)
-        tss_set_rsp0(tasks[next_id].kernel_stack_base + tasks[next_id].kernel_stack_size);
+    if (tasks[next_id]->user_mode && tasks[next_id]->kernel_stack_base != 0)
+        tss_set_rsp0(tasks[next_id]->kernel_stack_base + tasks[next_id]->kernel_stack_size);
 
     // Store the new CR3 in g_next_cr3 for the assembly stub to load AFTER it
     // has already switched RSP to this task's high-half kernel stack.
     // Loading CR3 here (in C) would leave the old task's low-VA boot stack
     // active with the new task's CR3 — the 'ret' out of this function would
     // try to read a return address from an unmapped low VA and triple-fault.
-    g_next_cr3 = tasks[next_id].cr3;
+    g_next_cr3 = tasks[next_id]->cr3;
 
     // Save outgoing task's x87/SSE state and restore the incoming task's.
     // FXSAVE/FXRSTOR require a 16-byte aligned operand (guaranteed by alignas(16)).
-    asm volatile("fxsave %0"  : "=m"(tasks[old_id].fxsave_area)  :: "memory");
-    asm volatile("fxrstor %0" :      : "m"(tasks[next_id].fxsave_area) : "memory");
+    asm volatile("fxsave %0"  : "=m"(tasks[old_id]->fxsave_area)  :: "memory");
+    asm volatile("fxrstor %0" :      : "m"(tasks[next_id]->fxsave_area) : "memory");
 
     // Save outgoing task's FS_BASE (MSR 0xC0000100) for thread-local storage.
     // Restore incoming task's FS_BASE so each thread sees its own TLS pointer.
     {
         pt::uint32_t lo, hi;
         asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(0xC0000100U));
-        tasks[old_id].fs_base = (pt::uint64_t)lo | ((pt::uint64_t)hi << 32);
+        tasks[old_id]->fs_base = (pt::uint64_t)lo | ((pt::uint64_t)hi << 32);
     }
     {
-        pt::uint64_t base = tasks[next_id].fs_base;
+        pt::uint64_t base = tasks[next_id]->fs_base;
         asm volatile("wrmsr" :: "c"(0xC0000100U),
                      "a"((pt::uint32_t)(base & 0xFFFFFFFF)),
                      "d"((pt::uint32_t)(base >> 32)));
     }
 
-    return tasks[next_id].preempt_rsp;
+    return tasks[next_id]->preempt_rsp;
 }
 
 // Called from irq0_schedule (timer interrupt boundary).
@@ -508,28 +861,29 @@ pt::uintptr_t TaskScheduler::preempt(pt::uintptr_t rsp)
     scheduler_ticks++;
 
     // Always update preempt_rsp so it stays fresh for when this task is resumed.
-    tasks[current_task_id].preempt_rsp = rsp;
-    tasks[current_task_id].ticks_alive++;
+    tasks[current_slot]->preempt_rsp = rsp;
+    tasks[current_slot]->ticks_alive++;
 
     // Wake any sleeping tasks whose deadline has expired.
     // If any task was woken, force a switch immediately so it runs within
     // one tick rather than waiting up to SCHEDULER_QUANTUM ticks.
     bool woke_any = false;
     pt::uint64_t now = get_ticks();
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_BLOCKED &&
-            tasks[i].sleep_deadline != 0 &&
-            now >= tasks[i].sleep_deadline) {
-            tasks[i].sleep_deadline = 0;
-            tasks[i].state = TASK_READY;
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        if (tasks[i]->state == TASK_BLOCKED &&
+            tasks[i]->sleep_deadline != 0 &&
+            now >= tasks[i]->sleep_deadline) {
+            tasks[i]->sleep_deadline = 0;
+            tasks[i]->state = TASK_READY;
             woke_any = true;
         }
     }
 
     // Time-slice preemption: switch when quantum expired or a woken task
     // needs the CPU.
-    if (woke_any || --tasks[current_task_id].remaining_ticks <= 0) {
-        tasks[current_task_id].remaining_ticks = SCHEDULER_QUANTUM;
+    if (woke_any || need_resched || --tasks[current_slot]->remaining_ticks <= 0) {
+        need_resched = false;
+        tasks[current_slot]->remaining_ticks = SCHEDULER_QUANTUM;
         return do_switch_to_next(rsp);
     }
 
@@ -541,7 +895,7 @@ void TaskScheduler::sleep_task(pt::uint64_t ms)
 {
     if (ms == 0) return;
 
-    Task* t = &tasks[current_task_id];
+    Task* t = tasks[current_slot];
     // Timer runs at 50 Hz → 20 ms per tick; round up to at least 1 tick.
     pt::uint64_t ticks_needed = ms / 20;
     if (ticks_needed == 0) ticks_needed = 1;
@@ -557,10 +911,10 @@ void TaskScheduler::sleep_task(pt::uint64_t ms)
 // they stay blocked until task_exit() of their awaited child unblocks them.
 pt::uintptr_t TaskScheduler::yield_tick(pt::uintptr_t rsp)
 {
-    tasks[current_task_id].preempt_rsp = rsp;
+    tasks[current_slot]->preempt_rsp = rsp;
 
-    if (tasks[current_task_id].state == TASK_RUNNING)
-        tasks[current_task_id].state = TASK_READY;
+    if (tasks[current_slot]->state == TASK_RUNNING)
+        tasks[current_slot]->state = TASK_READY;
     // TASK_BLOCKED: leave state unchanged so do_switch_to_next skips this task.
 
     return do_switch_to_next(rsp);
@@ -576,24 +930,16 @@ void TaskScheduler::task_yield()
 
 void TaskScheduler::kill_user_tasks()
 {
-    for (pt::uint32_t i = 1; i < MAX_TASKS; i++)
+    for (pt::uint32_t i = 1; i < task_capacity; i++)
     {
-        Task* t = &tasks[i];
+        Task* t = tasks[i];
         if (t->state == TASK_DEAD || !t->user_mode)
             continue;
 
-        klog("[SCHEDULER] kill_user_tasks: killing task %d\n", i);
+        klog("[SCHEDULER] kill_user_tasks: killing task %d\n", t->id);
 
         // Decrement FdTable refcount; close and free only when last reference.
-        if (t->fd_table) {
-            t->fd_table->refcount--;
-            if (t->fd_table->refcount == 0) {
-                for (pt::size_t fd = 0; fd < Task::MAX_FDS; fd++)
-                    close_fd(&t->fd_table->fds[fd]);
-                vmm.kfree(t->fd_table);
-            }
-            t->fd_table = nullptr;
-        }
+        release_fd_table(t);
 
         // Destroy window if task owns one.
         if (t->window_id != INVALID_WID && t->owns_window) {
@@ -602,6 +948,9 @@ void TaskScheduler::kill_user_tasks()
         t->window_id = INVALID_WID;
         t->owns_window = false;
 
+        // Release its audio stream; threads get theirs on their own pass.
+        mixer_close(t->id);
+
         // Free kernel interrupt stack.
         if (t->kernel_stack_base != 0) {
             vmm.kfree(reinterpret_cast<void*>(t->kernel_stack_base));
@@ -612,6 +961,8 @@ void TaskScheduler::kill_user_tasks()
         if (t->owns_page_tables && t->cr3 != 0 && t->cr3 != kernel_cr3) {
             vmm.free_frame(t->cr3);
             t->cr3 = 0;
+        } else if (!t->owns_page_tables) {
+            t->cr3 = 0;
         }
 
         // Free all user page tables and mapped frames (only for process owners).
@@ -625,25 +976,17 @@ void TaskScheduler::kill_user_tasks()
 
 bool TaskScheduler::kill_task(pt::uint32_t pid)
 {
-    if (pid == 0 || pid >= MAX_TASKS)
+    if (pid == 0)
         return false;
 
-    Task* t = &tasks[pid];
-    if (t->state == TASK_DEAD || !t->user_mode)
+    Task* t = get_task(pid);
+    if (!t || !t->user_mode)
         return false;
 
     klog("[SCHEDULER] kill_task: killing task %d\n", pid);
 
     // Decrement FdTable refcount; close and free only when last reference.
-    if (t->fd_table) {
-        t->fd_table->refcount--;
-        if (t->fd_table->refcount == 0) {
-            for (pt::size_t fd = 0; fd < Task::MAX_FDS; fd++)
-                close_fd(&t->fd_table->fds[fd]);
-            vmm.kfree(t->fd_table);
-        }
-        t->fd_table = nullptr;
-    }
+    release_fd_table(t);
 
     // Destroy window if task owns one.
     if (t->window_id != INVALID_WID && t->owns_window) {
@@ -652,6 +995,18 @@ bool TaskScheduler::kill_task(pt::uint32_t pid)
     t->window_id = INVALID_WID;
     t->owns_window = false;
 
+    // Release its audio stream, and those of the threads sharing its address
+    // space, as task_exit() does — task ids are never reused, so a stream
+    // left open would be mixed (and hold a mixer slot) forever.
+    mixer_close(t->id);
+    if (t->owns_page_tables && t->cr3 != 0) {
+        for (pt::uint32_t i = 0; i < task_capacity; i++) {
+            Task* th = tasks[i];
+            if (th == t || th->state == TASK_DEAD || th->owns_page_tables) continue;
+            if (th->cr3 == t->cr3) mixer_close(th->id);
+        }
+    }
+
     // Free kernel interrupt stack.
     if (t->kernel_stack_base != 0) {
         vmm.kfree(reinterpret_cast<void*>(t->kernel_stack_base));
@@ -659,9 +1014,13 @@ bool TaskScheduler::kill_task(pt::uint32_t pid)
     }
 
     // Free per-task PML4 frame (only if this task owns its page tables).
+    // A thread or vfork child only borrows its CR3; drop the reference so
+    // create_task's lazy cleanup never frees the owner's PML4.
     if (t->owns_page_tables && t->cr3 != 0 && t->cr3 != kernel_cr3) {
         vmm.free_frame(t->cr3);
         t->cr3 = 0;
+    } else if (!t->owns_page_tables) {
+        t->cr3 = 0;
     }
 
     // Free all user page tables and mapped frames (only for process owners).
@@ -669,11 +1028,11 @@ bool TaskScheduler::kill_task(pt::uint32_t pid)
         free_user_pagetables(t);
 
     // Wake any parent blocked in waitpid.
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_BLOCKED &&
-            tasks[i].waiting_for == pid) {
-            tasks[i].waiting_for = 0xFFFFFFFF;
-            tasks[i].state = TASK_READY;
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        if (tasks[i]->state == TASK_BLOCKED &&
+            tasks[i]->waiting_for == pid) {
+            tasks[i]->waiting_for = 0xFFFFFFFF;
+            tasks[i]->state = TASK_READY;
         }
     }
 
@@ -683,169 +1042,397 @@ bool TaskScheduler::kill_task(pt::uint32_t pid)
     return true;
 }
 
-// Virtual address of the ELF staging area in the kernel's high half.
-// ElfLoader writes ELF segments here; create_elf_task reads from here.
-// Using the high-half VA (via PML4[256]) instead of the identity-mapped
-// low-half (via PML4[0]) avoids any issues with the low-half mapping.
-static constexpr pt::uintptr_t ELF_STAGING_PHYS = 0x18000000;
-static constexpr pt::uintptr_t ELF_STAGING_VA   = KERNEL_OFFSET + ELF_STAGING_PHYS;
+// PML4 index of the higher-half kernel alias (VA 0xFFFF800000000000).
+// Task PML4s clear its U bit so ring-3 can never reach kernel memory.
+static constexpr pt::size_t KERNEL_PML4_IDX = 256;
+
+// A freshly built user address space, ready to be wired into PML4[0].
+struct UserImage {
+    pt::uintptr_t pdpt;        // PA of the new user PDPT
+    pt::uintptr_t entry;       // ELF entry point
+    pt::uintptr_t user_rsp;    // initial user RSP (points at argc)
+    pt::uintptr_t image_end;   // page-aligned end of the highest PT_LOAD segment
+    pt::size_t    image_pages; // pages mapped for the ELF image
+    pt::size_t    shared_pages; // ...of which are mapped from the text cache
+};
 
-// PML4/PDPT/PD indices for VA 0xFFFF800018000000
-static constexpr pt::size_t ELF_PML4_IDX  = 256;
-static constexpr pt::size_t ELF_PDPT_IDX  = 0;
-static constexpr pt::size_t ELF_PD_IDX    = 192;
-// Maximum ELF pages: MAX_PRIV_PTS PT frames × 512 pages each = 16 MB
-static constexpr pt::size_t MAX_ELF_PAGES = Task::MAX_PRIV_PTS * 512;
+// Stream every PT_LOAD segment from the file straight into freshly allocated
+// frames of the address space rooted at pdpt_pa.  Only the bytes a segment
+// does not supply from the file (page head before the segment, BSS tail) are
+// zeroed.  Pages start Present|User|NX; a page touched by several segments
+// gets the union of their permissions (PF_W adds Writable, PF_X clears NX).
+// Pages already mapped from the text cache are left alone.  Adds the pages
+// it allocates to *pages; returns false on a read error or if a segment
+// falls outside the user span.
+static bool map_elf_segments(pt::uintptr_t pdpt_pa, ElfImage* img, pt::size_t* pages)
+{
+    for (pt::size_t s = 0; s < img->num_segs; s++) {
+        const ElfSegment& seg = img->segs[s];
+        pt::uintptr_t start    = seg.vaddr & ~(pt::uintptr_t)0xFFF;
+        pt::uintptr_t end      = (seg.vaddr + seg.memsz + 4095) & ~(pt::uintptr_t)0xFFF;
+        pt::uintptr_t file_end = seg.vaddr + seg.filesz;
+        pt::uintptr_t mem_end  = seg.vaddr + seg.memsz;
+
+        for (pt::uintptr_t page = start; page < end; page += 4096) {
+            pt::uint64_t* pte = user_pte(pdpt_pa, page, true);
+            if (!pte) return false;
+            if (*pte & PTE_SHARED) continue;
+
+            // File-backed bytes [lo, hi) and segment bytes [seg_lo, seg_hi)
+            // that land on this page.
+            pt::uintptr_t seg_lo = (page > seg.vaddr) ? page : seg.vaddr;
+            pt::uintptr_t seg_hi = (page + 4096 < mem_end) ? page + 4096 : mem_end;
+            pt::uintptr_t lo = seg_lo;
+            pt::uintptr_t hi = (page + 4096 < file_end) ? page + 4096 : file_end;
+            if (hi < lo) hi = lo;
+
+            bool fresh = !(*pte & 0x01);
+            if (fresh) {
+                *pte = vmm.allocate_frame() | 0x05 | PTE_NX;  // Present + User
+                (*pages)++;
+            }
+            if (seg.flags & PF_W) *pte |= 0x02;       // Writable
+            if (seg.flags & PF_X) *pte &= ~PTE_NX;    // Executable
+
+            pt::uint8_t* kpage = reinterpret_cast<pt::uint8_t*>(
+                KERNEL_OFFSET + (*pte & PTE_ADDR_MASK));
+            if (lo < hi &&
+                !ElfLoader::read(img, seg.offset + (lo - seg.vaddr),
+                                 kpage + (lo - page), hi - lo))
+                return false;
+
+            if (fresh) {
+                // Nothing else has written this page: zero everything
+                // outside the file-backed bytes.
+                memset(kpage, 0, lo - page);
+                memset(kpage + (hi - page), 0, 4096 - (hi - page));
+            } else if (hi < seg_hi) {
+                // Shared with an earlier segment: only clear our BSS part.
+                memset(kpage + (hi - page), 0, seg_hi - hi);
+            }
+        }
+    }
+    return true;
+}
 
-pt::uint32_t TaskScheduler::create_elf_task(const char* filename,
-                                            int argc,
-                                            const char* const* argv)
+// True if any writable PT_LOAD segment touches the page at `page`.  Such
+// pages stay private even when a read-only segment shares them.
+static bool page_has_writable_seg(const ElfImage* img, pt::uintptr_t page)
 {
-    // 1. Load ELF into the shared staging area (phys 0x18000000 / ELF_STAGING_VA).
-    //    elf_loader.cpp redirects writes to ELF_STAGING_VA + (p_vaddr - USER_CODE_BASE).
-    pt::size_t code_size = 0;
-    pt::uintptr_t entry = ElfLoader::load(filename, &code_size);
-    if (entry == 0) {
-        klog("[ELF_TASK] Failed to load '%s'\n", filename);
-        return 0xFFFFFFFF;
+    for (pt::size_t s = 0; s < img->num_segs; s++) {
+        const ElfSegment& seg = img->segs[s];
+        if (!(seg.flags & PF_W)) continue;
+        pt::uintptr_t start = seg.vaddr & ~(pt::uintptr_t)0xFFF;
+        pt::uintptr_t end   = (seg.vaddr + seg.memsz + 4095) & ~(pt::uintptr_t)0xFFF;
+        if (page >= start && page < end) return true;
+    }
+    return false;
+}
+
+// Map every page of text-cache entry idx (already referenced by
+// TextCache::acquire) into the address space.  Returns the page count.
+static pt::size_t map_cached_text(pt::uintptr_t pdpt_pa, int idx)
+{
+    pt::size_t count = 0;
+    const TextPage* pages = TextCache::pages(idx, &count);
+    for (pt::size_t i = 0; i < count; i++) {
+        pt::uint64_t* pte = user_pte(pdpt_pa, pages[i].va, true);
+        *pte = pages[i].pte | TextCache::pte_tag(idx);
     }
-    if (code_size == 0) {
-        klog("[ELF_TASK] No loadable segments in '%s'\n", filename);
-        return 0xFFFFFFFF;
+    return count;
+}
+
+// Hand the read-only pages of a freshly loaded image to the text cache so
+// later execs of the same file can map them.  The pages stay mapped here
+// and are tagged shared.  Returns the number of pages shared.
+static pt::size_t share_elf_text(pt::uintptr_t pdpt_pa, const ElfImage* img,
+                                 const char* filename, pt::uint32_t mtime)
+{
+    pt::size_t max = 0;
+    for (pt::size_t s = 0; s < img->num_segs; s++) {
+        const ElfSegment& seg = img->segs[s];
+        if (!(seg.flags & PF_W))
+            max += ((seg.vaddr + seg.memsz + 4095) >> 12) - (seg.vaddr >> 12);
+    }
+    if (max == 0) return 0;
+
+    TextPage* pages = static_cast<TextPage*>(vmm.kmalloc(max * sizeof(TextPage)));
+    if (!pages) return 0;
+
+    // PT_LOAD segments are sorted by vaddr, so a page shared by two
+    // read-only segments is always the last one recorded.
+    pt::size_t n = 0;
+    for (pt::size_t s = 0; s < img->num_segs; s++) {
+        const ElfSegment& seg = img->segs[s];
+        if (seg.flags & PF_W) continue;
+        pt::uintptr_t start = seg.vaddr & ~(pt::uintptr_t)0xFFF;
+        pt::uintptr_t end   = (seg.vaddr + seg.memsz + 4095) & ~(pt::uintptr_t)0xFFF;
+        for (pt::uintptr_t page = start; page < end; page += 4096) {
+            if (n > 0 && pages[n - 1].va >= page) continue;
+            if (page_has_writable_seg(img, page)) continue;
+            pt::uint64_t* pte = user_pte(pdpt_pa, page, false);
+            if (!pte || !(*pte & 0x01)) continue;
+            pages[n].va  = page;
+            pages[n].pte = *pte;
+            n++;
+        }
     }
 
-    pt::size_t num_code_frames = (code_size + 4095) / 4096;
-    if (num_code_frames > MAX_ELF_PAGES) {
-        klog("[ELF_TASK] ELF too large: %d pages (max %d)\n",
-             (int)num_code_frames, (int)MAX_ELF_PAGES);
-        return 0xFFFFFFFF;
+    int idx = TextCache::insert(filename, img->file.file_size, mtime, pages, n);
+    if (idx < 0) {
+        vmm.kfree(pages);
+        return 0;
     }
-    pt::size_t num_pts = (num_code_frames + 511) / 512;
-    if (num_pts == 0) num_pts = 1;
-
-    // 2. Allocate fresh user_pdpt and user_pd frames.
-    //    Populate them with the boot identity-map entries (U/S cleared → kernel-only)
-    //    so ring-0 interrupt handlers can access device MMIO (framebuffer at 0xfd000000,
-    //    etc.) while this task's CR3 is active.  Code/stack entries are overridden below.
-    pt::uintptr_t user_pdpt_frame = vmm.allocate_frame();
-    pt::uintptr_t user_pd_frame   = vmm.allocate_frame();
-    pt::uint64_t* user_pdpt = reinterpret_cast<pt::uint64_t*>(user_pdpt_frame);
-    pt::uint64_t* user_pd   = reinterpret_cast<pt::uint64_t*>(user_pd_frame);
-
-    // Read boot PDPT and its PD[0] via direct PA (identity-mapped under boot CR3).
-    pt::uint64_t* boot_pml4  = reinterpret_cast<pt::uint64_t*>(kernel_cr3);
-    pt::uintptr_t boot_pdpt_pa = boot_pml4[0] & ~(pt::uintptr_t)0xFFF;
-    pt::uint64_t* boot_pdpt  = reinterpret_cast<pt::uint64_t*>(boot_pdpt_pa);
-    pt::uintptr_t boot_pd_pa   = boot_pdpt[0] & ~(pt::uintptr_t)0xFFF;
-    pt::uint64_t* boot_pd    = reinterpret_cast<pt::uint64_t*>(boot_pd_pa);
-
-    // user_pdpt[0] is wired to user_pd (with U/S=1) below.
-    // user_pdpt[1..3] copy boot PDPT entries (1..4 GB identity), U/S cleared.
-    memset(user_pdpt, 0, 4096);
-    for (int i = 1; i < 4; i++)
-        user_pdpt[i] = boot_pdpt[i] & ~(pt::uint64_t)0x04;
+    for (pt::size_t i = 0; i < n; i++)
+        *user_pte(pdpt_pa, pages[i].va, false) |= TextCache::pte_tag(idx);
+    return n;
+}
 
-    // user_pd copies all 512 boot PD0 entries (0..1 GB identity, U/S cleared).
-    // Code and stack entries are overridden with private PTs (U/S=1) below.
-    for (int i = 0; i < 512; i++)
-        user_pd[i] = boot_pd[i] & ~(pt::uint64_t)0x04;
-
-    klog("[ELF_TASK] user_pdpt=%lx user_pd=%lx num_pts=%d\n",
-         user_pdpt_frame, user_pd_frame, (int)num_pts);
-
-    // 3. Allocate code PT frames (zeroed) and populate with code data from staging.
-    pt::uintptr_t code_pt_frames[Task::MAX_PRIV_PTS];
-    for (pt::size_t k = 0; k < num_pts; k++) {
-        code_pt_frames[k] = vmm.allocate_frame();
-        memset(reinterpret_cast<void*>(code_pt_frames[k]), 0, 4096);
-    }
-
-    klog("[ELF_TASK] allocating %d code frames across %d PT(s)\n",
-         (int)num_code_frames, (int)num_pts);
-    for (pt::size_t i = 0; i < num_code_frames; i++) {
-        if (i % 50 == 0) klog("[ELF_TASK] i=%d\n", (int)i);
-        pt::uintptr_t frame = vmm.allocate_frame();
-        if (!frame) { klog("[ELF_TASK] allocate_frame returned 0 at i=%d\n", (int)i); break; }
-        memcpy(reinterpret_cast<void*>(frame),
-               reinterpret_cast<void*>(ELF_STAGING_VA + i * 4096),
-               4096);
-        // Build PTE flags from ELF segment permissions.
-        // Base: Present(0x01) | User(0x04) = 0x05.
-        // Add Writable(0x02) if PF_W set.
-        // Add NX (bit 63) if PF_X not set.
-        pt::uint8_t pflags = ElfLoader::page_flags[i];
-        pt::uint64_t pte = frame | 0x05;  // Present + User
-        if (pflags & PF_W) pte |= 0x02;   // Writable
-        if (!(pflags & PF_X)) pte |= PTE_NX;  // No-Execute
-        pt::uint64_t* cpt = reinterpret_cast<pt::uint64_t*>(code_pt_frames[i / 512]);
-        cpt[i % 512] = pte;
-    }
-
-    // Wire code PTs into user_pd at USER_CODE_PD_IDX.
-    for (pt::size_t k = 0; k < num_pts; k++)
-        user_pd[USER_CODE_PD_IDX + k] = code_pt_frames[k] | 0x07;
-
-    // 4. Allocate stack PT and stack frames; wire into user_pd[USER_STACK_PD_IDX].
-    pt::uintptr_t stack_pt_frame = vmm.allocate_frame();
-    pt::uint64_t* stack_pt = reinterpret_cast<pt::uint64_t*>(stack_pt_frame);
-    memset(stack_pt, 0, 4096);
-
-    for (pt::size_t i = 0; i < USER_STACK_PAGES; i++) {
-        pt::uintptr_t frame = vmm.allocate_frame();
-        memset(reinterpret_cast<void*>(frame), 0, 4096);
-        stack_pt[i] = frame | 0x07 | PTE_NX;  // RW + User + No-Execute
-    }
-    user_pd[USER_STACK_PD_IDX] = stack_pt_frame | 0x07;
-
-    // 5. Wire user_pdpt[0] → user_pd.
-    user_pdpt[USER_PDPT_IDX] = user_pd_frame | 0x07;
-
-    // 6. Create the task (allocates kernel stack, clones boot PML4).
+// Upper bound on the frames build_user_image() and start_user_image() take
+// for img: every page of every PT_LOAD segment (ignoring the text cache and
+// pages two segments share), the stack, a PT per 2 MB of each segment plus
+// its edges, the PDPT/PDs and the task's PML4.
+static pt::size_t user_image_frames(const ElfImage* img)
+{
+    pt::size_t pages = TaskScheduler::USER_STACK_PAGES;
+    pt::size_t tables = (TaskScheduler::USER_STACK_PAGES >> 9) + 1;
+    for (pt::size_t s = 0; s < img->num_segs; s++) {
+        const ElfSegment& seg = img->segs[s];
+        pt::size_t span = ((seg.vaddr + seg.memsz + 4095) >> 12) - (seg.vaddr >> 12);
+        pages  += span;
+        tables += (span >> 9) + 2;
+    }
+    return pages + tables + 8;
+}
+
+// Lay out argc/argv/envp at the top of the user stack so crt0 can extract
+// them.  Layout (high→low):
+//   [string data: env strings, then argv strings]
+//   [alignment]
+//   [NULL]  ← envp sentinel
+//   [envp[0..m-1]]
+//   [NULL]  ← argv sentinel
+//   [argv[0..n-1]]
+//   [argc]  ← returned RSP (16-byte aligned)
+// env_buf is a flat "K=V\0K=V\0\0" block.  Strings that would not fit in the
+// stack are dropped, as is the whole environment if the pointer arrays cannot
+// be allocated.
+static pt::uintptr_t build_user_stack(pt::uintptr_t pdpt_pa,
+                                      int argc, const char* const* argv,
+                                      const char* env_buf, pt::size_t env_len)
+{
+    const int ARGV_MAX_LOCAL = 16;
+    // Leave most of the stack for the program itself.
+    const pt::uintptr_t strings_floor = TaskScheduler::USER_STACK_TOP - 64 * 1024;
+
+    // Count the variables first; the environment can hold a few thousand
+    // short entries, too many for fixed arrays on the kernel stack.
+    int envc = 0;
+    {
+        const char* p = env_buf;
+        const char* end = env_buf + env_len;
+        while (p < end && *p) {
+            envc++;
+            while (p < end && *p) p++;
+            p++;  // skip NUL
+        }
+    }
+    const char** env_strs = nullptr;
+    pt::uint64_t* uenv_ptrs = nullptr;
+    if (envc > 0) {
+        env_strs  = static_cast<const char**>(vmm.kmalloc(envc * sizeof(char*)));
+        uenv_ptrs = static_cast<pt::uint64_t*>(vmm.kmalloc(envc * sizeof(pt::uint64_t)));
+        if (!env_strs || !uenv_ptrs) {
+            if (env_strs)  vmm.kfree(env_strs);
+            if (uenv_ptrs) vmm.kfree(uenv_ptrs);
+            env_strs = nullptr;
+            uenv_ptrs = nullptr;
+            envc = 0;
+        }
+    }
+    {
+        const char* p = env_buf;
+        for (int i = 0; i < envc; i++) {
+            env_strs[i] = p;
+            while (*p) p++;
+            p++;  // skip NUL
+        }
+    }
+
+    int real_argc = 0;
+    if (argv && argc > 0)
+        real_argc = (argc > ARGV_MAX_LOCAL) ? ARGV_MAX_LOCAL : argc;
+
+    pt::uint64_t rsp = TaskScheduler::USER_STACK_TOP;
+
+    // Write env string data downward, record user-space pointers.
+    int env_written = 0;
+    for (int i = envc - 1; i >= 0; i--) {
+        pt::size_t len = 0; while (env_strs[i][len]) len++;
+        len++;
+        if (rsp - len < strings_floor) break;
+        rsp -= len;
+        write_user_space(pdpt_pa, rsp, env_strs[i], len);
+        uenv_ptrs[i] = rsp;
+        env_written++;
+    }
+    // Keep the surviving (highest-index) entries contiguous from index 0.
+    int env_first = envc - env_written;
+
+    // Write argv string data downward, record user-space pointers.
+    pt::uint64_t uarg_ptrs[ARGV_MAX_LOCAL];
+    int arg_written = 0;
+    for (int i = real_argc - 1; i >= 0; i--) {
+        pt::size_t len = 0; while (argv[i][len]) len++;
+        len++;
+        if (rsp - len < strings_floor) break;
+        rsp -= len;
+        write_user_space(pdpt_pa, rsp, argv[i], len);
+        uarg_ptrs[i] = rsp;
+        arg_written++;
+    }
+    int arg_first = real_argc - arg_written;
+
+    rsp &= ~(pt::uint64_t)7;
+
+    // Total qwords: 1(argc) + argv + 1(argv NULL) + envp + 1(envp NULL)
+    {
+        pt::uint64_t total_qw = (pt::uint64_t)(arg_written + env_written + 3);
+        pt::uint64_t final_rsp = rsp - total_qw * 8;
+        if (final_rsp & 0xF) rsp -= 8;
+    }
+
+    auto push_qword = [&](pt::uint64_t val) {
+        rsp -= 8;
+        write_user_space(pdpt_pa, rsp, &val, 8);
+    };
+
+    push_qword(0);                                       // envp NULL sentinel
+    for (int i = envc - 1; i >= env_first; i--)
+        push_qword(uenv_ptrs[i]);
+    push_qword(0);                                       // argv NULL sentinel
+    for (int i = real_argc - 1; i >= arg_first; i--)
+        push_qword(uarg_ptrs[i]);
+    push_qword((pt::uint64_t)arg_written);               // argc
+
+    if (env_strs)  vmm.kfree(env_strs);
+    if (uenv_ptrs) vmm.kfree(uenv_ptrs);
+    return rsp;
+}
+
+// Load `filename` into a brand-new user address space: PT_LOAD segments,
+// a zeroed USER_STACK_PAGES stack and the initial argv/envp block.
+// Shared by create_elf_task and exec_task.  On failure nothing is leaked.
+static bool build_user_image(const char* filename,
+                             int argc, const char* const* argv,
+                             const char* env_buf, pt::size_t env_len,
+                             UserImage* out)
+{
+    ElfImage img;
+    if (!ElfLoader::load(filename, &img))
+        return false;
+
+    if (img.va_min < TaskScheduler::USER_CODE_BASE ||
+        img.va_max > TaskScheduler::USER_STACK_BOT) {
+        klog("[ELF_TASK] '%s' spans %lx-%lx, outside user image range %lx-%lx\n",
+             filename, img.va_min, img.va_max,
+             TaskScheduler::USER_CODE_BASE, TaskScheduler::USER_STACK_BOT);
+        ElfLoader::release(&img);
+        return false;
+    }
+
+    // Refuse rather than panic in allocate_frame() half-way through the
+    // mapping when RAM cannot back the image, its BSS and the stack.
+    if ((pt::uint64_t)user_image_frames(&img) * 4096 > vmm.get_free_mem()) {
+        klog("[ELF_TASK] '%s' needs %d pages, not enough free memory\n",
+             filename, (int)user_image_frames(&img));
+        ElfLoader::release(&img);
+        return false;
+    }
+
+    // Read-only segments come from the text cache when this exact file
+    // (same size and modification time) is already loaded; only the
+    // writable pages are then read from disk.
+    StatResult st = {};
+    bool cacheable = VFS::stat_file(filename, &st);
+    pt::uint32_t mtime = ((pt::uint32_t)st.modify_date << 16) | st.modify_time;
+    int cached = cacheable ? TextCache::acquire(filename, img.file.file_size, mtime) : -1;
+
+    pt::uintptr_t pdpt = new_user_space();
+    pt::size_t shared_pages = (cached >= 0) ? map_cached_text(pdpt, cached) : 0;
+    pt::size_t image_pages  = shared_pages;
+    bool mapped = map_elf_segments(pdpt, &img, &image_pages);
+    if (mapped && cached < 0 && cacheable)
+        shared_pages = share_elf_text(pdpt, &img, filename, mtime);
+    pt::uintptr_t entry = img.entry;
+    pt::uintptr_t va_max = img.va_max;
+    ElfLoader::release(&img);
+    if (!mapped || image_pages == 0) {
+        klog("[ELF_TASK] Failed to map segments of '%s'\n", filename);
+        free_user_space(pdpt);
+        return false;
+    }
+
+    for (pt::uintptr_t va = TaskScheduler::USER_STACK_BOT;
+         va < TaskScheduler::USER_STACK_TOP; va += 4096) {
+        pt::uint64_t* pte = user_pte(pdpt, va, true);
+        *pte = alloc_zeroed_frame() | 0x07 | PTE_NX;  // RW + User + No-Execute
+    }
+
+    out->pdpt        = pdpt;
+    out->entry       = entry;
+    out->user_rsp    = build_user_stack(pdpt, argc, argv, env_buf, env_len);
+    out->image_end   = (va_max + 4095) & ~(pt::uintptr_t)0xFFF;
+    out->image_pages  = image_pages;
+    out->shared_pages = shared_pages;
+    return true;
+}
+
+// First heap VA for an image ending at image_end: the next 2 MB boundary, so
+// the heap never shares a page table with the image.
+static inline pt::uintptr_t user_heap_base(pt::uintptr_t image_end)
+{
+    return (image_end + TaskScheduler::USER_HEAP_ALIGN - 1) &
+           ~(TaskScheduler::USER_HEAP_ALIGN - 1);
+}
+
+// Put a freshly built user image into a new task (steps 2-4 of
+// create_elf_task, shared with spawn_task).  env_buf is the flat
+// double-NUL environment block the task keeps for a later exec.
+// The task is returned still TASK_BLOCKED; on failure ui.pdpt is freed.
+static pt::uint32_t start_user_image(const char* filename,
+                                     const UserImage& ui,
+                                     const char* env_buf,
+                                     pt::size_t env_len)
+{
+    // 2. Create the task (allocates kernel stack, clones boot PML4).
     //    Start it BLOCKED so the scheduler can't pick it before we wire
     //    user_pdpt into PML4[0] — otherwise the task would IRET to ring-3
     //    with the kernel-cloned PML4, hitting the boot identity huge-page
     //    mapping (U/S=1) at 0x400000 and executing whatever bytes happen
     //    to live at PA 0x400000 (e.g. kernel heap garbage).
-    klog("[ELF_TASK] code frames allocated; calling create_task\n");
-    pt::uint32_t task_id = create_task(reinterpret_cast<void(*)()>(entry),
-                                       TASK_STACK_SIZE, true, /*start_blocked=*/true);
+    pt::uint32_t task_id = TaskScheduler::create_task(
+        reinterpret_cast<void(*)()>(ui.entry),
+        TaskScheduler::TASK_STACK_SIZE, true, /*start_blocked=*/true);
     if (task_id == 0xFFFFFFFF) {
-        // Free all allocated frames on failure.
-        for (pt::size_t k = 0; k < num_pts; k++) {
-            if (!code_pt_frames[k]) continue;
-            pt::uint64_t* cpt = reinterpret_cast<pt::uint64_t*>(code_pt_frames[k]);
-            for (int i = 0; i < 512; i++) {
-                if (cpt[i] & 0x01) vmm.free_frame(cpt[i] & PTE_ADDR_MASK);
-            }
-            vmm.free_frame(code_pt_frames[k]);
-        }
-        for (int i = 0; i < 512; i++) {
-            if (stack_pt[i] & 0x01) vmm.free_frame(stack_pt[i] & PTE_ADDR_MASK);
-        }
-        vmm.free_frame(stack_pt_frame);
-        vmm.free_frame(user_pd_frame);
-        vmm.free_frame(user_pdpt_frame);
+        free_user_space(ui.pdpt);
         return 0xFFFFFFFF;
     }
 
-    // 7. Wire new user address space into the task's PML4.
-    //    Task is currently TASK_BLOCKED (start_blocked above); we'll flip it
-    //    to TASK_READY at the end of step 8 once everything is wired up.
-    Task* task = &tasks[task_id];
-    pt::uint64_t* task_pml4 = reinterpret_cast<pt::uint64_t*>(task->cr3);
+    // 3. Wire new user address space into the task's PML4.
+    //    Task is currently TASK_BLOCKED (start_blocked above); the caller
+    //    flips it to TASK_READY once everything is wired up.
+    Task* task = TaskScheduler::get_task(task_id);
+    pt::uint64_t* task_pml4 = pa_table(task->cr3);
     // PML4[0] → user_pdpt (P|W|U): user code, heap, stack.
-    task_pml4[USER_PML4_IDX] = user_pdpt_frame | 0x07;
+    task_pml4[TaskScheduler::USER_PML4_IDX] = ui.pdpt | 0x07;
     // PML4[256] → boot PDPT (P|W, no U bit): kernel only.
-    task_pml4[ELF_PML4_IDX] &= ~(pt::uint64_t)0x04;
+    task_pml4[KERNEL_PML4_IDX] &= ~(pt::uint64_t)0x04;
 
-    // 8. Store page-table info in task struct.
-    task->user_pdpt    = user_pdpt_frame;
-    task->user_pd      = user_pd_frame;
-    task->stack_pt     = stack_pt_frame;
-    task->user_heap_top = USER_HEAP_BASE;
-    task->num_priv_pts = num_pts;
-    for (pt::size_t k = 0; k < num_pts; k++) task->priv_pt[k] = code_pt_frames[k];
-    for (pt::size_t k = num_pts; k < Task::MAX_PRIV_PTS; k++) task->priv_pt[k] = 0;
+    // 4. Store address-space layout in task struct.
+    task->user_pdpt      = ui.pdpt;
+    task->user_image_end = ui.image_end;
+    task->user_heap_top  = user_heap_base(ui.image_end);
 
     // Store basename for display (strip directory path, truncate to fit).
     {
@@ -858,107 +1445,42 @@ pt::uint32_t TaskScheduler::create_elf_task(const char* filename,
         task->name[i] = '\0';
     }
 
-    // Initialize default environment variables for the new task.
-    {
-        const char defaults[] = "HOME=/\0PATH=/";
-        memcpy(task->env_buf, defaults, sizeof(defaults));
-        task->env_buf[sizeof(defaults)] = '\0';  // double-NUL terminator
-        task->env_buf_len = sizeof(defaults) + 1;
-    }
-
-    // Build initial user stack with envp so crt0 can extract environ.
-    // Stack layout (high→low): [env strings][align][NULL envp][envp ptrs][NULL argv][argc=0] ← RSP
-    // stack_pt entries are direct-PA accessible (identity-mapped under kernel CR3).
-    {
-        auto elf_write_byte = [&](pt::uint64_t va, pt::uint8_t b) {
-            pt::size_t pt_idx = (va - USER_STACK_BOT) >> 12;
-            pt::uintptr_t pa = (stack_pt[pt_idx] & PTE_ADDR_MASK) + (va & 0xFFF);
-            *reinterpret_cast<pt::uint8_t*>(pa) = b;
-        };
-        auto elf_write_qword = [&](pt::uint64_t va, pt::uint64_t val) {
-            pt::size_t pt_idx = (va - USER_STACK_BOT) >> 12;
-            pt::uintptr_t pa = (stack_pt[pt_idx] & PTE_ADDR_MASK) + (va & 0xFFF);
-            *reinterpret_cast<pt::uint64_t*>(pa) = val;
-        };
-
-        const int ENV_MAX = 16;
-        const char* env_strs[ENV_MAX];
-        int envc = 0;
-        {
-            const char* p = task->env_buf;
-            const char* end = task->env_buf + task->env_buf_len;
-            while (p < end && *p && envc < ENV_MAX) {
-                env_strs[envc++] = p;
-                while (p < end && *p) p++;
-                p++;
-            }
-        }
+    // Environment the task keeps for a later exec.
+    set_task_env(task, env_buf, env_len);
 
-        const int ARGV_MAX_LOCAL = 16;
-        int real_argc = 0;
-        if (argv && argc > 0)
-            real_argc = (argc > ARGV_MAX_LOCAL) ? ARGV_MAX_LOCAL : argc;
-
-        pt::uint64_t rsp = USER_STACK_TOP;
-
-        // Write env string data downward.
-        pt::uint64_t uenv_ptrs[ENV_MAX];
-        for (int i = envc - 1; i >= 0; i--) {
-            const char* s = env_strs[i];
-            int len = 0; while (s[len]) len++;
-            len++;
-            rsp -= (pt::uint64_t)len;
-            for (int j = 0; j < len; j++)
-                elf_write_byte(rsp + (pt::uint64_t)j, (pt::uint8_t)s[j]);
-            uenv_ptrs[i] = rsp;
-        }
-
-        // Write argv string data downward.
-        pt::uint64_t uarg_ptrs[ARGV_MAX_LOCAL];
-        for (int i = real_argc - 1; i >= 0; i--) {
-            const char* s = argv[i];
-            int len = 0; while (s[len]) len++;
-            len++;
-            rsp -= (pt::uint64_t)len;
-            for (int j = 0; j < len; j++)
-                elf_write_byte(rsp + (pt::uint64_t)j, (pt::uint8_t)s[j]);
-            uarg_ptrs[i] = rsp;
-        }
+    // Patch the iretq frame's RSP to point to the argv/envp layout.
+    pt::uint64_t* frame = reinterpret_cast<pt::uint64_t*>(task->preempt_rsp);
+    frame[18] = ui.user_rsp;
 
-        rsp &= ~(pt::uint64_t)7;
+    klog("[ELF_TASK] Task %d: '%s' entry=%lx %d image pages (%d shared), heap at %lx\n",
+         task_id, filename, ui.entry, (int)ui.image_pages, (int)ui.shared_pages,
+         task->user_heap_top);
 
-        // Total qwords: 1(argc) + real_argc + 1(argv NULL) + envc + 1(envp NULL)
-        {
-            pt::uint64_t total_qw = (pt::uint64_t)(real_argc + envc + 3);
-            pt::uint64_t final_rsp = rsp - total_qw * 8;
-            if (final_rsp & 0xF) rsp -= 8;
-        }
-
-        // envp NULL sentinel
-        rsp -= 8; elf_write_qword(rsp, 0);
-        // envp pointers
-        for (int i = envc - 1; i >= 0; i--) {
-            rsp -= 8; elf_write_qword(rsp, uenv_ptrs[i]);
-        }
-        // argv NULL sentinel
-        rsp -= 8; elf_write_qword(rsp, 0);
-        // argv pointers
-        for (int i = real_argc - 1; i >= 0; i--) {
-            rsp -= 8; elf_write_qword(rsp, uarg_ptrs[i]);
-        }
-        // argc
-        rsp -= 8; elf_write_qword(rsp, (pt::uint64_t)real_argc);
+    return task_id;
+}
 
-        // Patch the iretq frame's RSP to point to the new stack layout.
-        pt::uint64_t* frame = reinterpret_cast<pt::uint64_t*>(task->preempt_rsp);
-        frame[18] = rsp;  // user RSP in iretq frame
+pt::uint32_t TaskScheduler::create_elf_task(const char* filename,
+                                            int argc,
+                                            const char* const* argv)
+{
+    // 1. Build the user address space: ELF segments copied straight into
+    //    per-task frames, stack allocated, argv/envp laid out.
+    //    The array's own NUL plus the explicit one give the double-NUL end.
+    static const char default_env[] = "HOME=/\0PATH=/\0";
+    UserImage ui;
+    if (!build_user_image(filename, argc, argv,
+                          default_env, sizeof(default_env), &ui)) {
+        klog("[ELF_TASK] Failed to load '%s'\n", filename);
+        return 0xFFFFFFFF;
     }
 
-    klog("[ELF_TASK] Task %d: '%s' entry=%lx %d code pages\n",
-         task_id, filename, entry, (int)num_code_frames);
+    pt::uint32_t task_id = start_user_image(filename, ui,
+                                            default_env, sizeof(default_env));
+    if (task_id == 0xFFFFFFFF)
+        return 0xFFFFFFFF;
 
     // All page tables and stack are fully wired; safe to schedule now.
-    task->state = TASK_READY;
+    find_task(task_id)->state = TASK_READY;
 
     return task_id;
 }
@@ -974,15 +1496,7 @@ void TaskScheduler::task_exit(int exit_code)
         current->exit_code = exit_code;
 
         // Decrement FdTable refcount; only close FDs and free when last reference.
-        if (current->fd_table) {
-            current->fd_table->refcount--;
-            if (current->fd_table->refcount == 0) {
-                for (pt::size_t i = 0; i < Task::MAX_FDS; i++)
-                    close_fd(&current->fd_table->fds[i]);
-                vmm.kfree(current->fd_table);
-            }
-            current->fd_table = nullptr;
-        }
+        release_fd_table(current);
 
         // Free the user execution stack eagerly (safe here; we're about to
         // switch away and will never return to user_rsp).
@@ -993,21 +1507,22 @@ void TaskScheduler::task_exit(int exit_code)
         }
 
         // Wake any parent task blocked in waitpid_task() waiting on us.
-        for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-            if (tasks[i].state == TASK_BLOCKED &&
-                tasks[i].waiting_for == current->id) {
-                tasks[i].waiting_for = 0xFFFFFFFF;
-                tasks[i].state = TASK_READY;
-                klog("[SCHEDULER] Unblocked parent task %d\n", i);
+        for (pt::uint32_t i = 0; i < task_capacity; i++) {
+            if (tasks[i]->state == TASK_BLOCKED &&
+                tasks[i]->waiting_for == current->id) {
+                tasks[i]->waiting_for = 0xFFFFFFFF;
+                tasks[i]->state = TASK_READY;
+                klog("[SCHEDULER] Unblocked parent task %d\n", tasks[i]->id);
             }
         }
 
         // Wake any thread blocked in thread_join_task() waiting on us.
-        if (current->join_tid != INVALID_TID &&
-            current->join_tid < MAX_TASKS &&
-            tasks[current->join_tid].state == TASK_BLOCKED) {
-            tasks[current->join_tid].state = TASK_READY;
-            klog("[SCHEDULER] Unblocked joining task %d\n", current->join_tid);
+        if (current->join_tid != INVALID_TID) {
+            Task* joiner = find_task(current->join_tid);
+            if (joiner && joiner->state == TASK_BLOCKED) {
+                joiner->state = TASK_READY;
+                klog("[SCHEDULER] Unblocked joining task %d\n", current->join_tid);
+            }
         }
 
         if (current->window_id != INVALID_WID && current->owns_window) {
@@ -1016,10 +1531,9 @@ void TaskScheduler::task_exit(int exit_code)
         current->window_id = INVALID_WID;
         current->owns_window = false;
 
-        // Release audio device if this task owns it
-        if (AC97::owner_task_id == (pt::int32_t)current->id) {
-            AC97::close();
-            klog("[SCHEDULER] Released audio device from task %d\n", current->id);
+        // Release this task's audio stream, if it has one
+        if (mixer_close(current->id)) {
+            klog("[SCHEDULER] Released audio stream of task %d\n", current->id);
         }
 
         // If we own the address space, reap any child threads that share it
@@ -1028,9 +1542,9 @@ void TaskScheduler::task_exit(int exit_code)
         // out from under them — the next kernel access via their stale CR3
         // page-faults (typically deep inside a syscall like sys_audio_write).
         if (current->owns_page_tables) {
-            for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-                if (i == current->id) continue;
-                Task& t = tasks[i];
+            for (pt::uint32_t i = 0; i < task_capacity; i++) {
+                if (i == current_slot) continue;
+                Task& t = *tasks[i];
                 if (t.state == TASK_DEAD) continue;
                 if (t.owns_page_tables) continue;          // separate process
                 if (t.cr3 != current->cr3) continue;       // not our thread
@@ -1041,30 +1555,16 @@ void TaskScheduler::task_exit(int exit_code)
                 // clear borrowed page-table references and free its kernel
                 // stack so the slot can be reused safely.
                 klog("[SCHEDULER] Reaping thread %d (parent %d exiting)\n",
-                     i, current->id);
-                if (AC97::owner_task_id == (pt::int32_t)t.id) {
-                    AC97::close();
-                }
+                     t.id, current->id);
+                mixer_close(t.id);
                 /* Drop our shared FdTable reference. The parent's task_exit
                  * already decremented its own ref above, so free here only
                  * fires if the parent had no other live thread holding it. */
-                if (t.fd_table) {
-                    t.fd_table->refcount--;
-                    if (t.fd_table->refcount == 0) {
-                        for (pt::size_t fi = 0; fi < Task::MAX_FDS; fi++)
-                            close_fd(&t.fd_table->fds[fi]);
-                        vmm.kfree(t.fd_table);
-                    }
-                    t.fd_table = nullptr;
-                }
-                t.cr3          = 0;
-                t.user_pdpt    = 0;
-                t.user_pd      = 0;
-                t.stack_pt     = 0;
-                for (pt::size_t k = 0; k < Task::MAX_PRIV_PTS; k++)
-                    t.priv_pt[k] = 0;
-                t.num_priv_pts = 0;
-                t.user_heap_top = 0;
+                release_fd_table(&t);
+                t.cr3            = 0;
+                t.user_pdpt      = 0;
+                t.user_image_end = 0;
+                t.user_heap_top  = 0;
                 if (t.kernel_stack_base != 0) {
                     vmm.kfree((void*)t.kernel_stack_base);
                     t.kernel_stack_base = 0;
@@ -1075,29 +1575,20 @@ void TaskScheduler::task_exit(int exit_code)
             }
         }
 
-        // For threads (owns_page_tables==false): zero PT pointers but do not
-        // free page table frames — the owner process still needs them.
-        // For processes: zero PT pointers; lazy free happens in create_task().
-        // (We can't call free_user_pagetables here because this task's CR3 is
-        // still active — the frames would leak but that is already the case.)
+        // For threads (owns_page_tables==false): zero the borrowed refs but do
+        // not free anything — the owner process still needs the page tables.
+        // For processes: switch to the boot PML4 (kernel stack, code and heap
+        // all live in the higher half, so execution continues unchanged) and
+        // free the whole user address space now.  The PML4 frame itself is
+        // released lazily by create_task() when the slot is reused.
         if (!current->owns_page_tables) {
-            // Thread: clear borrowed refs but don't free anything.
-            for (pt::size_t k = 0; k < Task::MAX_PRIV_PTS; k++)
-                current->priv_pt[k] = 0;
-            current->num_priv_pts = 0;
-            current->stack_pt     = 0;
-            current->user_pd      = 0;
-            current->user_pdpt    = 0;
-            current->user_heap_top = 0;
-            current->cr3          = 0;  // don't free this CR3 in create_task lazy cleanup
-        } else {
-            for (pt::size_t k = 0; k < Task::MAX_PRIV_PTS; k++)
-                current->priv_pt[k] = 0;
-            current->num_priv_pts = 0;
-            current->stack_pt     = 0;
-            current->user_pd      = 0;
-            current->user_pdpt    = 0;
-            current->user_heap_top = 0;
+            current->user_pdpt      = 0;
+            current->user_image_end = 0;
+            current->user_heap_top  = 0;
+            current->cr3            = 0;  // don't free this CR3 in create_task lazy cleanup
+        } else if (current->user_pdpt) {
+            asm volatile("mov cr3, %0" : : "r"(kernel_cr3) : "memory");
+            free_user_pagetables(current);
         }
 
         current->state = TASK_DEAD;
@@ -1123,55 +1614,25 @@ void TaskScheduler::task_exit(int exit_code)
 //
 pt::uint32_t TaskScheduler::fork_task(pt::uintptr_t syscall_frame_rsp)
 {
-    if (task_count >= MAX_TASKS) {
-        klog("[FORK] Max tasks reached\n");
-        return (pt::uint32_t)-1;
-    }
-
     Task* parent = get_current_task();
     if (!parent || !parent->user_mode) {
         klog("[FORK] fork from non-user task not supported\n");
         return (pt::uint32_t)-1;
     }
 
-    // Find a free slot.
-    Task* child = nullptr;
-    pt::uint32_t child_id = 0xFFFFFFFF;
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_DEAD) {
-            child    = &tasks[i];
-            child_id = i;
-            break;
-        }
-    }
+    // Reserve a slot and PID (previous occupant already cleaned up).
+    Task* child = alloc_slot();
     if (!child) {
         klog("[FORK] No free task slot\n");
         return (pt::uint32_t)-1;
     }
-
-    // Lazy cleanup of previous occupant (mirrors create_task).
-    if (child->kernel_stack_base != 0) {
-        vmm.kfree((void*)child->kernel_stack_base);
-        child->kernel_stack_base = 0;
-    }
-    if (child->user_stack_base != 0) {
-        vmm.kfree((void*)child->user_stack_base);
-        child->user_stack_base = 0;
-    }
-    if (child->cr3 != 0 && child->cr3 != kernel_cr3) {
-        vmm.free_frame(child->cr3);
-        child->cr3 = 0;
-    }
-    // free_user_pagetables uses KERNEL_OFFSET-mapped accesses inside, but the
-    // child slot may have been a previous task with old-style kmalloc stack
-    // (user_stack_base freed above) and zero user_pd/user_pdpt/stack_pt, so
-    // this is safe as a cleanup step.
-    free_user_pagetables(child);
+    pt::uint32_t child_id = child->id;
 
     // ── Allocate child kernel stack ──────────────────────────────────────────
     void* child_kstack_mem = vmm.kmalloc(TASK_STACK_SIZE);
     if (!child_kstack_mem) {
         klog("[FORK] Failed to allocate child kernel stack\n");
+        child->state = TASK_DEAD;
         return (pt::uint32_t)-1;
     }
 
@@ -1185,105 +1646,14 @@ pt::uint32_t TaskScheduler::fork_task(pt::uintptr_t syscall_frame_rsp)
     memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + child_pml4_frame),
            reinterpret_cast<void*>(KERNEL_OFFSET + parent->cr3), 4096);
 
-    // ── Allocate child user_pdpt, user_pd (fresh frames) ─────────────────────
-    pt::size_t par_num_pts = parent->num_priv_pts;
-    pt::uintptr_t child_user_pdpt_frame = vmm.allocate_frame();
-    pt::uintptr_t child_user_pd_frame   = vmm.allocate_frame();
-    pt::uint64_t* child_updpt = reinterpret_cast<pt::uint64_t*>(
-        KERNEL_OFFSET + child_user_pdpt_frame);
-    pt::uint64_t* child_upd = reinterpret_cast<pt::uint64_t*>(
-        KERNEL_OFFSET + child_user_pd_frame);
-
-    // Copy parent's user_pdpt/user_pd so child inherits boot identity-map entries
-    // (U/S=0, kernel-only) at indices 1..3 of pdpt and most of pd.
-    // Code/stack/heap entries are overwritten with deep copies below.
-    memcpy(child_updpt,
-           reinterpret_cast<void*>(KERNEL_OFFSET + parent->user_pdpt), 4096);
-    memcpy(child_upd,
-           reinterpret_cast<void*>(KERNEL_OFFSET + parent->user_pd), 4096);
-
-    // ── Deep-copy code PT frames ───────────────────────────────────────────
-    pt::uintptr_t new_pt_frames[Task::MAX_PRIV_PTS];
-    for (pt::size_t k = 0; k < Task::MAX_PRIV_PTS; k++) new_pt_frames[k] = 0;
-
-    klog("[FORK] deep-copying %d code PTs\n", (int)par_num_pts);
-    for (pt::size_t k = 0; k < par_num_pts; k++) {
-        new_pt_frames[k] = vmm.allocate_frame();
-        pt::uint64_t* parent_pt = reinterpret_cast<pt::uint64_t*>(
-            KERNEL_OFFSET + parent->priv_pt[k]);
-        pt::uint64_t* new_pt = reinterpret_cast<pt::uint64_t*>(
-            KERNEL_OFFSET + new_pt_frames[k]);
-        for (int i = 0; i < 512; i++) {
-            if (parent_pt[i] & 0x01) {
-                pt::uintptr_t src_frame = parent_pt[i] & PTE_ADDR_MASK;
-                pt::uint64_t  pte_flags = parent_pt[i] & 0x8000000000000FFFULL; // preserve NX + low flags
-                pt::uintptr_t dst_frame = vmm.allocate_frame();
-                memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + dst_frame),
-                       reinterpret_cast<void*>(KERNEL_OFFSET + src_frame), 4096);
-                new_pt[i] = dst_frame | pte_flags;
-            } else {
-                new_pt[i] = 0;
-            }
-        }
-        child_upd[USER_CODE_PD_IDX + k] = new_pt_frames[k] | 0x07;
-    }
-
-    // ── Deep-copy stack PT frames ──────────────────────────────────────────
-    pt::uintptr_t child_stack_pt_frame = vmm.allocate_frame();
-    pt::uint64_t* child_spt = reinterpret_cast<pt::uint64_t*>(
-        KERNEL_OFFSET + child_stack_pt_frame);
-    pt::uint64_t* parent_spt = reinterpret_cast<pt::uint64_t*>(
-        KERNEL_OFFSET + parent->stack_pt);
-    for (int i = 0; i < 512; i++) {
-        if (parent_spt[i] & 0x01) {
-            pt::uintptr_t src = parent_spt[i] & PTE_ADDR_MASK;
-            pt::uint64_t  pte_flags = parent_spt[i] & 0x8000000000000FFFULL;
-            pt::uintptr_t dst = vmm.allocate_frame();
-            memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + dst),
-                   reinterpret_cast<void*>(KERNEL_OFFSET + src), 4096);
-            child_spt[i] = dst | pte_flags;
-        } else {
-            child_spt[i] = 0;
-        }
-    }
-    child_upd[USER_STACK_PD_IDX] = child_stack_pt_frame | 0x07;
-
-    // ── Deep-copy heap PT frames ───────────────────────────────────────────
-    if (parent->user_pd) {
-        pt::uint64_t* parent_upd = reinterpret_cast<pt::uint64_t*>(
-            KERNEL_OFFSET + parent->user_pd);
-        pt::size_t heap_start = USER_CODE_PD_IDX + par_num_pts;
-        for (pt::size_t i = heap_start; i < USER_STACK_PD_IDX; i++) {
-            if (!(parent_upd[i] & 0x01)) continue;
-            if (parent_upd[i] & 0x80) continue;  // boot 2MB huge page, already in child_upd
-            pt::uintptr_t child_hpt_frame = vmm.allocate_frame();
-            pt::uint64_t* par_hpt = reinterpret_cast<pt::uint64_t*>(
-                KERNEL_OFFSET + (parent_upd[i] & PTE_ADDR_MASK));
-            pt::uint64_t* child_hpt = reinterpret_cast<pt::uint64_t*>(
-                KERNEL_OFFSET + child_hpt_frame);
-            for (int j = 0; j < 512; j++) {
-                if (par_hpt[j] & 0x01) {
-                    pt::uintptr_t src = par_hpt[j] & PTE_ADDR_MASK;
-                    pt::uint64_t  pte_flags = par_hpt[j] & 0x8000000000000FFFULL;
-                    pt::uintptr_t dst = vmm.allocate_frame();
-                    memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + dst),
-                           reinterpret_cast<void*>(KERNEL_OFFSET + src), 4096);
-                    child_hpt[j] = dst | pte_flags;
-                } else {
-                    child_hpt[j] = 0;
-                }
-            }
-            child_upd[i] = child_hpt_frame | 0x07;
-        }
-    }
+    // ── Deep-copy the user address space (image, heap, stack) ──────────────
+    klog("[FORK] deep-copying user address space\n");
+    pt::uintptr_t child_user_pdpt_frame = clone_user_space(parent->user_pdpt);
 
     // ── Wire child user address space ──────────────────────────────────────
-    child_updpt[USER_PDPT_IDX] = child_user_pd_frame | 0x07;
-
-    pt::uint64_t* child_pml4 = reinterpret_cast<pt::uint64_t*>(
-        KERNEL_OFFSET + child_pml4_frame);
+    pt::uint64_t* child_pml4 = pa_table(child_pml4_frame);
     child_pml4[USER_PML4_IDX] = child_user_pdpt_frame | 0x07;
-    child_pml4[ELF_PML4_IDX] &= ~(pt::uint64_t)0x04;  // clear U bit on kernel half
+    child_pml4[KERNEL_PML4_IDX] &= ~(pt::uint64_t)0x04;  // clear U bit on kernel half
 
     // ── Build child kernel stack frame ───────────────────────────────────────
     // Copy the parent's 160-byte PUSHALL+iretq frame verbatim, then patch rax.
@@ -1302,8 +1672,6 @@ pt::uint32_t TaskScheduler::fork_task(pt::uintptr_t syscall_frame_rsp)
     // frame[18] = user RSP — unchanged (same user VA as parent)
 
     // ── Populate child Task struct ────────────────────────────────────────────
-    child->id                = child_id;
-    child->state             = TASK_BLOCKED;
     child->kernel_stack_base = (pt::uintptr_t)child_kstack_mem;
     child->kernel_stack_size = TASK_STACK_SIZE;
     child->ticks_alive       = 0;
@@ -1313,48 +1681,32 @@ pt::uint32_t TaskScheduler::fork_task(pt::uintptr_t syscall_frame_rsp)
     child->user_mode         = true;
     child->user_stack_base   = 0;
     child->user_pdpt         = child_user_pdpt_frame;
-    child->user_pd           = child_user_pd_frame;
-    child->stack_pt          = child_stack_pt_frame;
-    child->user_heap_top     = parent->user_heap_top;
-    child->num_priv_pts      = par_num_pts;
-    for (pt::size_t k = 0; k < par_num_pts; k++) child->priv_pt[k] = new_pt_frames[k];
-    for (pt::size_t k = par_num_pts; k < Task::MAX_PRIV_PTS; k++) child->priv_pt[k] = 0;
+    child->user_image_end    = address_space_owner(parent)->user_image_end;
+    child->user_heap_top     = address_space_owner(parent)->user_heap_top;
     child->parent_id          = parent->id;
     child->waiting_for        = 0xFFFFFFFF;
     child->exit_code          = 0;
+    child->vfork_parent       = 0xFFFFFFFF;
     child->sleep_deadline     = 0;
     child->syscall_frame_rsp  = 0;
     child->window_id          = INVALID_WID;
     child->owns_window        = false;
     child->vterm_id           = parent->vterm_id;
     memcpy(child->name, parent->name, sizeof(child->name));
+    set_task_env(child, parent->env_buf, parent->env_buf_len);
 
     // Inherit parent's FPU/SSE state so the child resumes with valid x87/SSE context.
     memcpy(child->fxsave_area, parent->fxsave_area, 512);
 
     // Allocate a fresh FdTable for the child (deep copy; refcount=1).
-    // fork() creates a new process with its own independent FD table.
-    child->fd_table = static_cast<FdTable*>(vmm.kcalloc(sizeof(FdTable)));
-    child->fd_table->refcount = 1;
-    if (parent->fd_table) {
-        for (pt::size_t i = 0; i < Task::MAX_FDS; i++)
-            child->fd_table->fds[i] = parent->fd_table->fds[i];
-    }
+    // fork() creates a new process with its own independent FD table;
+    // inherited pipe ends gain a reference so each side closes independently.
+    child->fd_table = copy_fd_table(parent->fd_table);
     child->owns_page_tables = true;
     child->join_tid         = INVALID_TID;
     child->thread_result    = nullptr;
     child->fs_base          = parent->fs_base;
 
-    // Increment ref_count for every pipe FD inherited by the child so that
-    // each end is closed independently without premature buffer freeing.
-    for (pt::size_t i = 0; i < Task::MAX_FDS; i++) {
-        File* f = &child->fd_table->fds[i];
-        if (f->open && (f->type == FdType::PIPE_RD || f->type == FdType::PIPE_WR)) {
-            PipeBuffer* pipe = pipe_get_buf(f->fs_data);
-            pipe->ref_count++;
-        }
-    }
-
     task_count++;
     klog("[FORK] Forked task %d -> child %d\n", parent->id, child_id);
 #ifdef FORK_DEBUG
@@ -1365,10 +1717,246 @@ pt::uint32_t TaskScheduler::fork_task(pt::uintptr_t syscall_frame_rsp)
     return child_id;
 }
 
+// ─── spawn_task ───────────────────────────────────────────────────────────────
+//
+// posix_spawn in one call: load `filename` into a brand-new address space
+// and start it as a child of the caller.  Unlike fork+exec nothing of the
+// caller's image is copied; only its fd table is (then edited by `actions`).
+// The caller's argv/envp/path strings are copied to the kernel stack first,
+// exactly as exec_task does.
+//
+// Length of the user string s, looking at no more than max bytes (max if
+// no NUL is found within them); -1 if it leaves user memory first.
+static long user_strnlen(const char* s, pt::size_t max)
+{
+    for (pt::size_t n = 0; n < max; n++) {
+        if (!user_range_ok(reinterpret_cast<pt::uintptr_t>(s + n), 1)) return -1;
+        if (s[n] == '\0') return (long)n;
+    }
+    return (long)max;
+}
+
+// Element i of a user pointer array, or false if it is not user memory.
+static bool user_ptr_at(const char* const* array, int i, const char** out)
+{
+    return copy_from_user(out, array + i, sizeof(*out));
+}
+
+pt::uint32_t TaskScheduler::spawn_task(const char* filename,
+                                       const char* const* argv,
+                                       const char* const* envp,
+                                       const SpawnFileAction* actions,
+                                       const char* cwd)
+{
+    Task* parent = get_current_task();
+    if (!parent || !parent->user_mode || !filename) {
+        klog("[SPAWN] spawn from non-user task not supported\n");
+        return 0xFFFFFFFF;
+    }
+
+    // Every pointer below comes from the caller: strings are length-checked
+    // and arrays read through copy_from_user before anything is used.
+    char fname_buf[128];
+    if (user_strnlen(filename, sizeof(fname_buf)) < 0 ||
+        (cwd && user_strnlen(cwd, sizeof(fname_buf)) < 0))
+        return 0xFFFFFFFF;
+
+    // Relative paths are resolved against the caller-supplied cwd.
+    {
+        pt::size_t n = 0;
+        if (cwd && cwd[0] && filename[0] != '/') {
+            while (n < sizeof(fname_buf) - 2 && cwd[n]) { fname_buf[n] = cwd[n]; n++; }
+            if (n > 0 && fname_buf[n - 1] != '/') fname_buf[n++] = '/';
+        }
+        for (pt::size_t i = 0; n < sizeof(fname_buf) - 1 && filename[i]; i++)
+            fname_buf[n++] = filename[i];
+        fname_buf[n] = '\0';
+    }
+
+    const int ARGV_MAX_LOCAL = 16, ARG_MAX_LOCAL = 128;
+    char arg_flat[ARGV_MAX_LOCAL * ARG_MAX_LOCAL];
+    const char* arg_kptrs[ARGV_MAX_LOCAL];
+    int argc = 0;
+    if (argv) {
+        for (; argc < ARGV_MAX_LOCAL; argc++) {
+            const char* src;
+            if (!user_ptr_at(argv, argc, &src)) return 0xFFFFFFFF;
+            if (!src) break;
+            if (user_strnlen(src, ARG_MAX_LOCAL) < 0) return 0xFFFFFFFF;
+            char* dst = arg_flat + argc * ARG_MAX_LOCAL;
+            int j = 0;
+            while (j < ARG_MAX_LOCAL - 1 && src[j]) { dst[j] = src[j]; j++; }
+            dst[j] = '\0';
+            arg_kptrs[argc] = dst;
+        }
+    }
+
+    // Flatten envp into a heap "K=V\0K=V\0\0" block of at most
+    // ENV_MAX_SIZE bytes; entries that do not fit are dropped.  No envp
+    // means the child inherits the caller's block.
+    const char* env = parent->env_buf;
+    pt::size_t env_len = parent->env_buf_len;
+    char* env_copy = nullptr;
+    if (envp) {
+        pt::size_t total = 1;
+        const char* s;
+        for (int i = 0; ; i++) {
+            if (!user_ptr_at(envp, i, &s)) return 0xFFFFFFFF;
+            if (!s) break;
+            long len = user_strnlen(s, Task::ENV_MAX_SIZE);
+            if (len < 0) return 0xFFFFFFFF;
+            total += (pt::size_t)len + 1;
+            if (total > Task::ENV_MAX_SIZE) { total = Task::ENV_MAX_SIZE; break; }
+        }
+        env_copy = static_cast<char*>(vmm.kmalloc(total));
+        if (!env_copy) return 0xFFFFFFFF;
+        env_len = 0;
+        // Checked again: the caller's memory may have changed meanwhile.
+        for (int i = 0; user_ptr_at(envp, i, &s) && s; i++) {
+            long len = user_strnlen(s, Task::ENV_MAX_SIZE);
+            if (len <= 0 || env_len + (pt::size_t)len + 2 > total) continue;
+            memcpy(env_copy + env_len, s, (pt::size_t)len);
+            env_len += (pt::size_t)len;
+            env_copy[env_len++] = '\0';
+        }
+        env_copy[env_len++] = '\0';
+        env = env_copy;
+    }
+
+    // The action list, END included, copied in before any of it is applied.
+    SpawnFileAction kactions[SPAWN_MAX_ACTIONS + 1];
+    bool actions_ok = true;
+    if (actions) {
+        for (pt::size_t i = 0; i <= SPAWN_MAX_ACTIONS; i++) {
+            if (!copy_from_user(&kactions[i], actions + i, sizeof(SpawnFileAction))) {
+                actions_ok = false;
+                break;
+            }
+            if (kactions[i].op == SPAWN_FA_END) break;
+        }
+    }
+
+    FdTable* fdt = actions_ok ? copy_fd_table(parent->fd_table) : nullptr;
+    if (!fdt || !apply_file_actions(fdt, actions ? kactions : nullptr)) {
+        klog("[SPAWN] Bad file action list\n");
+        if (fdt) free_fd_table(fdt);
+        if (env_copy) vmm.kfree(env_copy);
+        return 0xFFFFFFFF;
+    }
+
+    UserImage ui;
+    if (!build_user_image(fname_buf, argc, arg_kptrs, env, env_len, &ui)) {
+        klog("[SPAWN] Failed to load '%s'\n", fname_buf);
+        free_fd_table(fdt);
+        if (env_copy) vmm.kfree(env_copy);
+        return 0xFFFFFFFF;
+    }
+
+    pt::uint32_t child_id = start_user_image(fname_buf, ui, env, env_len);
+    if (env_copy) vmm.kfree(env_copy);
+    if (child_id == 0xFFFFFFFF) {
+        free_fd_table(fdt);
+        return 0xFFFFFFFF;
+    }
+
+    Task* child = find_task(child_id);
+    release_fd_table(child);
+    child->fd_table  = fdt;
+    child->parent_id = parent->id;
+    child->vterm_id  = parent->vterm_id;
+    child->state     = TASK_READY;
+
+    klog("[SPAWN] Task %d spawned '%s' as child %d\n", parent->id, fname_buf, child_id);
+    return child_id;
+}
+
+// ─── vfork_task ───────────────────────────────────────────────────────────────
+//
+// Like fork_task, but the child borrows the parent's PML4 and user memory
+// instead of copying them: it is set up like a thread (owns_page_tables
+// false) with its own copy of the fd table.  The parent blocks here until
+// the child's exec_task gives it a fresh PML4 or the child exits, so the
+// two never run on the same user stack at once.
+//
+pt::uint32_t TaskScheduler::vfork_task(pt::uintptr_t syscall_frame_rsp)
+{
+    Task* parent = get_current_task();
+    if (!parent || !parent->user_mode) {
+        klog("[VFORK] vfork from non-user task not supported\n");
+        return (pt::uint32_t)-1;
+    }
+
+    Task* child = alloc_slot();
+    if (!child) {
+        klog("[VFORK] No free task slot\n");
+        return (pt::uint32_t)-1;
+    }
+    pt::uint32_t child_id = child->id;
+
+    void* child_kstack_mem = vmm.kmalloc(TASK_STACK_SIZE);
+    if (!child_kstack_mem) {
+        klog("[VFORK] Failed to allocate child kernel stack\n");
+        child->state = TASK_DEAD;
+        return (pt::uint32_t)-1;
+    }
+
+    // Same 160-byte PUSHALL+iretq frame as the parent, returning 0.
+    pt::uint8_t* child_kstack_top =
+        (pt::uint8_t*)child_kstack_mem + TASK_STACK_SIZE - 160;
+    memcpy(child_kstack_top, (void*)syscall_frame_rsp, 160);
+    reinterpret_cast<pt::uint64_t*>(child_kstack_top)[14] = 0;
+
+    Task* owner = address_space_owner(parent);
+    child->kernel_stack_base = (pt::uintptr_t)child_kstack_mem;
+    child->kernel_stack_size = TASK_STACK_SIZE;
+    child->ticks_alive       = 0;
+    child->preempt_rsp       = (pt::uintptr_t)child_kstack_top;
+    child->cr3               = parent->cr3;       // borrowed until exec/exit
+    child->owns_page_tables  = false;
+    child->user_mode         = true;
+    child->user_stack_base   = 0;
+    child->user_pdpt         = owner->user_pdpt;
+    child->user_image_end    = owner->user_image_end;
+    child->user_heap_top     = 0;  // heap is tracked by the owning process
+    child->parent_id         = parent->id;
+    child->waiting_for       = 0xFFFFFFFF;
+    child->join_tid          = INVALID_TID;
+    child->thread_result     = nullptr;
+    child->exit_code         = 0;
+    child->vfork_parent      = parent->id;
+    child->sleep_deadline    = 0;
+    child->syscall_frame_rsp = 0;
+    child->window_id         = INVALID_WID;
+    child->owns_window       = false;
+    child->vterm_id          = parent->vterm_id;
+    child->priority          = parent->priority;
+    child->remaining_ticks   = SCHEDULER_QUANTUM;
+    child->fs_base           = parent->fs_base;
+    memcpy(child->fxsave_area, parent->fxsave_area, 512);
+    memcpy(child->name, parent->name, sizeof(child->name));
+    set_task_env(child, parent->env_buf, parent->env_buf_len);
+    child->fd_table    = copy_fd_table(parent->fd_table);
+
+    task_count++;
+    child->state = TASK_READY;
+    klog("[VFORK] Task %d -> child %d (shared address space)\n", parent->id, child_id);
+
+    // Sleep until exec_task hands the address space back or the child dies;
+    // both paths wake us through waiting_for (see waitpid_task).
+    while (child->state != TASK_DEAD && child->vfork_parent == parent->id) {
+        parent->waiting_for = child_id;
+        parent->state       = TASK_BLOCKED;
+        asm volatile("int 0x81");
+    }
+
+    return child_id;
+}
+
 // ─── exec_task ────────────────────────────────────────────────────────────────
 //
 // Replace the current task's ELF image with a new file.
-// Does NOT allocate a new task slot, kernel stack, or user stack.
+// Keeps the task slot and kernel stack; the user address space (image, heap
+// and stack) is rebuilt from scratch.
 // The existing iretq frame on the kernel stack (pointed to by syscall_frame_rsp)
 // is patched in-place so that _syscall_stub's POPALL+iretq jumps to the new
 // entry point with a fresh user RSP.
@@ -1378,10 +1966,8 @@ pt::uint64_t TaskScheduler::exec_task(const char* filename,
                                       int argc,
                                       const char* const* argv)
 {
-    // 'filename' is a pointer into the calling task's private ELF code region
-    // (VA 0xFFFF800018000xxx, e.g. .rodata).  We must copy it to the kernel
-    // stack BEFORE switching CR3, because under kernel_cr3 that VA maps to the
-    // boot staging area, not the task's private frames.
+    // 'filename' and argv point into the calling image (e.g. its .rodata or
+    // stack), which is torn down below.  Copy them to the kernel stack first.
     char fname_buf[64];
     {
         int i = 0;
@@ -1389,7 +1975,6 @@ pt::uint64_t TaskScheduler::exec_task(const char* filename,
         fname_buf[i] = '\0';
     }
 
-    // Copy argv strings to kernel stack before CR3 switch.
     const int ARGV_MAX_LOCAL = 16, ARG_MAX_LOCAL = 128;
     char arg_flat[ARGV_MAX_LOCAL * ARG_MAX_LOCAL];
     const char* arg_kptrs[ARGV_MAX_LOCAL];
@@ -1409,232 +1994,66 @@ pt::uint64_t TaskScheduler::exec_task(const char* filename,
     Task* current = get_current_task();
     klog("[EXEC] Task %d: exec '%s'\n", current->id, fname_buf);
 
-    // 1. Load ELF into the staging area.
-    //
-    // Switch to boot PML4 so VA 0xFFFF800018000000 maps to the physical staging
-    // area (phys 0x18000000) rather than this task's private code frames.
-    // Kernel heap and code remain accessible (they're in separate PD entries).
-    // We pass fname_buf (kernel stack) instead of filename (ELF rodata).
-    asm volatile("mov cr3, %0" : : "r"(kernel_cr3) : "memory");
-
-    pt::size_t code_size = 0;
-    pt::uintptr_t entry = ElfLoader::load(fname_buf, &code_size);
-    if (entry == 0) {
+    // 1. Build the new address space (segments, stack, argv/envp) next to the
+    //    old one.  The old image stays intact until this succeeds, so a failed
+    //    exec returns -1 to a still-working caller.
+    UserImage ui;
+    if (!build_user_image(fname_buf, real_argc, arg_kptrs,
+                          current->env_buf, current->env_buf_len, &ui)) {
         klog("[EXEC] Failed to load '%s'\n", fname_buf);
-        // Restore task CR3 before returning.
-        asm volatile("mov cr3, %0" : : "r"(current->cr3) : "memory");
         return (pt::uint64_t)-1;
     }
 #ifdef FORK_DEBUG
-    klog("[EXEC_DEBUG] Loaded '%s': entry=%lx code_size=%u\n",
-         fname_buf, entry, (unsigned)code_size);
+    klog("[EXEC_DEBUG] Loaded '%s': entry=%lx image_pages=%u\n",
+         fname_buf, ui.entry, (unsigned)ui.image_pages);
 #endif
 
-    pt::size_t num_frames = (code_size + 4095) / 4096;
-    if (num_frames > MAX_ELF_PAGES) {
-        klog("[EXEC] ELF too large (%d pages, max %d)\n", (int)num_frames, (int)MAX_ELF_PAGES);
-        asm volatile("mov cr3, %0" : : "r"(current->cr3) : "memory");
-        return (pt::uint64_t)-1;
-    }
-    pt::size_t num_pts = (num_frames + 511) / 512;
-    if (num_pts == 0) num_pts = 1;
-
-    // 2. Allocate fresh user_pdpt, user_pd, code PT frames, and stack PT.
-    //    (Under kernel_cr3: identity map active, direct PA access OK.)
-    pt::uintptr_t new_user_pdpt_frame = vmm.allocate_frame();
-    pt::uintptr_t new_user_pd_frame   = vmm.allocate_frame();
-    pt::uint64_t* new_user_pdpt = reinterpret_cast<pt::uint64_t*>(new_user_pdpt_frame);
-    pt::uint64_t* new_user_pd   = reinterpret_cast<pt::uint64_t*>(new_user_pd_frame);
-
-    // Populate with boot identity-map (U/S cleared → kernel-only) so ring-0
-    // interrupt handlers can access device MMIO under this task's CR3.
-    pt::uint64_t* boot_pml4x  = reinterpret_cast<pt::uint64_t*>(kernel_cr3);
-    pt::uintptr_t boot_pdpt_pax = boot_pml4x[0] & ~(pt::uintptr_t)0xFFF;
-    pt::uint64_t* boot_pdptx  = reinterpret_cast<pt::uint64_t*>(boot_pdpt_pax);
-    pt::uintptr_t boot_pd_pax  = boot_pdptx[0] & ~(pt::uintptr_t)0xFFF;
-    pt::uint64_t* boot_pdx    = reinterpret_cast<pt::uint64_t*>(boot_pd_pax);
-
-    memset(new_user_pdpt, 0, 4096);
-    for (int i = 1; i < 4; i++)
-        new_user_pdpt[i] = boot_pdptx[i] & ~(pt::uint64_t)0x04;
-    for (int i = 0; i < 512; i++)
-        new_user_pd[i] = boot_pdx[i] & ~(pt::uint64_t)0x04;
-
-    pt::uintptr_t new_pt_frames[Task::MAX_PRIV_PTS];
-    for (pt::size_t k = 0; k < num_pts; k++) {
-        new_pt_frames[k] = vmm.allocate_frame();
-        memset(reinterpret_cast<void*>(new_pt_frames[k]), 0, 4096);
-    }
-
-    // 3. Copy ELF frames from staging; populate code PTs with W^X permissions.
-    for (pt::size_t i = 0; i < num_frames; i++) {
-        pt::uintptr_t frame = vmm.allocate_frame();
-        memcpy(reinterpret_cast<void*>(frame),
-               reinterpret_cast<void*>(ELF_STAGING_VA + i * 4096),
-               4096);
-        pt::uint8_t pflags = ElfLoader::page_flags[i];
-        pt::uint64_t pte = frame | 0x05;  // Present + User
-        if (pflags & PF_W) pte |= 0x02;
-        if (!(pflags & PF_X)) pte |= PTE_NX;
-        pt::uint64_t* new_pt = reinterpret_cast<pt::uint64_t*>(new_pt_frames[i / 512]);
-        new_pt[i % 512] = pte;
-    }
-    for (pt::size_t k = 0; k < num_pts; k++)
-        new_user_pd[USER_CODE_PD_IDX + k] = new_pt_frames[k] | 0x07;
-
-    // 4. Allocate stack PT and stack frames; wire into new_user_pd[USER_STACK_PD_IDX].
-    pt::uintptr_t new_stack_pt_frame = vmm.allocate_frame();
-    pt::uint64_t* new_stack_pt = reinterpret_cast<pt::uint64_t*>(new_stack_pt_frame);
-    memset(new_stack_pt, 0, 4096);
-    for (pt::size_t i = 0; i < USER_STACK_PAGES; i++) {
-        pt::uintptr_t frame = vmm.allocate_frame();
-        memset(reinterpret_cast<void*>(frame), 0, 4096);
-        new_stack_pt[i] = frame | 0x07 | PTE_NX;  // RW + User + No-Execute
-    }
-    new_user_pd[USER_STACK_PD_IDX] = new_stack_pt_frame | 0x07;
-
-    // 5. Wire user_pdpt[0] → user_pd.
-    new_user_pdpt[USER_PDPT_IDX] = new_user_pd_frame | 0x07;
-
-    // 6. Free old user page tables (code, stack, heap, user_pd, user_pdpt).
-    //    Still under kernel_cr3 — direct PA access OK.
-    free_user_pagetables(current);
-
-    // 7. Install new page tables in task struct and PML4.
-    current->user_pdpt    = new_user_pdpt_frame;
-    current->user_pd      = new_user_pd_frame;
-    current->stack_pt     = new_stack_pt_frame;
-    current->user_heap_top = USER_HEAP_BASE;
-    current->num_priv_pts = num_pts;
-    for (pt::size_t k = 0; k < num_pts; k++) current->priv_pt[k] = new_pt_frames[k];
-    for (pt::size_t k = num_pts; k < Task::MAX_PRIV_PTS; k++) current->priv_pt[k] = 0;
-
-    pt::uint64_t* current_pml4 = reinterpret_cast<pt::uint64_t*>(current->cr3);
-    current_pml4[USER_PML4_IDX] = new_user_pdpt_frame | 0x07;
-    current_pml4[ELF_PML4_IDX] &= ~(pt::uint64_t)0x04;  // clear U bit on kernel half
-
-    // 8. Build initial user RSP with argv + envp layout.
-    //    Stack frames are at physical addresses under kernel_cr3 — direct PA access OK.
-    //    For user VA `va` in [USER_STACK_BOT, USER_STACK_TOP):
-    //      pt_idx = (va - USER_STACK_BOT) >> 12
-    //      byte ptr = (new_stack_pt[pt_idx] & ~0xFFF) + (va & 0xFFF)
-    // Layout (high→low):
-    //   [string data: argv strings + env strings]
-    //   [alignment]
-    //   [NULL]  ← envp sentinel
-    //   [envp[0..m-1]]
-    //   [NULL]  ← argv sentinel
-    //   [argv[0..n-1]]
-    //   [argc]  ← final RSP
-    pt::uint64_t new_user_rsp = USER_STACK_TOP - 16;
-
-    // Helper lambda: write a byte at user VA via physical address.
-    auto write_byte = [&](pt::uint64_t va, pt::uint8_t b) {
-        pt::size_t pt_idx = (va - USER_STACK_BOT) >> 12;
-        pt::uintptr_t pa = (new_stack_pt[pt_idx] & PTE_ADDR_MASK) + (va & 0xFFF);
-        *reinterpret_cast<pt::uint8_t*>(pa) = b;
-    };
-    auto write_qword = [&](pt::uint64_t va, pt::uint64_t val) {
-        pt::size_t pt_idx = (va - USER_STACK_BOT) >> 12;
-        pt::uintptr_t pa = (new_stack_pt[pt_idx] & PTE_ADDR_MASK) + (va & 0xFFF);
-        *reinterpret_cast<pt::uint64_t*>(pa) = val;
-    };
-
-    {
-        pt::uint64_t rsp = USER_STACK_TOP;
-
-        // Count env strings from current task's env_buf (flat "K=V\0K=V\0\0").
-        const int ENV_MAX = 16;
-        const char* env_strs[ENV_MAX];
-        int envc = 0;
-        {
-            const char* p = current->env_buf;
-            const char* end = current->env_buf + current->env_buf_len;
-            while (p < end && *p && envc < ENV_MAX) {
-                env_strs[envc++] = p;
-                while (p < end && *p) p++;
-                p++;  // skip NUL
-            }
-        }
-
-        // Write env string data downward, record user-space pointers.
-        pt::uint64_t uenv_ptrs[ENV_MAX];
-        for (int i = envc - 1; i >= 0; i--) {
-            const char* s = env_strs[i];
-            int len = 0; while (s[len]) len++;
-            len++;
-            rsp -= (pt::uint64_t)len;
-            if (rsp < USER_STACK_BOT) { rsp += (pt::uint64_t)len; break; }
-            for (int j = 0; j < len; j++)
-                write_byte(rsp + (pt::uint64_t)j, (pt::uint8_t)s[j]);
-            uenv_ptrs[i] = rsp;
-        }
-
-        // Write argv string data downward, record user-space pointers.
-        pt::uint64_t uarg_ptrs[ARGV_MAX_LOCAL];
-        for (int i = real_argc - 1; i >= 0; i--) {
-            const char* s = arg_kptrs[i];
-            int len = 0; while (s[len]) len++;
-            len++;
-            rsp -= (pt::uint64_t)len;
-            if (rsp < USER_STACK_BOT) { rsp += (pt::uint64_t)len; break; }
-            for (int j = 0; j < len; j++)
-                write_byte(rsp + (pt::uint64_t)j, (pt::uint8_t)s[j]);
-            uarg_ptrs[i] = rsp;
-        }
-
-        // Align rsp down to 8 bytes.
-        rsp &= ~(pt::uint64_t)7;
-
-        // Total qwords to push: 1(argc) + real_argc + 1(NULL) + envc + 1(NULL)
-        {
-            pt::uint64_t total_qw = (pt::uint64_t)(real_argc + envc + 3);
-            pt::uint64_t final_rsp = rsp - total_qw * 8;
-            if (final_rsp & 0xF)
-                rsp -= 8;
-        }
-
-        // Write envp NULL sentinel.
-        rsp -= 8;
-        if (rsp >= USER_STACK_BOT) write_qword(rsp, 0);
-
-        // Write envp pointer array (reverse order).
-        for (int i = envc - 1; i >= 0; i--) {
-            rsp -= 8;
-            if (rsp < USER_STACK_BOT) { rsp += 8; break; }
-            write_qword(rsp, uenv_ptrs[i]);
-        }
-
-        // Write argv NULL sentinel.
-        rsp -= 8;
-        if (rsp >= USER_STACK_BOT) write_qword(rsp, 0);
-
-        // Write argv pointer array (reverse order).
-        for (int i = real_argc - 1; i >= 0; i--) {
-            rsp -= 8;
-            if (rsp < USER_STACK_BOT) { rsp += 8; break; }
-            write_qword(rsp, uarg_ptrs[i]);
-        }
+    // A vfork child is still running on its parent's PML4 and user space:
+    // give it a PML4 of its own before installing the new image.
+    bool vforked = current->vfork_parent != 0xFFFFFFFF;
+    if (vforked) {
+        pt::uintptr_t pml4_frame = vmm.allocate_frame();
+        memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + pml4_frame),
+               reinterpret_cast<void*>(KERNEL_OFFSET + kernel_cr3), 4096);
+        current->cr3              = pml4_frame;
+        current->owns_page_tables = true;
+    }
+
+    // 2. Install the new user PDPT and reload CR3 to flush stale user TLB
+    //    entries, then free the old address space (no longer reachable).
+    pt::uintptr_t old_pdpt = current->user_pdpt;
+    current->user_pdpt      = ui.pdpt;
+    current->user_image_end = ui.image_end;
+    current->user_heap_top  = user_heap_base(ui.image_end);
+
+    pt::uint64_t* current_pml4 = pa_table(current->cr3);
+    current_pml4[USER_PML4_IDX] = ui.pdpt | 0x07;
+    current_pml4[KERNEL_PML4_IDX] &= ~(pt::uint64_t)0x04;  // clear U bit on kernel half
+    asm volatile("mov cr3, %0" : : "r"(current->cr3) : "memory");
 
-        // Write argc qword.
-        rsp -= 8;
-        if (rsp >= USER_STACK_BOT) {
-            write_qword(rsp, (pt::uint64_t)real_argc);
-            new_user_rsp = rsp;
+    if (vforked) {
+        // The old space is the parent's; hand it back and let it run.
+        Task* parent = find_task(current->vfork_parent);
+        current->vfork_parent = 0xFFFFFFFF;
+        if (parent && parent->state == TASK_BLOCKED &&
+            parent->waiting_for == current->id) {
+            parent->waiting_for = 0xFFFFFFFF;
+            parent->state       = TASK_READY;
         }
+    } else {
+        free_user_space(old_pdpt);
     }
 
-    // 9. Reset FPU/SSE state for the new program (clean slate, not inherited
+    // 3. Reset FPU/SSE state for the new program (clean slate, not inherited
     //    from the pre-exec image which may have changed rounding mode etc.).
     memcpy(current->fxsave_area, default_fxsave, 512);
 
-    // 10. Patch the live iretq frame in-place.
+    // 4. Patch the live iretq frame in-place.
     pt::uint64_t* frame = reinterpret_cast<pt::uint64_t*>(syscall_frame_rsp);
-    frame[15] = entry;        // [+120] = new RIP
-    frame[18] = new_user_rsp; // [+144] = new user RSP
+    frame[15] = ui.entry;     // [+120] = new RIP
+    frame[18] = ui.user_rsp;  // [+144] = new user RSP
 
-    // 11. Switch back to task CR3 (now wired to new user address space) and flush TLB.
-    // Update task name to the new binary (basename only).
+    // 5. Update task name to the new binary (basename only).
     {
         const char* base = fname_buf;
         for (const char* p = fname_buf; *p; p++)
@@ -1645,11 +2064,10 @@ pt::uint64_t TaskScheduler::exec_task(const char* filename,
         current->name[i] = '\0';
     }
 
-    // 12. Flush stale keyboard events so the new program starts clean.
+    // 6. Flush stale keyboard events so the new program starts clean.
     flush_key_events();
 
-    klog("[EXEC] Task %d: iretq -> %lx rsp=%lx\n", current->id, entry, new_user_rsp);
-    asm volatile("mov cr3, %0" : : "r"(current->cr3) : "memory");
+    klog("[EXEC] Task %d: iretq -> %lx rsp=%lx\n", current->id, ui.entry, ui.user_rsp);
 
     return 0;
 }
@@ -1663,12 +2081,12 @@ pt::uint64_t TaskScheduler::exec_task(const char* filename,
 pt::uint64_t TaskScheduler::waitpid_task(pt::uint32_t child_id,
                                          int* out_exit_code)
 {
-    if (child_id >= MAX_TASKS) {
+    // Dead tasks stay findable by PID until their slot is reused.
+    Task* child = find_task(child_id);
+    if (!child) {
         klog("[WAITPID] Invalid child_id %u\n", child_id);
         return (pt::uint64_t)-1;
     }
-
-    Task* child  = &tasks[child_id];
     Task* parent = get_current_task();
 
     // Validate child belongs to this parent (skip check for task 0 kernel tasks).
@@ -1690,7 +2108,7 @@ pt::uint64_t TaskScheduler::waitpid_task(pt::uint32_t child_id,
     // of the child sets our state back to TASK_READY.
     // When the scheduler picks us up again, iretq returns right here (the
     // instruction after "int 0x81") so the loop re-checks the child state.
-    while (child->state != TASK_DEAD) {
+    while (child->state != TASK_DEAD && child->id == child_id) {
         parent->waiting_for = child_id;
         parent->state       = TASK_BLOCKED;
         asm volatile("int 0x81");
@@ -1707,55 +2125,175 @@ pt::uint64_t TaskScheduler::waitpid_task(pt::uint32_t child_id,
 
 // ─── map_user_pages ────────────────────────────────────────────────────────────
 //
-// Map [va, va+size) into the task's user address space by allocating physical
-// frames and inserting them into the per-task user_pd hierarchy.
+// Map [va, va+size) into the task's user address space by allocating zeroed
+// physical frames (RW + User + NX).  Missing PD/PT levels are created on
+// demand by user_pte(); pages already present are left untouched.
 //
 // Called from SYS_MMAP with the task's CR3 active.  Physical frames are NOT
 // in the user's identity range, so all PT accesses use KERNEL_OFFSET + PA.
+// The tables are walked (and built) for the whole range first, so a range
+// that user_pte() refuses part-way fails before any frame is mapped.
 //
-void TaskScheduler::map_user_pages(Task* t, pt::uintptr_t va, pt::size_t size)
+bool TaskScheduler::map_user_pages(Task* t, pt::uintptr_t va, pt::uint64_t size)
 {
-    if (!t->user_pd) return;
-    pt::uint64_t* upd = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + t->user_pd);
+    if (!t->user_pdpt || va + size < va) return false;
 
     for (pt::uintptr_t addr = va; addr < va + size; addr += 4096) {
-        pt::size_t pd_idx = (addr >> 21) & 0x1FF;
-        pt::size_t pt_idx = (addr >> 12) & 0x1FF;
-
-        // Allocate a new heap PT frame if this PD entry is empty or a 2MB huge page
-        // (boot identity entry that must be replaced with a 4KB PT for heap use).
-        if (!(upd[pd_idx] & 0x01) || (upd[pd_idx] & 0x80)) {
-            pt::uintptr_t pt_frame = vmm.allocate_frame();
-            pt::uint64_t* new_pt = reinterpret_cast<pt::uint64_t*>(
-                KERNEL_OFFSET + pt_frame);
-            memset(new_pt, 0, 4096);
-            upd[pd_idx] = pt_frame | 0x07;
+        if (!user_pte(t->user_pdpt, addr, true)) return false;
+    }
+    for (pt::uintptr_t addr = va; addr < va + size; addr += 4096) {
+        pt::uint64_t* pte = user_pte(t->user_pdpt, addr, false);
+        if (!(*pte & 0x01)) {
+            *pte = alloc_zeroed_frame() | 0x07 | PTE_NX;  // RW + User + No-Execute
+            asm volatile("invlpg [%0]" : : "r"(addr) : "memory");
         }
+    }
+    return true;
+}
 
-        pt::uintptr_t pt_pa = upd[pd_idx] & PTE_ADDR_MASK;
-        pt::uint64_t* hpt = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + pt_pa);
-        if (!(hpt[pt_idx] & 0x01)) {
-            pt::uintptr_t frame = vmm.allocate_frame();
-            pt::uint64_t* fp = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + frame);
-            memset(fp, 0, 4096);
-            hpt[pt_idx] = frame | 0x07 | PTE_NX;  // RW + User + No-Execute
-            asm volatile("invlpg [%0]" : : "r"(addr) : "memory");
+Task* TaskScheduler::address_space_owner(Task* t)
+{
+    if (t->owns_page_tables) return t;
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        Task& o = *tasks[i];
+        if (o.state != TASK_DEAD && o.owns_page_tables && o.cr3 == t->cr3)
+            return &o;
+    }
+    return t;
+}
+
+// ─── alloc_user_heap ───────────────────────────────────────────────────────────
+//
+// Bump-allocate `size` bytes (page multiple) of user heap for t's process.
+// The heap grows up from the end of the ELF image to USER_STACK_BOT; once
+// that is exhausted it continues at USER_HIGH_BASE, above the kernel-only
+// identity window, up to USER_VA_TOP.
+//
+// Where the next `size` bytes of heap VA go, or 0 if the span is exhausted.
+static pt::uintptr_t next_heap_va(const Task* owner, pt::uint64_t size)
+{
+    pt::uintptr_t va = owner->user_heap_top;
+    if (va < TaskScheduler::USER_STACK_BOT && size > TaskScheduler::USER_STACK_BOT - va)
+        va = TaskScheduler::USER_HIGH_BASE;
+    if (va >= TaskScheduler::USER_VA_TOP || size > TaskScheduler::USER_VA_TOP - va)
+        return 0;
+    return va;
+}
+
+pt::uintptr_t TaskScheduler::alloc_user_heap(Task* t, pt::uint64_t size)
+{
+    Task* owner = address_space_owner(t);
+    if (!owner->user_pdpt || size == 0) return 0;
+
+    pt::uintptr_t va = next_heap_va(owner, size);
+    if (!va) return 0;
+
+    // Refuse rather than panic in allocate_frame() when RAM cannot back the
+    // request (plus one PT per 2 MB for the tables themselves).
+    pt::uint64_t need = size + ((size >> 21) + 2) * 4096;
+    if (need > vmm.get_free_mem())
+        return 0;
+
+    if (!map_user_pages(owner, va, size))
+        return 0;
+    owner->user_heap_top = va + size;
+    return va;
+}
+
+// ─── unmap_user_pages ──────────────────────────────────────────────────────────
+//
+// Release heap pages [va, va+size) of t's process.  Page tables stay in place
+// (they are reused by later mappings and freed with the address space).
+//
+int TaskScheduler::unmap_user_pages(Task* t, pt::uintptr_t va, pt::uint64_t size)
+{
+    Task* owner = address_space_owner(t);
+    if (!owner->user_pdpt || size == 0) return -1;
+    if (va < owner->user_image_end || va + size < va) return -1;
+    if (va < USER_STACK_TOP && va + size > USER_STACK_BOT) return -1;
+
+    for (pt::uintptr_t addr = va; addr < va + size; addr += 4096) {
+        pt::uint64_t* pte = user_pte(owner->user_pdpt, addr, false);
+        if (!pte || !(*pte & 0x01)) continue;
+        if (!(*pte & PTE_BORROWED))
+            vmm.free_frame(*pte & PTE_ADDR_MASK);
+        *pte = 0;
+        asm volatile("invlpg [%0]" : : "r"(addr) : "memory");
+    }
+    return 0;
+}
+
+// ─── map_borrowed_pages ────────────────────────────────────────────────────────
+//
+// Map the physically contiguous kernel pages [phys, phys+size) into t's
+// process at a fresh heap VA, user read/write and no-execute.  The frames
+// stay owned by the kernel: nothing that unmaps the range frees them.
+//
+pt::uintptr_t TaskScheduler::map_borrowed_pages(Task* t, pt::uintptr_t phys, pt::size_t size)
+{
+    Task* owner = address_space_owner(t);
+    if (!owner->user_pdpt || size == 0 || ((phys | size) & 0xFFF)) return 0;
+
+    pt::uintptr_t va = next_heap_va(owner, size);
+    if (!va) return 0;
+    for (pt::size_t off = 0; off < size; off += 4096) {
+        pt::uint64_t* pte = user_pte(owner->user_pdpt, va + off, true);
+        if (!pte) {
+            unmap_borrowed_pages(owner->user_pdpt, va, off);
+            return 0;
+        }
+        *pte = (phys + off) | 0x07 | PTE_NX | PTE_BORROWED;
+        asm volatile("invlpg [%0]" : : "r"(va + off) : "memory");
+    }
+    owner->user_heap_top = va + size;
+    return va;
+}
+
+void TaskScheduler::unmap_borrowed_pages(pt::uintptr_t pdpt_pa, pt::uintptr_t va, pt::size_t size)
+{
+    for (pt::uintptr_t addr = va; addr < va + size; addr += 4096) {
+        pt::uint64_t* pte = user_pte(pdpt_pa, addr, false);
+        if (!pte || !(*pte & PTE_BORROWED)) continue;
+        *pte = 0;
+        asm volatile("invlpg [%0]" : : "r"(addr) : "memory");
+    }
+}
+
+void TaskScheduler::count_user_pages(Task* t, pt::size_t* shared, pt::size_t* priv)
+{
+    *shared = *priv = 0;
+    Task* owner = address_space_owner(t);
+    if (!owner->user_pdpt) return;
+
+    pt::uint64_t* pdpt = pa_table(owner->user_pdpt);
+    for (pt::size_t i = 0; i < 512; i++) {
+        if (is_kernel_pdpt_slot(i) || !(pdpt[i] & 0x01)) continue;
+        pt::uint64_t* pd = pa_table(pdpt[i] & PTE_ADDR_MASK);
+        for (pt::size_t j = 0; j < 512; j++) {
+            if (!(pd[j] & 0x01) || (pd[j] & 0x80)) continue;
+            pt::uint64_t* pt = pa_table(pd[j] & PTE_ADDR_MASK);
+            for (pt::size_t k = 0; k < 512; k++) {
+                if (!(pt[k] & 0x01) || (pt[k] & PTE_BORROWED)) continue;
+                if (pt[k] & PTE_SHARED) (*shared)++;
+                else                    (*priv)++;
+            }
         }
     }
 }
 
 // ─── dump_task_map ─────────────────────────────────────────────────────────────
 //
-// Print a compact memory map of a task's user address space to klog.
-// Walks user_pd entries and prints each mapped region with page counts.
+// Print a compact memory map of a task's user address space.
+// Walks the user page tables and prints each run of mapped pages, labelled
+// image / heap / stack by address.
 //
 void TaskScheduler::dump_task_map(pt::uint32_t task_id)
 {
-    if (task_id >= MAX_TASKS) {
+    Task* t = find_task(task_id);
+    if (!t) {
         vterm_printf("[MAP] invalid task id %d\n", (int)task_id);
         return;
     }
-    Task* t = &tasks[task_id];
     if (t->state == TASK_DEAD) {
         vterm_printf("[MAP] task %d is dead\n", (int)task_id);
         return;
@@ -1766,80 +2304,62 @@ void TaskScheduler::dump_task_map(pt::uint32_t task_id)
     vterm_printf("  state=%d user=%d cr3=%lx\n",
          (int)t->state, (int)t->user_mode, t->cr3);
 
-    if (!t->user_pd) {
+    if (!t->user_pdpt) {
         vterm_printf("  (kernel task — no user page tables)\n");
         return;
     }
 
-    vterm_printf("  user_pdpt=%lx  user_pd=%lx  stack_pt=%lx\n",
-         t->user_pdpt, t->user_pd, t->stack_pt);
-    vterm_printf("  heap_top=%lx  num_code_pts=%d\n",
-         t->user_heap_top, (int)t->num_priv_pts);
+    Task* owner = address_space_owner(t);
+    vterm_printf("  user_pdpt=%lx  image_end=%lx  heap_top=%lx\n",
+         t->user_pdpt, owner->user_image_end, owner->user_heap_top);
 
-    pt::uint64_t* upd = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + t->user_pd);
-
-    // Walk PD entries, coalescing contiguous regions of the same type.
+    // Walk every user page, coalescing runs of contiguous pages with the
+    // same label.
     pt::uintptr_t region_start = 0;
-    int region_pages = 0;
+    pt::uintptr_t region_end   = 0;
     const char* region_label = nullptr;
 
-    for (int pd_i = 0; pd_i < 512; pd_i++) {
-        if (!(upd[pd_i] & 0x01) || (upd[pd_i] & 0x80)) {
-            // Not present or 2MB huge page (boot identity) — flush region.
-            if (region_pages > 0) {
-                vterm_printf("  %lx-%lx  %dK  %s\n", region_start,
-                     region_start + (pt::uintptr_t)region_pages * 4096,
-                     region_pages * 4, region_label);
-                region_pages = 0;
-            }
-            continue;
-        }
-
-        // 4KB PT — count present entries.
-        pt::uintptr_t pt_pa = upd[pd_i] & PTE_ADDR_MASK;
-        pt::uint64_t* pt = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + pt_pa);
-        int count = 0;
-        for (int j = 0; j < 512; j++) {
-            if (pt[j] & 0x01) count++;
-        }
-        if (count == 0) {
-            if (region_pages > 0) {
-                vterm_printf("  %lx-%lx  %dK  %s\n", region_start,
-                     region_start + (pt::uintptr_t)region_pages * 4096,
-                     region_pages * 4, region_label);
-                region_pages = 0;
-            }
-            continue;
+    auto flush = [&]() {
+        if (region_end > region_start) {
+            vterm_printf("  %lx-%lx  %dK  %s\n", region_start, region_end,
+                 (int)((region_end - region_start) / 1024), region_label);
         }
+        region_start = region_end = 0;
+    };
 
-        const char* label;
-        if (pd_i == (int)USER_STACK_PD_IDX)
-            label = "stack";
-        else if (pd_i >= (int)USER_CODE_PD_IDX &&
-                 pd_i <  (int)USER_CODE_PD_IDX + (int)t->num_priv_pts)
-            label = "code";
-        else
-            label = "heap";
-
-        // Extend current region if same label, otherwise flush and start new.
-        if (region_label == label && region_pages > 0) {
-            region_pages += count;
-        } else {
-            if (region_pages > 0) {
-                vterm_printf("  %lx-%lx  %dK  %s\n", region_start,
-                     region_start + (pt::uintptr_t)region_pages * 4096,
-                     region_pages * 4, region_label);
+    pt::uint64_t* pdpt = pa_table(t->user_pdpt);
+    for (pt::size_t i = 0; i < 512; i++) {
+        if (is_kernel_pdpt_slot(i) || !(pdpt[i] & 0x01)) continue;
+        pt::uint64_t* pd = pa_table(pdpt[i] & PTE_ADDR_MASK);
+        for (pt::size_t j = 0; j < 512; j++) {
+            // Not present or 2MB huge page (boot identity) — no user pages.
+            if (!(pd[j] & 0x01) || (pd[j] & 0x80)) continue;
+            pt::uint64_t* pt = pa_table(pd[j] & PTE_ADDR_MASK);
+            for (pt::size_t k = 0; k < 512; k++) {
+                if (!(pt[k] & 0x01)) continue;
+                pt::uintptr_t va = (i << 30) | (j << 21) | (k << 12);
+                const char* label;
+                if (va >= USER_STACK_BOT && va < USER_STACK_TOP)
+                    label = "stack";
+                else if (pt[k] & PTE_SHARED)
+                    label = "image (shared)";
+                else if (pt[k] & PTE_BORROWED)
+                    label = "surface";
+                else if (va < owner->user_image_end)
+                    label = "image";
+                else
+                    label = "heap";
+
+                if (va != region_end || label != region_label) {
+                    flush();
+                    region_start = va;
+                    region_label = label;
+                }
+                region_end = va + 4096;
             }
-            region_start = (pt::uintptr_t)pd_i << 21;
-            region_pages = count;
-            region_label = label;
         }
     }
-    if (region_pages > 0) {
-        vterm_printf("  %lx-%lx  %dK  %s\n", region_start,
-             region_start + (pt::uintptr_t)region_pages * 4096,
-             region_pages * 4, region_label);
-    }
+    flush();
 }
 
 // ─── mprotect_pages ───────────────────────────────────────────────────────────
@@ -1851,31 +2371,32 @@ void TaskScheduler::dump_task_map(pt::uint32_t task_id)
 int TaskScheduler::mprotect_pages(pt::uintptr_t va, pt::size_t size, int prot)
 {
     Task* t = get_current_task();
-    if (!t || !t->user_pd) return -1;
-
-    pt::uint64_t* upd = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + t->user_pd);
+    if (!t || !t->user_pdpt) return -1;
 
     for (pt::uintptr_t addr = va & ~(pt::uintptr_t)0xFFF;
          addr < va + size; addr += 4096) {
-        pt::size_t pd_idx = (addr >> 21) & 0x1FF;
-        pt::size_t pt_idx = (addr >> 12) & 0x1FF;
-
-        if (!(upd[pd_idx] & 0x01) || (upd[pd_idx] & 0x80))
-            continue;  // not mapped or boot huge page
-
-        pt::uintptr_t pt_pa = upd[pd_idx] & PTE_ADDR_MASK;
-        pt::uint64_t* pt = reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + pt_pa);
-
-        if (!(pt[pt_idx] & 0x01))
+        pt::uint64_t* pte = user_pte(t->user_pdpt, addr, false);
+        if (!pte || !(*pte & 0x01))
             continue;  // page not present
 
         // Preserve the physical frame address; rebuild permission flags.
-        pt::uintptr_t frame = pt[pt_idx] & PTE_ADDR_MASK;
-        pt::uint64_t new_pte = frame | 0x05;  // Present + User
+        pt::uintptr_t frame = *pte & PTE_ADDR_MASK;
+        pt::uint64_t  soft  = *pte & (PTE_SHARED | PTE_TEXT_IDX_MASK | PTE_BORROWED);
+        if ((prot & 2) && (soft & PTE_SHARED)) {
+            // Making a shared text page writable: give this process its
+            // own copy so the other mappings are unaffected.
+            pt::uintptr_t copy = vmm.allocate_frame();
+            memcpy(reinterpret_cast<void*>(KERNEL_OFFSET + copy),
+                   reinterpret_cast<void*>(KERNEL_OFFSET + frame), 4096);
+            TextCache::put_page(*pte);
+            frame = copy;
+            soft  = 0;
+        }
+        pt::uint64_t new_pte = frame | soft | 0x05;  // Present + User
         if (prot & 2) new_pte |= 0x02;        // Writable
         if (!(prot & 1)) new_pte |= PTE_NX;   // No-Execute
 
-        pt[pt_idx] = new_pte;
+        *pte = new_pte;
         asm volatile("invlpg [%0]" : : "r"(addr) : "memory");
     }
     return 0;
@@ -1885,9 +2406,6 @@ int TaskScheduler::mprotect_pages(pt::uintptr_t va, pt::size_t size, int prot)
 
 bool g_perf_recording = false;
 
-// Heap-allocated on first "perf record"; freed on "perf stop" after dump.
-SyscallPerfData* g_perf_data = nullptr;
-
 const char* const g_syscall_names[] = {
     "SYS_WRITE",          // 0
     "SYS_EXIT",           // 1
@@ -1942,21 +2460,50 @@ const char* const g_syscall_names[] = {
     "SYS_OPEN_RW",        // 50
     "SYS_AUDIO_OPEN",     // 51
     "SYS_AUDIO_CLOSE",    // 52
+    "SYS_UDP_OPEN",       // 53
+    "SYS_UDP_SENDTO",     // 54
+    "SYS_UDP_RECVFROM",   // 55
+    "SYS_THREAD_CREATE",  // 56
+    "SYS_THREAD_EXIT",    // 57
+    "SYS_FUTEX",          // 58
+    "SYS_THREAD_JOIN",    // 59
+    "SYS_SPAWN",          // 60
+    "SYS_VFORK",          // 61
+    "SYS_MAP_WINDOW_SURFACE", // 62
+    "SYS_COMMIT_WINDOW",  // 63
+    "SYS_SET_WINDOW_PALETTE", // 64
+    "SYS_SET_WINDOW_SOURCE",  // 65
+    "SYS_GET_WINDOW_EVENTS",  // 66
+    "SYS_CREATE_SWAPCHAIN",   // 67
+    "SYS_PRESENT",            // 68
+    "SYS_DRAW_BATCH",         // 69
+    "SYS_AUDIO_VOLUME",       // 70
+    "SYS_AUDIO_MAP_RING",     // 71
+    "SYS_AUDIO_RING_WAIT",    // 72
 };
 
 void TaskScheduler::wake_task(pt::uint32_t id)
 {
-    if (id >= MAX_TASKS) return;
-    if (tasks[id].state == TASK_BLOCKED)
-        tasks[id].state = TASK_READY;
+    Task* t = find_task(id);
+    if (t && t->state == TASK_BLOCKED) {
+        t->state = TASK_READY;
+        // Outranks whoever is running: switch at the next tick rather than
+        // when its quantum runs out.
+        if (t->priority < tasks[current_slot]->priority)
+            need_resched = true;
+    }
 }
 
+// Per-task counters are allocated by the syscall path on a task's first
+// recorded call; dropping them all starts a fresh recording.
 void TaskScheduler::perf_reset_counters()
 {
-    if (g_perf_data)
-        vmm.kfree(g_perf_data);
-    g_perf_data = static_cast<SyscallPerfData*>(
-        vmm.kcalloc(MAX_TASKS * sizeof(SyscallPerfData)));
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        if (tasks[i]->perf) {
+            vmm.kfree(tasks[i]->perf);
+            tasks[i]->perf = nullptr;
+        }
+    }
 }
 
 // Print str right-padded to width with spaces.
@@ -1991,14 +2538,12 @@ static void pad_num(pt::uint64_t val, int width) {
 
 void TaskScheduler::perf_dump()
 {
-    if (!g_perf_data) return;
-
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        Task& t = tasks[i];
-        if (t.state == TASK_DEAD && t.id == 0)
+    for (pt::uint32_t i = 0; i < task_capacity; i++) {
+        Task& t = *tasks[i];
+        if (!t.perf)
             continue;
 
-        SyscallPerfData& pd = g_perf_data[i];
+        SyscallPerfData& pd = *t.perf;
 
         // Check if this task has any recorded syscalls.
         pt::uint64_t total_calls = 0;
@@ -2048,8 +2593,7 @@ void TaskScheduler::perf_dump()
         }
     }
 
-    vmm.kfree(g_perf_data);
-    g_perf_data = nullptr;
+    perf_reset_counters();
 }
 
 // ─── create_thread_task ──────────────────────────────────────────────────────
@@ -2064,42 +2608,24 @@ pt::uint32_t TaskScheduler::create_thread_task(pt::uintptr_t entry,
                                                pt::uint64_t  arg,
                                                pt::uint64_t  tls_base)
 {
-    if (task_count >= MAX_TASKS) {
-        klog("[THREAD] Max tasks reached\n");
-        return 0xFFFFFFFF;
-    }
-
     Task* parent = get_current_task();
     if (!parent || !parent->user_mode) {
         klog("[THREAD] create_thread_task from non-user task not supported\n");
         return 0xFFFFFFFF;
     }
 
-    // Find a free slot.
-    Task* child = nullptr;
-    pt::uint32_t child_id = 0xFFFFFFFF;
-    for (pt::uint32_t i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_DEAD) {
-            child    = &tasks[i];
-            child_id = i;
-            break;
-        }
-    }
+    Task* child = alloc_slot();
     if (!child) {
         klog("[THREAD] No free task slot\n");
         return 0xFFFFFFFF;
     }
-
-    // Lazy cleanup of previous occupant's kernel stack.
-    if (child->kernel_stack_base != 0) {
-        vmm.kfree((void*)child->kernel_stack_base);
-        child->kernel_stack_base = 0;
-    }
+    pt::uint32_t child_id = child->id;
 
     // Allocate new kernel stack for the thread.
     void* kstack = vmm.kmalloc(TASK_STACK_SIZE);
     if (!kstack) {
         klog("[THREAD] Failed to allocate kernel stack\n");
+        child->state = TASK_DEAD;
         return 0xFFFFFFFF;
     }
 
@@ -2121,7 +2647,6 @@ pt::uint32_t TaskScheduler::create_thread_task(pt::uintptr_t entry,
     stack[8] = arg;
 
     // Populate child Task struct.
-    child->id                = child_id;
     child->state             = TASK_READY;
     child->kernel_stack_base = (pt::uintptr_t)kstack;
     child->kernel_stack_size = TASK_STACK_SIZE;
@@ -2132,17 +2657,14 @@ pt::uint32_t TaskScheduler::create_thread_task(pt::uintptr_t entry,
     child->user_mode         = true;
     child->user_stack_base   = 0;
     child->user_pdpt         = parent->user_pdpt;
-    child->user_pd           = parent->user_pd;
-    child->stack_pt          = parent->stack_pt;
-    child->user_heap_top     = parent->user_heap_top;
-    child->num_priv_pts      = parent->num_priv_pts;
-    for (pt::size_t k = 0; k < Task::MAX_PRIV_PTS; k++)
-        child->priv_pt[k] = parent->priv_pt[k];
+    child->user_image_end    = parent->user_image_end;
+    child->user_heap_top     = 0;  // heap is tracked by the owning process
     child->parent_id         = parent->id;
     child->waiting_for       = 0xFFFFFFFF;
     child->join_tid          = INVALID_TID;
     child->thread_result     = nullptr;
     child->exit_code         = 0;
+    child->vfork_parent      = 0xFFFFFFFF;
     child->sleep_deadline    = 0;
     child->syscall_frame_rsp = 0;
     child->window_id         = INVALID_WID;
@@ -2153,7 +2675,6 @@ pt::uint32_t TaskScheduler::create_thread_task(pt::uintptr_t entry,
     child->fs_base           = tls_base;
     memcpy(child->fxsave_area, parent->fxsave_area, 512);
     child->name[0] = '\0';  // threads don't carry their own display name
-    child->env_buf_len = 0;
 
     // Share parent's FdTable (refcount increment).
     child->fd_table = parent->fd_table;
@@ -2181,31 +2702,20 @@ void TaskScheduler::thread_exit_task(void* result)
     current->thread_result = result;
 
     // Decrement FdTable refcount.
-    if (current->fd_table) {
-        current->fd_table->refcount--;
-        if (current->fd_table->refcount == 0) {
-            for (pt::size_t i = 0; i < Task::MAX_FDS; i++)
-                close_fd(&current->fd_table->fds[i]);
-            vmm.kfree(current->fd_table);
-        }
-        current->fd_table = nullptr;
-    }
+    release_fd_table(current);
 
     // Do NOT free page tables — they are owned by the parent process.
     // Clear pointers so lazy cleanup in create_task() doesn't re-free them.
-    for (pt::size_t k = 0; k < Task::MAX_PRIV_PTS; k++) current->priv_pt[k] = 0;
-    current->num_priv_pts = 0;
-    current->stack_pt     = 0;
-    current->user_pd      = 0;
-    current->user_pdpt    = 0;
-    current->user_heap_top = 0;
-    current->cr3          = 0;  // prevent lazy PML4 free in create_task
+    current->user_pdpt      = 0;
+    current->user_image_end = 0;
+    current->user_heap_top  = 0;
+    current->cr3            = 0;  // prevent lazy PML4 free in create_task
 
     // Wake any thread blocked in thread_join_task() waiting on us.
-    if (current->join_tid != INVALID_TID &&
-        current->join_tid < MAX_TASKS) {
-        if (tasks[current->join_tid].state == TASK_BLOCKED) {
-            tasks[current->join_tid].state = TASK_READY;
+    if (current->join_tid != INVALID_TID) {
+        Task* joiner = find_task(current->join_tid);
+        if (joiner && joiner->state == TASK_BLOCKED) {
+            joiner->state = TASK_READY;
             klog("[THREAD] Woke joiner task %d\n", current->join_tid);
         }
     }
@@ -2225,9 +2735,8 @@ void TaskScheduler::thread_exit_task(void* result)
 //
 pt::uint64_t TaskScheduler::thread_join_task(pt::uint32_t tid)
 {
-    if (tid >= MAX_TASKS) return (pt::uint64_t)-1;
-
-    Task* target = &tasks[tid];
+    Task* target = find_task(tid);
+    if (!target) return (pt::uint64_t)-1;
 
     // Fast path: thread already zombie (exited, waiting to be joined).
     if (target->state == TASK_ZOMBIE) {
@@ -2248,8 +2757,8 @@ pt::uint64_t TaskScheduler::thread_join_task(pt::uint32_t tid)
     }
     // Safe on single-core: no task_yield() between the state checks above and
     // the join_tid write here, so the target thread cannot exit in between.
-    target->join_tid = current_task_id;
-    tasks[current_task_id].state = TASK_BLOCKED;
+    target->join_tid = tasks[current_slot]->id;
+    tasks[current_slot]->state = TASK_BLOCKED;
     task_yield();  // yield; woken by thread_exit_task when target goes ZOMBIE
 
     // When we resume, the thread is ZOMBIE and thread_result is set.
@@ -0,0 +1,198 @@
+#include "text_cache.h"
+#include "virtual.h"
+#include "kernel.h"
+
+struct TextCacheEntry {
+    char          path[TextCache::MAX_PATH];
+    pt::uint32_t  size;
+    pt::uint32_t  mtime;
+    TextPage*     pages;       // kmalloc'd, num_pages long
+    pt::size_t    num_pages;
+    pt::uint32_t  refs;        // PTEs currently mapping one of the pages
+    pt::uint64_t  last_use;    // use_clock value of the last acquire/insert
+    bool          used;        // slot holds frames
+    bool          cached;      // findable by acquire(); false once retired
+};
+
+static TextCacheEntry entries[TextCache::MAX_ENTRIES];
+static pt::uint64_t   use_clock = 0;
+
+static_assert(TextCache::MAX_ENTRIES <= (PTE_TEXT_IDX_MASK >> PTE_TEXT_IDX_SHIFT) + 1,
+              "entry index must fit in the PTE index bits");
+
+// The loader reaches us from syscalls that re-enable interrupts while
+// waiting on the disk, so every table update runs with IF cleared.
+// pushfq/popfq keeps the caller's IF state (syscall IF=0, shell IF=1).
+static inline pt::uint64_t irq_save()
+{
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(pt::uint64_t flags)
+{
+    asm volatile("push %0; popfq" : : "r"(flags) : "memory", "cc");
+}
+
+// Normalise a path into a cache key: no leading '/', upper case (FAT names
+// are case-insensitive).  Returns false if it does not fit.
+static bool make_key(const char* path, char* out)
+{
+    while (*path == '/') path++;
+    pt::size_t i = 0;
+    for (; path[i]; i++) {
+        if (i >= TextCache::MAX_PATH - 1) return false;
+        char c = path[i];
+        out[i] = (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+    }
+    out[i] = '\0';
+    return i > 0;
+}
+
+static bool key_equal(const char* a, const char* b)
+{
+    while (*a && *a == *b) { a++; b++; }
+    return *a == *b;
+}
+
+static void release(TextCacheEntry& e)
+{
+    for (pt::size_t i = 0; i < e.num_pages; i++)
+        vmm.free_frame(e.pages[i].pte & 0x000FFFFFFFFFF000ULL);
+    vmm.kfree(e.pages);
+    e.pages     = nullptr;
+    e.num_pages = 0;
+    e.used      = false;
+    e.cached    = false;
+}
+
+// Stop handing out entry e; free it now if nothing maps it.
+static void retire(TextCacheEntry& e)
+{
+    e.cached = false;
+    if (e.refs == 0) release(e);
+}
+
+// Index of the current entry whose key is `key`, or -1.
+static int find(const char* key)
+{
+    for (pt::size_t i = 0; i < TextCache::MAX_ENTRIES; i++)
+        if (entries[i].used && entries[i].cached && key_equal(entries[i].path, key))
+            return (int)i;
+    return -1;
+}
+
+static TextCacheEntry* entry_of(pt::uint64_t pte)
+{
+    pt::size_t idx = (pte & PTE_TEXT_IDX_MASK) >> PTE_TEXT_IDX_SHIFT;
+    if (idx >= TextCache::MAX_ENTRIES || !entries[idx].used) {
+        klog("[TEXTCACHE] stray shared PTE %lx\n", pte);
+        return nullptr;
+    }
+    return &entries[idx];
+}
+
+int TextCache::acquire(const char* path, pt::uint32_t size, pt::uint32_t mtime)
+{
+    char key[MAX_PATH];
+    if (!make_key(path, key)) return -1;
+
+    pt::uint64_t flags = irq_save();
+    int idx = find(key);
+    if (idx >= 0) {
+        TextCacheEntry& e = entries[idx];
+        if (e.size == size && e.mtime == mtime) {
+            e.refs    += (pt::uint32_t)e.num_pages;
+            e.last_use = ++use_clock;
+        } else {
+            klog("[TEXTCACHE] '%s' changed on disk, retiring entry %d\n", key, idx);
+            retire(e);
+            idx = -1;
+        }
+    }
+    irq_restore(flags);
+    return idx;
+}
+
+const TextPage* TextCache::pages(int idx, pt::size_t* count)
+{
+    *count = entries[idx].num_pages;
+    return entries[idx].pages;
+}
+
+int TextCache::insert(const char* path, pt::uint32_t size, pt::uint32_t mtime,
+                      TextPage* pages, pt::size_t count)
+{
+    char key[MAX_PATH];
+    if (count == 0 || !make_key(path, key)) return -1;
+
+    pt::uint64_t flags = irq_save();
+    int old = find(key);
+    if (old >= 0) {
+        // Another exec of the same file got here first: keep ours private.
+        if (entries[old].size == size && entries[old].mtime == mtime) {
+            irq_restore(flags);
+            return -1;
+        }
+        retire(entries[old]);
+    }
+
+    // Free slot, else the least recently used idle entry.
+    int slot = -1;
+    for (pt::size_t i = 0; i < MAX_ENTRIES && slot < 0; i++)
+        if (!entries[i].used) slot = (int)i;
+    if (slot < 0) {
+        for (pt::size_t i = 0; i < MAX_ENTRIES; i++) {
+            if (!entries[i].cached || entries[i].refs != 0) continue;
+            if (slot < 0 || entries[i].last_use < entries[slot].last_use)
+                slot = (int)i;
+        }
+        if (slot < 0) {
+            irq_restore(flags);
+            return -1;
+        }
+        release(entries[slot]);
+    }
+
+    TextCacheEntry& e = entries[slot];
+    memcpy(e.path, key, sizeof(key));
+    e.size      = size;
+    e.mtime     = mtime;
+    e.pages     = pages;
+    e.num_pages = count;
+    e.refs      = (pt::uint32_t)count;
+    e.last_use  = ++use_clock;
+    e.used      = true;
+    e.cached    = true;
+    irq_restore(flags);
+    klog("[TEXTCACHE] cached %d pages of '%s' in entry %d\n", (int)count, key, slot);
+    return slot;
+}
+
+void TextCache::get_page(pt::uint64_t pte)
+{
+    pt::uint64_t flags = irq_save();
+    TextCacheEntry* e = entry_of(pte);
+    if (e) e->refs++;
+    irq_restore(flags);
+}
+
+void TextCache::put_page(pt::uint64_t pte)
+{
+    pt::uint64_t flags = irq_save();
+    TextCacheEntry* e = entry_of(pte);
+    if (e && e->refs > 0 && --e->refs == 0 && !e->cached)
+        release(*e);
+    irq_restore(flags);
+}
+
+pt::size_t TextCache::resident_pages()
+{
+    pt::uint64_t flags = irq_save();
+    pt::size_t n = 0;
+    for (pt::size_t i = 0; i < MAX_ENTRIES; i++)
+        if (entries[i].used) n += entries[i].num_pages;
+    irq_restore(flags);
+    return n;
+}
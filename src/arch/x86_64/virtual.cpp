@@ -1,43 +1,5 @@
 #include "virtual.h"
 
-void memset(void* dst, pt::uint64_t value, const pt::size_t size)
-{
-    const pt::uint8_t fill_byte = (pt::uint8_t)value;
-
-    if (size < 8)
-    {
-        for (auto* ptr = (pt::uint8_t*)dst; ptr < (pt::uint8_t*)((pt::uint64_t)dst + size); ptr++)
-            *ptr = fill_byte;
-        return;
-    }
-
-    // Build an 8-byte pattern from the single fill byte.
-    pt::uint64_t pattern = fill_byte;
-    pattern |= pattern << 8;
-    pattern |= pattern << 16;
-    pattern |= pattern << 32;
-
-    const pt::uint64_t aligned_size = size - (size % 8);
-
-    for (auto* ptr = (pt::uint64_t*)dst; ptr < (pt::uint64_t*)((pt::uint64_t)dst + aligned_size); ptr++)
-        *ptr = pattern;
-
-    // Handle remaining 1–7 trailing bytes.
-    for (auto* ptr = (pt::uint8_t*)((pt::uint64_t)dst + aligned_size); ptr < (pt::uint8_t*)((pt::uint64_t)dst + size); ptr++)
-        *ptr = fill_byte;
-}
-
-void* memcpy(void* dest, const void* src, pt::size_t n) {
-    pt::uint8_t* d = (pt::uint8_t*)dest;
-    const pt::uint8_t* s = (const pt::uint8_t*)src;
-    
-    while (n--) {
-        *d++ = *s++;
-    }
-    
-    return dest;
-}
-
 pt::size_t VMM::memsize() {
     pt::size_t total = 0;
     kMemoryRegion* r = firstFreeMemoryRegion;
@@ -367,35 +329,6 @@ void VMM::initialize_frame_allocator(memory_map_entry* mmap[])
         }
     }
 
-    // The ELF staging area lives at a fixed high physical address
-    // (ELF_STAGING_PHYS .. +ELF_STAGING_SIZE, reserved below).  If RAM does
-    // not physically extend that far, the staging region is unbacked: writes
-    // are silently dropped and reads return zero, so every ELF loads as a page
-    // of zeros and the task faults at its entry point.  Refuse to boot with a
-    // clear message instead of limping into that corruption.  (QEMU's default
-    // is 128 MB; run with e.g. `-m 512M` — the Makefile's `make run` does.)
-    //
-    // TODO(refactor): this fixed staging area is the root of two problems — the
-    // 400 MB RAM floor enforced here, and an unlocked shared-buffer race (the
-    // staging region + ElfLoader::page_flags[] are globals; create_elf_task is
-    // preemptible mid-copy, so two concurrent exec/load calls corrupt each
-    // other's staging).  Both go away by copying PT_LOAD segments directly into
-    // the freshly-allocated per-task code frames and dropping this region; then
-    // this RAM check can be relaxed/removed.
-    constexpr pt::uintptr_t ELF_STAGING_PHYS = 0x18000000;          // 384 MB
-    constexpr pt::size_t    ELF_STAGING_SIZE = 16 * 1024 * 1024;    // 16 MB
-    constexpr pt::uintptr_t MIN_RAM_REQUIRED = ELF_STAGING_PHYS + ELF_STAGING_SIZE;  // 400 MB
-    if (top_of_ram < MIN_RAM_REQUIRED)
-    {
-        klog("[VMM] FATAL: only %d MB RAM detected; potatOS needs at least %d MB "
-             "(ELF staging area lives at %d MB). Boot QEMU with e.g. -m 512M.\n",
-             (int)(top_of_ram / (1024 * 1024)),
-             (int)(MIN_RAM_REQUIRED / (1024 * 1024)),
-             (int)(ELF_STAGING_PHYS / (1024 * 1024)));
-        kernel_panic("Insufficient RAM: need >= 400 MB (try QEMU -m 512M)",
-                     NotAbleToAllocateMemory);
-    }
-
     // Calculate bitmap size (1 bit per 4KB frame)
     pt::size_t num_frames = total_memory / 4096;
     frame_bitmap_size = (num_frames + 7) / 8;
@@ -429,25 +362,7 @@ void VMM::initialize_frame_allocator(memory_map_entry* mmap[])
         }
     }
 
-    // Reserve the ELF staging area (16MB at PA 0x18000000) so that
-    // allocate_frame() never returns frames from this region.
-    // create_elf_task copies code pages FROM the staging area while
-    // simultaneously calling allocate_frame() for destination frames;
-    // without this reservation, allocated frames can land in the staging
-    // range and corrupt the source data mid-copy.  (ELF_STAGING_PHYS /
-    // ELF_STAGING_SIZE are declared above with the minimum-RAM check.)
-    pt::size_t staging_start = ELF_STAGING_PHYS / 4096;
-    pt::size_t staging_end   = (ELF_STAGING_PHYS + ELF_STAGING_SIZE) / 4096;
-    for (pt::size_t i = staging_start; i < staging_end; i++)
-    {
-        pt::size_t byte_idx = i / 8;
-        pt::uint8_t bit_idx = i % 8;
-        if (byte_idx < frame_bitmap_size)
-        {
-            frame_bitmap[byte_idx] |= (1 << bit_idx);
-        }
-    }
-
+    frame_search_hint = kernel_frames / 8;
     frame_allocator_ready = true;
     klog("[VMM] Frame allocator ready: %d frames, %d bytes bitmap\n", num_frames, frame_bitmap_size);
 }
@@ -471,8 +386,10 @@ pt::uintptr_t VMM::allocate_frame()
     pt::uint64_t saved_flags;
     asm volatile("pushfq; pop %0; cli" : "=r"(saved_flags) :: "memory");
 
-    // Find first free frame
-    for (pt::size_t byte_idx = 0; byte_idx < frame_bitmap_size; byte_idx++)
+    // Find first free frame.  Every byte below frame_search_hint is known to
+    // be full, so start there instead of rescanning the reserved low region
+    // (and every frame already handed out) on each call.
+    for (pt::size_t byte_idx = frame_search_hint; byte_idx < frame_bitmap_size; byte_idx++)
     {
         if (frame_bitmap[byte_idx] != 0xFF)
         {
@@ -483,6 +400,7 @@ pt::uintptr_t VMM::allocate_frame()
                 {
                     // Mark frame as used
                     frame_bitmap[byte_idx] |= (1 << bit_idx);
+                    frame_search_hint = byte_idx;
                     pt::size_t frame_num = byte_idx * 8 + bit_idx;
                     asm volatile("push %0; popfq" : : "r"(saved_flags) : "memory");
                     return frame_num * 4096;
@@ -509,6 +427,7 @@ void VMM::free_frame(pt::uintptr_t frame)
         pt::uint64_t saved_flags;
         asm volatile("pushfq; pop %0; cli" : "=r"(saved_flags) :: "memory");
         frame_bitmap[byte_idx] &= ~(1 << bit_idx);
+        if (byte_idx < frame_search_hint) frame_search_hint = byte_idx;
         asm volatile("push %0; popfq" : : "r"(saved_flags) : "memory");
     }
 }
@@ -518,9 +437,9 @@ pt::size_t VMM::get_total_mem() const {
     return frame_bitmap_size * 8 * 4096;
 }
 
-pt::size_t VMM::get_free_mem() const {
+pt::uint64_t VMM::get_free_mem() const {
     if (!frame_allocator_ready || !frame_bitmap) return 0;
-    pt::size_t free_frames = 0;
+    pt::uint64_t free_frames = 0;
     for (pt::size_t i = 0; i < frame_bitmap_size; i++) {
         pt::uint8_t byte = frame_bitmap[i];
         for (int b = 0; b < 8; b++)
@@ -528,3 +447,174 @@ pt::size_t VMM::get_free_mem() const {
     }
     return free_frames * 4096;
 }
+
+// ── Memory types ────────────────────────────────────────────────────────
+
+static constexpr pt::uint32_t MSR_MTRRCAP       = 0xFE;
+static constexpr pt::uint32_t MSR_MTRR_PHYSBASE = 0x200;  // + 2n; PHYSMASK is + 2n + 1
+static constexpr pt::uint32_t MSR_PAT           = 0x277;
+static constexpr pt::uint32_t MSR_MTRR_DEF_TYPE = 0x2FF;
+
+static constexpr pt::uint64_t PTE_PWT     = 1ULL << 3;
+static constexpr pt::uint64_t PTE_PCD     = 1ULL << 4;
+static constexpr pt::uint64_t PTE_PS      = 1ULL << 7;   // 2 MB entry in a PD
+static constexpr pt::uint64_t PTE_PAT_4K  = 1ULL << 7;   // PAT index bit 2 in a PT
+static constexpr pt::uint64_t PTE_PAT_2M  = 1ULL << 12;  // ... and in a 2 MB entry
+static constexpr pt::uint64_t PTE_FRAME   = 0x000FFFFFFFFFF000ULL;
+
+static bool g_pat_wc = false;
+
+static inline pt::uint64_t rdmsr(pt::uint32_t msr)
+{
+    pt::uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return (pt::uint64_t)hi << 32 | lo;
+}
+
+static inline void wrmsr(pt::uint32_t msr, pt::uint64_t value)
+{
+    asm volatile("wrmsr" :: "c"(msr), "a"((pt::uint32_t)value),
+                 "d"((pt::uint32_t)(value >> 32)) : "memory");
+}
+
+static inline void cpuid(pt::uint32_t leaf, pt::uint32_t& eax, pt::uint32_t& edx)
+{
+    pt::uint32_t ebx, ecx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(leaf), "c"(0));
+}
+
+static inline pt::uint32_t cpuid_edx(pt::uint32_t leaf)
+{
+    pt::uint32_t eax, edx;
+    cpuid(leaf, eax, edx);
+    return edx;
+}
+
+// Write back and drop every cache line and every non-global TLB entry, so
+// no line or translation with the old type survives a type change.
+static inline void flush_caches_and_tlb()
+{
+    pt::uint64_t cr3;
+    asm volatile("wbinvd" ::: "memory");
+    asm volatile("mov %0, cr3" : "=r"(cr3));
+    asm volatile("mov cr3, %0" :: "r"(cr3) : "memory");
+}
+
+bool VMM::init_pat()
+{
+    if (!((cpuid_edx(1) >> 16) & 1)) {   // CPUID.1:EDX[16]
+        klog("[VMM] No PAT; VRAM stays at its MTRR type\n");
+        return false;
+    }
+    // Power-on PAT is WB, WT, UC-, UC repeated.  Entry 1 (WT) is unused
+    // here, so it becomes WC (type 1) the way Linux does it; the others,
+    // including PCD|PWT = UC for MMIO, keep their meaning.
+    pt::uint64_t pat = rdmsr(MSR_PAT);
+    pat = (pat & ~(0xFFULL << 8)) | (0x01ULL << 8);
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    flush_caches_and_tlb();
+    wrmsr(MSR_PAT, pat);
+    flush_caches_and_tlb();
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    g_pat_wc = true;
+    klog("[VMM] PAT: entry 1 = WC (%lx)\n", pat);
+    return true;
+}
+
+bool VMM::set_memory_type(pt::uintptr_t phys, pt::size_t size, MemType type)
+{
+    if (type == MemType::WriteCombining && !g_pat_wc) return false;
+    if (size == 0 || phys + size > 0x100000000ULL) return false;
+    // PAT index = PAT:PCD:PWT; the PAT bit stays clear (entries 0..3).
+    pt::uint64_t bits = type == MemType::WriteCombining ? PTE_PWT
+                      : type == MemType::Uncached       ? PTE_PWT | PTE_PCD
+                      : 0;
+
+    pt::uint64_t cr3;
+    asm volatile("mov %0, cr3" : "=r"(cr3));
+    auto table = [](pt::uint64_t entry) {
+        return reinterpret_cast<pt::uint64_t*>(KERNEL_OFFSET + (entry & PTE_FRAME));
+    };
+    pt::uint64_t* pdpt = table(table(cr3)[0]);
+
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    bool ok = true;
+    for (pt::uintptr_t a = phys & ~0x1FFFFFULL; a < phys + size; a += 0x200000) {
+        pt::uint64_t l3 = pdpt[a >> 30];
+        if (!(l3 & 0x01)) { ok = false; break; }
+        pt::uint64_t* pde = &table(l3)[(a >> 21) & 0x1FF];
+        if (!(*pde & 0x01)) { ok = false; break; }
+        if (*pde & PTE_PS) {
+            *pde = (*pde & ~(PTE_PWT | PTE_PCD | PTE_PAT_2M)) | bits;
+            continue;
+        }
+        // Split into 4 KB pages: only those inside the range.
+        pt::uint64_t* ptes = table(*pde);
+        for (pt::size_t i = 0; i < 512; i++) {
+            pt::uintptr_t pa = a + i * 4096;
+            if (pa + 4096 <= phys || pa >= phys + size || !(ptes[i] & 0x01)) continue;
+            ptes[i] = (ptes[i] & ~(PTE_PWT | PTE_PCD | PTE_PAT_4K)) | bits;
+        }
+    }
+    flush_caches_and_tlb();
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    return ok;
+}
+
+bool VMM::mtrr_set_wc(pt::uintptr_t phys, pt::size_t size)
+{
+    if (!((cpuid_edx(1) >> 12) & 1)) return false;   // CPUID.1:EDX[12]
+    pt::uint64_t cap = rdmsr(MSR_MTRRCAP);
+    if (!((cap >> 10) & 1)) return false;            // no WC type
+    pt::uint32_t count = cap & 0xFF;
+
+    pt::size_t span = 4096;
+    while (span < size) span <<= 1;
+    if (phys & (span - 1)) return false;
+
+    // Physical address width bounds the PHYSBASE/PHYSMASK fields.
+    pt::uint32_t width = 36, eax, edx;
+    cpuid(0x80000000, eax, edx);
+    if (eax >= 0x80000008) {
+        cpuid(0x80000008, eax, edx);
+        width = eax & 0xFF;
+    }
+    pt::uint64_t addr_mask = ((1ULL << width) - 1) & ~0xFFFULL;
+
+    pt::int32_t slot = -1;
+    for (pt::uint32_t n = 0; n < count; n++) {
+        pt::uint64_t base = rdmsr(MSR_MTRR_PHYSBASE + 2 * n);
+        pt::uint64_t mask = rdmsr(MSR_MTRR_PHYSBASE + 2 * n + 1);
+        if (!(mask & (1ULL << 11))) {
+            if (slot < 0) slot = (pt::int32_t)n;
+            continue;
+        }
+        // Overlap test: both ranges are aligned powers of two.
+        pt::uint64_t m = mask & addr_mask;
+        bool overlaps = ((phys ^ base) & m & ~(span - 1) & addr_mask) == 0;
+        if (overlaps && (base & 0xFF) == 0) {
+            klog("[VMM] MTRR %d keeps %lx uncached; no WC\n", n, phys);
+            return false;
+        }
+    }
+    if (slot < 0) return false;
+
+    // SDM 11.11.7.2: caches off and flushed, MTRRs off while they change.
+    pt::uint64_t flags, cr0;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    asm volatile("mov %0, cr0" : "=r"(cr0));
+    asm volatile("mov cr0, %0" :: "r"((cr0 | (1ULL << 30)) & ~(1ULL << 29)) : "memory");
+    flush_caches_and_tlb();
+    pt::uint64_t def = rdmsr(MSR_MTRR_DEF_TYPE);
+    wrmsr(MSR_MTRR_DEF_TYPE, def & ~(1ULL << 11));
+    wrmsr(MSR_MTRR_PHYSBASE + 2 * slot, (phys & addr_mask) | 0x01);
+    wrmsr(MSR_MTRR_PHYSBASE + 2 * slot + 1, (~(pt::uint64_t)(span - 1) & addr_mask) | (1ULL << 11));
+    wrmsr(MSR_MTRR_DEF_TYPE, def);
+    flush_caches_and_tlb();
+    asm volatile("mov cr0, %0" :: "r"(cr0) : "memory");
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    klog("[VMM] MTRR %d: %lx + %lx write-combining\n", slot, phys, span);
+    return true;
+}
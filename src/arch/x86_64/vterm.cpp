@@ -14,6 +14,11 @@ static bool is_active(pt::uint32_t id) {
     return g_active_vt == id;
 }
 
+// Whether two cells render identically.  A space shows only its bg.
+static bool same_look(const VTermCell& a, const VTermCell& b) {
+    return a.ch == b.ch && a.bg == b.bg && (a.ch == ' ' || a.fg == b.fg);
+}
+
 // ── VTerm implementation ───────────────────────────────────────────────
 
 void VTerm::init(pt::uint32_t id, pt::uint32_t cols, pt::uint32_t rows) {
@@ -42,25 +47,52 @@ void VTerm::clear() {
     m_ansi.n_params = 0;
     m_saved_col = 0;
     m_saved_row = 0;
+    redraw();
 }
 
-void VTerm::render_cell(pt::uint32_t, pt::uint32_t) {
-    // No-op: compositor renders all cells during Flush().
+void VTerm::render_cell(pt::uint32_t col, pt::uint32_t row) {
+    // The compositor draws cells during Flush(); just mark this one damaged.
+    if (m_batch) {
+        m_dirty[row][col >> 6] |= 1ULL << (col & 63);
+        return;
+    }
+    if (!is_active(m_id) || !fbterm.is_ready()) return;
+    const pt::uint32_t gw = fbterm.glyph_w(), gh = fbterm.glyph_h();
+    Framebuffer::get_instance()->add_damage((pt::int32_t)(col * gw), (pt::int32_t)(row * gh), gw, gh);
 }
 
-void VTerm::scroll() {
-    // Shift cell rows up by 1
-    for (pt::uint32_t r = 1; r < m_rows; r++) {
-        for (pt::uint32_t c = 0; c < m_cols; c++) {
-            m_cells[(r - 1) * m_cols + c] = m_cells[r * m_cols + c];
-        }
+void VTerm::flush_dirty() {
+    const bool show = is_active(m_id) && fbterm.is_ready();
+    const pt::uint32_t gw = fbterm.glyph_w(), gh = fbterm.glyph_h();
+    for (pt::uint32_t r = 0; r < m_rows; r++) {
+        const pt::uint64_t lo = m_dirty[r][0], hi = m_dirty[r][1];
+        if (!(lo | hi)) continue;
+        m_dirty[r][0] = m_dirty[r][1] = 0;
+        if (!show) continue;
+        const pt::uint32_t first = lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll(hi);
+        const pt::uint32_t last  = hi ? 127 - __builtin_clzll(hi) : 63 - __builtin_clzll(lo);
+        Framebuffer::get_instance()->add_damage((pt::int32_t)(first * gw), (pt::int32_t)(r * gh),
+                                                (last - first + 1) * gw, gh);
     }
-    // Clear bottom row
-    for (pt::uint32_t c = 0; c < m_cols; c++) {
-        m_cells[(m_rows - 1) * m_cols + c] = { ' ', m_fg, m_bg };
+}
+
+void VTerm::scroll() {
+    // A cell needs redrawing only if the cell moving into it looks
+    // different; blank margins usually stay blank.  Bits already set stay
+    // set: that cell's old content never reached the screen either.
+    const VTermCell blank = { ' ', m_fg, m_bg };
+    for (pt::uint32_t r = 0; r < m_rows; r++) {
+        const VTermCell* now  = &m_cells[r * m_cols];
+        const VTermCell* next = r + 1 < m_rows ? now + m_cols : nullptr;
+        for (pt::uint32_t c = 0; c < m_cols; c++)
+            if (!same_look(now[c], next ? next[c] : blank))
+                m_dirty[r][c >> 6] |= 1ULL << (c & 63);
     }
+    memmove(m_cells, m_cells + m_cols, (pt::size_t)(m_rows - 1) * m_cols * sizeof(VTermCell));
+    for (pt::uint32_t c = 0; c < m_cols; c++)
+        m_cells[(m_rows - 1) * m_cols + c] = blank;
     m_cur_row = m_rows - 1;
-    // Compositor renders updated cells during Flush().
+    if (!m_batch) flush_dirty();
 }
 
 void VTerm::handle_csi(char cmd) {
@@ -105,7 +137,8 @@ void VTerm::handle_csi(char cmd) {
             for (pt::uint32_t i = 0; i < m_rows * m_cols; i++)
                 m_cells[i] = { ' ', m_fg, m_bg };
             m_cur_col = m_cur_row = 0;
-            if (!m_batch && is_active(m_id)) redraw();
+            if (m_batch) m_redraw = true;
+            else if (is_active(m_id)) redraw();
         } else if (mode == 0) {
             // Clear from cursor to end
             for (pt::uint32_t c = m_cur_col; c < m_cols; c++)
@@ -113,7 +146,8 @@ void VTerm::handle_csi(char cmd) {
             for (pt::uint32_t r = m_cur_row + 1; r < m_rows; r++)
                 for (pt::uint32_t c = 0; c < m_cols; c++)
                     m_cells[r * m_cols + c] = { ' ', m_fg, m_bg };
-            if (!m_batch && is_active(m_id)) redraw();
+            if (m_batch) m_redraw = true;
+            else if (is_active(m_id)) redraw();
         }
         break;
     }
@@ -219,7 +253,12 @@ char VTerm::pop_input() {
 }
 
 void VTerm::redraw() {
-    // No-op: compositor renders all cells during Flush().
+    // Mark the whole terminal area damaged; Flush() re-renders the cells.
+    for (pt::uint32_t r = 0; r < m_rows; r++) m_dirty[r][0] = m_dirty[r][1] = 0;
+    m_redraw = false;
+    if (!is_active(m_id) || !fbterm.is_ready()) return;
+    Framebuffer::get_instance()->add_damage(0, 0, m_cols * fbterm.glyph_w(),
+                                            m_rows * fbterm.glyph_h());
 }
 
 void VTerm::begin_batch() {
@@ -228,7 +267,8 @@ void VTerm::begin_batch() {
 
 void VTerm::end_batch() {
     m_batch = false;
-    // Compositor renders updated cells during Flush().
+    if (m_redraw) redraw();
+    else          flush_dirty();
 }
 
 // ── global functions ───────────────────────────────────────────────────
@@ -245,7 +285,8 @@ void vterm_switch(pt::uint32_t vt_id) {
     if (g_active_vt < VTERM_COUNT)
         WindowManager::focused_per_vt[g_active_vt] = WindowManager::focused_id;
     g_active_vt = vt_id;
-    // Compositor picks up the new active VTerm + windows on next Flush().
+    // on_vt_switch damages the whole screen; the next Flush() rebuilds it
+    // from the new active VTerm + windows.
     WindowManager::on_vt_switch();
 }
 
@@ -268,6 +309,8 @@ static void vterm_putstr(const char* s) {
 
 void vterm_printf(const char* fmt, ...) {
     if (g_active_vt >= VTERM_COUNT) return;
+    VTerm& vt = g_vterms[g_active_vt];
+    vt.begin_batch();
 
     va_list args;
     va_start(args, fmt);
@@ -343,4 +386,5 @@ void vterm_printf(const char* fmt, ...) {
     }
 
     va_end(args);
+    vt.end_batch();
 }
@@ -4,12 +4,20 @@
 #include "virtual.h"
 #include "vterm.h"
 #include "task.h"
+#include "compositor.h"
+#include "device/timer.h"
+#include "simd.h"
+#include "syscall.h"
 
 Window       WindowManager::windows[MAX_WINDOWS];
 pt::uint32_t WindowManager::focused_id = INVALID_WID;
 pt::uint32_t WindowManager::focused_per_vt[VTERM_COUNT];
 pt::uint32_t WindowManager::z_order[MAX_WINDOWS];
 pt::uint32_t WindowManager::z_count = 0;
+void*        WindowManager::retired = nullptr;
+pt::uint32_t WindowManager::composite_depth = 0;
+bool         WindowManager::vis_dirty = true;
+bool         WindowManager::occlusion_enabled = true;
 
 void WindowManager::initialize()
 {
@@ -19,6 +27,7 @@ void WindowManager::initialize()
         windows[i].active        = false;
         windows[i].chromeless    = false;
         windows[i].text_mode     = false;
+        windows[i].indexed       = false;
         windows[i].screen_x      = 0;
         windows[i].screen_y      = 0;
         windows[i].total_w       = 0;
@@ -27,9 +36,18 @@ void WindowManager::initialize()
         windows[i].client_oy     = 0;
         windows[i].client_w      = 0;
         windows[i].client_h      = 0;
+        windows[i].buf_w         = 0;
+        windows[i].buf_h         = 0;
+        windows[i].bilinear      = false;
         windows[i].pixel_buf     = nullptr;
+        windows[i].buf_alloc     = nullptr;
+        windows[i].surface_va    = 0;
+        windows[i].surface_pdpt  = 0;
+        windows[i].surface_size  = 0;
         windows[i].ev_read       = 0;
         windows[i].ev_write      = 0;
+        windows[i].ev_waiter     = INVALID_WID;
+        windows[i].want_mouse    = false;
         windows[i].text_col         = 0;
         windows[i].text_row         = 0;
         windows[i].wrap_pending     = false;
@@ -41,11 +59,14 @@ void WindowManager::initialize()
         windows[i].ansi.n_params    = 0;
         windows[i].ansi.private_mode = false;
         windows[i].vt_id            = INVALID_VT;
+        windows[i].vis_count        = 0;
+        windows[i].swap             = nullptr;
     }
     focused_id = INVALID_WID;
     for (pt::uint32_t v = 0; v < VTERM_COUNT; v++)
         focused_per_vt[v] = INVALID_WID;
     z_count = 0;
+    vis_dirty = true;
 }
 
 // ── Z-order helpers ─────────────────────────────────────────────────────
@@ -90,6 +111,8 @@ bool WindowManager::is_on_active_vt(pt::uint32_t wid)
 void WindowManager::on_vt_switch()
 {
     if (g_active_vt >= VTERM_COUNT) return;
+    Framebuffer::get_instance()->damage_all();
+    vis_dirty = true;
     focused_id = focused_per_vt[g_active_vt];
     // Validate that saved focus is still valid
     if (focused_id != INVALID_WID &&
@@ -98,6 +121,38 @@ void WindowManager::on_vt_switch()
         focused_id = INVALID_WID;
 }
 
+// ── Damage ──────────────────────────────────────────────────────────────
+
+void WindowManager::damage_window(pt::uint32_t wid)
+{
+    if (!is_on_active_vt(wid)) return;
+    const Window* win = &windows[wid];
+    // screen_x may be "negative" (wrapped) after a drag off the left edge.
+    Framebuffer::get_instance()->add_damage((pt::int32_t)win->screen_x,
+                                            (pt::int32_t)win->screen_y,
+                                            win->total_w, win->total_h);
+}
+
+void WindowManager::damage_client(const Window* win, pt::uint32_t x, pt::uint32_t y,
+                                  pt::uint32_t w, pt::uint32_t h)
+{
+    if (!is_on_active_vt(win->id)) return;
+    if (win->buf_w != win->client_w || win->buf_h != win->client_h) {
+        // To screen pixels, with one source pixel of margin: bilinear
+        // output beside the rect samples it too.
+        pt::uint64_t sx0 = x ? x - 1 : 0, sy0 = y ? y - 1 : 0;
+        pt::uint64_t sx1 = (pt::uint64_t)x + w + 1, sy1 = (pt::uint64_t)y + h + 1;
+        if (sx1 > win->buf_w) sx1 = win->buf_w;
+        if (sy1 > win->buf_h) sy1 = win->buf_h;
+        x = (pt::uint32_t)(sx0 * win->client_w / win->buf_w);
+        y = (pt::uint32_t)(sy0 * win->client_h / win->buf_h);
+        w = (pt::uint32_t)((sx1 * win->client_w + win->buf_w - 1) / win->buf_w) - x;
+        h = (pt::uint32_t)((sy1 * win->client_h + win->buf_h - 1) / win->buf_h) - y;
+    }
+    Framebuffer::get_instance()->add_damage((pt::int32_t)(win->client_ox + x),
+                                            (pt::int32_t)(win->client_oy + y), w, h);
+}
+
 // ── Window lifecycle ────────────────────────────────────────────────────
 
 pt::uint32_t WindowManager::create_window(pt::uint32_t x, pt::uint32_t y,
@@ -114,6 +169,7 @@ pt::uint32_t WindowManager::create_window(pt::uint32_t x, pt::uint32_t y,
         }
     }
     if (wid == INVALID_WID) return INVALID_WID;
+    if ((flags & WF_INDEXED8) && (flags & WF_TEXT)) return INVALID_WID;
 
     Window* win        = &windows[wid];
     win->id            = wid;
@@ -121,6 +177,7 @@ pt::uint32_t WindowManager::create_window(pt::uint32_t x, pt::uint32_t y,
     win->active        = true;
     win->chromeless    = (flags & WF_CHROMELESS) != 0;
     win->text_mode     = (flags & WF_TEXT) != 0;
+    win->indexed       = (flags & WF_INDEXED8) != 0;
 
     if (win->chromeless) {
         win->screen_x  = x;
@@ -137,14 +194,25 @@ pt::uint32_t WindowManager::create_window(pt::uint32_t x, pt::uint32_t y,
     win->client_oy = y;
     win->client_w  = w;
     win->client_h  = h;
+    win->buf_w     = w;
+    win->buf_h     = h;
+    win->bilinear  = false;
 
     // Allocate per-window pixel buffer
-    pt::size_t buf_size = (pt::size_t)w * h * sizeof(pt::uint32_t);
-    win->pixel_buf = reinterpret_cast<pt::uint32_t*>(vmm.kcalloc(buf_size));
-    win->buf_capacity = buf_size;
+    pt::size_t bpp = win->indexed ? 1 : sizeof(pt::uint32_t);
+    win->pixel_buf = alloc_pixels((pt::size_t)w * h * bpp,
+                                  &win->buf_capacity, &win->buf_alloc);
+    for (pt::uint32_t i = 0; i < 256; i++)
+        win->palette[i] = i * 0x010101u;
+    win->surface_va   = 0;
+    win->surface_pdpt = 0;
+    win->surface_size = 0;
+    win->swap         = nullptr;
 
     win->ev_read            = 0;
     win->ev_write           = 0;
+    win->ev_waiter          = INVALID_WID;
+    win->want_mouse         = false;
     win->text_col           = 0;
     win->text_row           = 0;
     win->wrap_pending       = false;
@@ -159,13 +227,16 @@ pt::uint32_t WindowManager::create_window(pt::uint32_t x, pt::uint32_t y,
     win->vt_id              = g_active_vt;
 
     z_insert_top(wid);
+    vis_dirty = true;
 
     // Chromeless windows never hold keyboard focus.
     if (!win->chromeless) {
+        if (focused_id != INVALID_WID) damage_window(focused_id);  // title goes inactive
         focused_id = wid;
         if (g_active_vt < VTERM_COUNT)
             focused_per_vt[g_active_vt] = wid;
     }
+    damage_window(wid);
 
     return wid;
 }
@@ -177,15 +248,23 @@ void WindowManager::destroy_window(pt::uint32_t wid)
     if (!win->active) return;
 
     pt::uint32_t dead_vt = win->vt_id;
+    damage_window(wid);
+    destroy_swapchain(win);
     // Free pixel buffer (compositor stops drawing this window next frame)
-    if (win->pixel_buf) {
-        vmm.kfree(win->pixel_buf);
-        win->pixel_buf = nullptr;
-    }
+    unmap_surface(win);
+    void* buf = win->buf_alloc;
+    win->pixel_buf = nullptr;
+    win->buf_alloc = nullptr;
+    retire_buffer(buf);
 
     win->active        = false;
     win->owner_task_id = INVALID_WID;
+    if (win->ev_waiter != INVALID_WID) {
+        TaskScheduler::wake_task(win->ev_waiter);
+        win->ev_waiter = INVALID_WID;
+    }
     z_remove(wid);
+    vis_dirty = true;
 
     // Update per-VT focus for the dead window's VT — pick topmost in z_order
     if (dead_vt < VTERM_COUNT && focused_per_vt[dead_vt] == wid) {
@@ -200,8 +279,10 @@ void WindowManager::destroy_window(pt::uint32_t wid)
     }
 
     // Update global focused_id if the destroyed window was focused
-    if (focused_id == wid)
+    if (focused_id == wid) {
         focused_id = (dead_vt == g_active_vt) ? focused_per_vt[dead_vt] : INVALID_WID;
+        if (focused_id != INVALID_WID) damage_window(focused_id);
+    }
 }
 
 bool WindowManager::resize_window(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t y,
@@ -211,6 +292,28 @@ bool WindowManager::resize_window(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t
     Window* win = &windows[wid];
     if (!win->active) return false;
 
+    damage_window(wid);  // old area
+
+    // Reallocate pixel buffer only if new size exceeds current capacity
+    pt::size_t needed = (pt::size_t)w * h * (win->indexed ? 1 : sizeof(pt::uint32_t));
+    void*         old_alloc = nullptr;
+    void*         new_alloc = nullptr;
+    pt::size_t    new_cap   = 0;
+    pt::uint32_t* new_buf   = nullptr;
+    if (needed > win->buf_capacity)
+        new_buf = alloc_pixels(needed, &new_cap, &new_alloc);
+    // Swapchain buffers that no longer hold a frame go; the client has to
+    // create new ones for the new size.
+    if (win->swap && needed > win->swap->capacity)
+        destroy_swapchain(win);
+
+    // A source size that still fits the new client area is kept.
+    bool scaled = win->buf_w != win->client_w || win->buf_h != win->client_h;
+
+    // Size and buffer change together, so the compositor never pairs the
+    // new size with the old buffer.
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
     // Update geometry (chromeless only — normal windows would need chrome recalc)
     win->screen_x  = x;
     win->screen_y  = y;
@@ -220,13 +323,21 @@ bool WindowManager::resize_window(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t
     win->client_oy = y;
     win->client_w  = w;
     win->client_h  = h;
-
-    // Reallocate pixel buffer only if new size exceeds current capacity
-    pt::size_t needed = (pt::size_t)w * h * sizeof(pt::uint32_t);
-    if (needed > win->buf_capacity) {
-        if (win->pixel_buf) vmm.kfree(win->pixel_buf);
-        win->pixel_buf = reinterpret_cast<pt::uint32_t*>(vmm.kcalloc(needed));
-        win->buf_capacity = needed;
+    if (!scaled || win->buf_w > w || win->buf_h > h) {
+        win->buf_w = w;
+        win->buf_h = h;
+    }
+    if (new_buf) {
+        old_alloc = win->buf_alloc;
+        win->pixel_buf = new_buf;
+        win->buf_alloc = new_alloc;
+        win->buf_capacity = new_cap;
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    if (old_alloc) {
+        // The client's mapping still points at the old pages.
+        unmap_surface(win);
+        retire_buffer(old_alloc);
     }
 
     // Reset text cursor
@@ -234,19 +345,21 @@ bool WindowManager::resize_window(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t
     win->text_row = 0;
     win->wrap_pending = false;
 
+    vis_dirty = true;
+    damage_window(wid);  // new area
     return true;
 }
 
 // ── Chrome drawing (writes to back buffer, called from composite) ───────
 
-void WindowManager::draw_chrome(pt::uint32_t wid, bool active)
+void WindowManager::draw_chrome(pt::uint32_t wid, bool active, Framebuffer* fb)
 {
     if (wid >= MAX_WINDOWS) return;
     Window* win = &windows[wid];
     if (!win->active) return;
     if (win->chromeless) return;
 
-    Framebuffer* fb = Framebuffer::get_instance();
+    if (!fb) fb = Framebuffer::get_instance();
     if (!fb) return;
 
     // Unpack border color
@@ -276,110 +389,757 @@ void WindowManager::draw_chrome(pt::uint32_t wid, bool active)
     if (win->title[0] && fbterm.is_ready()) {
         pt::uint32_t tx = win->screen_x + BORDER_W + 4;
         pt::uint32_t ty = win->screen_y + BORDER_W;
-        fbterm.draw_at(tx, ty, win->title, 0xFFFFFF, tc);
+        fbterm.draw_at(tx, ty, win->title, 0xFFFFFF, tc, fb);
     }
 }
 
-// ── Compositor: blit all visible windows to back buffer ─────────────────
+// ── Visible regions ─────────────────────────────────────────────────────
+
+// Windows that composite() paints.  Everything else is transparent to it.
+static bool is_layer(const Window* win)
+{
+    return win->active && win->pixel_buf && WindowManager::is_on_active_vt(win->id);
+}
+
+// screen_x/y may be "negative" (wrapped) after a drag off the left edge.
+static ScreenRect frame_rect(const Window* win)
+{
+    pt::int32_t x = (pt::int32_t)win->screen_x, y = (pt::int32_t)win->screen_y;
+    return { x, y, x + (pt::int32_t)win->total_w, y + (pt::int32_t)win->total_h };
+}
+
+// Append the parts of `a` outside `b` to out[n..] (at most four rects: full-
+// width bands above and below b, then the pieces left and right of it).
+// Returns false, leaving n unchanged, if they do not fit in `cap`.
+static bool rect_subtract(const ScreenRect& a, const ScreenRect& b,
+                          ScreenRect* out, pt::uint32_t& n, pt::uint32_t cap)
+{
+    if (b.x1 <= a.x0 || b.x0 >= a.x1 || b.y1 <= a.y0 || b.y0 >= a.y1) {
+        if (n >= cap) return false;
+        out[n++] = a;
+        return true;
+    }
+    ScreenRect piece[4];
+    pt::uint32_t k = 0;
+    pt::int32_t my0 = a.y0, my1 = a.y1;
+    if (b.y0 > a.y0) { piece[k++] = { a.x0, a.y0, a.x1, b.y0 }; my0 = b.y0; }
+    if (b.y1 < a.y1) { piece[k++] = { a.x0, b.y1, a.x1, a.y1 }; my1 = b.y1; }
+    if (b.x0 > a.x0) piece[k++] = { a.x0, my0, b.x0, my1 };
+    if (b.x1 < a.x1) piece[k++] = { b.x1, my0, a.x1, my1 };
+    if (n + k > cap) return false;
+    for (pt::uint32_t i = 0; i < k; i++) out[n++] = piece[i];
+    return true;
+}
 
-void WindowManager::composite(Framebuffer* fb)
+void WindowManager::update_visibility()
+{
+    for (pt::uint32_t i = 0; i < MAX_WINDOWS; i++)
+        windows[i].vis_count = 0;
+
+    for (pt::uint32_t zi = 0; zi < z_count; zi++) {
+        Window* win = &windows[z_order[zi]];
+        if (!is_layer(win)) continue;
+
+        const ScreenRect frame = frame_rect(win);
+        pt::uint32_t n = 0;
+        win->vis[n++] = frame;
+
+        // Cut away the frame of every window stacked above this one.
+        for (pt::uint32_t zj = zi + 1; zj < z_count && n > 0; zj++) {
+            const Window* above = &windows[z_order[zj]];
+            if (!is_layer(above)) continue;
+            const ScreenRect cover = frame_rect(above);
+
+            ScreenRect next[VIS_MAX];
+            pt::uint32_t m = 0;
+            bool fits = true;
+            for (pt::uint32_t i = 0; i < n && fits; i++)
+                fits = rect_subtract(win->vis[i], cover, next, m, VIS_MAX);
+            if (!fits) {
+                // Too fragmented: paint the whole frame.  Still correct,
+                // since windows are composited back to front.
+                win->vis[0] = frame;
+                n = 1;
+                break;
+            }
+            for (pt::uint32_t i = 0; i < m; i++) win->vis[i] = next[i];
+            n = m;
+        }
+        win->vis_count = n;
+    }
+}
+
+// ── Scaled blits ────────────────────────────────────────────────────────
+
+// A window whose buffer is smaller than its client area, snapshotted by
+// composite().
+struct ScaledSource {
+    const pt::uint32_t* buf;
+    const pt::uint32_t* palette;  // non-null: buf holds 8-bit indices
+    pt::uint32_t bw, bh;          // buffer size
+    pt::uint32_t cw, ch;          // client size on screen
+    bool bilinear;
+};
+
+// Output pixels per source fetch.  Upscaling reads at most one source
+// pixel per output pixel, plus one neighbour, so this bounds the stack
+// scratch an indexed window is expanded into.
+static constexpr pt::uint32_t SCALE_CHUNK = 128;
+
+// Source pixels [sx, sx + n) of row sy as 0x00RRGGBB: the buffer itself,
+// or tmp after a palette lookup.
+static const pt::uint32_t* source_span(const ScaledSource& s, pt::uint32_t sy,
+                                       pt::uint32_t sx, pt::uint32_t n, pt::uint32_t* tmp)
+{
+    pt::size_t off = (pt::size_t)sy * s.bw + sx;
+    if (!s.palette) return s.buf + off;
+    simd_index8_to_xrgb(tmp, reinterpret_cast<const pt::uint8_t*>(s.buf) + off, s.palette, n);
+    return tmp;
+}
+
+// Fill screen rect [x0,x1) x [y0,y1) of the back buffer (inside the client
+// area at ox, oy) from a scaled window.  Positions are sampled at pixel
+// centres.  Nearest has an exact path for integer factors and copies the
+// row above when a source row repeats.
+static void blit_scaled(const ScaledSource& s, pt::uintptr_t back,
+                        pt::uint32_t fb_stride, pt::uint32_t fb_bytes,
+                        pt::int64_t ox, pt::int64_t oy,
+                        pt::int64_t x0, pt::int64_t y0, pt::int64_t x1, pt::int64_t y1)
+{
+    pt::uint32_t tmp0[SCALE_CHUNK + 2], tmp1[SCALE_CHUNK + 2];
+    bool bilinear = s.bilinear && s.bw >= 2 && s.bh >= 2;
+    pt::uint32_t step  = (pt::uint32_t)(((pt::uint64_t)s.bw << 16) / s.cw);
+    pt::uint32_t k     = s.cw / s.bw;
+    bool         int_x = !bilinear && s.cw % s.bw == 0;
+    pt::uint32_t dx0   = (pt::uint32_t)(x0 - ox);
+    pt::uint32_t width = (pt::uint32_t)(x1 - x0);
+    pt::uint32_t prev_sy = 0xFFFFFFFF;
+
+    for (pt::int64_t y = y0; y < y1; y++) {
+        pt::uint32_t* dst = reinterpret_cast<pt::uint32_t*>(
+            back + (pt::uint32_t)x0 * fb_bytes + (pt::uint32_t)y * fb_stride);
+        pt::uint64_t dy = (pt::uint64_t)(y - oy);
+
+        if (!bilinear) {
+            pt::uint32_t sy = (pt::uint32_t)((2 * dy + 1) * s.bh / (2 * s.ch));
+            if (sy == prev_sy) {
+                simd_copy32(dst, reinterpret_cast<const pt::uint32_t*>(
+                                     reinterpret_cast<pt::uintptr_t>(dst) - fb_stride), width);
+                continue;
+            }
+            prev_sy = sy;
+            for (pt::uint32_t done = 0; done < width; ) {
+                pt::uint32_t n  = width - done < SCALE_CHUNK ? width - done : SCALE_CHUNK;
+                pt::uint32_t dx = dx0 + done;
+                if (int_x) {
+                    pt::uint32_t phase = dx % k;
+                    pt::uint32_t need  = (phase + n + k - 1) / k;
+                    simd_scale_int(dst + done, source_span(s, sy, dx / k, need, tmp0),
+                                   k, phase, n);
+                } else {
+                    pt::uint64_t pos = (((2 * (pt::uint64_t)dx + 1) * s.bw) << 16) / (2 * s.cw);
+                    pt::uint32_t sx   = (pt::uint32_t)(pos >> 16);
+                    pt::uint32_t last = (pt::uint32_t)((pos + (pt::uint64_t)(n - 1) * step) >> 16);
+                    simd_scale_nearest(dst + done, source_span(s, sy, sx, last - sx + 1, tmp0),
+                                       (pt::uint32_t)(pos - ((pt::uint64_t)sx << 16)), step, n);
+                }
+                done += n;
+            }
+            continue;
+        }
+
+        // Bilinear: 8.8 row position, clamped so both rows exist.
+        pt::int64_t py = (pt::int64_t)(((2 * dy + 1) * s.bh << 8) / (2 * s.ch)) - 128;
+        if (py < 0) py = 0;
+        pt::uint32_t sy = (pt::uint32_t)(py >> 8);
+        pt::uint32_t wy = (pt::uint32_t)(py & 0xFF);
+        if (sy >= s.bh - 1) { sy = s.bh - 2; wy = 256; }
+        for (pt::uint32_t done = 0; done < width; ) {
+            pt::uint32_t n  = width - done < SCALE_CHUNK ? width - done : SCALE_CHUNK;
+            pt::uint32_t dx = dx0 + done;
+            pt::int64_t pos = (pt::int64_t)((((2 * (pt::uint64_t)dx + 1) * s.bw) << 16) / (2 * s.cw))
+                              - 0x8000;
+            pt::int64_t end = pos + (pt::int64_t)(n - 1) * step;
+            pt::uint32_t sx   = pos < 0 ? 0 : (pt::uint32_t)(pos >> 16);
+            pt::uint32_t last = (end < 0 ? 0 : (pt::uint32_t)(end >> 16)) + 1;
+            if (last > s.bw - 1) last = s.bw - 1;
+            if (sx > s.bw - 2) sx = s.bw - 2;
+            const pt::uint32_t* r0 = source_span(s, sy, sx, last - sx + 1, tmp0);
+            const pt::uint32_t* r1 = source_span(s, sy + 1, sx, last - sx + 1, tmp1);
+            simd_scale_bilinear(dst + done, r0, r1, (pt::int32_t)(pos - ((pt::int64_t)sx << 16)),
+                                step, last - sx, wy, n);
+            done += n;
+        }
+    }
+}
+
+// ── Compositor: blit visible windows to back buffer ─────────────────────
+
+void WindowManager::composite(Framebuffer* fb, const DamageRect& clip)
 {
     if (!fb) return;
     pt::uintptr_t back = fb->get_back();
     if (!back) return;
 
-    pt::uint32_t fb_w      = fb->get_width();
-    pt::uint32_t fb_h      = fb->get_height();
+    // Runs with interrupts enabled in the compositor task, so syscalls and
+    // IRQ handlers can change windows mid-frame.  Shared state is only read
+    // under short cli sections, and pixel buffers dropped meanwhile stay
+    // allocated until the frame is done (retire_buffer).
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    composite_depth++;
+    if (vis_dirty) {
+        vis_dirty = false;
+        update_visibility();
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+
+    pt::int64_t  fb_w      = fb->get_width();
+    pt::int64_t  fb_h      = fb->get_height();
     pt::uint32_t fb_stride = fb->get_stride();
     pt::uint32_t fb_bytes  = fb->get_bpp() / 8;
 
-    // Blit windows in z-order (back to front)
-    for (pt::uint32_t zi = 0; zi < z_count; zi++) {
-        pt::uint32_t wid = z_order[zi];
-        Window* win = &windows[wid];
-        if (!win->active || !win->pixel_buf) continue;
-        if (!is_on_active_vt(wid)) continue;
-
-        // Clip to screen bounds (client_ox/oy may wrap negative via uint32)
-        pt::int32_t ox = (pt::int32_t)win->client_ox;
-        pt::int32_t oy = (pt::int32_t)win->client_oy;
-        pt::int32_t src_x = 0, src_y = 0;
-        pt::int32_t dst_x = ox, dst_y = oy;
-        if (dst_x < 0) { src_x = -dst_x; dst_x = 0; }
-        if (dst_y < 0) { src_y = -dst_y; dst_y = 0; }
-        if (src_x >= (pt::int32_t)win->client_w ||
-            src_y >= (pt::int32_t)win->client_h) continue;
-
-        pt::uint32_t blit_w = win->client_w - (pt::uint32_t)src_x;
-        pt::uint32_t blit_h = win->client_h - (pt::uint32_t)src_y;
-        if ((pt::uint32_t)dst_x + blit_w > fb_w) blit_w = fb_w - (pt::uint32_t)dst_x;
-        if ((pt::uint32_t)dst_y + blit_h > fb_h) blit_h = fb_h - (pt::uint32_t)dst_y;
-
-        // Blit pixel_buf rows to back buffer
-        for (pt::uint32_t y = 0; y < blit_h; y++) {
-            pt::uint32_t* src = &win->pixel_buf[((pt::uint32_t)src_y + y) * win->client_w
-                                                 + (pt::uint32_t)src_x];
-            pt::uint32_t* dst = reinterpret_cast<pt::uint32_t*>(
-                back + (pt::uint32_t)dst_x * fb_bytes
-                     + ((pt::uint32_t)dst_y + y) * fb_stride);
-            for (pt::uint32_t x = 0; x < blit_w; x++)
-                dst[x] = src[x];
+    // Area that may be written: the damage rect, within the screen
+    pt::int64_t lim_x0 = clip.x0, lim_y0 = clip.y0;
+    pt::int64_t lim_x1 = clip.x1 < fb_w ? clip.x1 : fb_w;
+    pt::int64_t lim_y1 = clip.y1 < fb_h ? clip.y1 : fb_h;
+
+    kernel_fpu_begin();
+
+    // Blit windows in z-order (back to front), each only where it is not
+    // covered by a window above it
+    for (pt::uint32_t zi = 0; ; zi++) {
+        // Snapshot the window so buffer, size and region agree
+        ScreenRect vis[VIS_MAX];
+        pt::uint32_t vis_count;
+        const pt::uint32_t* buf;
+        const pt::uint32_t* palette;  // non-null: buf holds 8-bit indices
+        pt::uint32_t wid, cw, ch, bw, bh;
+        pt::int64_t ox, oy;
+        bool chromeless, bilinear;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+        if (zi >= z_count) {
+            asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+            break;
+        }
+        wid = z_order[zi];
+        const Window* win = &windows[wid];
+        vis_count = 0;
+        if (is_layer(win)) {
+            if (occlusion_enabled) {
+                vis_count = win->vis_count;
+                for (pt::uint32_t v = 0; v < vis_count; v++) vis[v] = win->vis[v];
+            } else {
+                vis[0] = frame_rect(win);
+                vis_count = 1;
+            }
+        }
+        buf = win->pixel_buf;
+        if (win->swap && win->swap->shown >= 0)
+            buf = win->swap->buf[win->swap->shown];
+        palette = win->indexed ? win->palette : nullptr;
+        cw = win->client_w;
+        ch = win->client_h;
+        bw = win->buf_w;
+        bh = win->buf_h;
+        bilinear = win->bilinear;
+        // Client area on screen (client_ox/oy may wrap negative via uint32)
+        ox = (pt::int32_t)win->client_ox;
+        oy = (pt::int32_t)win->client_oy;
+        chromeless = win->chromeless;
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+
+        bool shown = false;
+        for (pt::uint32_t v = 0; v < vis_count; v++) {
+            const ScreenRect& r = vis[v];
+            pt::int64_t x0 = r.x0 > lim_x0 ? r.x0 : lim_x0;
+            pt::int64_t y0 = r.y0 > lim_y0 ? r.y0 : lim_y0;
+            pt::int64_t x1 = r.x1 < lim_x1 ? r.x1 : lim_x1;
+            pt::int64_t y1 = r.y1 < lim_y1 ? r.y1 : lim_y1;
+            if (x0 >= x1 || y0 >= y1) continue;
+            shown = true;
+
+            // Uncovered span of the client area
+            if (x0 < ox) x0 = ox;
+            if (y0 < oy) y0 = oy;
+            if (x1 > ox + cw) x1 = ox + cw;
+            if (y1 > oy + ch) y1 = oy + ch;
+            if (x0 >= x1 || y0 >= y1) continue;
+
+            if (bw != cw || bh != ch) {
+                ScaledSource s = { buf, palette, bw, bh, cw, ch, bilinear };
+                blit_scaled(s, back, fb_stride, fb_bytes, ox, oy, x0, y0, x1, y1);
+                continue;
+            }
+
+            pt::uint32_t blit_w = (pt::uint32_t)(x1 - x0);
+            for (pt::int64_t y = y0; y < y1; y++) {
+                pt::uint32_t src_off = (pt::uint32_t)(y - oy) * cw + (pt::uint32_t)(x0 - ox);
+                pt::uint32_t* dst = reinterpret_cast<pt::uint32_t*>(
+                    back + (pt::uint32_t)x0 * fb_bytes + (pt::uint32_t)y * fb_stride);
+                if (palette)
+                    simd_index8_to_xrgb(dst, reinterpret_cast<const pt::uint8_t*>(buf) + src_off,
+                                        palette, blit_w);
+                else
+                    simd_copy32(dst, &buf[src_off], blit_w);
+            }
         }
 
         // Draw chrome for non-chromeless windows
-        if (!win->chromeless)
-            draw_chrome(wid, focused_id == wid);
+        if (shown && !chromeless)
+            draw_chrome(wid, focused_id == wid, fb);
+    }
+
+    kernel_fpu_end();
+
+    // Free what was retired during the frame, once no composite is running
+    void* dead = nullptr;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    if (--composite_depth == 0) {
+        dead = retired;
+        retired = nullptr;
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    while (dead) {
+        void* next = *static_cast<void**>(dead);
+        vmm.kfree(dead);
+        dead = next;
+    }
+}
+
+void WindowManager::retire_buffer(void* buf)
+{
+    if (!buf) return;
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    if (composite_depth == 0) {
+        asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+        vmm.kfree(buf);
+        return;
+    }
+    // Linked through the first word (pixel buffers are never smaller).
+    *static_cast<void**>(buf) = retired;
+    retired = buf;
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+pt::uint32_t* WindowManager::alloc_pixels(pt::size_t bytes, pt::size_t* capacity, void** alloc)
+{
+    // Whole pages, page-aligned: a mapped surface must not expose whatever
+    // else the heap keeps next to it.  The heap is physically contiguous,
+    // so the pages can be lent to a client as one run of frames.
+    pt::size_t cap = (bytes + 4095) & ~(pt::size_t)4095;
+    if (cap == 0) cap = 4096;
+    void* block = vmm.kcalloc(cap + 4095);
+    *alloc    = block;
+    *capacity = cap;
+    return reinterpret_cast<pt::uint32_t*>(
+        ((pt::uintptr_t)block + 4095) & ~(pt::uintptr_t)4095);
+}
+
+bool WindowManager::win_set_palette(pt::uint32_t wid, const pt::uint32_t* colors,
+                                    pt::uint32_t first, pt::uint32_t count)
+{
+    Window* win = get_window(wid);
+    if (!win || !win->indexed || first >= 256 || count > 256 - first) return false;
+    for (pt::uint32_t i = 0; i < count; i++)
+        win->palette[first + i] = colors[i] & 0xFFFFFF;
+    // Every pixel may have changed colour.
+    damage_client(win, 0, 0, win->buf_w, win->buf_h);
+    return true;
+}
+
+bool WindowManager::set_source_size(pt::uint32_t wid, pt::uint32_t w, pt::uint32_t h,
+                                    bool bilinear)
+{
+    Window* win = get_window(wid);
+    if (!win || !win->pixel_buf || win->text_mode) return false;
+    if (w == 0 || h == 0) {
+        w = win->client_w;
+        h = win->client_h;
+    }
+    // The buffer holds the whole client area, so a smaller picture always
+    // fits in it; only the row length changes.
+    if (w > win->client_w || h > win->client_h) return false;
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    win->buf_w    = w;
+    win->buf_h    = h;
+    win->bilinear = bilinear;
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    damage_window(wid);
+    return true;
+}
+
+// ── Shared surfaces ─────────────────────────────────────────────────────
+
+pt::uintptr_t WindowManager::map_surface(pt::uint32_t wid, Task* t)
+{
+    Window* win = get_window(wid);
+    if (!win || !win->pixel_buf || !t) return 0;
+
+    Task* owner = TaskScheduler::address_space_owner(t);
+    if (win->surface_va && win->surface_pdpt == owner->user_pdpt)
+        return win->surface_va;
+    unmap_surface(win);
+
+    pt::uintptr_t va = TaskScheduler::map_borrowed_pages(
+        t, VMM::virt_to_phys(win->pixel_buf), win->buf_capacity);
+    if (!va) return 0;
+    win->surface_va   = va;
+    win->surface_pdpt = owner->user_pdpt;
+    win->surface_size = win->buf_capacity;
+    return va;
+}
+
+void WindowManager::unmap_surface(Window* win)
+{
+    if (!win->surface_va) return;
+    TaskScheduler::unmap_borrowed_pages(win->surface_pdpt, win->surface_va,
+                                        win->surface_size);
+    win->surface_va   = 0;
+    win->surface_pdpt = 0;
+    win->surface_size = 0;
+}
+
+void WindowManager::forget_surfaces(pt::uintptr_t pdpt)
+{
+    for (pt::uint32_t i = 0; i < MAX_WINDOWS; i++) {
+        if (windows[i].surface_va && windows[i].surface_pdpt == pdpt) {
+            windows[i].surface_va   = 0;
+            windows[i].surface_pdpt = 0;
+            windows[i].surface_size = 0;
+        }
+        if (windows[i].swap && windows[i].swap->pdpt == pdpt)
+            windows[i].swap->pdpt = 0;
+    }
+}
+
+void WindowManager::commit_surface(pt::uint32_t wid, const SurfaceRect* rects,
+                                   pt::uint32_t count)
+{
+    Window* win = get_window(wid);
+    if (!win || !win->pixel_buf) return;
+    if (count == 0) {
+        damage_client(win, 0, 0, win->buf_w, win->buf_h);
+        return;
+    }
+    for (pt::uint32_t i = 0; i < count; i++) {
+        pt::uint32_t x = rects[i].x, y = rects[i].y;
+        if (x >= win->buf_w || y >= win->buf_h) continue;
+        pt::uint32_t w = rects[i].w, h = rects[i].h;
+        if (w > win->buf_w - x) w = win->buf_w - x;
+        if (h > win->buf_h - y) h = win->buf_h - y;
+        if (w && h) damage_client(win, x, y, w, h);
+    }
+}
+
+// ── Swapchains ──────────────────────────────────────────────────────────
+
+// How long present() sleeps before it stops waiting for the compositor and
+// moves the frame along itself: the window may be on a hidden VT, or
+// entirely off screen, so no frame will ever be drawn for it.
+static constexpr pt::uint64_t SWAP_WAIT_TICKS = 5;   // 100 ms at 50 Hz
+
+bool WindowManager::create_swapchain(pt::uint32_t wid, Task* t, pt::uint32_t count,
+                                     pt::uintptr_t* vas)
+{
+    Window* win = get_window(wid);
+    if (!win || !win->pixel_buf || win->text_mode || !t) return false;
+    destroy_swapchain(win);
+    if (count == 0) return true;
+    if (count < 2 || count > SWAP_MAX) return false;
+
+    SwapChain* sc = static_cast<SwapChain*>(vmm.kcalloc(sizeof(SwapChain)));
+    if (!sc) return false;
+    // Client size, so a later SYS_SET_WINDOW_SOURCE still fits.
+    const pt::size_t bytes = (pt::size_t)win->client_w * win->client_h *
+                             (win->indexed ? 1 : sizeof(pt::uint32_t));
+    bool ok = true;
+    for (pt::uint32_t i = 0; i < count && ok; i++) {
+        sc->buf[i] = alloc_pixels(bytes, &sc->capacity, &sc->alloc[i]);
+        if (!sc->alloc[i]) { ok = false; break; }
+        sc->va[i] = TaskScheduler::map_borrowed_pages(t, VMM::virt_to_phys(sc->buf[i]),
+                                                      sc->capacity);
+        if (!sc->va[i]) ok = false;
+    }
+    sc->pdpt = TaskScheduler::address_space_owner(t)->user_pdpt;
+    if (!ok) {
+        for (pt::uint32_t i = 0; i < count; i++) {
+            if (sc->va[i]) TaskScheduler::unmap_borrowed_pages(sc->pdpt, sc->va[i], sc->capacity);
+            if (sc->alloc[i]) vmm.kfree(sc->alloc[i]);
+        }
+        vmm.kfree(sc);
+        return false;
+    }
+
+    sc->count  = count;
+    sc->queued = -1;
+    sc->shown  = -1;
+    sc->waiter = INVALID_WID;
+    for (pt::uint32_t i = 0; i < count; i++) {
+        sc->state[i] = SwapChain::FREE;
+        vas[i] = sc->va[i];
+    }
+    sc->state[0] = SwapChain::ACQUIRED;
+
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    win->swap = sc;
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    return true;
+}
+
+void WindowManager::destroy_swapchain(Window* win)
+{
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    SwapChain* sc = win->swap;
+    win->swap = nullptr;
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+    if (!sc) return;
+
+    // A presenter asleep on it sees win->swap change and gives up.
+    if (sc->waiter != INVALID_WID) TaskScheduler::wake_task(sc->waiter);
+    for (pt::uint32_t i = 0; i < sc->count; i++) {
+        if (sc->pdpt) TaskScheduler::unmap_borrowed_pages(sc->pdpt, sc->va[i], sc->capacity);
+        retire_buffer(sc->alloc[i]);
     }
+    vmm.kfree(sc);
+    damage_client(win, 0, 0, win->buf_w, win->buf_h);
+}
+
+bool WindowManager::latch_frame(SwapChain* sc)
+{
+    if (sc->queued < 0) return false;
+    if (sc->shown >= 0) sc->state[sc->shown] = SwapChain::RETIRING;
+    sc->shown = sc->queued;
+    sc->state[sc->shown] = SwapChain::SHOWN;
+    sc->queued  = -1;
+    sc->latched = true;
+    return true;
+}
+
+void WindowManager::frame_shown(SwapChain* sc, pt::uint64_t now)
+{
+    if (!sc->latched) return;
+    sc->latched = false;
+    for (pt::uint32_t i = 0; i < sc->count; i++)
+        if (sc->state[i] == SwapChain::RETIRING) sc->state[i] = SwapChain::FREE;
+    sc->shown_seq = sc->seq[sc->shown];
+    sc->shown_us  = now;
+    if (sc->waiter != INVALID_WID) {
+        TaskScheduler::wake_task(sc->waiter);
+        sc->waiter = INVALID_WID;
+    }
+}
+
+void WindowManager::latch_frames()
+{
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    for (pt::uint32_t i = 0; i < MAX_WINDOWS; i++)
+        if (windows[i].active && windows[i].swap) latch_frame(windows[i].swap);
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+void WindowManager::frames_shown()
+{
+    const pt::uint64_t now = get_microseconds();
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    for (pt::uint32_t i = 0; i < MAX_WINDOWS; i++)
+        if (windows[i].active && windows[i].swap) frame_shown(windows[i].swap, now);
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+// Sleep until frame_shown() wakes us or SWAP_WAIT_TICKS pass.  Entered and
+// left with interrupts off, like the FUTEX_WAIT block.  False: the
+// swapchain was removed meanwhile.
+static bool swap_wait(Window* win, SwapChain* sc, Task* t, bool* timed_out)
+{
+    sc->waiter = t->id;
+    t->sleep_deadline = get_ticks() + SWAP_WAIT_TICKS;
+    t->state = TASK_BLOCKED;
+    asm volatile("sti");
+    TaskScheduler::task_yield();
+    asm volatile("cli");
+    t->sleep_deadline = 0;
+    if (win->swap != sc) return false;
+    *timed_out = sc->waiter == t->id;
+    if (*timed_out) sc->waiter = INVALID_WID;
+    return true;
+}
+
+pt::int64_t WindowManager::present(pt::uint32_t wid, pt::uint32_t idx, PresentInfo* info)
+{
+    Window* win = get_window(wid);
+    Task* t = TaskScheduler::get_current_task();
+    if (!win || !t) return -1;
+
+    asm volatile("cli");
+    SwapChain* sc = win->swap;
+    if (!sc || idx >= sc->count || sc->state[idx] != SwapChain::ACQUIRED) {
+        asm volatile("sti");
+        return -1;
+    }
+    // One frame deep: wait until the compositor has taken the last one.
+    // After a timeout nothing is drawing this window, so the frame moves
+    // along without a composite.
+    bool timed_out;
+    while (sc->queued >= 0) {
+        if (!swap_wait(win, sc, t, &timed_out)) { asm volatile("sti"); return -1; }
+        if (timed_out) {
+            latch_frame(sc);
+            frame_shown(sc, get_microseconds());
+        }
+    }
+    sc->state[idx] = SwapChain::QUEUED;
+    sc->queued     = (pt::int32_t)idx;
+    sc->seq[idx]   = ++sc->presented;
+    const pt::uint64_t seq = sc->presented;
+    asm volatile("sti");
+    damage_client(win, 0, 0, win->buf_w, win->buf_h);
+
+    // Hand over a free buffer: with two, that is the one this frame
+    // replaces, free once the frame is on screen.  The swapchain may have
+    // been destroyed while interrupts were on.
+    asm volatile("cli");
+    if (win->swap != sc) { asm volatile("sti"); return -1; }
+    pt::int64_t next = -1;
+    while (next < 0) {
+        for (pt::uint32_t i = 0; i < sc->count; i++) {
+            if (sc->state[i] == SwapChain::FREE) { next = i; break; }
+        }
+        if (next >= 0) break;
+        if (!swap_wait(win, sc, t, &timed_out)) { asm volatile("sti"); return -1; }
+        if (timed_out) {
+            latch_frame(sc);
+            frame_shown(sc, get_microseconds());
+        }
+    }
+    sc->state[next] = SwapChain::ACQUIRED;
+    if (info) {
+        info->seq         = seq;
+        info->shown_seq   = sc->shown_seq;
+        info->shown_us    = sc->shown_us;
+        info->interval_us = COMPOSITOR_FRAME_US;
+    }
+    asm volatile("sti");
+    return next;
 }
 
 // ── Per-window drawing (writes to pixel_buf) ────────────────────────────
 
+// Clip x, y, w, h to the buffer; false if nothing is left.
+static bool clip_to_buf(const Window* win, pt::uint32_t& x, pt::uint32_t& y,
+                        pt::uint32_t& w, pt::uint32_t& h)
+{
+    if (x >= win->buf_w || y >= win->buf_h || w == 0 || h == 0) return false;
+    if (w > win->buf_w - x) w = win->buf_w - x;
+    if (h > win->buf_h - y) h = win->buf_h - y;
+    return true;
+}
+
+static inline void fill32(pt::uint32_t* dst, pt::uint32_t value, pt::size_t count)
+{
+    asm volatile("rep stosd" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+// Fill a clipped rect.  A full-width rect is one run, since rows are packed.
+static void fill_clipped(Window* win, pt::uint32_t x, pt::uint32_t y,
+                         pt::uint32_t w, pt::uint32_t h, pt::uint32_t color)
+{
+    const pt::size_t bw = win->buf_w;
+    if (win->indexed) {
+        // color is a palette index
+        auto* row = reinterpret_cast<pt::uint8_t*>(win->pixel_buf) + y * bw + x;
+        if (w == bw) { memset(row, color & 0xFF, bw * h); return; }
+        for (; h; h--, row += bw) memset(row, color & 0xFF, w);
+        return;
+    }
+    pt::uint32_t* row = win->pixel_buf + y * bw + x;
+    if (w == bw) { fill32(row, color, bw * h); return; }
+    for (; h; h--, row += bw) fill32(row, color, w);
+}
+
 void WindowManager::win_fill_rect(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t y,
                                    pt::uint32_t w, pt::uint32_t h, pt::uint32_t color)
 {
     Window* win = get_window(wid);
     if (!win || !win->pixel_buf) return;
-    // Clip to client area
-    if (x >= win->client_w || y >= win->client_h) return;
-    if (x + w > win->client_w) w = win->client_w - x;
-    if (y + h > win->client_h) h = win->client_h - y;
-    for (pt::uint32_t row = y; row < y + h; row++)
-        for (pt::uint32_t col = x; col < x + w; col++)
-            win->pixel_buf[row * win->client_w + col] = color;
+    if (!clip_to_buf(win, x, y, w, h)) return;
+    fill_clipped(win, x, y, w, h, color);
+    damage_client(win, x, y, w, h);
 }
 
 void WindowManager::win_draw_pixels(pt::uint32_t wid, const pt::uint8_t* data,
                                      pt::uint32_t x, pt::uint32_t y,
-                                     pt::uint32_t w, pt::uint32_t h)
+                                     pt::uint32_t w, pt::uint32_t h,
+                                     pt::uint32_t format, pt::uint32_t stride)
 {
     Window* win = get_window(wid);
     if (!win || !win->pixel_buf || !data) return;
-    for (pt::uint32_t dy = 0; dy < h; dy++) {
-        if (y + dy >= win->client_h) break;
-        for (pt::uint32_t dx = 0; dx < w; dx++) {
-            if (x + dx >= win->client_w) break;
-            pt::uint32_t src_off = (dy * w + dx) * 3;
-            pt::uint32_t color = (pt::uint32_t)data[src_off] << 16
-                               | (pt::uint32_t)data[src_off + 1] << 8
-                               | (pt::uint32_t)data[src_off + 2];
-            win->pixel_buf[(y + dy) * win->client_w + (x + dx)] = color;
+    if (x >= win->buf_w || y >= win->buf_h) return;
+    pt::uint32_t bpp = pixfmt_bytes(format);
+    if (bpp == 0) return;
+    // Indexed windows take only indices, and only they have a palette.
+    if (win->indexed != (format == PIXFMT_INDEX8)) return;
+    // Rows are `stride` bytes apart in the source even when clipped on the right.
+    const pt::uint64_t row = stride ? stride : (pt::uint64_t)w * bpp;
+    // Clip by subtraction: x + w can wrap in 32 bits.
+    pt::uint32_t copy_w = w, copy_h = h;
+    if (copy_w > win->buf_w - x) copy_w = win->buf_w - x;
+    if (copy_h > win->buf_h - y) copy_h = win->buf_h - y;
+
+    kernel_fpu_begin();
+    for (pt::uint32_t dy = 0; dy < copy_h; dy++) {
+        pt::uint32_t*      dst = &win->pixel_buf[(y + dy) * win->buf_w + x];
+        const pt::uint8_t* src = data + dy * row;
+        switch (format) {
+        case PIXFMT_INDEX8:
+            memcpy(reinterpret_cast<pt::uint8_t*>(win->pixel_buf)
+                       + (y + dy) * win->buf_w + x, src, copy_w);
+            break;
+        case PIXFMT_XRGB8888:
+        case PIXFMT_ARGB8888:
+            // Same layout as the window buffer: a straight row copy.
+            simd_copy32(dst, reinterpret_cast<const pt::uint32_t*>(src), copy_w);
+            break;
+        case PIXFMT_RGB565:
+            simd_rgb565_to_xrgb(dst, reinterpret_cast<const pt::uint16_t*>(src), copy_w);
+            break;
+        default:
+            simd_rgb24_to_xrgb(dst, src, copy_w);
+            break;
         }
     }
+    kernel_fpu_end();
+    damage_client(win, x, y, copy_w, copy_h);
+}
+
+bool WindowManager::user_pixels_ok(const pt::uint8_t* data, pt::uint32_t w, pt::uint32_t h,
+                                   pt::uint32_t format, pt::uint32_t stride)
+{
+    const pt::uint64_t row = (pt::uint64_t)w * pixfmt_bytes(format);
+    if (stride != 0 && stride < row) return false;
+    if (w == 0 || h == 0) return true;
+    // (h - 1) full strides, then one row: at most ~2^64 - 2^33, no wrap.
+    const pt::uint64_t span = (pt::uint64_t)(h - 1) * (stride ? stride : row) + row;
+    return user_range_ok(reinterpret_cast<pt::uintptr_t>(data), span);
 }
 
 void WindowManager::win_draw_text(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t y,
                                    const char* str, pt::uint32_t fg, pt::uint32_t bg)
 {
     Window* win = get_window(wid);
-    if (!win || !win->pixel_buf || !str) return;
+    if (!win || !win->pixel_buf || win->indexed || !str) return;
     if (!fbterm.is_ready()) return;
-    while (*str) {
-        fbterm.render_glyph_to_buf(*str, win->pixel_buf,
-                                    win->client_w, win->client_h,
-                                    x, y, fg, bg);
-        x += fbterm.glyph_w();
-        str++;
-    }
+    pt::uint32_t n = 0;
+    while (str[n]) n++;
+    fbterm.draw_text(str, n, win->pixel_buf, win->buf_w,
+                     DamageRect{ 0, 0, win->buf_w, win->buf_h }, x, y, fg, bg);
+    damage_client(win, x, y, n * fbterm.glyph_w(), fbterm.glyph_h());
 }
 
 void WindowManager::win_put_glyph(pt::uint32_t wid, char c,
@@ -387,33 +1147,194 @@ void WindowManager::win_put_glyph(pt::uint32_t wid, char c,
                                    pt::uint32_t fg, pt::uint32_t bg)
 {
     Window* win = get_window(wid);
-    if (!win || !win->pixel_buf) return;
+    if (!win || !win->pixel_buf || win->indexed) return;
     if (!fbterm.is_ready()) return;
     fbterm.render_glyph_to_buf(c, win->pixel_buf,
-                                win->client_w, win->client_h,
+                                win->buf_w, win->buf_h,
                                 px, py, fg, bg);
+    damage_client(win, px, py, fbterm.glyph_w(), fbterm.glyph_h());
 }
 
 void WindowManager::win_scroll_up(pt::uint32_t wid, pt::uint32_t pixels)
 {
     Window* win = get_window(wid);
-    if (!win || !win->pixel_buf || pixels == 0) return;
+    if (!win || !win->pixel_buf || win->indexed || pixels == 0) return;
+
+    pt::uint32_t w = win->buf_w;
+    pt::uint32_t h = win->buf_h;
+    if (pixels > h) pixels = h;
+
+    // Rows are packed, so the shift is one move and the vacated strip one
+    // fill.
+    const pt::size_t row_bytes = (pt::size_t)w * 4;
+    memmove(win->pixel_buf, win->pixel_buf + (pt::size_t)pixels * w, (h - pixels) * row_bytes);
+    memset(win->pixel_buf + (pt::size_t)(h - pixels) * w, 0, pixels * row_bytes);
+    damage_client(win, 0, 0, w, h);
+}
 
-    pt::uint32_t w = win->client_w;
-    pt::uint32_t h = win->client_h;
+// ── Command batches (SYS_DRAW_BATCH) ────────────────────────────────────
 
-    // Shift rows up
-    for (pt::uint32_t y = pixels; y < h; y++) {
-        pt::uint32_t* src = &win->pixel_buf[y * w];
-        pt::uint32_t* dst = &win->pixel_buf[(y - pixels) * w];
-        for (pt::uint32_t x = 0; x < w; x++)
-            dst[x] = src[x];
+// Move a w × h block from (sx, sy) to (dx, dy); the two may overlap.
+static bool copy_rect(Window* win, pt::uint32_t sx, pt::uint32_t sy,
+                      pt::uint32_t& w, pt::uint32_t& h, pt::uint32_t dx, pt::uint32_t dy)
+{
+    if (!clip_to_buf(win, sx, sy, w, h) || !clip_to_buf(win, dx, dy, w, h)) return false;
+    const pt::size_t bpp = win->indexed ? 1 : 4;
+    const pt::size_t pitch = win->buf_w * bpp;
+    auto* base = reinterpret_cast<pt::uint8_t*>(win->pixel_buf);
+    pt::uint8_t*       dst = base + dy * pitch + dx * bpp;
+    const pt::uint8_t* src = base + sy * pitch + sx * bpp;
+    if (w == win->buf_w) {   // whole rows: one move
+        memmove(dst, src, pitch * h);
+        return true;
     }
-    // Clear vacated bottom rows
-    pt::uint32_t clear_start = (h > pixels) ? (h - pixels) : 0;
-    for (pt::uint32_t y = clear_start; y < h; y++)
-        for (pt::uint32_t x = 0; x < w; x++)
-            win->pixel_buf[y * w + x] = 0x000000;
+    // Rows are walked away from the overlap; memmove handles it within a row.
+    if (dy > sy) {
+        for (pt::uint32_t r = h; r-- > 0; )
+            memmove(dst + r * pitch, src + r * pitch, w * bpp);
+    } else {
+        for (pt::uint32_t r = 0; r < h; r++)
+            memmove(dst + r * pitch, src + r * pitch, w * bpp);
+    }
+    return true;
+}
+
+// Draw a line with both ends included.  Axis-aligned lines are fills; the
+// rest are Bresenham, skipping pixels outside the buffer.  Ends are within
+// ±DRAW_COORD_MAX, so nothing here overflows.
+static bool line_in_range(const DrawLine& l)
+{
+    const pt::int32_t m = DRAW_COORD_MAX;
+    return l.x0 >= -m && l.x0 <= m && l.y0 >= -m && l.y0 <= m &&
+           l.x1 >= -m && l.x1 <= m && l.y1 >= -m && l.y1 <= m;
+}
+
+static void draw_line(Window* win, const DrawLine& l)
+{
+    pt::int32_t x0 = l.x0, y0 = l.y0, x1 = l.x1, y1 = l.y1;
+    if (x0 > x1) { pt::int32_t t = x0; x0 = x1; x1 = t; t = y0; y0 = y1; y1 = t; }
+    pt::int32_t top = y0 < y1 ? y0 : y1, bottom = y0 < y1 ? y1 : y0;
+    const pt::int32_t bw = (pt::int32_t)win->buf_w, bh = (pt::int32_t)win->buf_h;
+    if (x1 < 0 || x0 >= bw || bottom < 0 || top >= bh) return;
+    if (y0 == y1 || x0 == x1) {
+        pt::int32_t cx0 = x0 < 0 ? 0 : x0, cy0 = top < 0 ? 0 : top;
+        pt::int32_t cx1 = x1 >= bw ? bw - 1 : x1, cy1 = bottom >= bh ? bh - 1 : bottom;
+        fill_clipped(win, cx0, cy0, cx1 - cx0 + 1, cy1 - cy0 + 1, l.color);
+        return;
+    }
+    const pt::int32_t dx = x1 - x0, sy = y0 < y1 ? 1 : -1;
+    const pt::int32_t dy = y0 < y1 ? y0 - y1 : y1 - y0;   // -|dy|
+    pt::int32_t err = dx + dy;
+    auto* idx = reinterpret_cast<pt::uint8_t*>(win->pixel_buf);
+    for (;;) {
+        if (x0 >= 0 && x0 < bw && y0 >= 0 && y0 < bh) {
+            pt::size_t at = (pt::size_t)y0 * win->buf_w + x0;
+            if (win->indexed) idx[at] = (pt::uint8_t)l.color;
+            else              win->pixel_buf[at] = l.color;
+        }
+        if (x0 == x1 && y0 == y1) break;
+        pt::int32_t e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0++; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
+
+pt::int64_t WindowManager::draw_batch(pt::uint32_t wid, const pt::uint8_t* cmds, pt::size_t bytes)
+{
+    Window* win = get_window(wid);
+    if (!win || !win->pixel_buf) return -1;
+    const pt::uint32_t gw = fbterm.is_ready() ? fbterm.glyph_w() : 0;
+    const pt::uint32_t gh = fbterm.is_ready() ? fbterm.glyph_h() : 0;
+
+    // One FPU section for every blit in the batch.
+    kernel_fpu_begin();
+    pt::int64_t done = 0;
+    pt::size_t off = 0;
+    while (bytes - off >= sizeof(DrawCmd)) {
+        union {
+            DrawCmd  cmd;
+            DrawFill fill;
+            DrawCopy copy;
+            DrawBlit blit;
+            DrawText text;
+            DrawLine line;
+        } c;
+        if (!copy_from_user(&c.cmd, cmds + off, sizeof(DrawCmd))) break;
+        const pt::size_t size = c.cmd.size;
+        if (size < sizeof(DrawCmd) || (size & 7) || size > bytes - off) break;
+        const pt::uint8_t* body = cmds + off;
+
+        bool ok = true;
+        switch (c.cmd.op) {
+        case DRAW_FILL: {
+            if (size < sizeof(DrawFill) || !copy_from_user(&c, body, sizeof(DrawFill))) { ok = false; break; }
+            pt::uint32_t x = c.fill.x, y = c.fill.y, w = c.fill.w, h = c.fill.h;
+            if (!clip_to_buf(win, x, y, w, h)) break;
+            fill_clipped(win, x, y, w, h, c.fill.color);
+            damage_client(win, x, y, w, h);
+            break;
+        }
+        case DRAW_COPY: {
+            if (size < sizeof(DrawCopy) || !copy_from_user(&c, body, sizeof(DrawCopy))) { ok = false; break; }
+            pt::uint32_t w = c.copy.w, h = c.copy.h;
+            if (copy_rect(win, c.copy.sx, c.copy.sy, w, h, c.copy.dx, c.copy.dy))
+                damage_client(win, c.copy.dx, c.copy.dy, w, h);
+            break;
+        }
+        case DRAW_BLIT: {
+            if (size < sizeof(DrawBlit) || !copy_from_user(&c, body, sizeof(DrawBlit))) { ok = false; break; }
+            if (c.blit.format >= PIXFMT_COUNT) { ok = false; break; }
+            // The pixels are read in place, so they must be user memory too.
+            if (!user_pixels_ok(reinterpret_cast<const pt::uint8_t*>(c.blit.pixels),
+                                c.blit.w, c.blit.h, c.blit.format, c.blit.stride)) { ok = false; break; }
+            win_draw_pixels(wid, reinterpret_cast<const pt::uint8_t*>(c.blit.pixels),
+                            c.blit.x, c.blit.y, c.blit.w, c.blit.h,
+                            c.blit.format, c.blit.stride);
+            break;
+        }
+        case DRAW_TEXT: {
+            if (size < sizeof(DrawText) || !copy_from_user(&c, body, sizeof(DrawText))) { ok = false; break; }
+            const pt::uint32_t n = c.text.len;
+            if (n > DRAW_TEXT_MAX || n > size - sizeof(DrawText)) { ok = false; break; }
+            char str[DRAW_TEXT_MAX];
+            if (!copy_from_user(str, body + sizeof(DrawText), n)) { ok = false; break; }
+            if (win->indexed || gw == 0 || n == 0) break;
+            fbterm.draw_text(str, n, win->pixel_buf, win->buf_w,
+                             DamageRect{ 0, 0, win->buf_w, win->buf_h },
+                             c.text.x, c.text.y, c.text.fg, c.text.bg);
+            pt::uint32_t x = c.text.x, y = c.text.y, w = n * gw, h = gh;
+            if (clip_to_buf(win, x, y, w, h)) damage_client(win, x, y, w, h);
+            break;
+        }
+        case DRAW_LINE: {
+            if (size < sizeof(DrawLine) || !copy_from_user(&c, body, sizeof(DrawLine))) { ok = false; break; }
+            if (!line_in_range(c.line)) { ok = false; break; }
+            draw_line(win, c.line);
+            // Damage the bounding box, clipped.
+            pt::int64_t x0 = c.line.x0 < c.line.x1 ? c.line.x0 : c.line.x1;
+            pt::int64_t x1 = c.line.x0 < c.line.x1 ? c.line.x1 : c.line.x0;
+            pt::int64_t y0 = c.line.y0 < c.line.y1 ? c.line.y0 : c.line.y1;
+            pt::int64_t y1 = c.line.y0 < c.line.y1 ? c.line.y1 : c.line.y0;
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 >= x0 && y1 >= y0) {
+                pt::uint32_t x = (pt::uint32_t)x0, y = (pt::uint32_t)y0;
+                pt::uint32_t w = (pt::uint32_t)(x1 - x0 + 1), h = (pt::uint32_t)(y1 - y0 + 1);
+                if (clip_to_buf(win, x, y, w, h))
+                    damage_client(win, x, y, w, h);
+            }
+            break;
+        }
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok) break;
+        off += size;
+        done++;
+    }
+    kernel_fpu_end();
+    return done;
 }
 
 // ── Event handling ──────────────────────────────────────────────────────
@@ -427,6 +1348,41 @@ void WindowManager::push_key_event(pt::uint64_t ev)
     if (win->ev_write - win->ev_read >= EVENT_CAP) return;
     win->events[win->ev_write % EVENT_CAP] = ev;
     win->ev_write++;
+    if (win->ev_waiter != INVALID_WID) {
+        TaskScheduler::wake_task(win->ev_waiter);
+        win->ev_waiter = INVALID_WID;
+    }
+}
+
+void WindowManager::push_mouse_event(pt::int8_t dx, pt::int8_t dy, bool left, bool right)
+{
+    if (focused_id == INVALID_WID) return;
+    Window* win = &windows[focused_id];
+    if (!win->active || !win->want_mouse) return;
+
+    // A packet that only moves the mouse folds into an unread motion event
+    // with the same buttons, so a fast-moving mouse costs one slot per read
+    // instead of one per packet.  Readers pop with interrupts off, so the
+    // tail cannot be consumed while it is being rewritten.
+    const pt::uint64_t buttons = wev_make_mouse(0, 0, left, right);
+    if (win->ev_write != win->ev_read) {
+        pt::uint64_t& tail = win->events[(win->ev_write - 1) % EVENT_CAP];
+        if ((tail & ~(pt::uint64_t)0xFFFFFFFF) == buttons) {
+            pt::int32_t sx = (pt::int16_t)(tail & 0xFFFF) + dx;
+            pt::int32_t sy = (pt::int16_t)((tail >> 16) & 0xFFFF) + dy;
+            if (sx >= -32768 && sx <= 32767 && sy >= -32768 && sy <= 32767) {
+                tail = wev_make_mouse((pt::int16_t)sx, (pt::int16_t)sy, left, right);
+                return;
+            }
+        }
+    }
+    if (win->ev_write - win->ev_read >= EVENT_CAP) return;
+    win->events[win->ev_write % EVENT_CAP] = wev_make_mouse(dx, dy, left, right);
+    win->ev_write++;
+    if (win->ev_waiter != INVALID_WID) {
+        TaskScheduler::wake_task(win->ev_waiter);
+        win->ev_waiter = INVALID_WID;
+    }
 }
 
 pt::uint64_t WindowManager::poll_event(pt::uint32_t wid)
@@ -434,12 +1390,69 @@ pt::uint64_t WindowManager::poll_event(pt::uint32_t wid)
     if (wid >= MAX_WINDOWS) return 0;
     Window* win = &windows[wid];
     if (!win->active) return 0;
-    if (win->ev_read == win->ev_write) return 0;
-    pt::uint64_t ev = win->events[win->ev_read % EVENT_CAP];
-    win->ev_read++;
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    pt::uint64_t ev = 0;
+    if (win->ev_read != win->ev_write) {
+        ev = win->events[win->ev_read % EVENT_CAP];
+        win->ev_read++;
+    }
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory");
     return ev;
 }
 
+pt::uint32_t WindowManager::poll_events(pt::uint32_t wid, pt::uint64_t* out, pt::uint32_t max)
+{
+    if (wid >= MAX_WINDOWS) return 0;
+    Window* win = &windows[wid];
+    if (!win->active) return 0;
+    pt::uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    pt::uint32_t n = win->ev_write - win->ev_read;
+    if (n > max) n = max;
+    for (pt::uint32_t i = 0; i < n; i++)
+        out[i] = win->events[(win->ev_read + i) % EVENT_CAP];
+    win->ev_read += n;
+    asm volatile("push %0; popfq" :: "r"(flags) : "memory");
+    return n;
+}
+
+pt::uint32_t WindowManager::wait_events(pt::uint32_t wid, pt::uint64_t timeout_ms)
+{
+    if (wid >= MAX_WINDOWS) return 0;
+    Window* win = &windows[wid];
+    Task* t = TaskScheduler::get_current_task();
+
+    // Same shape as FUTEX_WAIT: check and go TASK_BLOCKED with interrupts
+    // off, so an event pushed by the keyboard or mouse IRQ between the check
+    // and the yield still finds the waiter and wakes it.  A timeout rides on
+    // the sleep deadline that preempt() already scans; whichever comes
+    // first makes the task READY again.
+    asm volatile("cli");
+    if (!win->active || win->ev_write != win->ev_read || timeout_ms == 0 ||
+        win->ev_waiter != INVALID_WID) {
+        pt::uint32_t n = win->active ? win->ev_write - win->ev_read : 0;
+        asm volatile("sti");
+        return n;
+    }
+    win->ev_waiter = t->id;
+    if (timeout_ms != WEV_WAIT_FOREVER) {
+        // 50 Hz timer: round up to whole 20 ms ticks, as sleep_task() does.
+        pt::uint64_t ticks = (timeout_ms + 19) / 20;
+        t->sleep_deadline = get_ticks() + ticks;
+    }
+    t->state = TASK_BLOCKED;
+    asm volatile("sti");
+    TaskScheduler::task_yield();
+
+    asm volatile("cli");
+    t->sleep_deadline = 0;
+    if (win->ev_waiter == t->id) win->ev_waiter = INVALID_WID;  // timed out
+    pt::uint32_t n = win->active ? win->ev_write - win->ev_read : 0;
+    asm volatile("sti");
+    return n;
+}
+
 Window* WindowManager::get_window(pt::uint32_t wid)
 {
     if (wid >= MAX_WINDOWS) return nullptr;
@@ -641,6 +1654,58 @@ void WindowManager::put_char(pt::uint32_t wid, char c)
     }
 }
 
+void WindowManager::write_text(pt::uint32_t wid, const char* buf, pt::uint32_t n)
+{
+    Window* win = get_window(wid);
+    if (!win) return;
+    const pt::uint32_t gw = fbterm.glyph_w();
+    const pt::uint32_t gh = fbterm.glyph_h();
+    if (gw == 0 || gh == 0) return;
+    const pt::uint32_t cols = win->client_w / gw;
+    const pt::uint32_t rows = win->client_h / gh;
+    if (cols == 0 || rows == 0) return;
+    const bool drawable = win->pixel_buf && !win->indexed;
+
+    pt::uint32_t i = 0;
+    while (i < n) {
+        // Escapes, control characters and anything inside a sequence take
+        // the per-character path.
+        pt::uint32_t len = 0;
+        while (i + len < n && buf[i + len] >= 0x20 && buf[i + len] < 0x7F) len++;
+        if (len == 0 || win->ansi.state != AnsiParser::NORMAL) {
+            put_char(wid, buf[i++]);
+            continue;
+        }
+        // Same cursor rules as put_char, a line at a time.
+        while (len) {
+            if (win->wrap_pending) {
+                win->wrap_pending = false;
+                win->text_col = 0;
+                if (++win->text_row >= rows) {
+                    win_scroll_up(wid, gh);
+                    win->text_row = rows - 1;
+                }
+            }
+            pt::uint32_t take = cols - win->text_col;
+            if (take > len) take = len;
+            const pt::uint32_t px = win->text_col * gw, py = win->text_row * gh;
+            if (drawable) {
+                fbterm.draw_text(buf + i, take, win->pixel_buf, win->buf_w,
+                                 DamageRect{ 0, 0, win->buf_w, win->buf_h },
+                                 px, py, win->fg, win->bg);
+                damage_client(win, px, py, take * gw, gh);
+            }
+            win->text_col += take;
+            i   += take;
+            len -= take;
+            if (win->text_col >= cols) {
+                win->text_col = cols - 1;
+                win->wrap_pending = true;
+            }
+        }
+    }
+}
+
 // ── Focus & raise (compositor handles visual updates) ───────────────────
 
 void WindowManager::raise_window(pt::uint32_t wid)
@@ -653,12 +1718,15 @@ void WindowManager::raise_window(pt::uint32_t wid)
 
     z_remove(wid);
     z_insert_top(wid);
+    vis_dirty = true;
+    damage_window(wid);
 }
 
 void WindowManager::set_focus(pt::uint32_t wid)
 {
     // INVALID_WID means "unfocus all" — click on the desktop.
     if (wid == INVALID_WID) {
+        if (focused_id != INVALID_WID) damage_window(focused_id);
         focused_id = INVALID_WID;
         if (g_active_vt < VTERM_COUNT)
             focused_per_vt[g_active_vt] = INVALID_WID;
@@ -673,6 +1741,8 @@ void WindowManager::set_focus(pt::uint32_t wid)
 
     if (focused_id == wid) return;
 
+    if (focused_id != INVALID_WID) damage_window(focused_id);
+    damage_window(wid);
     focused_id = wid;
     if (g_active_vt < VTERM_COUNT)
         focused_per_vt[g_active_vt] = wid;
@@ -734,13 +1804,17 @@ void WindowManager::move_window(pt::uint32_t wid, pt::int32_t new_x, pt::int32_t
     if (new_y < min_y) new_y = min_y;
     if (new_y > max_y) new_y = max_y;
 
-    // Compositor repaints from wallpaper+VTerm next frame — no restore needed.
+    // Damaging the old frame makes the compositor repaint what was under
+    // it from wallpaper+VTerm+lower windows — no restore needed.
+    damage_window(wid);
 
     // Update position (screen_x/y is the outer frame origin)
     win->screen_x = (pt::uint32_t)new_x;
     win->screen_y = (pt::uint32_t)new_y;
     win->client_ox = win->screen_x + BORDER_W;
     win->client_oy = win->screen_y + BORDER_W + TITLE_BAR_H;
+    vis_dirty = true;
+    damage_window(wid);
     // pixel_buf content is preserved — no text cursor reset needed
 }
 
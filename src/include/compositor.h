@@ -0,0 +1,26 @@
+#pragma once
+#include "defs.h"
+
+// ── Compositor task ─────────────────────────────────────────────────────────
+// Framebuffer::Flush() runs in a kernel task of its own, with interrupts
+// enabled, instead of inside the timer IRQ.  The task sleeps until damage
+// arrives, then composites at most once per frame interval: damage that
+// comes in meanwhile merges into the pending list and goes out together.
+
+constexpr pt::uint32_t COMPOSITOR_HZ       = 60;
+constexpr pt::uint64_t COMPOSITOR_FRAME_US = 1000000 / COMPOSITOR_HZ;
+
+struct CompositorStats {
+    pt::uint64_t wakeups;   // times new damage woke the idle task
+    pt::uint64_t dropped;   // frame intervals missed: a frame that finished
+                            // k intervals after it was due drops k
+};
+
+// Create the task.  Call once the framebuffer and back buffer exist.
+void compositor_start();
+
+// New damage is pending.  Called by Framebuffer::add_damage(); safe from
+// IRQ handlers and syscalls.
+void compositor_wake();
+
+const CompositorStats& compositor_stats();
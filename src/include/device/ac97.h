@@ -72,12 +72,12 @@ constexpr pt::uint16_t AC97_VOLUME_MUTE = 0x8000;
 struct __attribute__((packed)) AC97_BDL_Entry {
     pt::uint32_t phys_addr;    // Physical address of the audio data buffer
     pt::uint16_t num_samples;  // Number of 16-bit samples (not bytes)
-    pt::uint16_t flags;        // Bit 15: last entry, Bit 14: interrupt on completion
+    pt::uint16_t flags;        // Bit 15: interrupt on completion, Bit 14: buffer underrun policy
 };
 
 // BDL flags
-constexpr pt::uint16_t AC97_BDL_FLAG_LAST = 0x8000;  // Last buffer in list
-constexpr pt::uint16_t AC97_BDL_FLAG_IOC  = 0x4000;  // Interrupt on completion
+constexpr pt::uint16_t AC97_BDL_FLAG_IOC  = 0x8000;  // Raise BCIS when this buffer completes
+constexpr pt::uint16_t AC97_BDL_FLAG_BUP  = 0x4000;  // Past LVI: 1 = output zeros, 0 = repeat last sample
 
 // AC97 hardware limits
 constexpr pt::uint8_t  AC97_MAX_BDL_ENTRIES  = 32;    // 5-bit CIV in the hardware
@@ -93,6 +93,22 @@ constexpr pt::uint32_t AC97_DMA_BUFFER_BYTES = 0x8000;  // 32 KB per DMA buffer
 //    head-room for slow producers. 4 × 32 KB ≈ 680 ms is a safe default.
 constexpr pt::uint8_t  AC97_QUEUE_LIMIT      = 4;
 
+// A writer blocked in queue_pcm_wait() is woken by the buffer-completion
+// interrupt.  The deadline is only a safety net for a lost interrupt; with
+// no usable IRQ line the driver polls once per tick instead.
+constexpr pt::uint64_t AC97_WAIT_TICKS       = 5;    // 100 ms at 50 Hz
+
+// Counters behind /proc/audio.
+struct AudioStats {
+    pt::uint64_t interrupts;    // PCM-Out interrupts handled
+    pt::uint64_t writes;        // chunks queued
+    pt::uint64_t blocked;       // writes that had to wait for a free slot
+    pt::uint64_t underruns;     // ring ran dry while the mixer owned it
+    pt::uint64_t wakeups;       // blocked writers woken by the interrupt
+    pt::uint64_t wake_us;       // interrupt -> writer running, summed
+    pt::uint64_t wake_max_us;
+};
+
 class AC97 {
 public:
     // Find AC97 on PCI bus, reset codec, configure volume.
@@ -102,23 +118,9 @@ public:
     // True if initialize() succeeded.
     static bool is_present();
 
-    // Generate a square-wave beep internally and play it.
-    // Frequency Hz, duration in milliseconds (capped by one DMA buffer ~340 ms at 48 kHz).
-    static bool play_beep(pt::uint32_t frequency_hz = 880, pt::uint32_t duration_ms = 500);
-
-    // Play raw 16-bit signed little-endian stereo PCM at the given sample rate.
-    // data    : pointer to PCM samples
-    // length  : byte count
-    // rate    : sample rate in Hz (default 48000)
-    static bool play_pcm(const pt::uint8_t* data, pt::uint32_t length,
-                         pt::uint32_t rate = 48000);
-
     // Stop DMA playback.
     static void stop();
 
-    // True while DMA is running.
-    static bool is_playing();
-
     // Open audio device: configure sample rate and channels. Caller sets owner_task_id.
     static bool open(pt::uint32_t rate, pt::uint8_t channels, pt::uint8_t format);
 
@@ -128,13 +130,31 @@ public:
     // Queue PCM data into next free DMA slot. Returns bytes queued, 0 if full.
     static pt::uint32_t queue_pcm(const pt::uint8_t* data, pt::uint32_t length);
 
+    // queue_pcm, but sleep until a slot frees up instead of returning 0.
+    // Returns 0 only if the calling task does not own the device.
+    static pt::uint32_t queue_pcm_wait(const pt::uint8_t* data, pt::uint32_t length);
+
+    // PCM-Out interrupt.  The line may be shared, so returns false without
+    // touching anything if the channel has no status bit latched.
+    static bool handle_irq();
+
+    // Audio queued ahead of the DAC in microseconds (current buffer
+    // remainder plus the entries up to LVI).  0 when halted.
+    static pt::uint64_t queued_us();
+
+    // PCI interrupt line, and whether the driver runs interrupt-driven.
+    static pt::uint8_t irq_line();
+    static bool        irq_enabled();
+
+    static const AudioStats& stats();
+
     // Check if current DMA slot finished; auto-start next if queued.
     static void poll_dma();
 
     // True if at least one DMA slot is available for writing.
     static bool has_free_slot();
 
-    // Task that owns the audio device (-1 = no owner).
+    // Task feeding the ring — the mixer task while it plays (-1 = idle).
     static pt::int32_t owner_task_id;
 
     // Set master volume 0 (mute) .. 100 (max).
@@ -174,12 +194,17 @@ private:
     // Set sample rate on NAM (enables VRA if codec supports it)
     static void set_sample_rate(pt::uint32_t rate);
 
-    // Fill the BDL for a contiguous audio buffer, start DMA
-    static bool start_dma(const pt::uint8_t* data, pt::uint32_t length);
-
     // Reset PCM-Out channel registers
     static void reset_channel();
 
+    // Interrupt state.  `waiter` is the task sleeping in queue_pcm_wait()
+    // (-1 = none); `irq_stamp_us` is when the last interrupt woke it.
+    static pt::uint8_t   pci_irq;
+    static bool          use_irq;
+    static pt::int32_t   waiter;
+    static pt::uint64_t  irq_stamp_us;
+    static AudioStats    audio_stats;
+
     // Streaming ring buffer state (double-buffered DMA via BDL entries 0..N-1)
     static pt::uint8_t   ring_head;       // next BDL entry to fill (0..AC97_RING_SIZE-1)
     static bool          dma_running;     // true while RPBM bit is set
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "defs.h"
+
+// Bochs Graphics Adapter (BGA) / QEMU stdvga "dispi" interface
+//
+// The mode the bootloader set is left alone.  The driver only grows the
+// virtual height to two screens and moves the Y offset, so the compositor
+// can draw into the hidden half of VRAM and show it in one register write.
+//
+// Registers are reached through an index/data I/O port pair.  The linear
+// framebuffer is BAR0 of the PCI function.
+//
+// PCI identification: vendor=0x1234 device=0x1111
+
+constexpr pt::uint16_t BGA_VENDOR_ID = 0x1234;
+constexpr pt::uint16_t BGA_DEVICE_ID = 0x1111;
+
+constexpr pt::uint16_t BGA_IOPORT_INDEX = 0x01CE;
+constexpr pt::uint16_t BGA_IOPORT_DATA  = 0x01CF;
+
+// Register indices
+constexpr pt::uint16_t BGA_INDEX_ID          = 0x00;
+constexpr pt::uint16_t BGA_INDEX_XRES        = 0x01;
+constexpr pt::uint16_t BGA_INDEX_YRES        = 0x02;
+constexpr pt::uint16_t BGA_INDEX_BPP         = 0x03;
+constexpr pt::uint16_t BGA_INDEX_ENABLE      = 0x04;
+constexpr pt::uint16_t BGA_INDEX_VIRT_WIDTH  = 0x06;
+constexpr pt::uint16_t BGA_INDEX_VIRT_HEIGHT = 0x07;
+constexpr pt::uint16_t BGA_INDEX_X_OFFSET    = 0x08;
+constexpr pt::uint16_t BGA_INDEX_Y_OFFSET    = 0x09;
+constexpr pt::uint16_t BGA_INDEX_VIDEO_MEMORY_64K = 0x0A;  // VRAM size in 64 KB units
+
+// ID register values: 0xB0C0 .. 0xB0C5.  Virtual size and offsets exist
+// from 0xB0C1 on.
+constexpr pt::uint16_t BGA_ID_MIN = 0xB0C1;
+constexpr pt::uint16_t BGA_ID_MAX = 0xB0C5;
+
+constexpr pt::uint16_t BGA_ENABLED = 0x01;
+
+class BGA {
+public:
+    // Find the adapter, check that it is scanning out `lfb` in the given
+    // mode, and stretch the virtual height to two pages.  Returns false
+    // (and leaves the registers alone) if any of that does not hold or
+    // VRAM is too small for a second page.
+    static bool initialize(pt::uintptr_t lfb, pt::uint32_t width,
+                           pt::uint32_t height, pt::uint32_t bpp, pt::uint32_t stride);
+
+    // True if initialize() succeeded.
+    static bool is_present();
+
+    // Bytes of VRAM (0 if not present).
+    static pt::size_t vram_size();
+
+    // Scan out from row `y` of the virtual screen.  Page n starts at row
+    // n * height.  Takes effect at the next refresh.
+    static void set_y_offset(pt::uint32_t y);
+
+private:
+    static pt::uint16_t read(pt::uint16_t index);
+    static void         write(pt::uint16_t index, pt::uint16_t value);
+
+    static bool       initialized;
+    static pt::size_t vram_bytes;
+};
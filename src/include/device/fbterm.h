@@ -26,14 +26,24 @@ public:
     void print(const char* str);
 
     // Draw a string at a fixed pixel position (does not affect the scroll cursor).
-    // Useful for HUD overlays like a clock.
+    // Useful for HUD overlays like a clock.  `target` overrides the bound
+    // framebuffer (the compositor passes the one it is building).
     void draw_at(pt::uint32_t px, pt::uint32_t py, const char* str,
-                 pt::uint32_t fg = 0xFFFFFF, pt::uint32_t bg = 0x000000);
+                 pt::uint32_t fg = 0xFFFFFF, pt::uint32_t bg = 0x000000,
+                 Framebuffer* target = nullptr);
 
     // Render one glyph at absolute pixel (px, py) using fg/bg; no cursor change.
     void put_char_at(char c, pt::uint32_t px, pt::uint32_t py,
                      pt::uint32_t fg = 0xFFFFFF, pt::uint32_t bg = 0x000000);
 
+    // Draw `n` characters of `str` as one run from pixel (px, py) into a
+    // 32-bit buffer `pitch` pixels wide, clipped to `clip`.  Glyphs are
+    // copied from the atlas for (fg, bg); characters above 127 show as '?'.
+    void draw_text(const char* str, pt::uint32_t n, pt::uint32_t* buf,
+                   pt::uint32_t pitch, const DamageRect& clip,
+                   pt::uint32_t px, pt::uint32_t py,
+                   pt::uint32_t fg, pt::uint32_t bg);
+
     // Render one glyph into an arbitrary uint32 buffer (for window pixel_buf).
     void render_glyph_to_buf(char c, pt::uint32_t* buf,
                               pt::uint32_t buf_w, pt::uint32_t buf_h,
@@ -59,10 +69,26 @@ public:
     Framebuffer* get_fb() const { return m_fb; }
 
 private:
-    void draw_glyph(char c, pt::uint32_t px, pt::uint32_t py);
+    // Colors are passed in rather than read from m_fg/m_bg so the compositor
+    // task and other callers can draw concurrently.
+    void draw_glyph(char c, pt::uint32_t px, pt::uint32_t py,
+                    pt::uint32_t fg, pt::uint32_t bg, Framebuffer* fb = nullptr);
     void newline();
     void scroll();
 
+    // Glyph atlas: for each (fg, bg) pair in use, all ATLAS_GLYPHS glyphs
+    // pre-rendered to 32-bit pixels, one glyph_w × glyph_h block after
+    // another.  Slots are filled on first use and reused round robin.  The
+    // compositor and syscalls draw text concurrently, so the atlas is only
+    // touched with interrupts off (draw_text).
+    static constexpr pt::uint32_t ATLAS_SLOTS  = 8;
+    static constexpr pt::uint32_t ATLAS_GLYPHS = 128;
+    struct AtlasSlot {
+        pt::uint32_t  fg, bg;
+        bool          valid;
+    };
+    const pt::uint32_t* atlas_for(pt::uint32_t fg, pt::uint32_t bg);
+
     Framebuffer*       m_fb        = nullptr;
     const pt::uint8_t* m_glyphs    = nullptr;  // pointer into psf_data past header
     pt::uint32_t       m_glyph_h   = 0;
@@ -77,6 +103,9 @@ private:
     AnsiParser         m_ansi;
     pt::uint32_t       m_saved_col = 0;
     pt::uint32_t       m_saved_row = 0;
+    pt::uint32_t*      m_atlas_px  = nullptr;  // ATLAS_SLOTS glyph sets
+    AtlasSlot          m_atlas[ATLAS_SLOTS] = {};
+    pt::uint32_t       m_atlas_next = 0;
 };
 
 extern FbTerm fbterm;
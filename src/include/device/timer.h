@@ -27,5 +27,13 @@ void check_timers();
 void timer_list_all();
 // Called by irq0_schedule; increments ticks and fires callbacks (no scheduler call).
 void timer_tick();
-// Enable framebuffer flush in timer_tick (call after Framebuffer is fully initialized).
-void enable_fb_flush();
+
+// Delay between the PIT firing and timer_tick() running, i.e. how long
+// interrupts were held off.  Reported by /proc/fbstat.
+struct TickLatency {
+    pt::uint64_t samples;
+    pt::uint64_t total_us;
+    pt::uint64_t last_us;
+    pt::uint64_t max_us;
+};
+const TickLatency& timer_tick_latency();
@@ -1,20 +1,43 @@
 #pragma once
 #include "defs.h"
+#include "fs/vfs.h"
+
+// One PT_LOAD segment as described by its program header.
+struct ElfSegment {
+    pt::uintptr_t vaddr;    // first VA of the segment
+    pt::uint64_t  offset;   // file offset of the segment's data
+    pt::uint64_t  filesz;   // bytes backed by the file
+    pt::uint64_t  memsz;    // bytes in memory (excess over filesz is zero)
+    pt::uint32_t  flags;    // PF_X | PF_W | PF_R
+};
+
+// Parsed ELF executable: entry point and PT_LOAD segments, plus the open
+// file they are streamed from.  Produced by ElfLoader::load, released by
+// ElfLoader::release.
+struct ElfImage {
+    static constexpr pt::size_t MAX_SEGMENTS = 16;
+
+    pt::uintptr_t entry;
+    pt::uintptr_t va_min;              // lowest segment VA
+    pt::uintptr_t va_max;              // one past the highest segment byte
+    ElfSegment    segs[MAX_SEGMENTS];
+    pt::size_t    num_segs;
+    File          file;                // open while the image is loaded
+    pt::uint32_t  file_pos;            // current read position in `file`
+};
 
 class ElfLoader {
 public:
-    // Maximum ELF code pages (must match Task::MAX_PRIV_PTS * 512).
-    static constexpr pt::size_t MAX_ELF_PAGES = 8 * 512;  // 16 MB
+    // Open an ELF file, read and validate only its ELF and program headers,
+    // and collect its PT_LOAD segments.  Segment data stays on disk; the
+    // caller streams it into its own frames with read().
+    // Returns false on failure (nothing is left open).
+    static bool load(const char* filename, ElfImage* img);
 
-    // Per-page permission flags stored during load(), consumed by create_elf_task.
-    // Bit 0 = executable, bit 1 = writable (matches PF_X, PF_W from ELF spec).
-    static pt::uint8_t page_flags[MAX_ELF_PAGES];
+    // Read `len` bytes at file offset `offset` into `dst`.  Sequential reads
+    // skip the seek.  Returns false on a short read.
+    static bool read(ElfImage* img, pt::uint64_t offset, void* dst, pt::size_t len);
 
-    // Load ELF segments from a FAT12 file into virtual memory.
-    // Returns the entry point address, or 0 on failure.
-    // If out_code_size is non-null, it receives the total byte span of all
-    // PT_LOAD segments (max(vaddr+memsz) - min(vaddr)).
-    // Populates page_flags[] with per-page permissions.
-    static pt::uintptr_t load(const char* filename,
-                              pt::size_t* out_code_size = nullptr);
+    // Close the file held by a loaded image.
+    static void release(ElfImage* img);
 };
@@ -3,32 +3,120 @@
 #include "boot.h"
 #include "virtual.h"
 
+// Screen rectangle, half-open: [x0, x1) × [y0, y1).
+struct DamageRect {
+    pt::uint32_t x0, y0, x1, y1;
+};
+
+// Compositor cost counters, reported by /proc/fbstat.
+struct FrameStats {
+    pt::uint64_t frames;      // Flush calls that recomposited something
+    pt::uint64_t idle;        // Flush calls skipped because nothing was damaged
+    pt::uint64_t pixels;      // pixels recomposited and uploaded, all frames
+    pt::uint64_t total_us;    // time spent in non-idle Flush calls
+    pt::uint64_t last_us;
+    pt::uint64_t max_us;
+    pt::uint64_t last_pixels;
+    pt::uint64_t upload_us;   // time spent copying the back buffer to VRAM
+    pt::uint64_t flips;       // pages shown by page flipping
+    pt::uint64_t replay_pixels; // pixels redrawn because the page missed a frame
+    pt::uint64_t cursor_moves;  // Flush calls that only moved the cursor
+    pt::uint64_t cursor_bytes;  // VRAM bytes written by those
+    pt::uint64_t cursor_us;     // time spent in them
+    pt::uint64_t cursor_shown;  // cursor positions that reached the screen
+    pt::uint64_t cursor_lat_us; // set_cursor_pos → on screen, summed over those
+    pt::uint64_t cursor_lat_max;
+};
+
+// How VRAM is cached.  Firmware leaves it uncached, where every store is a
+// separate bus write; write-combining lets the CPU batch them into bursts.
+enum class VramMapping : pt::uint8_t {
+    Uncached,   // as the firmware left it
+    PatWC,      // page tables select the PAT write-combining entry
+    MtrrWC,     // a variable-range MTRR covers it (no PAT)
+};
+
 class Framebuffer
 {
     pt::uintptr_t m_addr;       // VRAM (front buffer)
     pt::uintptr_t m_back;       // back buffer (all rendering goes here)
+    pt::uintptr_t m_back_ram;   // RAM back buffer; m_back unless page flipping
     pt::uintptr_t m_wallpaper;  // wallpaper buffer (persistent desktop layer)
     pt::uint32_t  m_width;
     pt::uint32_t  m_height;
     pt::uint32_t  m_bpp;
     pt::uint32_t  m_stride;
-    bool          m_dirty;      // true if back buffer has changed since last flush
 
-    // Cursor state (composited during Flush, not drawn to back buffer)
+    // Screen areas that changed since the last Flush.  Overlapping or
+    // touching rects are merged on insert; when the list is full the new
+    // rect is folded into whichever entry grows least.
+    static constexpr pt::uint32_t DAMAGE_MAX = 16;
+    DamageRect    m_damage[DAMAGE_MAX];
+    pt::uint32_t  m_damage_count;
+
+    // PutPixel (and so FillRect and the fbterm glyph renderer) only writes
+    // inside this rect.  Flush narrows it to the damage rect being rebuilt.
+    DamageRect    m_clip;
+
+    FrameStats    m_stats;
+    VramMapping   m_mapping;
+
+    // Page flipping (device/bga.h): two screens of VRAM.  The compositor
+    // draws straight into the hidden one (m_back) and then shows it, so no
+    // upload is needed and nothing half-drawn is ever scanned out.  That
+    // page last saw the frame before the previous one, so each Flush also
+    // redraws the previous frame's damage (m_prev).
+    pt::uintptr_t m_pages[2];   // 0 when the adapter cannot flip
+    pt::uint32_t  m_front;      // page being scanned out
+    bool          m_flip;       // flipping now
+    bool          m_flip_want;  // requested; Flush switches over
+    DamageRect    m_prev[DAMAGE_MAX];
+    pt::uint32_t  m_prev_count;
+
+    // Cursor overlay.  The sprite is drawn onto the page being shown and
+    // never into the back buffer.  Each page keeps the pixels the sprite
+    // covers (page 0 when not flipping), so a move only rewrites the old
+    // and new 16×16 rects: Flush needs no damage and composites nothing.
+    static constexpr pt::int32_t CURSOR_PX = 16;
+    struct CursorSave {
+        pt::int32_t  x, y;
+        bool         drawn;
+        pt::uint32_t under[CURSOR_PX * CURSOR_PX];
+    };
+    CursorSave    m_under[2];
+    // Where the mouse wants it (set_cursor_pos, IRQ context).
     pt::int16_t   m_cursor_x;
     pt::int16_t   m_cursor_y;
     bool          m_cursor_visible;
+    bool          m_cursor_dirty;    // differs from what is on screen
+    pt::uint64_t  m_cursor_req_us;   // when it started to
 
     Framebuffer(const pt::uintptr_t addr, const pt::uint32_t width,
                 const pt::uint32_t height, const pt::uint32_t bpp,
-                const pt::uint32_t stride) : m_addr(addr), m_back(0),
+                const pt::uint32_t stride) : m_addr(addr), m_back(0), m_back_ram(0),
                                    m_wallpaper(0), m_width(width), m_height(height),
                                    m_bpp(bpp), m_stride(stride),
-                                   m_dirty(false),
+                                   m_damage_count(0),
+                                   m_clip{0, 0, width, height},
+                                   m_stats{},
+                                   m_mapping(VramMapping::Uncached),
+                                   m_pages{0, 0}, m_front(0),
+                                   m_flip(false), m_flip_want(false),
+                                   m_prev_count(0),
+                                   m_under{},
                                    m_cursor_x(0), m_cursor_y(0),
-                                   m_cursor_visible(false)
+                                   m_cursor_visible(false), m_cursor_dirty(false),
+                                   m_cursor_req_us(0)
     {
     }
+    static void MergeDamage(DamageRect* list, pt::uint32_t& count, DamageRect n);
+    void RebuildRect(const DamageRect& r);
+    void SwitchFlipMode();
+    // Restore / save-and-draw the cursor on `page` (an index into m_under);
+    // the save-under is read from `src`.  Both return VRAM bytes written.
+    pt::uint64_t EraseCursor(pt::uint32_t page);
+    pt::uint64_t DrawCursor(pt::uint32_t page, pt::uintptr_t src);
+    pt::uintptr_t page_addr(pt::uint32_t page) const { return m_flip ? m_pages[page] : m_addr; }
     void PutPixel(
         pt::uint32_t x, pt::uint32_t y,
         pt::uint32_t color);
@@ -46,26 +134,47 @@ public:
 
     static void Init(const boot_framebuffer *fb);
     void InitBackBuffer();
+
+    // Map VRAM write-combining: PAT if the CPU has it, else an MTRR.
+    // Leaves it uncached (and says so) when neither works.
+    void InitWriteCombining();
+    VramMapping   get_mapping() const { return m_mapping; }
+    pt::uintptr_t get_vram()    const { return m_addr; }
+
+    // Set up page flipping if the display is a Bochs/QEMU stdvga adapter
+    // with VRAM for two screens, and turn it on.  Call before
+    // InitWriteCombining() so the mapping covers both pages.
+    void InitPageFlip();
+    // Switch between page flipping and copying the RAM back buffer to
+    // VRAM; takes effect at the next Flush.  False if flipping is
+    // unavailable.
+    bool SetPageFlip(bool on);
+    bool can_flip()    const { return m_pages[1] != 0; }
+    bool is_flipping() const { return m_flip; }
     pt::uint32_t  get_width()  const { return m_width; }
     pt::uint32_t  get_height() const { return m_height; }
     pt::uintptr_t get_back()   const { return m_back; }
+    pt::uintptr_t get_back_ram() const { return m_back_ram; }
     pt::uint32_t  get_stride() const { return m_stride; }
     pt::uint32_t  get_bpp()    const { return m_bpp; }
+    const DamageRect& get_clip() const { return m_clip; }
     void Free() {
         if (m_wallpaper) {
             vmm.kfree(reinterpret_cast<void*>(m_wallpaper));
             m_wallpaper = 0;
         }
-        if (m_back) {
-            vmm.kfree(reinterpret_cast<void*>(m_back));
-            m_back = 0;
+        if (m_back_ram) {
+            vmm.kfree(reinterpret_cast<void*>(m_back_ram));
+            m_back_ram = m_back = 0;
         }
     }
     static Framebuffer* get_instance();
 
+    // format: PIXFMT_* (syscall.h); stride: source bytes per row, 0 = packed.
     void Draw(const pt::uint8_t* what,
               pt::uint32_t x_pos, pt::uint32_t y_pos,
-              pt::uint32_t width, pt::uint32_t height);
+              pt::uint32_t width, pt::uint32_t height,
+              pt::uint32_t format, pt::uint32_t stride);
 
     void Clear(pt::uint8_t r, pt::uint8_t g, pt::uint8_t b);
     void FillRect(pt::uint32_t x, pt::uint32_t y,
@@ -77,8 +186,12 @@ public:
                         pt::uint32_t w, pt::uint32_t h,
                         pt::uint32_t pixels);
 
-    // Cursor position (composited during Flush, not drawn to back buffer)
+    // Move the cursor overlay.  Wakes the compositor without damaging
+    // anything; safe from IRQ handlers.
     void set_cursor_pos(pt::int16_t x, pt::int16_t y, bool visible);
+    pt::int16_t get_cursor_x() const { return m_cursor_x; }
+    pt::int16_t get_cursor_y() const { return m_cursor_y; }
+    bool cursor_visible() const { return m_cursor_visible; }
 
     // Allocate wallpaper buffer and fill with black.
     void InitWallpaper();
@@ -91,6 +204,19 @@ public:
     // Fill wallpaper buffer with a solid color.
     void ClearWallpaper(pt::uint8_t r, pt::uint8_t g, pt::uint8_t b);
 
-    // Copy back buffer to VRAM (with cursor overlay). Called from timer interrupt.
+    // Mark a screen area for recomposition on the next Flush and wake the
+    // compositor task.  Clipped to the screen; safe from any context.
+    void add_damage(pt::int32_t x, pt::int32_t y, pt::uint32_t w, pt::uint32_t h);
+    void damage_all();
+    bool has_damage() const { return m_damage_count != 0 || m_cursor_dirty; }
+
+    const FrameStats& frame_stats() const { return m_stats; }
+
+    // Rebuild the damaged areas of the back buffer (wallpaper, VTerm, windows)
+    // and stream them to VRAM with non-temporal stores, then overlay the
+    // cursor.  When page flipping, rebuild in the hidden page and show it
+    // instead.  With no damage but a cursor move, only the cursor is
+    // redrawn; with neither it returns immediately.  Called by the compositor task (compositor.h)
+    // with interrupts enabled.
     void Flush();
 };
@@ -43,6 +43,8 @@ private:
     int gen_version (char* buf, int cap);
     int gen_meminfo (char* buf, int cap);
     int gen_uptime  (char* buf, int cap);
+    int gen_fbstat  (char* buf, int cap);
+    int gen_audio   (char* buf, int cap);
     int gen_status  (pt::uint32_t pid, char* buf, int cap);
     int gen_maps    (pt::uint32_t pid, char* buf, int cap);
     int gen_syscalls(pt::uint32_t pid, char* buf, int cap);
@@ -0,0 +1,76 @@
+#pragma once
+#include "defs.h"
+
+struct Task;
+
+// ── Audio mixer ─────────────────────────────────────────────────────────────
+// Tasks no longer own the AC97.  Each task that opens audio (or just writes
+// it) gets a stream of its own with its own sample rate, format, channel
+// count and volume.  A kernel task resamples every stream to the codec rate
+// (16.16 fixed-point, linear interpolation), mixes them with saturation and
+// queues the result on the AC97 ring one period at a time.  While a stream
+// is open but empty it mixes silence, so the DAC keeps running; with no
+// stream at all the task sleeps and the ring drains.
+
+constexpr pt::uint32_t MIXER_RATE          = 48000;
+constexpr pt::uint32_t MIXER_PERIOD_FRAMES = 1024;   // ~21 ms per DMA buffer
+constexpr pt::uint32_t MIXER_MAX_STREAMS   = 16;
+
+// Each stream queues up to STREAM_SLOTS writes of at most STREAM_SLOT_BYTES:
+// the depth and chunk size a single owner used to get from the DMA ring.
+constexpr pt::uint32_t STREAM_SLOTS        = 4;
+constexpr pt::uint32_t STREAM_SLOT_BYTES   = 0x8000;
+
+struct MixerStats {
+    pt::uint64_t periods;   // periods queued on the AC97
+    pt::uint64_t mix_us;    // time spent mixing them, summed
+    pt::uint64_t max_us;    // worst single period
+    pt::uint64_t starved;   // an open stream ran dry part-way through a period
+};
+
+// Start the mixer task.  Call once AC97::initialize() has succeeded.
+void mixer_start();
+bool mixer_running();
+
+// Task streams, keyed by task id (SYS_AUDIO_*).  Opening again replaces the
+// task's stream.  Formats are AUDIO_FMT_* from syscall.h.
+bool         mixer_open(pt::uint32_t task, pt::uint32_t rate, pt::uint8_t channels,
+                        pt::uint8_t format);
+bool         mixer_close(pt::uint32_t task);   // false: task had no stream
+bool         mixer_has_stream(pt::uint32_t task);
+bool         mixer_can_write(pt::uint32_t task);
+bool         mixer_set_volume(pt::uint32_t task, pt::uint32_t percent);
+
+// Queue one chunk from user memory (truncated to STREAM_SLOT_BYTES) on the
+// task's stream.  Returns bytes queued, 0 if all slots are full — or, with
+// `block`, sleeps until the mixer frees one and returns 0 only if the stream
+// was closed, is fed from a ring, or the buffer is not user memory.
+pt::uint32_t mixer_write(pt::uint32_t task, const pt::uint8_t* data, pt::uint32_t bytes,
+                         bool block);
+
+// Feed the task's stream from an AudioRing (syscall.h) of `bytes` PCM,
+// rounded up to a power of two, lent to t's process like a window surface.
+// From then on the mixer reads the client's samples in place: no copy, no
+// syscall per chunk.  Mapping again returns the same ring.  Returns the
+// ring's user address, or 0.
+pt::uintptr_t mixer_map_ring(pt::uint32_t task, Task* t, pt::uint32_t bytes);
+
+// Sleep until `want` bytes of the task's ring are free or timeout_ms has
+// passed (0: just look).  Returns the free bytes, or -1 without a ring.
+pt::int64_t   mixer_ring_wait(pt::uint32_t task, pt::uint32_t want, pt::uint64_t timeout_ms);
+
+// free_user_space(): the rings lent to that address space are gone with it,
+// so their streams are closed.
+void          mixer_forget_rings(pt::uintptr_t pdpt);
+
+// One-shot kernel sound played in place from `data`.  With `take` the mixer
+// kfree()s the buffer when it has played.  Returns a stream id or -1.
+pt::int32_t  mixer_play_clip(const pt::uint8_t* data, pt::uint32_t bytes, pt::uint32_t rate,
+                             pt::uint8_t channels, pt::uint8_t format, bool take);
+bool         mixer_clip_playing(pt::int32_t id);
+
+// Square-wave beep as a clip (the boot sound when boot.raw is missing).
+void         mixer_beep(pt::uint32_t frequency_hz, pt::uint32_t duration_ms);
+
+pt::uint32_t mixer_stream_count();
+const MixerStats& mixer_stats();
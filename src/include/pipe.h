@@ -8,7 +8,8 @@ struct PipeBuffer {
     pt::uint32_t read_pos;       // monotonically increasing (mod CAPACITY for index)
     pt::uint32_t write_pos;      // monotonically increasing
     pt::uint32_t ref_count;      // number of open FD ends (2 initially; +1 per fork)
-    bool         writer_closed;  // set when the WR end is closed → reader gets EOF
+    pt::uint32_t writers;        // open WR ends among them (1 initially)
+    bool         writer_closed;  // set when the last WR end is closed → reader gets EOF
 };
 
 // Store/load a PipeBuffer* inside File::fs_data[0..7] via memcpy.
@@ -41,6 +41,15 @@ private:
     void execute_play(const char* cmd);
     void execute_disk(const char* cmd);
     void execute_diskbench(const char* cmd);
+    void execute_execbench(const char* cmd);
+    void execute_membench(const char* cmd);
+    void execute_simdbench(const char* cmd);
+    void execute_compbench(const char* cmd);
+    void execute_scalebench(const char* cmd);
+    void execute_vrambench(const char* cmd);
+    void execute_flipbench(const char* cmd);
+    void execute_cursorbench(const char* cmd);
+    void execute_mixbench(const char* cmd);
     void execute_echo(const char* cmd);
     void execute_clear(const char* cmd);
     void execute_timers(const char* cmd);
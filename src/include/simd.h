@@ -0,0 +1,62 @@
+#pragma once
+#include "defs.h"
+
+// ── Kernel SIMD sections ────────────────────────────────────────────────────
+// The kernel is built with -mgeneral-regs-only because the interrupted
+// task's x87/SSE state is live in the registers (the scheduler only saves
+// it on a context switch).  Code that wants SSE2 brackets it with
+// kernel_fpu_begin()/kernel_fpu_end(), which save and restore that state:
+//   * interrupts enabled (syscall or kernel task that did sti): saved into
+//     the current Task, so the section may be preempted — the scheduler's
+//     FXSAVE on switch-out then carries the kernel's XMM values with it;
+//   * interrupts disabled (IRQ handlers, cli sections): saved into one
+//     static area; nothing can interleave until interrupts come back on.
+// Sections nest.  IF must be the same at begin and end.  MXCSR is reset to
+// its default inside the section.  Only SSE/SSE2 is available: state is
+// saved with FXSAVE, which does not cover the upper halves of YMM.
+void kernel_fpu_begin();
+void kernel_fpu_end();
+
+// ── SSE2 routines (simd.cpp) ────────────────────────────────────────────────
+// Call only between kernel_fpu_begin() and kernel_fpu_end().
+
+// Copy `count` 32-bit pixels; no alignment requirements, no overlap.
+void simd_copy32(pt::uint32_t* dst, const pt::uint32_t* src, pt::size_t count);
+
+// Convert `count` packed RGB24 pixels (R, G, B bytes) to 0x00RRGGBB.
+// Never reads past src + 3 * count.
+void simd_rgb24_to_xrgb(pt::uint32_t* dst, const pt::uint8_t* src, pt::size_t count);
+
+// Convert `count` RGB565 pixels to 0x00RRGGBB, replicating the top bits
+// into the low ones so 0x1F and 0x3F become 0xFF.
+void simd_rgb565_to_xrgb(pt::uint32_t* dst, const pt::uint16_t* src, pt::size_t count);
+
+// Look `count` 8-bit indices up in a 256-entry 0x00RRGGBB palette.
+void simd_index8_to_xrgb(pt::uint32_t* dst, const pt::uint8_t* src,
+                         const pt::uint32_t* palette, pt::size_t count);
+
+// Upscale one row by an integer factor k: dst[i] = src[(phase + i) / k],
+// phase < k.  Reads src[0 .. (phase + count - 1) / k].
+void simd_scale_int(pt::uint32_t* dst, const pt::uint32_t* src, pt::uint32_t k,
+                    pt::uint32_t phase, pt::size_t count);
+
+// Nearest-neighbour row: dst[i] = src[(pos + i * step) >> 16] (16.16).
+void simd_scale_nearest(pt::uint32_t* dst, const pt::uint32_t* src, pt::uint32_t pos,
+                        pt::uint32_t step, pt::size_t count);
+
+// Bilinear row between source rows row0 and row1, weighted wy/256 towards
+// row1 (0..256).  Horizontal positions are 16.16 as above, clamped to
+// [0, last]; needs last >= 1.  Reads row[0 .. last] only.
+void simd_scale_bilinear(pt::uint32_t* dst, const pt::uint32_t* row0,
+                         const pt::uint32_t* row1, pt::int32_t pos, pt::uint32_t step,
+                         pt::uint32_t last, pt::uint32_t wy, pt::size_t count);
+
+// Copy into memory a device will read (DMA buffers) with non-temporal
+// stores, so the data does not evict the CPU's working set.  Fenced.
+void simd_stream_copy(void* dst, const void* src, pt::size_t n);
+
+// The same for `count` 32-bit pixels, unfenced, so a batch of rows can go
+// out before a single simd_store_fence().  Meant for write-combining VRAM,
+// where full 64-byte bursts are what the bus wants.
+void simd_stream_copy32(pt::uint32_t* dst, const pt::uint32_t* src, pt::size_t count);
+void simd_store_fence();
@@ -21,7 +21,7 @@ constexpr pt::uint64_t SYS_WAITPID  = 16; // rdi=child_id, rsi=exit_code_ptr; re
 constexpr pt::uint64_t SYS_PIPE        = 17; // rdi=int[2] ptr; fills [0]=rd_fd [1]=wr_fd; returns 0 or -1
 constexpr pt::uint64_t SYS_LSEEK       = 18; // rdi=fd, rsi=offset, rdx=whence; returns new pos or -1
 constexpr pt::uint64_t SYS_FB_HEIGHT   = 19; // returns framebuffer height in pixels
-constexpr pt::uint64_t SYS_DRAW_PIXELS   = 20; // rdi=buf, rsi=x, rdx=y, rcx=w, r8=h — blit pixel buffer
+constexpr pt::uint64_t SYS_DRAW_PIXELS   = 20; // rdi=buf, rsi=x, rdx=y, rcx=w|fmt<<32, r8=h|stride<<32 — blit pixel buffer
 // Returns (scancode | 0x100) if pressed, scancode if released, (uint64)-1 if queue empty.
 constexpr pt::uint64_t SYS_GET_KEY_EVENT = 21; // no args
 constexpr pt::uint64_t SYS_CREATE        = 22; // rdi=filename; create/truncate for writing; returns fd or -1
@@ -37,7 +37,7 @@ constexpr pt::uint64_t SYS_SOCK_CONNECT     = 31; // rdi=dst_ip, rsi=dst_port; r
 constexpr pt::uint64_t SYS_GET_MOUSE_EVENT  = 32; // () → encoded event or (uint64)-1 if empty
 // Encoding: bits[7:0]=dx(int8), bits[15:8]=dy(int8,+up), bit[16]=left, bit[17]=right
 constexpr pt::uint64_t SYS_GET_MICROS       = 33; // () → microseconds since boot (uint64)
-constexpr pt::uint64_t SYS_AUDIO_WRITE      = 34; // rdi=data, rsi=bytes, rdx=rate; 1=ok, 0=busy, -1=absent
+constexpr pt::uint64_t SYS_AUDIO_WRITE      = 34; // rdi=data, rsi=bytes, rdx=rate|flags; bytes queued, 0=busy, -1=absent
 constexpr pt::uint64_t SYS_AUDIO_PLAYING    = 35; // () → 1=playing, 0=idle, -1=no AC97
 constexpr pt::uint64_t SYS_WRITE_SERIAL     = 36; // rdi=buf, rsi=len; write raw bytes to COM1 serial log
 constexpr pt::uint64_t SYS_SET_WINDOW_TITLE = 37; // rdi=wid, rsi=title_ptr; set window title bar text
@@ -54,7 +54,7 @@ constexpr pt::uint64_t SYS_GET_WINDOW_POS  = 47; // () → client_ox|(client_oy<
 constexpr pt::uint64_t SYS_SET_FS_BASE    = 48; // rdi=base; set FS segment base (thread-local storage)
 constexpr pt::uint64_t SYS_MKDIR           = 49; // rdi=path; create directory (recursive); returns 0 or -1
 constexpr pt::uint64_t SYS_OPEN_RW        = 50; // rdi=filename; open existing for read+write; returns fd or -1
-constexpr pt::uint64_t SYS_AUDIO_OPEN    = 51; // rdi=rate, rsi=channels, rdx=format; returns 0 or -1
+constexpr pt::uint64_t SYS_AUDIO_OPEN    = 51; // rdi=rate, rsi=channels, rdx=AUDIO_FMT_*; returns 0 or -1
 constexpr pt::uint64_t SYS_AUDIO_CLOSE   = 52; // no args; returns 0 or -1
 constexpr pt::uint64_t SYS_UDP_OPEN      = 53; // rdi=port (0=ephemeral); returns fd or -1
 constexpr pt::uint64_t SYS_UDP_SENDTO    = 54; // rdi=fd, rsi=buf, rdx=len, rcx=dst_ip, r8=dst_port; returns bytes sent or -1
@@ -63,3 +63,137 @@ constexpr pt::uint64_t SYS_THREAD_CREATE = 56; // rdi=entry_fn, rsi=arg, rdx=sta
 constexpr pt::uint64_t SYS_THREAD_EXIT   = 57; // rdi=retval; terminate calling thread
 constexpr pt::uint64_t SYS_FUTEX         = 58; // rdi=op, rsi=addr, rdx=val; WAIT=0 WAKE=1; returns 0/-1 or wake count
 constexpr pt::uint64_t SYS_THREAD_JOIN   = 59; // rdi=tid, rsi=retval_ptr; block until thread exits; returns 0 or -1
+constexpr pt::uint64_t SYS_SPAWN         = 60; // rdi=path, rsi=argv, rdx=envp, rcx=file_actions, r8=cwd; returns child id or -1
+constexpr pt::uint64_t SYS_VFORK         = 61; // borrow the address space until exec/exit; returns child id (parent) or 0 (child)
+constexpr pt::uint64_t SYS_MAP_WINDOW_SURFACE = 62; // () → VA of the task window's pixels (stride = buf_w*4) or -1
+constexpr pt::uint64_t SYS_COMMIT_WINDOW = 63; // rdi=SurfaceRect*, rsi=count (0 = whole client area); returns 0 or -1
+constexpr pt::uint64_t SYS_SET_WINDOW_PALETTE = 64; // rdi=const uint32_t* colors, rsi=first, rdx=count; indexed windows; returns 0 or -1
+constexpr pt::uint64_t SYS_SET_WINDOW_SOURCE = 65; // rdi=src_w, rsi=src_h (0,0 = unscaled), rdx=WSCALE_*; returns 0 or -1
+constexpr pt::uint64_t SYS_GET_WINDOW_EVENTS = 66; // rdi=wid, rsi=uint64_t* out, rdx=max, rcx=timeout_ms, r8=WEVF_*; returns count or -1
+constexpr pt::uint64_t SYS_CREATE_SWAPCHAIN = 67; // rdi=count (2..3, 0 = remove), rsi=uint64_t* vas; returns 0 or -1
+constexpr pt::uint64_t SYS_PRESENT       = 68; // rdi=buffer, rsi=PresentInfo* (may be null); returns next buffer or -1
+constexpr pt::uint64_t SYS_DRAW_BATCH    = 69; // rdi=const DrawCmd* list, rsi=bytes; returns commands run or -1
+constexpr pt::uint64_t SYS_AUDIO_VOLUME  = 70; // rdi=percent (0..100) for the caller's stream; returns 0 or -1
+constexpr pt::uint64_t SYS_AUDIO_MAP_RING = 71; // rdi=ring bytes; feed the caller's stream from shared memory; returns AudioRing VA or -1
+constexpr pt::uint64_t SYS_AUDIO_RING_WAIT = 72; // rdi=free bytes wanted, rsi=timeout_ms (0 = poll); returns free bytes or -1
+
+// SYS_DRAW_PIXELS source formats, passed in bits 32..39 of rcx.  Bits
+// 32..63 of r8 give the source stride in bytes (0 = packed rows).  Callers
+// that pass plain w and h get packed RGB24.
+constexpr pt::uint32_t PIXFMT_RGB24    = 0;  // R, G, B bytes
+constexpr pt::uint32_t PIXFMT_XRGB8888 = 1;  // 0x??RRGGBB; the top byte is ignored
+constexpr pt::uint32_t PIXFMT_ARGB8888 = 2;  // 0xAARRGGBB; alpha is ignored (windows are opaque)
+constexpr pt::uint32_t PIXFMT_RGB565   = 3;  // RRRRRGGG GGGBBBBB, little-endian 16-bit
+constexpr pt::uint32_t PIXFMT_INDEX8   = 4;  // palette index; WF_INDEXED8 windows only
+constexpr pt::uint32_t PIXFMT_COUNT    = 5;
+
+// Bytes per pixel of a PIXFMT_* value (0 for unknown formats).
+inline pt::uint32_t pixfmt_bytes(pt::uint32_t fmt)
+{
+    switch (fmt) {
+    case PIXFMT_RGB24:    return 3;
+    case PIXFMT_XRGB8888:
+    case PIXFMT_ARGB8888: return 4;
+    case PIXFMT_RGB565:   return 2;
+    case PIXFMT_INDEX8:   return 1;
+    default:              return 0;
+    }
+}
+
+// SYS_AUDIO_WRITE flag, in the upper half of rdx: sleep until a DMA slot
+// is free instead of returning 0 on a full queue.
+constexpr pt::uint64_t AUDIO_WRITE_BLOCK = 1ull << 32;
+
+// SYS_AUDIO_OPEN sample formats.  Samples are interleaved, little-endian.
+constexpr pt::uint8_t AUDIO_FMT_S16 = 0;  // signed 16-bit (what SYS_AUDIO_WRITE auto-opens)
+constexpr pt::uint8_t AUDIO_FMT_U8  = 1;  // unsigned 8-bit, 0x80 = silence
+
+// SYS_AUDIO_MAP_RING shared memory: this header, then the PCM ring at
+// AUDIO_RING_DATA bytes from it.  Positions count bytes since the ring was
+// mapped and only grow; position p lives at data[p & (size - 1)].  The
+// client stores PCM and then advances `write`; the mixer picks it up on its
+// next period without a syscall, advances `read` and refreshes the timing:
+// the PCM just before `read` reaches the DAC delay_us after stamp_us.
+struct AudioRing {
+    volatile pt::uint64_t write;        // client: end of the PCM it produced
+    volatile pt::uint64_t read;         // mixer: end of the PCM it consumed
+    pt::uint32_t          size;         // ring bytes, a power of two
+    pt::uint32_t          frame_bytes;  // channels * sample bytes
+    pt::uint32_t          rate;
+    volatile pt::uint32_t delay_us;     // mixed but not yet played, at stamp_us
+    volatile pt::uint64_t stamp_us;     // get_microseconds() of the last period
+    volatile pt::uint64_t starved;      // periods in which the ring ran dry
+};
+constexpr pt::uint32_t AUDIO_RING_DATA = 4096;
+constexpr pt::uint32_t AUDIO_RING_MIN  = 4096;
+constexpr pt::uint32_t AUDIO_RING_MAX  = 256 * 1024;
+
+// SYS_SPAWN file action, applied in order to the child's copy of the
+// caller's fd table.  A list ends at the first SPAWN_FA_END entry.
+struct SpawnFileAction {
+    pt::int32_t op;     // SPAWN_FA_*
+    pt::int32_t fd;     // CLOSE: fd to close; DUP2: source fd
+    pt::int32_t newfd;  // DUP2: target fd
+};
+constexpr pt::int32_t SPAWN_FA_END   = 0;
+constexpr pt::int32_t SPAWN_FA_CLOSE = 1;
+constexpr pt::int32_t SPAWN_FA_DUP2  = 2;
+constexpr pt::size_t  SPAWN_MAX_ACTIONS = 16;
+
+// SYS_COMMIT_WINDOW damage rect, in client-area pixels.  Rects are clipped
+// to the client area; at most SURFACE_MAX_RECTS are taken per call.
+struct SurfaceRect {
+    pt::uint32_t x, y, w, h;
+};
+constexpr pt::size_t  SURFACE_MAX_RECTS = 32;
+
+// SYS_SET_WINDOW_SOURCE filters: how the compositor stretches a window's
+// source-size buffer over its client area.
+constexpr pt::uint32_t WSCALE_NEAREST  = 0;
+constexpr pt::uint32_t WSCALE_BILINEAR = 1;
+
+// SYS_GET_WINDOW_EVENTS: at most WEV_BATCH_MAX events per call.  timeout_ms
+// 0 returns at once; WEV_WAIT_FOREVER blocks until an event arrives.  With
+// max == 0 the call only waits and returns the number of queued events.
+constexpr pt::uint32_t WEV_BATCH_MAX    = 256;
+constexpr pt::uint64_t WEV_WAIT_FOREVER = ~(pt::uint64_t)0;
+constexpr pt::uint64_t WEVF_MOUSE       = 1;  // also queue mouse packets (WEV_MOUSE_BIT)
+
+// SYS_PRESENT feedback.  Timestamps are get_microseconds().
+struct PresentInfo {
+    pt::uint64_t seq;         // number of the frame just presented (1, 2, ...)
+    pt::uint64_t shown_seq;   // last frame that reached the screen (0 = none yet)
+    pt::uint64_t shown_us;    // when it did
+    pt::uint64_t interval_us; // compositor frame interval
+};
+
+// SYS_DRAW_BATCH command list: commands packed back to back, each starting
+// with a DrawCmd whose `size` is the whole command in bytes, a multiple of
+// 8.  Coordinates are client-area pixels (buffer pixels for scaled windows)
+// and are clipped.  The kernel stops at the first command with an unknown
+// op or a bad size and returns how many it ran.  Colours are 0x00RRGGBB,
+// or a palette index in an indexed window.
+struct DrawCmd {
+    pt::uint16_t op;          // DRAW_*
+    pt::uint16_t size;        // bytes, header included
+};
+constexpr pt::uint16_t DRAW_FILL = 1;  // DrawFill
+constexpr pt::uint16_t DRAW_COPY = 2;  // DrawCopy: move pixels within the window
+constexpr pt::uint16_t DRAW_BLIT = 3;  // DrawBlit: pixels from the caller, as SYS_DRAW_PIXELS
+constexpr pt::uint16_t DRAW_TEXT = 4;  // DrawText + len chars, padded to 8 bytes
+constexpr pt::uint16_t DRAW_LINE = 5;  // DrawLine, both ends included
+constexpr pt::uint32_t DRAW_TEXT_MAX = 256;  // chars per DRAW_TEXT
+constexpr pt::int32_t  DRAW_COORD_MAX = 32767;  // |x|, |y| of a DRAW_LINE end
+
+struct DrawFill { DrawCmd cmd; pt::uint32_t x, y, w, h, color; };
+struct DrawCopy { DrawCmd cmd; pt::uint32_t sx, sy, w, h, dx, dy, pad; };
+struct DrawBlit {
+    DrawCmd      cmd;
+    pt::uint32_t x, y, w, h;
+    pt::uint32_t format;      // PIXFMT_*
+    pt::uint32_t stride;      // source bytes per row, 0 = packed
+    pt::uint32_t pad;
+    pt::uint64_t pixels;      // user pointer
+};
+struct DrawText { DrawCmd cmd; pt::uint32_t x, y, fg, bg, len; };
+struct DrawLine { DrawCmd cmd; pt::int32_t x0, y0, x1, y1; pt::uint32_t color; };
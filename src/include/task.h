@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "fs/vfs.h"
 #include "vterm.h"
+#include "syscall.h"
 
 // Task states
 enum TaskState {
@@ -36,20 +37,72 @@ struct TaskContext {
     pt::uint64_t rflags;
 } __attribute__((packed));
 
-static constexpr pt::size_t TASK_MAX_FDS = 32;
+// Per-process open file limit.  Tables start with one FdTable::CHUNK of
+// slots and grow a chunk at a time up to this.
+static constexpr pt::size_t TASK_MAX_FDS = 8192;
+
+// Size of each process's user virtual address span in GB.  PML4[0] covers
+// 512 GB; spans above 4 GB enable the high heap (see TaskScheduler).
+// Override at build time with CPPFLAGS += -DUSER_VA_SPAN_GB=<n>.
+#ifndef USER_VA_SPAN_GB
+#define USER_VA_SPAN_GB 64
+#endif
+
 constexpr pt::uint32_t INVALID_TID = 0xFFFFFFFF;
 
 // Ref-counted file-descriptor table shared between threads.
+// Files live in fixed-size chunks, so a File* taken by one thread stays
+// valid while another thread grows the table (only the chunk directory
+// is reallocated).
 struct FdTable {
-    File         fds[TASK_MAX_FDS];
+    static constexpr pt::size_t CHUNK = 64;
+    File**       chunks;     // capacity / CHUNK chunk pointers
+    pt::uint32_t capacity;   // fds currently backed by a chunk
+    pt::uint32_t free_hint;  // no free fd >= 3 below this
     pt::uint32_t refcount;
 };
 
+// Slot for fd (open or not), or nullptr past the table's capacity.
+static inline File* fd_slot(const FdTable* t, int fd)
+{
+    if (!t || fd < 0 || (pt::uint32_t)fd >= t->capacity) return nullptr;
+    return &t->chunks[fd / FdTable::CHUNK][fd % FdTable::CHUNK];
+}
+
+// Open file for fd, or nullptr.
+static inline File* fd_get(const FdTable* t, int fd)
+{
+    File* f = fd_slot(t, fd);
+    return (f && f->open) ? f : nullptr;
+}
+
+// Call after closing fd so fd_table_alloc can hand it out again.
+static inline void fd_table_released(FdTable* t, int fd)
+{
+    if (fd >= 3 && (pt::uint32_t)fd < t->free_hint) t->free_hint = fd;
+}
+
+// Empty table (refcount=1) with its first chunk allocated.
+FdTable* fd_table_create();
+
+// Slot for fd, growing the table to cover it.  nullptr past TASK_MAX_FDS
+// or when out of memory.
+File* fd_table_reserve(FdTable* t, int fd);
+
+// Lowest free fd >= 3 (0/1/2 are stdin/stdout/stderr), growing the table
+// when full.  The slot is not marked open.  Returns -1 at TASK_MAX_FDS.
+int fd_table_alloc(FdTable* t);
+
+struct SyscallPerfData;
+
 // Task control block
 struct Task {
     static constexpr pt::size_t MAX_FDS = TASK_MAX_FDS;
 
+    // PID, handed out by TaskScheduler's allocator and resolved through its
+    // hash; it is not an index into the task table.
     pt::uint32_t id;
+    Task* pid_next;             // next task in the same PID hash bucket
     TaskState state;
     TaskContext context;        // legacy; kept for padding / future use
     pt::uintptr_t kernel_stack_base;
@@ -77,23 +130,22 @@ struct Task {
     pt::uint32_t  join_tid;          // task waiting to join this one (INVALID_TID if none)
     void*         thread_result;     // value from SYS_THREAD_EXIT / pthread_exit
 
-    // Per-task user-space page-table frames.
-    // user_pdpt/user_pd are fresh (not boot-table copies), wired at PML4[0].
-    // priv_pt[] holds code PT frames; stack_pt holds the 2MB stack PT.
+    // Per-task user address space.
+    // user_pdpt is a fresh PDPT wired at PML4[0]; every PD/PT below it is
+    // allocated on demand by the user page-table walker in task.cpp, so the
+    // ELF image, heap and stack may sit anywhere inside the user VA span.
     // All zero for kernel tasks or tasks without create_elf_task.
-    // MAX_PRIV_PTS=8 covers up to 8×512×4KB = 16 MB of ELF code.
-    static constexpr pt::size_t MAX_PRIV_PTS = 8;
     pt::uintptr_t user_pdpt;                  // PA of per-task user PDPT (PML4[0] target)
-    pt::uintptr_t user_pd;                    // PA of per-task user PD   (PDPT[0] target)
-    pt::uintptr_t priv_pt[MAX_PRIV_PTS];      // PA of code PT frames
-    pt::size_t    num_priv_pts;               // how many priv_pt[] entries are valid
-    pt::uintptr_t stack_pt;                   // PA of stack PT frame  (PD[511] target)
+    pt::uintptr_t user_image_end;             // first VA past the loaded ELF image
     pt::uintptr_t user_heap_top;              // next free user heap VA (for SYS_MMAP)
 
     // Process hierarchy and exit status (for fork/waitpid).
     pt::uint32_t parent_id;    // 0xFFFFFFFF = no parent
     pt::uint32_t waiting_for;  // child task ID we're blocked on; 0xFFFFFFFF = none
     int  exit_code;    // populated by task_exit() / SYS_EXIT
+    // vfork child still borrowing its parent's address space: the parent
+    // stays blocked until we exec or exit.  0xFFFFFFFF = not a vfork child.
+    pt::uint32_t vfork_parent;
 
     // Timed sleep: absolute tick deadline set by sleep_task().
     // 0 means the task is not sleeping (default).
@@ -117,9 +169,10 @@ struct Task {
     // ELF filename that was loaded into this task (set by create_elf_task / exec_task).
     char name[16];
 
-    // Flat environment buffer: "KEY=VAL\0KEY2=VAL2\0\0" (double-NUL terminated).
-    static constexpr pt::size_t ENV_BUF_SIZE = 512;
-    char env_buf[ENV_BUF_SIZE];
+    // Flat environment buffer: "KEY=VAL\0KEY2=VAL2\0\0" (double-NUL terminated),
+    // heap-allocated to fit; nullptr for threads and kernel tasks.
+    static constexpr pt::size_t ENV_MAX_SIZE = 32768;
+    char* env_buf;
     pt::size_t env_buf_len;  // bytes used (including final double-NUL)
 
     // 512-byte FXSAVE area for x87/SSE state (must be 16-byte aligned).
@@ -127,6 +180,11 @@ struct Task {
     // don't corrupt each other's floating-point state.
     pt::uint8_t fxsave_area[512] __attribute__((aligned(16)));
 
+    // State that was live when this task entered kernel_fpu_begin() with
+    // interrupts enabled; restored by the matching kernel_fpu_end().
+    pt::uint8_t  kfpu_save[512] __attribute__((aligned(16)));
+    pt::uint32_t kfpu_depth;    // nesting depth of open kernel FPU sections
+
     // Per-task snapshot of g_syscall_rsp captured at the START of every syscall
     // handler invocation (before any blocking that would let other tasks
     // overwrite the global).  fork_task and exec_task use this instead of the
@@ -138,10 +196,14 @@ struct Task {
     // Written by SYS_SET_FS_BASE and by SYS_THREAD_CREATE (for new thread TLS).
     // Saved/restored on every context switch so each thread has its own TLS pointer.
     pt::uint64_t fs_base;
+
+    // Syscall profiler counters; allocated on this task's first syscall
+    // while "perf record" is active, freed by perf_dump / perf_reset_counters.
+    SyscallPerfData* perf;
 };
 
 // Per-task syscall profiling counters (separate from Task to keep struct small).
-static constexpr pt::size_t NUM_SYSCALLS = 60;
+static constexpr pt::size_t NUM_SYSCALLS = 73;
 struct SyscallPerfData {
     pt::uint64_t counts[NUM_SYSCALLS];
     pt::uint64_t usec[NUM_SYSCALLS];
@@ -161,32 +223,41 @@ extern pt::uintptr_t g_next_cr3;
 // Syscall profiler state — set by "perf record", cleared by "perf stop".
 extern bool g_perf_recording;
 
-// Per-task syscall profiler data — allocated by "perf record", freed by "perf stop".
-// Indexed by task ID (0..MAX_TASKS-1). nullptr when profiler is not active.
-extern SyscallPerfData* g_perf_data;
-
 // Human-readable syscall names indexed by syscall number.
 extern const char* const g_syscall_names[];
 
 class TaskScheduler {
 public:
-    static constexpr pt::size_t MAX_TASKS = 32;
+    // Ceiling on concurrent tasks (processes + threads).  The task table
+    // starts at TABLE_GROW slots and doubles on demand up to this.
+    static constexpr pt::size_t MAX_TASKS = 4096;
+    static constexpr pt::size_t TABLE_GROW = 32;
+    // PIDs count up to PID_MAX and then wrap, skipping PIDs still in use.
+    static constexpr pt::uint32_t PID_MAX = 0x7FFFFFFF;
+    static constexpr pt::size_t PID_HASH_SIZE = 1024;  // power of two
     static constexpr pt::size_t TASK_STACK_SIZE = 16384;  // 16KB kernel interrupt stack
     static constexpr pt::size_t USER_STACK_SIZE  = 2097152; // 2MB user execution stack
     // How many timer ticks between forced preemptions.
     // At 50 Hz this gives ~60 ms time slices.
     static constexpr pt::size_t SCHEDULER_QUANTUM = 3;
 
-    // User-space virtual address layout constants.
+    // User-space virtual address layout.
+    //   [USER_CODE_BASE, image end)        ELF PT_LOAD segments (any size)
+    //   [image end (2 MB aligned), STACK)  low heap, grows upward
+    //   [USER_STACK_BOT, USER_STACK_TOP)   user stack
+    //   [USER_STACK_TOP, USER_HIGH_BASE)   boot identity map, kernel-only (MMIO)
+    //   [USER_HIGH_BASE, USER_VA_TOP)      high heap, used once the low heap is full
+    // Page tables for every range are allocated on demand.
     static constexpr pt::uintptr_t USER_CODE_BASE    = 0x0000000000400000ULL; // ELF load base
-    static constexpr pt::uintptr_t USER_HEAP_BASE    = 0x0000000001000000ULL; // heap start
     static constexpr pt::uintptr_t USER_STACK_BOT    = 0x000000003FE00000ULL; // PD[511] start
     static constexpr pt::uintptr_t USER_STACK_TOP    = 0x0000000040000000ULL; // initial RSP
+    static constexpr pt::uintptr_t USER_HIGH_BASE    = 0x0000000100000000ULL; // 4 GB
+    static constexpr pt::uintptr_t USER_VA_TOP       = (pt::uintptr_t)USER_VA_SPAN_GB << 30;
+    static constexpr pt::uintptr_t USER_HEAP_ALIGN   = 0x200000;  // heap starts on a fresh PT
     static constexpr pt::size_t    USER_PML4_IDX     = 0;    // PML4 index for user space
-    static constexpr pt::size_t    USER_PDPT_IDX     = 0;    // PDPT index for first 1GB
-    static constexpr pt::size_t    USER_CODE_PD_IDX  = 2;    // 0x400000 / 2MB = 2
-    static constexpr pt::size_t    USER_STACK_PD_IDX = 511;  // 0x3FE00000 / 2MB = 511
     static constexpr pt::size_t    USER_STACK_PAGES  = 512;  // 2MB / 4KB
+    static_assert(USER_VA_SPAN_GB >= 1 && USER_VA_SPAN_GB <= 512,
+                  "user VA span must fit in PML4[0]");
 
     // Initialize scheduler
     static void initialize();
@@ -260,6 +331,22 @@ public:
                                   int argc = 0,
                                   const char* const* argv = nullptr);
 
+    // spawn_task: start an ELF as a child of the current task without
+    // copying the caller's address space (posix_spawn).  argv and envp are
+    // NULL-terminated user arrays (envp == nullptr inherits the caller's
+    // environment); actions edit the inherited fd table; a relative path is
+    // resolved against cwd.  Returns the child ID, or 0xFFFFFFFF on failure.
+    static pt::uint32_t spawn_task(const char* filename,
+                                   const char* const* argv,
+                                   const char* const* envp,
+                                   const SpawnFileAction* actions,
+                                   const char* cwd);
+
+    // vfork_task: create a child that runs on the caller's address space
+    // and user stack; the caller blocks until the child execs or exits.
+    // Returns child task ID to parent; child frame gets rax=0.
+    static pt::uint32_t vfork_task(pt::uintptr_t syscall_frame_rsp);
+
     // waitpid_task: block until child exits; writes its exit code.
     // Returns 0 on success, (uint64_t)-1 on invalid child_id / not a child.
     static pt::uint64_t waitpid_task(pt::uint32_t child_id,
@@ -288,12 +375,39 @@ public:
     static void sleep_task(pt::uint64_t ms);
 
     // Map [va, va+size) into the task's user address space by allocating
-    // physical frames and inserting them into the task's user_pd hierarchy.
-    // Called from the SYS_MMAP handler (task CR3 active — uses KERNEL_OFFSET).
-    static void map_user_pages(Task* t, pt::uintptr_t va, pt::size_t size);
+    // physical frames and inserting them into the task's user page tables
+    // (intermediate tables are created on demand).
+    // Returns false, with nothing mapped, if the range leaves the user VA span.
+    static bool map_user_pages(Task* t, pt::uintptr_t va, pt::uint64_t size);
+
+    // Reserve and map `size` bytes of fresh zeroed heap for the process that
+    // owns t's address space.  Returns the VA, or 0 if the span is exhausted.
+    static pt::uintptr_t alloc_user_heap(Task* t, pt::uint64_t size);
+
+    // The process task that owns t's address space (t itself for processes,
+    // the creating process for threads).  Heap bookkeeping lives there so
+    // every thread of a process allocates from the same user_heap_top.
+    static Task* address_space_owner(Task* t);
+
+    // Unmap heap pages [va, va+size) and free their frames (borrowed
+    // pages are only unmapped).
+    // Returns 0 on success, -1 if the range touches the ELF image or stack.
+    static int unmap_user_pages(Task* t, pt::uintptr_t va, pt::uint64_t size);
+
+    // Lend the physically contiguous, page-aligned kernel pages
+    // [phys, phys+size) to t's process at a fresh heap VA (RW, NX).
+    // The frames are never freed through the mapping.  Returns the VA or 0.
+    static pt::uintptr_t map_borrowed_pages(Task* t, pt::uintptr_t phys, pt::size_t size);
+    // Drop borrowed mappings in [va, va+size) of the address space rooted
+    // at pdpt_pa; other pages in the range are left alone.
+    static void unmap_borrowed_pages(pt::uintptr_t pdpt_pa, pt::uintptr_t va, pt::size_t size);
+
+    // Count the user pages mapped in t's process: those shared through the
+    // text cache and those private to the process (image, heap, stack).
+    static void count_user_pages(Task* t, pt::size_t* shared, pt::size_t* priv);
 
     // Dump a compact memory map of a task's user address space to klog.
-    // Walks user_pd entries and prints contiguous mapped regions.
+    // Walks the user page tables and prints contiguous mapped regions.
     static void dump_task_map(pt::uint32_t task_id);
 
     // Change page permissions for [va, va+size) in the current task.
@@ -312,18 +426,49 @@ public:
     static void wake_task(pt::uint32_t id);
 
 private:
-    static Task tasks[MAX_TASKS];
+    // Task table: task_capacity slot pointers into 16-byte aligned blocks
+    // of Task structs.  Blocks are never freed, so a Task* stays valid
+    // when the directory grows; dead slots are recycled by alloc_slot().
+    static Task** tasks;
+    static pt::uint32_t task_capacity;
     static pt::uint32_t task_count;
-    static pt::uint32_t current_task_id;
+    static pt::uint32_t current_slot;
     static pt::uint64_t scheduler_ticks;
+    static bool need_resched;  // wake_task() woke a higher-priority task
+
+    // PID allocator and PID -> Task hash (chained through Task::pid_next).
+    // A dead task stays hashed until its slot is reused, so waitpid can
+    // still collect its exit code.
+    static pt::uint32_t next_pid;
+    static Task* pid_hash[PID_HASH_SIZE];
 
     // Round-robin: find next ready task and switch to it.
     // Returns new preempt_rsp (or current_rsp if no switch).
     static pt::uintptr_t do_switch_to_next(pt::uintptr_t current_rsp);
 
+    // Double the table with fresh dead slots; false at MAX_TASKS or OOM.
+    // The first call installs TABLE_GROW static slots (no heap yet).
+    static bool grow_table();
+
+    // Claim a dead slot (growing the table if none is free), release what
+    // its previous occupant left behind and give it a new PID.  The task
+    // comes back TASK_BLOCKED; nullptr at MAX_TASKS or when out of memory.
+    static Task* alloc_slot();
+
+    // Task with this PID in any state (including dead), or nullptr.
+    static Task* find_task(pt::uint32_t id);
+
 public:
-    // Get task by ID — returns nullptr if id is out of range.
+    // Get a live task by ID — returns nullptr if unknown or dead.
     static Task* get_task(pt::uint32_t id);
+
+    // Walk the task table: slot(i) for i < slot_count().  Dead tasks are
+    // included; the table only grows, so slot_count() never shrinks.
+    static pt::uint32_t slot_count() { return task_capacity; }
+    static Task* slot(pt::uint32_t i) { return i < task_capacity ? tasks[i] : nullptr; }
+
+    // Number of live tasks.
+    static pt::uint32_t live_count() { return task_count; }
 private:
 
     // irq0_schedule and yield_schedule are C-linkage functions in idt.cpp
@@ -0,0 +1,57 @@
+#pragma once
+#include "defs.h"
+
+// Software PTE bits for user pages owned by the text cache.  Bit 9 is an
+// AVL bit the MMU ignores; bits 52..58 (also ignored) hold the cache entry
+// index so a mapping can be dropped without a reverse lookup.
+constexpr pt::uint64_t PTE_SHARED         = 1ULL << 9;
+constexpr int          PTE_TEXT_IDX_SHIFT = 52;
+constexpr pt::uint64_t PTE_TEXT_IDX_MASK  = 0x7FULL << PTE_TEXT_IDX_SHIFT;
+
+// One cached page: its user VA and the PTE to install (frame | P | U [| NX]).
+struct TextPage {
+    pt::uintptr_t va;
+    pt::uint64_t  pte;
+};
+
+// TextCache — read-only PT_LOAD pages shared between processes that run the
+// same ELF file.  Entries are keyed by path, size and FAT modification time,
+// so rewriting a binary retires its old entry.
+//
+// Every PTE that maps a cached page holds one reference on its entry.  The
+// cache keeps an entry's frames after the last process exits so the next
+// exec of the same file maps them again instead of reading the disk; such
+// idle entries are evicted LRU when a new binary needs a slot.  A stale or
+// evicted entry that is still mapped lives on until its last PTE goes away.
+class TextCache {
+public:
+    static constexpr pt::size_t MAX_ENTRIES = 16;
+    static constexpr pt::size_t MAX_PATH    = 64;
+
+    // Find a current entry for this file.  On a hit, takes one reference
+    // per page (the caller must map every page) and returns the entry
+    // index; returns -1 on a miss.
+    static int acquire(const char* path, pt::uint32_t size, pt::uint32_t mtime);
+
+    // Pages of entry idx (valid while the caller holds references).
+    static const TextPage* pages(int idx, pt::size_t* count);
+
+    // Adopt `pages` (kmalloc'd, ownership passes to the cache on success)
+    // as a new entry with one reference per page.  Returns the entry index,
+    // or -1 if no slot can be freed (the caller keeps the pages private).
+    static int insert(const char* path, pt::uint32_t size, pt::uint32_t mtime,
+                      TextPage* pages, pt::size_t count);
+
+    // Software bits to OR into a PTE that maps a page of entry idx.
+    static pt::uint64_t pte_tag(int idx) {
+        return PTE_SHARED | ((pt::uint64_t)idx << PTE_TEXT_IDX_SHIFT);
+    }
+
+    // Add / drop the reference held by one shared PTE.  put_page frees the
+    // entry's frames once it is unreferenced and no longer cached.
+    static void get_page(pt::uint64_t pte);
+    static void put_page(pt::uint64_t pte);
+
+    // Total frames held by the cache (mapped or idle).
+    static pt::size_t resident_pages();
+};
@@ -21,9 +21,23 @@ constexpr pt::uintptr_t KERNEL_OFFSET = 0xFFFF800000000000ULL;
 constexpr pt::uintptr_t HEAP_PHYS_BASE  = 0x200000;    // 2 MB (kernel binary below)
 constexpr pt::uintptr_t HEAP_PHYS_LIMIT = 0x4000000;   // 64 MB heap ceiling
 
-// Memory utility functions
+// Memory utility functions (memops.cpp).  Large copies use rep movsb when
+// the CPU reports ERMS/FSRM, rep movsq otherwise; see mem_init().
 void memset(void* dst, pt::uint64_t value, const pt::size_t size);
 void* memcpy(void* dest, const void* src, pt::size_t n);
+void* memmove(void* dest, const void* src, pt::size_t n);
+
+// Copy between kernel memory and the current task's user address space.
+// false (nothing copied) if the user range is outside the user windows.
+// user_range_ok() is that check alone, for memory read in place.
+bool user_range_ok(pt::uintptr_t addr, pt::uint64_t n);
+bool copy_to_user(void* user_dst, const void* src, pt::size_t n);
+bool copy_from_user(void* dst, const void* user_src, pt::size_t n);
+
+// Probe CPUID for ERMS/FSRM.  Until called, the rep movsq paths are used.
+void mem_init();
+extern bool g_mem_erms;
+extern bool g_mem_fsrm;
 
 class VMM;
 
@@ -57,6 +71,9 @@ struct PageTableL4 {
     pt::uint8_t flags;
 };
 
+// Memory types (caching modes) of device memory such as VRAM.
+enum class MemType { WriteBack, WriteCombining, Uncached };
+
 class VMM
 {
     kMemoryRegion* firstFreeMemoryRegion;
@@ -91,6 +108,22 @@ public:
     void unmap_page(pt::uintptr_t virt);
     pt::uintptr_t virt_to_phys_walk(pt::uintptr_t virt) const;
 
+    // Reprogram PAT entry 1 (PWT set, PCD clear) as write-combining.
+    // Returns false if the CPU has no PAT; WriteCombining is then only
+    // reachable through mtrr_set_wc().
+    static bool init_pat();
+    // Set the type of the identity (and high-half) mapping of physical
+    // [phys, phys + size), below 4 GB, in the page tables of the current
+    // CR3.  The 1..4 GB tables are shared by every address space; the
+    // first GB is copied into each new one, so change it before the first
+    // user task.  Flushes caches and the TLB.
+    static bool set_memory_type(pt::uintptr_t phys, pt::size_t size, MemType type);
+    // Without PAT: cover [phys, phys + size) with a write-combining
+    // variable-range MTRR (size rounded up to a power of two; phys must be
+    // aligned to it).  Fails when no MTRR is free or an uncached one
+    // already overlaps the range, since UC wins over WC.
+    static bool mtrr_set_wc(pt::uintptr_t phys, pt::size_t size);
+
     // Physical frame allocator
     pt::uintptr_t allocate_frame();
     void free_frame(pt::uintptr_t frame);
@@ -99,7 +132,7 @@ public:
     // Physical memory statistics (uses frame bitmap).
     // Returns 0 if frame allocator not yet initialized.
     pt::size_t get_total_mem() const;  // total detected RAM in bytes
-    pt::size_t get_free_mem()  const;  // free physical RAM in bytes
+    pt::uint64_t get_free_mem() const; // free physical RAM in bytes
 
     VMM() = default;
 
@@ -108,6 +141,7 @@ public:
         this->pageTables = static_cast<PageTableL4 *>(l4_page_address);
         this->frame_bitmap = nullptr;
         this->frame_bitmap_size = 0;
+        this->frame_search_hint = 0;
         this->frame_allocator_ready = false;
 
         pt::size_t top_size = 0;
@@ -164,5 +198,6 @@ private:
     // Frame allocator state
     pt::uint8_t* frame_bitmap;
     pt::size_t frame_bitmap_size;
+    pt::size_t frame_search_hint;  // lowest bitmap byte that may have a free bit
     bool frame_allocator_ready;
 };
\ No newline at end of file
@@ -7,6 +7,7 @@ constexpr pt::uint32_t VTERM_MAX_COLS  = 80;
 constexpr pt::uint32_t VTERM_MAX_ROWS  = 50;
 constexpr pt::uint32_t VTERM_INPUT_SZ  = 128;
 constexpr pt::uint32_t INVALID_VT      = 0xFFFFFFFF;
+static_assert(VTERM_MAX_COLS <= 128, "dirty bits are two qwords per row");
 
 struct VTermCell {
     char          ch;
@@ -34,6 +35,7 @@ private:
     void scroll();
     void handle_csi(char cmd);
     void render_cell(pt::uint32_t col, pt::uint32_t row);
+    void flush_dirty();
 
     pt::uint32_t m_id   = INVALID_VT;
     pt::uint32_t m_cols = 0;
@@ -51,6 +53,13 @@ private:
     pt::uint32_t m_saved_row = 0;
     bool         m_batch     = false;
 
+    // Cells whose damage has not been submitted yet, one bit per cell.
+    // Inside a batch (SYS_WRITE, vterm_printf) writes and scrolls only set
+    // bits; end_batch() turns each row's dirty span into one damage rect.
+    // m_redraw asks end_batch() for the whole terminal instead.
+    pt::uint64_t m_dirty[VTERM_MAX_ROWS][2];
+    bool         m_redraw    = false;
+
     char         m_input[VTERM_INPUT_SZ];
     pt::uint32_t m_input_read  = 0;
     pt::uint32_t m_input_write = 0;
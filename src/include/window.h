@@ -4,12 +4,18 @@
 #include "vterm.h"
 
 class Framebuffer;
+struct DamageRect;
+struct SurfaceRect;
+struct PresentInfo;
+struct Task;
 
-constexpr pt::uint32_t MAX_WINDOWS  = 8;
+constexpr pt::uint32_t MAX_WINDOWS  = 16;
 constexpr pt::uint32_t TITLE_BAR_H  = 16;  // px; matches PSF1 glyph height
 constexpr pt::uint32_t BORDER_W     = 1;   // px; 1-px border on all sides
-constexpr pt::uint32_t EVENT_CAP    = 32;  // per-window ring size (power of 2)
+constexpr pt::uint32_t EVENT_CAP    = 256; // per-window ring size (power of 2)
 constexpr pt::uint32_t INVALID_WID  = 0xFFFFFFFF;
+constexpr pt::uint32_t VIS_MAX      = 32;  // visible-region rects per window
+constexpr pt::uint32_t SWAP_MAX     = 3;   // buffers in a window's swapchain
 
 // Flags for create_window
 constexpr pt::uint32_t WF_CHROMELESS = 1u; // no border or title bar; client = full rect
@@ -17,6 +23,9 @@ constexpr pt::uint32_t WF_TEXT       = 2u; // text-mode window: stdout/stderr (S
                                            // fd=1/2) render into this window instead of the
                                            // vterm. Graphical windows omit this so their
                                            // debug text stays out of the framebuffer.
+constexpr pt::uint32_t WF_INDEXED8   = 4u; // 8-bit palette-indexed buffer, expanded through
+                                           // the window palette by the compositor.  Not
+                                           // with WF_TEXT.
 
 // 64-bit event encoding: bit 8 = pressed, bits 7:0 = PS/2 set-1 scancode.
 // 0 is the sentinel for "no event" (scancode 0 is never emitted by PS/2).
@@ -26,6 +35,49 @@ inline pt::uint64_t wev_make_key(pt::uint8_t sc, bool pressed) {
     return (pt::uint64_t)sc | (pressed ? WEV_KEY_PRESS_BIT : 0u);
 }
 
+// Mouse events (only queued for windows that asked, see SYS_GET_WINDOW_EVENTS):
+// bit 63 set, bits 15:0 = dx, bits 31:16 = dy (signed, PS/2 convention:
+// positive = up), bit 32 = left button, bit 33 = right button.  Consecutive
+// motion with the same buttons is merged into the unread tail event.
+constexpr pt::uint64_t WEV_MOUSE_BIT = (pt::uint64_t)1 << 63;
+
+inline pt::uint64_t wev_make_mouse(pt::int16_t dx, pt::int16_t dy, bool left, bool right) {
+    return WEV_MOUSE_BIT | (pt::uint64_t)(pt::uint16_t)dx |
+           (pt::uint64_t)(pt::uint16_t)dy << 16 |
+           (left ? (pt::uint64_t)1 << 32 : 0u) | (right ? (pt::uint64_t)1 << 33 : 0u);
+}
+
+// Frames a client renders into while the compositor shows another
+// (SYS_CREATE_SWAPCHAIN / SYS_PRESENT).  Each buffer is owned by exactly one
+// side: the client (ACQUIRED), nobody (FREE), or the compositor (QUEUED for
+// the next frame, SHOWN, or RETIRING: replaced this frame, free once it is
+// on screen).  All fields change with interrupts off.
+struct SwapChain {
+    enum State : pt::uint8_t { FREE, ACQUIRED, QUEUED, SHOWN, RETIRING };
+
+    pt::uint32_t  count;
+    pt::uint32_t* buf[SWAP_MAX];     // page-aligned, client size
+    void*         alloc[SWAP_MAX];   // blocks to retire
+    pt::size_t    capacity;          // bytes per buffer, whole pages
+    pt::uintptr_t va[SWAP_MAX];      // client mappings
+    pt::uintptr_t pdpt;              // address space holding them (0 = forgotten)
+    State         state[SWAP_MAX];
+    pt::uint64_t  seq[SWAP_MAX];     // frame number a QUEUED/SHOWN buffer carries
+
+    pt::int32_t   queued;            // buffer taken by the next frame, -1 = none
+    pt::int32_t   shown;             // buffer composited, -1 = still pixel_buf
+    bool          latched;           // shown changed in the frame being drawn
+    pt::uint64_t  presented;         // frames presented so far
+    pt::uint64_t  shown_seq;         // last frame that reached the screen
+    pt::uint64_t  shown_us;          // ... and when
+    pt::uint32_t  waiter;            // task blocked in present(), INVALID_WID = none
+};
+
+// Half-open screen rect; signed because frames can hang off the left/top edge.
+struct ScreenRect {
+    pt::int32_t x0, y0, x1, y1;
+};
+
 struct Window {
     pt::uint32_t id;
     pt::uint32_t owner_task_id;   // INVALID_WID = free slot
@@ -33,6 +85,7 @@ struct Window {
     bool         active;
     bool         chromeless;      // no border/title bar; client area = full rect
     bool         text_mode;       // WF_TEXT: stdout/stderr routed into this window
+    bool         indexed;         // WF_INDEXED8: pixel_buf holds one palette index per pixel
 
     // Outer frame position and size (includes border + title bar)
     pt::uint32_t screen_x, screen_y;
@@ -44,14 +97,30 @@ struct Window {
     pt::uint32_t client_ox, client_oy;
     pt::uint32_t client_w,  client_h;
 
-    // Per-window pixel buffer (client_w × client_h, ARGB32).
-    // All window rendering goes here; compositor blits to back buffer.
+    // Size of the pixel data (SYS_SET_WINDOW_SOURCE).  Equal to the client
+    // size unless the client asked the compositor to stretch a smaller
+    // picture over the client area; never larger than it.
+    pt::uint32_t buf_w, buf_h;
+    bool         bilinear;        // filter when buf_w/buf_h != client size
+
+    // Per-window pixel buffer (buf_w × buf_h, ARGB32, or bytes when
+    // indexed).  All window rendering goes here; compositor blits to back buffer.
+    // Page-aligned inside buf_alloc so it can be mapped into the owner.
     pt::uint32_t* pixel_buf;
-    pt::size_t    buf_capacity;  // allocated size in bytes (may be > client_w*client_h*4)
+    pt::size_t    buf_capacity;  // usable bytes, whole pages (may be > client_w*client_h*4)
+    void*         buf_alloc;     // kcalloc'd block holding pixel_buf
+
+    // Where pixel_buf is mapped in a client (SYS_MAP_WINDOW_SURFACE);
+    // surface_va == 0: not mapped.
+    pt::uintptr_t surface_va;
+    pt::uintptr_t surface_pdpt;  // address space holding the mapping
+    pt::size_t    surface_size;
 
     // Per-window event ring (ev_read == ev_write → empty)
     pt::uint64_t events[EVENT_CAP];
     pt::uint32_t ev_read, ev_write;
+    pt::uint32_t ev_waiter;       // task blocked in wait_events(), INVALID_WID = none
+    bool         want_mouse;      // owner asked for mouse events in its ring
 
     // Text cursor for stdout rendering inside the client area (in character units)
     pt::uint32_t text_col, text_row;
@@ -63,6 +132,18 @@ struct Window {
     pt::uint32_t saved_col, saved_row;  // for \x1b[s / \x1b[u
 
     char title[32];   // window title (null-terminated, set via SYS_SET_WINDOW_TITLE)
+
+    // Colours (0x00RRGGBB) of an indexed window; grey ramp until set.
+    pt::uint32_t palette[256];
+
+    // Parts of the outer frame not covered by windows above it, kept by
+    // update_visibility().  vis_count == 0: fully hidden (or not composited).
+    ScreenRect   vis[VIS_MAX];
+    pt::uint32_t vis_count;
+
+    // Present queue; nullptr until the owner creates one.  While a frame
+    // has been shown from it, composite() reads that buffer, not pixel_buf.
+    SwapChain*   swap;
 };
 
 class WindowManager {
@@ -81,24 +162,84 @@ public:
     static bool       resize_window(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t y,
                                     pt::uint32_t w, pt::uint32_t h);
 
-    // ── Compositor: blit all visible windows to back buffer ──
-    static void composite(Framebuffer* fb);
+    // ── Compositor: blit visible windows inside `clip` to back buffer ──
+    static void composite(Framebuffer* fb, const DamageRect& clip);
+
+    // Queue a window's whole frame (chrome included) for recomposition.
+    // No-op for windows that are not on the active VT.
+    static void damage_window(pt::uint32_t wid);
 
     // ── Per-window drawing (writes to pixel_buf, not framebuffer) ──
     static void win_fill_rect(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t y,
                               pt::uint32_t w, pt::uint32_t h, pt::uint32_t color);
+    // format: PIXFMT_* (syscall.h); stride: source bytes per row, 0 = packed.
     static void win_draw_pixels(pt::uint32_t wid, const pt::uint8_t* data,
                                 pt::uint32_t x, pt::uint32_t y,
-                                pt::uint32_t w, pt::uint32_t h);
+                                pt::uint32_t w, pt::uint32_t h,
+                                pt::uint32_t format, pt::uint32_t stride);
+    // True if every source byte win_draw_pixels() would read from `data`
+    // lies in user memory.  A stride shorter than a row is refused.
+    static bool user_pixels_ok(const pt::uint8_t* data, pt::uint32_t w, pt::uint32_t h,
+                               pt::uint32_t format, pt::uint32_t stride);
     static void win_draw_text(pt::uint32_t wid, pt::uint32_t x, pt::uint32_t y,
                               const char* str, pt::uint32_t fg, pt::uint32_t bg);
     static void win_put_glyph(pt::uint32_t wid, char c,
                               pt::uint32_t px, pt::uint32_t py,
                               pt::uint32_t fg, pt::uint32_t bg);
     static void win_scroll_up(pt::uint32_t wid, pt::uint32_t pixels);
+    // Run a SYS_DRAW_BATCH list read from user memory at `cmds`.  Returns
+    // the number of commands run, or -1 if wid has no pixel buffer.
+    static pt::int64_t draw_batch(pt::uint32_t wid, const pt::uint8_t* cmds, pt::size_t bytes);
+    // Replace palette entries [first, first+count) of an indexed window and
+    // repaint it.  Returns false for a non-indexed window or a bad range.
+    static bool win_set_palette(pt::uint32_t wid, const pt::uint32_t* colors,
+                                pt::uint32_t first, pt::uint32_t count);
+    // Make the pixel buffer w × h and have the compositor scale it up to
+    // the client area; w == 0 or h == 0 goes back to 1:1.  The buffer is
+    // not converted: the client redraws after the call.  Fails for text
+    // windows and for sizes larger than the client area.
+    static bool set_source_size(pt::uint32_t wid, pt::uint32_t w, pt::uint32_t h,
+                                bool bilinear);
+
+    // ── Shared surfaces ──
+    // Map wid's pixel buffer into task t's process and return its VA (0 on
+    // failure).  The mapping lasts until the window is destroyed or its
+    // buffer is reallocated by a resize; mapping again then returns a new VA.
+    static pt::uintptr_t map_surface(pt::uint32_t wid, Task* t);
+    // Queue client rects (already in kernel memory) for recomposition.
+    // count == 0 damages the whole client area.
+    static void          commit_surface(pt::uint32_t wid, const SurfaceRect* rects,
+                                        pt::uint32_t count);
+    // The address space rooted at pdpt is being freed: forget any surface
+    // mapped there (its page tables are about to go away).
+    static void          forget_surfaces(pt::uintptr_t pdpt);
+
+    // ── Swapchains ──
+    // Give wid `count` (2..SWAP_MAX) client-size buffers mapped into t and
+    // store their VAs in vas[]; buffer 0 is handed to the client.  count 0
+    // removes the swapchain.  Returns false on bad arguments or no memory.
+    static bool          create_swapchain(pt::uint32_t wid, Task* t, pt::uint32_t count,
+                                          pt::uintptr_t* vas);
+    // Queue buffer idx (the client's) for the next frame, then block until
+    // a buffer is free and hand it over.  Returns its index, or -1.
+    static pt::int64_t   present(pt::uint32_t wid, pt::uint32_t idx, PresentInfo* info);
+    // Compositor task, around Framebuffer::Flush(): make queued frames the
+    // shown ones, then, once the frame is out, free the buffers they
+    // replaced, stamp the time and wake blocked presenters.
+    static void          latch_frames();
+    static void          frames_shown();
 
     static void        push_key_event(pt::uint64_t ev);  // routes to focused window
+    // Queue a mouse packet for the focused window if it wants mouse events,
+    // merging pure motion into the unread tail event.  IRQ context.
+    static void        push_mouse_event(pt::int8_t dx, pt::int8_t dy, bool left, bool right);
     static pt::uint64_t poll_event(pt::uint32_t wid);    // returns 0 if empty
+    // Pop up to max events into out; returns how many.
+    static pt::uint32_t poll_events(pt::uint32_t wid, pt::uint64_t* out, pt::uint32_t max);
+    // Block the calling task until wid's ring is non-empty or timeout_ms has
+    // passed (WEV_WAIT_FOREVER: no timeout; 0: don't block).  Returns the
+    // number of queued events.
+    static pt::uint32_t wait_events(pt::uint32_t wid, pt::uint64_t timeout_ms);
     static Window*     get_window(pt::uint32_t wid);
     static pt::uint32_t get_task_window(pt::uint32_t task_id);
     static pt::uint32_t get_window_count();
@@ -117,13 +258,17 @@ public:
     // Render a character into the window's client area, advancing the text cursor.
     // Handles \n, \r, \t and wrapping/scrolling within the client area.
     static void        put_char(pt::uint32_t wid, char c);
+    // put_char over a whole buffer (SYS_WRITE).  Runs of printable text
+    // are drawn as one glyph run with one damage rect per line.
+    static void        write_text(pt::uint32_t wid, const char* buf, pt::uint32_t n);
 
     static pt::uint32_t focused_id;
     static pt::uint32_t focused_per_vt[VTERM_COUNT];  // per-VT focus tracking
     static bool        is_focused(pt::uint32_t wid) { return focused_id == wid; }
     static bool        is_on_active_vt(pt::uint32_t wid);
     static void        on_vt_switch();  // called by vterm_switch()
-    static void        draw_chrome(pt::uint32_t wid, bool active);
+    // fb: target being composited (defaults to the screen's framebuffer).
+    static void        draw_chrome(pt::uint32_t wid, bool active, Framebuffer* fb = nullptr);
     static void        move_window(pt::uint32_t wid, pt::int32_t new_x, pt::int32_t new_y);
     static bool        hit_title_bar(pt::uint32_t wid, pt::int16_t px, pt::int16_t py);
     static void        raise_window(pt::uint32_t wid);
@@ -137,6 +282,10 @@ public:
     };
     static pt::uint32_t list_windows(WinListEntry* buf, pt::uint32_t max_entries);
 
+    // When false, composite() paints every window's whole frame (no
+    // occlusion culling).  Only compbench turns it off, for comparison.
+    static bool        occlusion_enabled;
+
 private:
     static Window windows[MAX_WINDOWS];
     static pt::uint32_t z_order[MAX_WINDOWS];  // wids, back-to-front (0=bottom)
@@ -145,6 +294,34 @@ private:
     static void z_remove(pt::uint32_t wid);
     static void z_insert_top(pt::uint32_t wid);
 
+    // Visible regions are recomputed lazily by composite() after anything
+    // that changes the stacking: create, destroy, move, resize, raise, VT switch.
+    static bool vis_dirty;
+    static void update_visibility();
+
+    // Pixel buffers dropped by destroy/resize while a composite() is in
+    // progress; that composite may still be reading them, so the last one
+    // to finish frees them.  Linked through each buffer's first word.
+    static void*        retired;
+    static pt::uint32_t composite_depth;
+    static void retire_buffer(void* buf);
+
+    // Page-aligned, zeroed pixel buffer of at least `bytes`; sets
+    // *capacity (whole pages) and *alloc (the block to retire later).
+    static pt::uint32_t* alloc_pixels(pt::size_t bytes, pt::size_t* capacity, void** alloc);
+    // Drop win's client mapping, if any, before its buffer goes away.
+    static void unmap_surface(Window* win);
+    // Unmap and retire win's swapchain; pixel_buf is shown again.
+    static void destroy_swapchain(Window* win);
+    // Latch/stamp one swapchain (interrupts off).
+    static bool latch_frame(SwapChain* sc);
+    static void frame_shown(SwapChain* sc, pt::uint64_t now);
+
+    // Queue part of a window's pixel buffer (buffer coordinates; scaled to
+    // the client area for scaled windows).
+    static void damage_client(const Window* win, pt::uint32_t x, pt::uint32_t y,
+                              pt::uint32_t w, pt::uint32_t h);
+
     static constexpr pt::uint32_t COLOR_BORDER    = 0x404040;
     static constexpr pt::uint32_t COLOR_TITLE_ACT = 0x0055AA;
     static constexpr pt::uint32_t COLOR_TITLE_INF = 0x303030;
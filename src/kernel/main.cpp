@@ -18,6 +18,9 @@
 #include "assets.h"
 #include "tss.h"
 #include "window.h"
+#include "compositor.h"
+#include "mixer.h"
+#include "syscall.h"
 #include "net/net.h"
 #include "vterm.h"
 
@@ -37,6 +40,7 @@ void thirty_minute_callback(void* data) {
 
 ASMCALL void kernel_main(boot_info* boot_info, void* l4_page_table) {
     klog("[MAIN] Welcome to 64-bit potat OS\n");
+    mem_init();
 
     auto bi = BootInfo(boot_info);
     panic_set_elf_symbols(bi.get_elf_symbols());
@@ -73,12 +77,13 @@ ASMCALL void kernel_main(boot_info* boot_info, void* l4_page_table) {
 
     // Audio
     if (AC97::initialize()) {
+        mixer_start();
         if (BootSound && BootSoundSize > 0) {
             klog("[MAIN] Playing boot sound (%d bytes)...\n", BootSoundSize);
-            AC97::play_pcm(BootSound, BootSoundSize, 48000);
+            mixer_play_clip(BootSound, BootSoundSize, 48000, 2, AUDIO_FMT_S16, false);
         } else {
             klog("[MAIN] Playing startup beep...\n");
-            AC97::play_beep(880, 300);
+            mixer_beep(880, 300);
         }
     }
 
@@ -90,9 +95,10 @@ ASMCALL void kernel_main(boot_info* boot_info, void* l4_page_table) {
 
     // Display
     Framebuffer::Init(boot_fb);
+    Framebuffer::get_instance()->InitPageFlip();
+    Framebuffer::get_instance()->InitWriteCombining();
     Framebuffer::get_instance()->InitBackBuffer();
     Framebuffer::get_instance()->InitWallpaper();
-    enable_fb_flush();
     if (FontData && FontDataSize > 0) {
         if (fbterm.init(FontData, FontDataSize, Framebuffer::get_instance()))
             klog("[MAIN] Framebuffer terminal ready\n");
@@ -102,6 +108,7 @@ ASMCALL void kernel_main(boot_info* boot_info, void* l4_page_table) {
     if (fbterm.is_ready())
         vterm_init(fbterm.get_cols(), fbterm.get_rows());
     WindowManager::initialize();
+    compositor_start();
     if (TaskScheduler::create_elf_task("BIN/TASKBAR.ELF") == 0xFFFFFFFF)
         klog("[MAIN] BIN/TASKBAR.ELF not found or failed to start\n");
 
@@ -12,10 +12,13 @@
 #include "device/ahci.h"
 #include "fs/vfs.h"
 #include "device/ac97.h"
+#include "mixer.h"
+#include "syscall.h"
 #include "device/acpi.h"
 #include "device/rtc.h"
 #include "window.h"
 #include "task.h"
+#include "simd.h"
 #include "net/net.h"
 #include "libs/stdlib.h"
 
@@ -35,6 +38,15 @@ constexpr char cat_cmd[] = "cat ";
 constexpr char play_cmd[] = "play ";
 constexpr char disk_cmd[] = "disk";
 constexpr char diskbench_cmd[] = "diskbench";
+constexpr char execbench_cmd[] = "execbench";
+constexpr char membench_cmd[] = "membench";
+constexpr char simdbench_cmd[] = "simdbench";
+constexpr char compbench_cmd[] = "compbench";
+constexpr char scalebench_cmd[] = "scalebench";
+constexpr char vrambench_cmd[] = "vrambench";
+constexpr char flipbench_cmd[] = "flipbench";
+constexpr char cursorbench_cmd[] = "cursorbench";
+constexpr char mixbench_cmd[] = "mixbench";
 constexpr char help_cmd[] = "help";
 constexpr char echo_cmd[] = "echo ";
 constexpr char clear_cmd[] = "clear";
@@ -83,6 +95,15 @@ void print_help() {
     vterm_printf("  write <file> <text> - Create a new file with text content\n");
     vterm_printf("  rm <file>        - Delete a file\n");
     vterm_printf("  exec <file>      - Load and run an ELF program\n");
+    vterm_printf("  execbench        - Time exec of 100 KB and 4 MB ELF binaries\n");
+    vterm_printf("  membench         - Check memcpy/memmove and report GB/s, 16 B to 8 MB\n");
+    vterm_printf("  simdbench        - Scalar vs SSE2 blit, RGB24 convert and PCM copy\n");
+    vterm_printf("  compbench        - Composite 8 overlapping windows at 1920x1080\n");
+    vterm_printf("  scalebench       - 320x200 frame shown at 960x600: prescaled vs compositor\n");
+    vterm_printf("  vrambench        - Full-screen VRAM upload: uncached vs write-combining\n");
+    vterm_printf("  flipbench        - Compositor frame time: copy to VRAM vs page flipping\n");
+    vterm_printf("  cursorbench      - Pointer-motion latency: cursor overlay vs recompositing\n");
+    vterm_printf("  mixbench         - Audio mixer CPU with 8 streams of mixed rates/formats\n");
     vterm_printf("  net              - Show network configuration\n");
     vterm_printf("  ping <ip|host>   - Send ICMP echo requests (resolves hostname via DNS)\n");
     vterm_printf("  dhcp             - Run DHCP to acquire IP address\n");
@@ -453,11 +474,631 @@ void Shell::execute_diskbench(const char*) {
     vmm.kfree(raw);
 }
 
+void Shell::execute_execbench(const char*) {
+    // Wall-clock cost of create_elf_task + run-to-exit + reap for two payload
+    // binaries (~100 KB and ~4 MB of file-backed .rodata). The first run of
+    // each is a warm-up so the disk cache and FAT chain lookups are primed.
+    constexpr int ITERS = 20;
+    const char* const bins[] = { "BIN/EXEC100K.ELF", "BIN/EXEC4M.ELF" };
+
+    for (pt::size_t b = 0; b < sizeof(bins) / sizeof(bins[0]); b++) {
+        const char* path = bins[b];
+        File f;
+        memset(&f, 0, sizeof(f));
+        if (!VFS::open_file(path, &f)) {
+            vterm_printf("execbench: %s not found\n", path);
+            continue;
+        }
+        pt::uint32_t size = f.file_size;
+        VFS::close_file(&f);
+
+        pt::uint64_t total = 0, lo = ~0ULL, hi = 0;
+        bool ok = true;
+        for (int i = 0; i <= ITERS && ok; i++) {
+            pt::uint64_t t0 = get_microseconds();
+            pt::uint32_t id = TaskScheduler::create_elf_task(path);
+            if (id == 0xFFFFFFFF) { ok = false; break; }
+            int code = 0;
+            TaskScheduler::waitpid_task(id, &code);
+            pt::uint64_t us = get_microseconds() - t0;
+            if (code != 0) ok = false;
+            if (i == 0) continue;  // warm-up
+            total += us;
+            if (us < lo) lo = us;
+            if (us > hi) hi = us;
+        }
+        if (!ok) {
+            vterm_printf("execbench: %s failed to run\n", path);
+            continue;
+        }
+        vterm_printf("  %s (%d KB): avg %d us, min %d us, max %d us (%d runs)\n",
+                     path, size / 1024, (pt::uint32_t)(total / ITERS),
+                     (pt::uint32_t)lo, (pt::uint32_t)hi, ITERS);
+    }
+}
+
+void Shell::execute_membench(const char*) {
+    // Throughput of the kernel memcpy/memset for sizes 16 B .. 8 MB, with
+    // buffers 64-byte aligned and then deliberately misaligned (src+1,
+    // dst+3).  Each size moves ~64 MB in total so small sizes run enough
+    // iterations to be measurable.
+    constexpr pt::size_t MAX = 8u << 20;
+    pt::uint8_t* raw_src = (pt::uint8_t*)vmm.kmalloc(MAX + 128);
+    pt::uint8_t* raw_dst = (pt::uint8_t*)vmm.kmalloc(MAX + 128);
+    if (!raw_src || !raw_dst) {
+        vterm_printf("alloc failed\n");
+        if (raw_src) vmm.kfree(raw_src);
+        if (raw_dst) vmm.kfree(raw_dst);
+        return;
+    }
+    pt::uint8_t* src = (pt::uint8_t*)(((pt::uintptr_t)raw_src + 63) & ~(pt::uintptr_t)63);
+    pt::uint8_t* dst = (pt::uint8_t*)(((pt::uintptr_t)raw_dst + 63) & ~(pt::uintptr_t)63);
+    for (pt::size_t i = 0; i < MAX + 64; i++) src[i] = (pt::uint8_t)(i * 7 + 1);
+
+    // Correctness first: every length 0..200 at a few offsets, then
+    // overlapping memmove both ways, checked against a byte loop.
+    bool ok = true;
+    for (pt::size_t len = 0; len <= 200 && ok; len++) {
+        for (pt::size_t off = 0; off < 4 && ok; off++) {
+            memset(dst, 0xEE, 256);
+            memcpy(dst + off, src + 3 - off, len);
+            for (pt::size_t i = 0; i < 256; i++) {
+                pt::uint8_t want = (i >= off && i < off + len) ? src[3 - off + (i - off)] : 0xEE;
+                if (dst[i] != want) { ok = false; break; }
+            }
+        }
+    }
+    for (pt::size_t len = 1; len <= 300 && ok; len += 13) {
+        for (int shift = -9; shift <= 9 && ok; shift += 3) {
+            for (pt::size_t i = 0; i < 512; i++) dst[i] = (pt::uint8_t)i;
+            memmove(dst + 100 + shift, dst + 100, len);
+            for (pt::size_t i = 0; i < len; i++)
+                if (dst[100 + shift + i] != (pt::uint8_t)(100 + i)) { ok = false; break; }
+        }
+    }
+    vterm_printf("membench: ERMS=%d FSRM=%d, self-test %s\n",
+                 (int)g_mem_erms, (int)g_mem_fsrm, ok ? "PASS" : "FAIL");
+
+    // GB/s with two decimals: bytes per microsecond is MB/s.
+    auto print_gbps = [](pt::uint64_t bytes, pt::uint64_t us) {
+        if (us == 0) us = 1;
+        pt::uint64_t hundredths = bytes / (us * 10);
+        vterm_printf("  %d.%d%d", (int)(hundredths / 100),
+                     (int)(hundredths / 10 % 10), (int)(hundredths % 10));
+    };
+
+    vterm_printf("size: memcpy / memcpy unaligned / memset, GB/s\n");
+    static const pt::size_t sizes[] = {
+        16, 64, 256, 1u << 10, 4u << 10, 64u << 10, 1u << 20, MAX
+    };
+    for (pt::size_t size : sizes) {
+        const pt::uint64_t iters = (64ull << 20) / size;
+        const pt::uint64_t bytes = iters * size;
+
+        if (size >= (1u << 20))      vterm_printf("  %d MB:", (int)(size >> 20));
+        else if (size >= (1u << 10)) vterm_printf("  %d KB:", (int)(size >> 10));
+        else                         vterm_printf("  %d B:", (int)size);
+
+        pt::uint64_t t0 = get_microseconds();
+        for (pt::uint64_t i = 0; i < iters; i++) memcpy(dst, src, size);
+        print_gbps(bytes, get_microseconds() - t0);
+
+        t0 = get_microseconds();
+        for (pt::uint64_t i = 0; i < iters; i++) memcpy(dst + 3, src + 1, size);
+        print_gbps(bytes, get_microseconds() - t0);
+
+        t0 = get_microseconds();
+        for (pt::uint64_t i = 0; i < iters; i++) memset(dst, (pt::uint8_t)i, size);
+        print_gbps(bytes, get_microseconds() - t0);
+        vterm_printf("\n");
+    }
+
+    vmm.kfree(raw_src);
+    vmm.kfree(raw_dst);
+}
+
+void Shell::execute_simdbench(const char*) {
+    // Each accelerated path against the scalar loop it replaced, on its
+    // usual working size: a 1024x768 frame blit, a 640x480 RGB24 upload
+    // and a 32 KB AC97 DMA chunk.  SSE2 timings include the
+    // kernel_fpu_begin/end pair around every call.
+    constexpr pt::size_t FRAME_PX = 1024 * 768;
+    constexpr pt::size_t RGB_PX   = 640 * 480;
+    constexpr pt::size_t PCM      = 32 * 1024;
+    constexpr int        REPS     = 20;
+
+    pt::uint32_t* a   = (pt::uint32_t*)vmm.kmalloc(FRAME_PX * 4);
+    pt::uint32_t* b   = (pt::uint32_t*)vmm.kmalloc(FRAME_PX * 4);
+    pt::uint8_t*  rgb = (pt::uint8_t*)vmm.kmalloc(RGB_PX * 3);
+    if (!a || !b || !rgb) {
+        vterm_printf("alloc failed\n");
+        if (a) vmm.kfree(a);
+        if (b) vmm.kfree(b);
+        if (rgb) vmm.kfree(rgb);
+        return;
+    }
+    for (pt::size_t i = 0; i < FRAME_PX; i++) a[i] = (pt::uint32_t)(i * 2654435761u);
+    for (pt::size_t i = 0; i < RGB_PX * 3; i++) rgb[i] = (pt::uint8_t)(i * 7 + 3);
+
+    // The section must hand back exactly the register state it found.
+    pt::uint8_t before[512] __attribute__((aligned(16)));
+    pt::uint8_t after[512] __attribute__((aligned(16)));
+    asm volatile("fxsave %0" : "=m"(before) :: "memory");
+    kernel_fpu_begin();
+    simd_copy32(b, a, 64);
+    kernel_fpu_end();
+    asm volatile("fxsave %0" : "=m"(after) :: "memory");
+    // Bytes 0..415 are FCW..XMM15; the rest is reserved/available.
+    vterm_printf("simdbench: FPU state preserved: %s\n",
+                 memcmp((const char*)before, (const char*)after, 416) ? "FAIL" : "PASS");
+
+    pt::uint64_t t0 = get_microseconds();
+    for (int r = 0; r < 10000; r++) {
+        kernel_fpu_begin();
+        kernel_fpu_end();
+    }
+    vterm_printf("  begin/end pair: %d ns\n", (int)((get_microseconds() - t0) / 10));
+
+    auto report = [](const char* what, pt::uint64_t scalar_us, pt::uint64_t simd_us, bool ok) {
+        if (simd_us == 0) simd_us = 1;
+        pt::uint64_t x10 = scalar_us * 10 / simd_us;
+        vterm_printf("  %s: scalar %d us, sse2 %d us (%d.%dx) %s\n", what,
+                     (int)scalar_us, (int)simd_us, (int)(x10 / 10), (int)(x10 % 10),
+                     ok ? "ok" : "MISMATCH");
+    };
+
+    // Compositor blit / frame copy.
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS; r++)
+        for (pt::size_t i = 0; i < FRAME_PX; i++) b[i] = a[i];
+    pt::uint64_t scalar_us = (get_microseconds() - t0) / REPS;
+    memset(b, 0, FRAME_PX * 4);
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS; r++) {
+        kernel_fpu_begin();
+        simd_copy32(b, a, FRAME_PX);
+        kernel_fpu_end();
+    }
+    report("blit 1024x768  ", scalar_us, (get_microseconds() - t0) / REPS,
+           !memcmp((const char*)a, (const char*)b, FRAME_PX * 4));
+
+    // RGB24 -> XRGB (win_draw_pixels).
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS; r++)
+        for (pt::size_t i = 0; i < RGB_PX; i++)
+            a[i] = (pt::uint32_t)rgb[i * 3] << 16 | (pt::uint32_t)rgb[i * 3 + 1] << 8
+                 | (pt::uint32_t)rgb[i * 3 + 2];
+    scalar_us = (get_microseconds() - t0) / REPS;
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS; r++) {
+        kernel_fpu_begin();
+        simd_rgb24_to_xrgb(b, rgb, RGB_PX);
+        kernel_fpu_end();
+    }
+    report("rgb24 640x480  ", scalar_us, (get_microseconds() - t0) / REPS,
+           !memcmp((const char*)a, (const char*)b, RGB_PX * 4));
+
+    // RGB565 -> XRGB (win_draw_pixels, PIXFMT_RGB565).
+    auto* rgb565 = reinterpret_cast<const pt::uint16_t*>(rgb);
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS; r++)
+        for (pt::size_t i = 0; i < RGB_PX; i++) {
+            pt::uint32_t p = rgb565[i];
+            pt::uint32_t r5 = p >> 11, g6 = (p >> 5) & 0x3F, b5 = p & 0x1F;
+            a[i] = ((r5 << 3) | (r5 >> 2)) << 16 | ((g6 << 2) | (g6 >> 4)) << 8
+                 | ((b5 << 3) | (b5 >> 2));
+        }
+    scalar_us = (get_microseconds() - t0) / REPS;
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS; r++) {
+        kernel_fpu_begin();
+        simd_rgb565_to_xrgb(b, rgb565, RGB_PX);
+        kernel_fpu_end();
+    }
+    report("rgb565 640x480 ", scalar_us, (get_microseconds() - t0) / REPS,
+           !memcmp((const char*)a, (const char*)b, RGB_PX * 4));
+
+    // AC97 DMA chunk copy.
+    auto* src8 = reinterpret_cast<const pt::uint8_t*>(a);
+    auto* dst8 = reinterpret_cast<pt::uint8_t*>(b);
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS * 10; r++)
+        for (pt::size_t i = 0; i < PCM; i++) dst8[i] = src8[i];
+    scalar_us = (get_microseconds() - t0) / (REPS * 10);
+    memset(b, 0, PCM);
+    t0 = get_microseconds();
+    for (int r = 0; r < REPS * 10; r++) {
+        kernel_fpu_begin();
+        simd_stream_copy(dst8, src8, PCM);
+        kernel_fpu_end();
+    }
+    report("pcm 32 KB      ", scalar_us, (get_microseconds() - t0) / (REPS * 10),
+           !memcmp((const char*)src8, (const char*)dst8, PCM));
+
+    vmm.kfree(a);
+    vmm.kfree(b);
+    vmm.kfree(rgb);
+}
+
+void Shell::execute_compbench(const char*) {
+    // Full-frame composites of 8 cascaded 800x600 windows into an offscreen
+    // 1920x1080 target, with and without occlusion culling.  The windows are
+    // real ones on this VT, so they also flash on screen while it runs.
+    constexpr pt::uint32_t W = 1920, H = 1080;
+    constexpr pt::uint32_t NWIN = 8, WIN_W = 800, WIN_H = 600;
+    constexpr int FRAMES = 30;
+
+    void* vram = vmm.kmalloc(W * H * 4);
+    if (!vram) {
+        vterm_printf("alloc failed\n");
+        return;
+    }
+    boot_framebuffer bfb{};
+    bfb.framebuffer_addr   = reinterpret_cast<pt::uintptr_t>(vram);
+    bfb.framebuffer_pitch  = W * 4;
+    bfb.framebuffer_width  = W;
+    bfb.framebuffer_height = H;
+    bfb.framebuffer_bpp    = 32;
+    Framebuffer fb(&bfb);
+    fb.InitBackBuffer();
+
+    pt::uint32_t wids[NWIN];
+    pt::uint32_t created = 0;
+    pt::uint32_t owner = TaskScheduler::get_current_task()->id;
+    for (pt::uint32_t i = 0; i < NWIN; i++) {
+        pt::uint32_t wid = WindowManager::create_window(40 + i * 140, 40 + i * 60,
+                                                        WIN_W, WIN_H, owner);
+        if (wid == INVALID_WID) break;
+        wids[created++] = wid;
+        WindowManager::win_fill_rect(wid, 0, 0, WIN_W, WIN_H, 0x203040 + i * 0x101010);
+        Window* win = WindowManager::get_window(wid);
+        const char title[] = "compbench";
+        for (pt::uint32_t j = 0; j < sizeof(title); j++) win->title[j] = title[j];
+    }
+    if (created < NWIN)
+        vterm_printf("compbench: only %d window slots free\n", (int)created);
+
+    const DamageRect full = { 0, 0, W, H };
+    pt::uint64_t us[2];
+    for (int pass = 0; pass < 2; pass++) {
+        WindowManager::occlusion_enabled = (pass == 0);
+        WindowManager::composite(&fb, full);  // warm up, rebuild visible regions
+        pt::uint64_t t0 = get_microseconds();
+        for (int f = 0; f < FRAMES; f++)
+            WindowManager::composite(&fb, full);
+        us[pass] = (get_microseconds() - t0) / FRAMES;
+    }
+    WindowManager::occlusion_enabled = true;
+
+    pt::uint32_t rects = 0;
+    for (pt::uint32_t i = 0; i < created; i++)
+        rects += WindowManager::get_window(wids[i])->vis_count;
+    vterm_printf("compbench: %d windows %dx%d at %dx%d, %d visible rects\n",
+                 (int)created, (int)WIN_W, (int)WIN_H, (int)W, (int)H, (int)rects);
+    vterm_printf("  occluded: %d us/frame\n", (int)us[0]);
+    vterm_printf("  naive:    %d us/frame\n", (int)us[1]);
+
+    for (pt::uint32_t i = 0; i < created; i++)
+        WindowManager::destroy_window(wids[i]);
+    fb.Free();
+    vmm.kfree(vram);
+}
+
+void Shell::execute_scalebench(const char*) {
+    // A 320x200 game frame shown in a 960x600 window, end to end: the
+    // client's work, the upload into the window and the composite into an
+    // offscreen 1920x1080 target.  "prescaled" triples the pixels on the
+    // CPU first, as the game shims used to; the others upload 320x200 and
+    // let the compositor scale.
+    constexpr pt::uint32_t W = 1920, H = 1080;
+    constexpr pt::uint32_t SW = 320, SH = 200, K = 3, DW = SW * K, DH = SH * K;
+    constexpr int FRAMES = 30;
+
+    void* vram = vmm.kmalloc(W * H * 4);
+    auto* src  = static_cast<pt::uint32_t*>(vmm.kmalloc(SW * SH * 4));
+    auto* big  = static_cast<pt::uint32_t*>(vmm.kmalloc(DW * DH * 4));
+    pt::uint32_t wid = WindowManager::create_window(100, 100, DW, DH,
+                                                    TaskScheduler::get_current_task()->id);
+    if (!vram || !src || !big || wid == INVALID_WID) {
+        vterm_printf("scalebench: alloc failed\n");
+        if (wid != INVALID_WID) WindowManager::destroy_window(wid);
+        if (vram) vmm.kfree(vram);
+        if (src)  vmm.kfree(src);
+        if (big)  vmm.kfree(big);
+        return;
+    }
+    Window* win = WindowManager::get_window(wid);
+    const char title[] = "scalebench";
+    for (pt::uint32_t j = 0; j < sizeof(title); j++) win->title[j] = title[j];
+    for (pt::uint32_t y = 0; y < SH; y++)
+        for (pt::uint32_t x = 0; x < SW; x++)
+            src[y * SW + x] = (x & 0xFF) << 16 | (y & 0xFF) << 8 | ((x ^ y) & 0xFF);
+
+    boot_framebuffer bfb{};
+    bfb.framebuffer_addr   = reinterpret_cast<pt::uintptr_t>(vram);
+    bfb.framebuffer_pitch  = W * 4;
+    bfb.framebuffer_width  = W;
+    bfb.framebuffer_height = H;
+    bfb.framebuffer_bpp    = 32;
+    Framebuffer fb(&bfb);
+    fb.InitBackBuffer();
+    const DamageRect full = { 0, 0, W, H };
+
+    vterm_printf("scalebench: %dx%d shown at %dx%d, %d frames\n",
+                 (int)SW, (int)SH, (int)DW, (int)DH, FRAMES);
+    static const char* const names[] = { "prescaled", "nearest x3", "bilinear x3" };
+    for (int mode = 0; mode < 3; mode++) {
+        WindowManager::set_source_size(wid, mode ? SW : 0, mode ? SH : 0, mode == 2);
+        WindowManager::composite(&fb, full);  // warm up
+        pt::uint64_t t0 = get_microseconds();
+        for (int f = 0; f < FRAMES; f++) {
+            if (mode == 0) {
+                for (pt::uint32_t y = 0; y < DH; y++) {
+                    const pt::uint32_t* s = &src[(y / K) * SW];
+                    pt::uint32_t* d = &big[y * DW];
+                    for (pt::uint32_t x = 0; x < DW; x++) d[x] = s[x / K];
+                }
+                WindowManager::win_draw_pixels(wid, reinterpret_cast<pt::uint8_t*>(big),
+                                               0, 0, DW, DH, PIXFMT_XRGB8888, 0);
+            } else {
+                WindowManager::win_draw_pixels(wid, reinterpret_cast<pt::uint8_t*>(src),
+                                               0, 0, SW, SH, PIXFMT_XRGB8888, 0);
+            }
+            WindowManager::composite(&fb, full);
+        }
+        pt::uint64_t us = (get_microseconds() - t0) / FRAMES;
+        pt::uint32_t bytes = mode ? SW * SH * 4 : DW * DH * 4;
+        vterm_printf("  %s: %d us/frame, %d KB uploaded\n", names[mode], (int)us,
+                     (int)(bytes / 1024));
+    }
+
+    WindowManager::destroy_window(wid);
+    fb.Free();
+    vmm.kfree(big);
+    vmm.kfree(src);
+    vmm.kfree(vram);
+}
+
+void Shell::execute_vrambench(const char*) {
+    // Full-screen uploads from the RAM back buffer into the real VRAM, as Flush
+    // does them: plain SSE2 stores into uncached VRAM (the old mapping),
+    // the same into write-combining VRAM, and non-temporal streaming stores
+    // into write-combining VRAM (the current path).  Without PAT the
+    // mapping cannot be switched back and forth, so only the copy kinds
+    // are compared.  The screen is repainted afterwards.
+    Framebuffer* fb = Framebuffer::get_instance();
+    const pt::uintptr_t vram = fb->get_vram(), back = fb->get_back_ram();
+    if (!vram || !back) {
+        vterm_printf("vrambench: no framebuffer\n");
+        return;
+    }
+    const pt::size_t size  = (pt::size_t)fb->get_stride() * fb->get_height();
+    const pt::size_t count = size / 4;
+    constexpr int FRAMES = 20;
+    const bool pat = fb->get_mapping() == VramMapping::PatWC;
+
+    struct Run { const char* name; MemType type; bool stream; };
+    static const Run runs[] = {
+        { "uncached, copy", MemType::Uncached,       false },
+        { "WC, copy",       MemType::WriteCombining, false },
+        { "WC, stream",     MemType::WriteCombining, true  },
+    };
+    static const char* const mappings[] = { "uncached", "WC (PAT)", "WC (MTRR)" };
+    vterm_printf("vrambench: %dx%d, %d KB per frame, %d frames, VRAM %s\n",
+                 (int)fb->get_width(), (int)fb->get_height(), (int)(size / 1024),
+                 FRAMES, mappings[(int)fb->get_mapping()]);
+
+    for (const Run& run : runs) {
+        if (pat) VMM::set_memory_type(vram, size, run.type);
+        else if (run.type == MemType::Uncached) continue;
+        auto* dst = reinterpret_cast<pt::uint32_t*>(vram);
+        auto* src = reinterpret_cast<const pt::uint32_t*>(back);
+        kernel_fpu_begin();
+        pt::uint64_t t0 = get_microseconds();
+        for (int f = 0; f < FRAMES; f++) {
+            if (run.stream) simd_stream_copy32(dst, src, count);
+            else            simd_copy32(dst, src, count);
+        }
+        simd_store_fence();
+        pt::uint64_t us = get_microseconds() - t0;
+        kernel_fpu_end();
+        if (us == 0) us = 1;
+        vterm_printf("  %s: %d us/frame, %d MB/s\n", pat ? run.name : run.stream ? "stream" : "copy",
+                     (int)(us / FRAMES), (int)((pt::uint64_t)size * FRAMES / us));
+    }
+    if (pat) VMM::set_memory_type(vram, size, MemType::WriteCombining);
+    fb->damage_all();
+}
+
+void Shell::execute_flipbench(const char*) {
+    // The live compositor, copying vs page flipping, for two kinds of
+    // frame: the whole screen damaged, and one 256x256 rect.  Each frame
+    // is damaged here and then waited for; the cost is the compositor's
+    // own Flush time (frame_stats), so other damage only adds noise.
+    Framebuffer* fb = Framebuffer::get_instance();
+    if (!fb->can_flip()) {
+        vterm_printf("flipbench: display cannot flip (needs Bochs VBE / QEMU stdvga)\n");
+        return;
+    }
+    constexpr int FRAMES = 30;
+    const bool was_flipping = fb->is_flipping();
+    const FrameStats& s = fb->frame_stats();
+
+    // Damage, then sleep until the compositor has drawn a frame.
+    auto frame = [&](pt::uint32_t w, pt::uint32_t h) {
+        const pt::uint64_t n = s.frames;
+        fb->add_damage(0, 0, w, h);
+        while (s.frames == n) TaskScheduler::sleep_task(1);
+    };
+
+    vterm_printf("flipbench: %dx%d, %d frames per run\n",
+                 (int)fb->get_width(), (int)fb->get_height(), FRAMES);
+    struct Shape { const char* name; pt::uint32_t w, h; };
+    const Shape shapes[] = {
+        { "full screen", fb->get_width(), fb->get_height() },
+        { "256x256",     256,             256 },
+    };
+    for (const Shape& shape : shapes) {
+        pt::uint64_t avg[2];
+        for (int flip = 0; flip < 2; flip++) {
+            fb->SetPageFlip(flip != 0);
+            frame(shape.w, shape.h);   // switch over and settle
+            frame(shape.w, shape.h);
+            const pt::uint64_t f0 = s.frames, us0 = s.total_us, up0 = s.upload_us;
+            const pt::uint64_t fl0 = s.flips;
+            for (int i = 0; i < FRAMES; i++) frame(shape.w, shape.h);
+            const pt::uint64_t frames = s.frames - f0;
+            avg[flip] = (s.total_us - us0) / frames;
+            if (flip)
+                vterm_printf("  %s, flip: %d us/frame, %d flips\n", shape.name,
+                             (int)avg[1], (int)(s.flips - fl0));
+            else
+                vterm_printf("  %s, copy: %d us/frame (%d us upload)\n", shape.name,
+                             (int)avg[0], (int)((s.upload_us - up0) / frames));
+        }
+        vterm_printf("  %s: flipping saves %d us/frame\n", shape.name,
+                     (int)((pt::int64_t)avg[0] - (pt::int64_t)avg[1]));
+    }
+    fb->SetPageFlip(was_flipping);
+}
+
+void Shell::execute_cursorbench(const char*) {
+    // Pointer motion across the live screen, two ways: the cursor overlay
+    // alone, and the old path, where every move also damaged the old and
+    // new 16x16 rects and Flush recomposited and uploaded them.  Each move
+    // waits until it is on screen.  Latency is set_cursor_pos to sprite
+    // drawn, as the compositor records it, so it includes the wait for the
+    // next frame slot; other damage on screen only adds noise.
+    Framebuffer* fb = Framebuffer::get_instance();
+    if (!fb->get_back()) {
+        vterm_printf("cursorbench: no framebuffer\n");
+        return;
+    }
+    constexpr int MOVES = 60;
+    constexpr pt::int16_t STEP = 7, SPRITE = 16;
+    const FrameStats& s = fb->frame_stats();
+    const pt::int16_t x0 = fb->get_cursor_x(), y0 = fb->get_cursor_y();
+    const bool was_visible = fb->cursor_visible();
+    const pt::int16_t span = (pt::int16_t)((fb->get_height() < 480 ? fb->get_height() : 480) - SPRITE);
+
+    vterm_printf("cursorbench: %dx%d, %d moves per run, %s\n",
+                 (int)fb->get_width(), (int)fb->get_height(), MOVES,
+                 fb->is_flipping() ? "page flipping" : "copy to VRAM");
+    for (int recomposite = 0; recomposite < 2; recomposite++) {
+        const pt::uint64_t shown0 = s.cursor_shown, lat0 = s.cursor_lat_us;
+        const pt::uint64_t us0 = s.total_us + s.cursor_us;
+        const pt::uint64_t bytes0 = s.pixels * 4 + s.cursor_bytes;
+        pt::uint64_t max_lat = 0;
+        pt::int16_t px = 0, py = 0;
+        int moves = 0;
+        for (int i = 1; i <= MOVES; i++) {
+            const pt::int16_t x = (pt::int16_t)((i * STEP) % span), y = x;
+            if (fb->cursor_visible() && x == fb->get_cursor_x() && y == fb->get_cursor_y())
+                continue;   // not a move: nothing would be drawn
+            if (recomposite) {
+                fb->add_damage(px, py, SPRITE, SPRITE);
+                fb->add_damage(x, y, SPRITE, SPRITE);
+            }
+            const pt::uint64_t n = s.cursor_shown, lat = s.cursor_lat_us;
+            fb->set_cursor_pos(x, y, true);
+            while (s.cursor_shown == n) TaskScheduler::sleep_task(1);
+            if (s.cursor_lat_us - lat > max_lat) max_lat = s.cursor_lat_us - lat;
+            px = x;
+            py = y;
+            moves++;
+        }
+        if (moves == 0) continue;
+        const pt::uint64_t shown = s.cursor_shown - shown0;
+        vterm_printf("  %s: latency %d us avg, %d us max; %d us and %d bytes per move\n",
+                     recomposite ? "recomposite" : "overlay    ",
+                     (int)((s.cursor_lat_us - lat0) / shown), (int)max_lat,
+                     (int)((s.total_us + s.cursor_us - us0) / moves),
+                     (int)((s.pixels * 4 + s.cursor_bytes - bytes0) / moves));
+    }
+    fb->set_cursor_pos(x0, y0, was_visible);
+}
+
+void Shell::execute_mixbench(const char*) {
+    // Eight clips at once, each with its own rate, format and channel
+    // count, through the live mixer.  Reports the mixer task's CPU time per
+    // second of audio it produced meanwhile; anything else playing is
+    // included.  Every clip is a sawtooth at its own pitch.
+    if (!mixer_running()) {
+        vterm_printf("mixbench: audio not available\n");
+        return;
+    }
+    struct Config { pt::uint32_t rate; pt::uint8_t channels, format; };
+    static const Config cfg[] = {
+        {  8000, 1, AUDIO_FMT_U8  }, { 11025, 1, AUDIO_FMT_S16 },
+        { 11025, 2, AUDIO_FMT_U8  }, { 22050, 2, AUDIO_FMT_S16 },
+        { 32000, 1, AUDIO_FMT_S16 }, { 44100, 2, AUDIO_FMT_S16 },
+        { 48000, 2, AUDIO_FMT_S16 }, { 48000, 1, AUDIO_FMT_U8  },
+    };
+    constexpr int STREAMS = sizeof(cfg) / sizeof(cfg[0]);
+    constexpr pt::uint32_t SECONDS = 2;
+    constexpr pt::int32_t AMPLITUDE = 3000;   // eight of them stay below full scale
+
+    const MixerStats& ms = mixer_stats();
+    const AudioStats& as = AC97::stats();
+    const pt::uint64_t periods0 = ms.periods, us0 = ms.mix_us;
+    const pt::uint64_t starved0 = ms.starved, under0 = as.underruns;
+
+    pt::int32_t ids[STREAMS];
+    int started = 0;
+    for (int i = 0; i < STREAMS; i++) {
+        const Config& c = cfg[i];
+        const pt::uint32_t sample = c.format == AUDIO_FMT_U8 ? 1 : 2;
+        const pt::uint32_t frames = c.rate * SECONDS;
+        const pt::uint32_t bytes  = frames * c.channels * sample;
+        const pt::uint32_t period = c.rate / (220 + 110 * i);
+        pt::uint8_t* buf = (pt::uint8_t*)vmm.kmalloc(bytes);
+        ids[i] = -1;
+        if (!buf) continue;
+        for (pt::uint32_t f = 0; f < frames; f++) {
+            pt::int32_t v = (pt::int32_t)(f % period) * 2 * AMPLITUDE / (pt::int32_t)period - AMPLITUDE;
+            for (pt::uint32_t ch = 0; ch < c.channels; ch++) {
+                pt::uint32_t k = f * c.channels + ch;
+                if (sample == 1) buf[k] = (pt::uint8_t)((v >> 8) + 128);
+                else             ((pt::int16_t*)buf)[k] = (pt::int16_t)v;
+            }
+        }
+        ids[i] = mixer_play_clip(buf, bytes, c.rate, c.channels, c.format, true);
+        if (ids[i] < 0) vmm.kfree(buf);
+        else            started++;
+    }
+
+    const pt::uint64_t deadline = get_ticks() + (SECONDS + 3) * 50;
+    for (bool playing = true; playing && get_ticks() < deadline; ) {
+        TaskScheduler::sleep_task(20);
+        playing = false;
+        for (int i = 0; i < STREAMS; i++)
+            if (mixer_clip_playing(ids[i])) playing = true;
+    }
+
+    const pt::uint64_t periods = ms.periods - periods0;
+    if (started == 0 || periods == 0) {
+        vterm_printf("mixbench: nothing was mixed (%d streams started)\n", started);
+        return;
+    }
+    const pt::uint64_t audio_us = periods * MIXER_PERIOD_FRAMES * 1000000ull / MIXER_RATE;
+    const pt::uint64_t mix_us   = ms.mix_us - us0;
+    const pt::uint64_t per_sec  = mix_us * 1000000ull / audio_us;
+    vterm_printf("mixbench: %d streams, %d periods (%d ms of audio)\n",
+                 started, (int)periods, (int)(audio_us / 1000));
+    // vterm_printf has no field widths: hundredths of a percent digit by digit.
+    vterm_printf("  mixer CPU: %d us per second of audio (%d.%d%d%%), %d us per period\n",
+                 (int)per_sec, (int)(per_sec / 10000), (int)(per_sec / 1000 % 10),
+                 (int)(per_sec / 100 % 10), (int)(mix_us / periods));
+    vterm_printf("  starved %d, DMA underruns %d, worst period since boot %d us\n",
+                 (int)(ms.starved - starved0), (int)(as.underruns - under0),
+                 (int)ms.max_us);
+}
+
 void Shell::execute_play(const char* cmd) {
     const char* filename = cmd + 5;
     if (filename[0] == '\0') {
         vterm_printf("Usage: play <filename>\n");
-    } else if (!AC97::is_present()) {
+    } else if (!mixer_running()) {
         vterm_printf("AC97 audio not available\n");
     } else {
         char path_buf[256];
@@ -468,10 +1109,10 @@ void Shell::execute_play(const char* cmd) {
             pt::uint8_t* buf = (pt::uint8_t*)vmm.kmalloc(file.file_size);
             if (buf) {
                 pt::uint32_t bytes_read = VFS::read_file(&file, buf, file.file_size);
-                AC97::play_pcm(buf, bytes_read, 48000);
-                // Wait for DMA to finish before freeing the buffer
-                while (AC97::is_playing()) { /* spin */ }
-                vmm.kfree(buf);
+                // The mixer plays it alongside any other stream and frees
+                // the buffer when done.
+                if (mixer_play_clip(buf, bytes_read, 48000, 2, AUDIO_FMT_S16, true) < 0)
+                    vmm.kfree(buf);
             }
             VFS::close_file(&file);
         } else {
@@ -562,8 +1203,11 @@ void Shell::execute_task(const char* cmd) {
         while (*id_str == ' ' || *id_str == '\t') id_str++;
         if (*id_str == '\0') {
             // Dump all non-dead tasks.
-            for (pt::uint32_t i = 0; i < TaskScheduler::MAX_TASKS; i++)
-                TaskScheduler::dump_task_map(i);
+            for (pt::uint32_t i = 0; i < TaskScheduler::slot_count(); i++) {
+                Task* t = TaskScheduler::slot(i);
+                if (t->state != TASK_DEAD)
+                    TaskScheduler::dump_task_map(t->id);
+            }
         } else {
             // Parse decimal task id.
             pt::uint32_t tid = 0;
@@ -894,20 +1538,18 @@ void Shell::execute_wget(const char* cmd) {
 void Shell::execute_ps(const char* cmd) {
     (void)cmd;
     const char* state_names[] = { "ready", "run  ", "block", "dead " };
-    vterm_printf("PID  NAME             STATE  MODE   TICKS\n");
-    Task* current = TaskScheduler::get_current_task();
-    Task* base = current - current->id;
-    for (pt::uint32_t i = 0; i < TaskScheduler::MAX_TASKS; i++) {
-        Task* t = &base[i];
+    vterm_printf("  PID  NAME             STATE  MODE   TICKS\n");
+    for (pt::uint32_t i = 0; i < TaskScheduler::slot_count(); i++) {
+        Task* t = TaskScheduler::slot(i);
         if (t->state == TASK_DEAD)
             continue;
         const char* name = t->name[0] ? t->name : "(kernel)";
         const char* state = (t->state <= 3) ? state_names[t->state] : "?????";
         const char* mode = t->user_mode ? "user" : "kern";
-        // Manual padding: PID right-aligned in 3 chars
-        if (i < 10) vterm_printf("  ");
-        else if (i < 100) vterm_printf(" ");
-        vterm_printf("%d  ", (int)i);
+        // Manual padding: PID right-aligned in 5 chars
+        for (pt::uint32_t w = 10000; w > 1 && t->id < w; w /= 10)
+            vterm_printf(" ");
+        vterm_printf("%d  ", (int)t->id);
         // Name left-padded to 16 chars
         vterm_printf("%s", name);
         int nlen = 0;
@@ -958,11 +1600,9 @@ void Shell::execute_neofetch(const char* cmd) {
     constexpr const char* C_RST  = "\033[0m";   // reset
 
     // Count active tasks
-    Task* current = TaskScheduler::get_current_task();
-    Task* base = current - current->id;
     int active = 0;
-    for (pt::uint32_t i = 0; i < TaskScheduler::MAX_TASKS; i++) {
-        if (base[i].state != TASK_DEAD)
+    for (pt::uint32_t i = 0; i < TaskScheduler::slot_count(); i++) {
+        if (TaskScheduler::slot(i)->state != TASK_DEAD)
             active++;
     }
 
@@ -1136,6 +1776,33 @@ bool Shell::execute(const char* cmd) {
     else if (!memcmp(cmd, diskbench_cmd, sizeof(diskbench_cmd))) {
         execute_diskbench(cmd);
     }
+    else if (!memcmp(cmd, execbench_cmd, sizeof(execbench_cmd))) {
+        execute_execbench(cmd);
+    }
+    else if (!memcmp(cmd, membench_cmd, sizeof(membench_cmd))) {
+        execute_membench(cmd);
+    }
+    else if (!memcmp(cmd, simdbench_cmd, sizeof(simdbench_cmd))) {
+        execute_simdbench(cmd);
+    }
+    else if (!memcmp(cmd, compbench_cmd, sizeof(compbench_cmd))) {
+        execute_compbench(cmd);
+    }
+    else if (!memcmp(cmd, scalebench_cmd, sizeof(scalebench_cmd))) {
+        execute_scalebench(cmd);
+    }
+    else if (!memcmp(cmd, vrambench_cmd, sizeof(vrambench_cmd))) {
+        execute_vrambench(cmd);
+    }
+    else if (!memcmp(cmd, flipbench_cmd, sizeof(flipbench_cmd))) {
+        execute_flipbench(cmd);
+    }
+    else if (!memcmp(cmd, cursorbench_cmd, sizeof(cursorbench_cmd))) {
+        execute_cursorbench(cmd);
+    }
+    else if (!memcmp(cmd, mixbench_cmd, sizeof(mixbench_cmd))) {
+        execute_mixbench(cmd);
+    }
     else if (!memcmp(cmd, disk_cmd, sizeof(disk_cmd))) {
         execute_disk(cmd);
     }
@@ -0,0 +1,107 @@
+/* audiolat — how small a mapped audio ring can get before it underruns.
+ *
+ * Plays a 48 kHz stereo tone through sys_audio_map_ring() with ring sizes
+ * from one mixer period (4 KB, ~21 ms) up to 64 KB, fed two ways:
+ *
+ *   wait    sys_audio_ring_wait() for a quarter ring, then fill it — an
+ *           audio thread such as the SDL callback worker
+ *   frame   sleep a 60 Hz frame, then top the ring up — a game that mixes
+ *           from its main loop, as the DevilutionX shim does
+ *
+ * For each run it prints the periods in which the ring ran dry and the
+ * write-to-DAC latency: what sits in the ring plus what the mixer has
+ * already queued on the AC97 (delay_us).  Pass seconds per run as argv[1]
+ * (default 2). */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/syscall.h"
+
+#define RATE        48000
+#define FRAME_BYTES 4
+
+static unsigned int phase;
+
+/* Triangle wave, ~440 Hz, into the ring at its write position. */
+static void fill(struct audio_ring *r, unsigned long bytes)
+{
+    short *d = (short *)audio_ring_data(r);
+    unsigned long mask = r->size / 2 - 1;
+    unsigned long pos = (unsigned long)(r->write / 2);
+    for (unsigned long i = 0; i < bytes / FRAME_BYTES; i++) {
+        int t = (int)(phase++ % 109) * 600 - 32700;
+        short v = (short)((t < 0 ? -t : t) - 16350);
+        d[(pos + i * 2) & mask] = v;
+        d[(pos + i * 2 + 1) & mask] = v;
+    }
+    audio_ring_commit(r, bytes);
+}
+
+/* Latency of the sample just written, in microseconds. */
+static unsigned long long latency_us(const struct audio_ring *r)
+{
+    unsigned long long queued = r->write - r->read;
+    return queued * 1000000ULL / (RATE * FRAME_BYTES) + r->delay_us;
+}
+
+static void run(unsigned long size, int frame_mode, int seconds)
+{
+    if (sys_audio_open(RATE, 2, AUDIO_FMT_S16) != 0) {
+        puts("  cannot open an audio stream");
+        return;
+    }
+    struct audio_ring *r = sys_audio_map_ring(size);
+    if (!r) {
+        puts("  cannot map a ring");
+        sys_audio_close();
+        return;
+    }
+
+    unsigned long quarter = r->size / 4;
+    unsigned long long sum = 0, worst = 0, samples = 0, wakes = 0;
+    unsigned long long start = sys_get_micros();
+    unsigned long long end = start + (unsigned long long)seconds * 1000000ULL;
+    fill(r, r->size);
+    unsigned long long starved0 = r->starved;
+
+    while (sys_get_micros() < end) {
+        if (frame_mode) {
+            sys_sleep_ms(16);
+            unsigned long room = audio_ring_free(r) & ~(unsigned long)(FRAME_BYTES - 1);
+            if (room) fill(r, room);
+        } else {
+            long room = sys_audio_ring_wait(quarter, 100);
+            if (room < 0) break;
+            if ((unsigned long)room < quarter) continue;
+            fill(r, quarter);
+        }
+        wakes++;
+        unsigned long long us = latency_us(r);
+        sum += us;
+        if (us > worst) worst = us;
+        samples++;
+    }
+
+    unsigned long long starved = r->starved - starved0;
+    printf("  %-5s %6lu B %4llu ms  %5llu fills  %4llu starved  %5llu ms avg  %5llu ms max\n",
+           frame_mode ? "frame" : "wait", (unsigned long)r->size,
+           (unsigned long long)r->size * 1000ULL / (RATE * FRAME_BYTES), wakes, starved,
+           samples ? sum / samples / 1000 : 0, worst / 1000);
+    sys_audio_close();
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = (argc > 1) ? atoi(argv[1]) : 2;
+    if (seconds <= 0) seconds = 2;
+    if (sys_audio_is_playing() < 0) {
+        puts("audiolat: no audio device");
+        return 1;
+    }
+
+    printf("audiolat: %d s per run, 48 kHz stereo S16\n", seconds);
+    for (int mode = 0; mode < 2; mode++)
+        for (unsigned long size = AUDIO_RING_MIN; size <= 64 * 1024; size *= 2)
+            run(size, mode, seconds);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/string.h"
+#include "libc/syscall.h"
+
+/* Exercises the on-demand user page tables: a 64 MB static BSS (well past
+ * the old 16 MB ELF image limit) and a 200 MB heap built from 1 MB mallocs. */
+
+#define BSS_SIZE    (64UL * 1024 * 1024)
+#define HEAP_BLOCKS 200
+#define BLOCK_SIZE  (1024UL * 1024)
+
+static unsigned char big_bss[BSS_SIZE];
+static unsigned char *blocks[HEAP_BLOCKS];
+
+static unsigned long elapsed_ms(unsigned long long t0)
+{
+    return (unsigned long)((sys_get_micros() - t0) / 1000);
+}
+
+static int test_bss(void)
+{
+    unsigned long long t0 = sys_get_micros();
+
+    /* The loader must hand us zeroed BSS on every page. */
+    for (unsigned long off = 0; off < BSS_SIZE; off += 4096) {
+        if (big_bss[off] != 0 || big_bss[off + 4095] != 0) {
+            printf("[bigmem] FAIL: bss not zero at offset %lx\n", off);
+            return 1;
+        }
+    }
+    for (unsigned long off = 0; off < BSS_SIZE; off += 4096)
+        *(unsigned long *)&big_bss[off] = off ^ 0x5A5A5A5AUL;
+    for (unsigned long off = 0; off < BSS_SIZE; off += 4096) {
+        if (*(unsigned long *)&big_bss[off] != (off ^ 0x5A5A5A5AUL)) {
+            printf("[bigmem] FAIL: bss readback at offset %lx\n", off);
+            return 1;
+        }
+    }
+
+    printf("[bigmem] PASS: 64 MB bss at %p (%lu ms)\n",
+           (void *)big_bss, elapsed_ms(t0));
+    return 0;
+}
+
+static int test_heap(void)
+{
+    unsigned long long t0 = sys_get_micros();
+    int n = 0;
+
+    for (; n < HEAP_BLOCKS; n++) {
+        blocks[n] = (unsigned char *)malloc(BLOCK_SIZE);
+        if (!blocks[n]) {
+            printf("[bigmem] FAIL: malloc #%d of 1 MB returned NULL\n", n);
+            break;
+        }
+        memset(blocks[n], (unsigned char)n, BLOCK_SIZE);
+    }
+
+    int fail = (n != HEAP_BLOCKS);
+    for (int i = 0; i < n && !fail; i++) {
+        for (unsigned long off = 0; off < BLOCK_SIZE; off += 512) {
+            if (blocks[i][off] != (unsigned char)i) {
+                printf("[bigmem] FAIL: heap block %d corrupt at %lx\n", i, off);
+                fail = 1;
+                break;
+            }
+        }
+    }
+
+    if (!fail)
+        printf("[bigmem] PASS: %d MB heap %p-%p (%lu ms)\n", n,
+               (void *)blocks[0], (void *)(blocks[n - 1] + BLOCK_SIZE),
+               elapsed_ms(t0));
+
+    for (int i = 0; i < n; i++)
+        free(blocks[i]);
+    return fail;
+}
+
+int main(void)
+{
+    puts("[bigmem] starting");
+    int fail = test_bss();
+    fail |= test_heap();
+    puts(fail ? "[bigmem] FAILED" : "[bigmem] all tests passed");
+    return fail;
+}
@@ -0,0 +1,80 @@
+/* catbench — text output throughput: "cat" a 1 MB file to stdout.
+ *
+ * Writes CATBENCH.TXT (1 MB of 64-byte lines), then times two passes:
+ *
+ *   file      read it back in 4 KB chunks and write each chunk to stdout,
+ *             as cat does
+ *   memory    write the same text from a buffer, to separate the text
+ *             rendering cost from the disk
+ *
+ * Run it from the shell window (text-mode window) or a VTerm; both render
+ * through the glyph atlas.  The report is printed after the text. */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/syscall.h"
+
+#define FILE_BYTES (1024 * 1024)
+#define LINE_BYTES 64
+#define CHUNK      4096
+#define NAME       "CATBENCH.TXT"
+
+static char text[FILE_BYTES];
+
+static void make_text(void)
+{
+    static const char words[] = "The quick brown fox jumps over the lazy dog 0123456789";
+    for (int l = 0; l < FILE_BYTES / LINE_BYTES; l++) {
+        char *p = text + l * LINE_BYTES;
+        snprintf(p, LINE_BYTES, "%06d %s ......", l, words);
+        for (int i = 0; i < LINE_BYTES - 1; i++)
+            if (p[i] == '\0') p[i] = '.';
+        p[LINE_BYTES - 1] = '\n';
+    }
+}
+
+static void report(const char *name, unsigned long bytes, unsigned long long us)
+{
+    if (us == 0) us = 1;
+    printf("  %-7s %7lu bytes  %8llu us  %6llu KB/s  %6llu lines/s\n", name, bytes, us,
+           (unsigned long long)bytes * 1000000ULL / 1024 / us,
+           (unsigned long long)bytes / LINE_BYTES * 1000000ULL / us);
+}
+
+int main(void)
+{
+    make_text();
+    FILE *f = fopen(NAME, "w");
+    if (!f || fwrite(text, 1, FILE_BYTES, f) != FILE_BYTES) {
+        puts("catbench: cannot write " NAME);
+        return 1;
+    }
+    fclose(f);
+
+    static char chunk[CHUNK];
+    int fd = sys_open(NAME);
+    if (fd < 0) {
+        puts("catbench: cannot open " NAME);
+        return 1;
+    }
+    unsigned long file_bytes = 0;
+    unsigned long long t0 = sys_get_micros();
+    long got;
+    while ((got = sys_read(fd, chunk, CHUNK)) > 0) {
+        sys_write(1, chunk, (size_t)got);
+        file_bytes += (unsigned long)got;
+    }
+    unsigned long long us_file = sys_get_micros() - t0;
+    sys_close(fd);
+
+    t0 = sys_get_micros();
+    for (unsigned long off = 0; off < FILE_BYTES; off += CHUNK)
+        sys_write(1, text + off, CHUNK);
+    unsigned long long us_mem = sys_get_micros() - t0;
+
+    printf("\ncatbench: %d KB, %d-byte lines, %d-byte writes\n",
+           FILE_BYTES / 1024, LINE_BYTES, CHUNK);
+    report("file", file_bytes, us_file);
+    report("memory", FILE_BYTES, us_mem);
+    return file_bytes == FILE_BYTES ? 0 : 1;
+}
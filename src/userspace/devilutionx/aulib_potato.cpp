@@ -2,10 +2,12 @@
  * aulib_potato.cpp — Aulib shim for potatOS.
  *
  * Replaces SDL_audiolib with a minimal software mixer that:
- *  - Owns the kernel AC97 device via sys_audio_open()/sys_audio_close().
+ *  - Opens its kernel audio stream via sys_audio_open()/sys_audio_close().
  *  - Decodes WAV files directly (see DecoderDrwav below).
  *  - Mixes all active Aulib::Stream objects into a stereo int16_t buffer
- *    and submits it to the kernel via sys_audio_write().
+ *    and stores it straight into the stream's shared ring
+ *    (sys_audio_map_ring()), or submits it via sys_audio_write() when no
+ *    ring could be mapped.
  *
  * The mixer is driven by Aulib::process() which is called from the
  * SDL_PollEvent() hook in our SDL2 shim (so every frame of the game loop
@@ -42,6 +44,7 @@ static int             g_channels       = 2;
 static int             g_buffer_frames  = 2048;
 static SDL_AudioFormat g_format         = AUDIO_S16SYS;
 static bool            g_initialized    = false;
+static audio_ring*     g_ring           = nullptr;
 
 int sampleRate() { return g_sample_rate; }
 int channelCount() { return g_channels; }
@@ -81,8 +84,13 @@ bool init(int freq, SDL_AudioFormat format, int channels, int frameSize,
         return false;
     }
 
-    serial_printf("[Aulib] init rate=%d ch=%d buf=%d\n",
-                  freq, channels, frameSize);
+    // Four mixed chunks of shared ring (see process()); the mixer below
+    // writes stereo S16 frames, 4 bytes each.
+    int chunk = std::min(std::max(frameSize, 128), 2048);
+    g_ring = sys_audio_map_ring(static_cast<unsigned long>(chunk) * 4 * 4);
+
+    serial_printf("[Aulib] init rate=%d ch=%d buf=%d ring=%d\n",
+                  freq, channels, frameSize, g_ring ? static_cast<int>(g_ring->size) : 0);
     g_initialized = true;
     return true;
 }
@@ -90,7 +98,8 @@ bool init(int freq, SDL_AudioFormat format, int channels, int frameSize,
 void quit() {
     if (!g_initialized) return;
     g_active_streams.clear();
-    sys_audio_close();
+    sys_audio_close();   // unmaps the ring
+    g_ring        = nullptr;
     g_initialized = false;
     serial_printf("[Aulib] quit\n");
 }
@@ -120,9 +129,11 @@ void process() {
     static int32_t mix_accum[2048 * 2];
     static int16_t mix_out[2048 * 2];
 
-    // Keep feeding the kernel until both DMA slots are full.
+    const unsigned long chunk_bytes = static_cast<unsigned long>(frames_per_chunk) * 4;
+
+    // Keep feeding the kernel until the ring (or the stream's slots) is full.
     // sys_audio_is_playing(): 1 = busy (no free slot), 0 = free slot available.
-    while (sys_audio_is_playing() == 0) {
+    while (g_ring ? audio_ring_free(g_ring) >= chunk_bytes : sys_audio_is_playing() == 0) {
         bool any_active = false;
 
         // Zero the accumulator for this chunk.
@@ -160,13 +171,26 @@ void process() {
 
         if (!any_active) break;
 
-        // Clip to int16 range.
+        // Clip to int16 range, into the ring when there is one: the
+        // kernel mixer reads it from there, no copy and no syscall.
         const int total_samples = frames_per_chunk * 2;
+        int16_t* out  = mix_out;
+        uint32_t pos  = 0;
+        uint32_t mask = ~0u;
+        if (g_ring) {
+            out  = reinterpret_cast<int16_t*>(audio_ring_data(g_ring));
+            pos  = static_cast<uint32_t>(g_ring->write / 2);
+            mask = g_ring->size / 2 - 1;
+        }
         for (int i = 0; i < total_samples; i++) {
             int32_t v = mix_accum[i];
             if (v >  32767) v =  32767;
             if (v < -32768) v = -32768;
-            mix_out[i] = static_cast<int16_t>(v);
+            out[(pos + i) & mask] = static_cast<int16_t>(v);
+        }
+        if (g_ring) {
+            audio_ring_commit(g_ring, chunk_bytes);
+            continue;
         }
 
         // Push to kernel. rate arg is ignored post-open.
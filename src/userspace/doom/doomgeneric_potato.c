@@ -16,9 +16,6 @@
 #define SCREEN_W   DOOMGENERIC_RESX   /* default 640 */
 #define SCREEN_H   DOOMGENERIC_RESY   /* default 400 */
 
-/* Packed RGB24 output buffer in .bss (640×400×3 = 768 000 bytes) */
-static unsigned char rgb_buf[SCREEN_W * SCREEN_H * 3];
-
 /* Window ID for this Doom instance (-1 = no window) */
 static long g_wid = -1;
 
@@ -46,20 +43,12 @@ void DG_Init(void)
 
 void DG_DrawFrame(void)
 {
-    /* DG_ScreenBuffer = SCREEN_W * SCREEN_H * uint32_t (XRGB8888).
-       Convert to packed RGB24 for sys_draw_pixels. */
-    pixel_t       *src = DG_ScreenBuffer;
-    unsigned char *dst = rgb_buf;
-    int n = SCREEN_W * SCREEN_H;
-    while (n--) {
-        unsigned int px = (unsigned int)*src++;
-        *dst++ = (px >> 16) & 0xFF; /* R */
-        *dst++ = (px >>  8) & 0xFF; /* G */
-        *dst++ =  px        & 0xFF; /* B */
-    }
-    /* Draw at (0,0) relative to the window client area; the kernel translates
+    /* DG_ScreenBuffer = SCREEN_W * SCREEN_H * uint32_t (XRGB8888), the
+       window buffer's own format, so the kernel copies it row by row.
+       Draw at (0,0) relative to the window client area; the kernel translates
        to screen-absolute coordinates via SYS_DRAW_PIXELS window clipping. */
-    sys_draw_pixels(rgb_buf, 0, 0, SCREEN_W, SCREEN_H);
+    sys_draw_pixels_fmt(DG_ScreenBuffer, 0, 0, SCREEN_W, SCREEN_H,
+                        PIXFMT_XRGB8888, 0);
 }
 
 /* ── timing ──────────────────────────────────────────────────────────────── */
@@ -137,10 +126,17 @@ static unsigned char sc_to_doom(int sc)
 
 int DG_GetKey(int *pressed, unsigned char *doomKey)
 {
+    /* Doom asks once per key until we say no more; refill from the window's
+     * event ring (so we only receive keys when focused) a batch at a time. */
+    static uint64_t batch[32];
+    static long count = 0, pos = 0;
     for (;;) {
-        /* Poll the window's event ring so we only receive keys when focused. */
-        long ev = (g_wid >= 0) ? sys_get_window_event(g_wid) : 0;
-        if (ev == 0) return 0;
+        if (pos == count) {
+            count = (g_wid >= 0) ? sys_get_window_events(g_wid, batch, 32, 0, 0) : 0;
+            pos = 0;
+            if (count <= 0) { count = 0; return 0; }
+        }
+        long ev = (long)batch[pos++];
         int sc = (int)(ev & 0xFF);
         unsigned char dk = sc_to_doom(sc);
         if (!dk) continue;          /* ignore unmapped keys */
@@ -55,14 +55,17 @@ uint8_t lastPalette[768];
 static uint8_t *framebuf = NULL;
 static int fb_w = 0, fb_h = 0;
 
-/* 256-entry palette: RGBA, expanded from BUILD's 0-63 VGA range to 0-255 */
+/* 256-entry palette: RGBA, expanded from BUILD's 0-63 VGA range to 0-255.
+   Kept for VBE_getPalette; the window gets a copy via sys_set_window_palette. */
 static uint8_t palette_rgba[256 * 4];
 
-/* RGB24 output buffer for sys_draw_pixels (at 2x scale) */
-#define DUKE_SCALE 1
-static uint8_t *rgb_buf = NULL;
+/* On-screen size of the indexed (8 bpp) window: the largest whole multiple
+   of the engine's framebuffer that fits the screen.  The framebuffer is
+   handed to the kernel as-is and the compositor does the enlarging. */
 static int disp_w = 0, disp_h = 0;
 
+static void upload_palette(void);
+
 /* Screen allocation tracking (mirrors original display.c) */
 static uint8_t screenalloctype = 255;
 
@@ -191,22 +194,23 @@ int32_t _setgamemode(uint8_t davidoption, int32_t daxdim, int32_t daydim)
     framebuf = (uint8_t *)malloc(fb_w * fb_h);
     memset(framebuf, 0, fb_w * fb_h);
 
-    /* Allocate scaled RGB24 output buffer */
-    disp_w = fb_w * DUKE_SCALE;
-    disp_h = fb_h * DUKE_SCALE;
-    if (rgb_buf) free(rgb_buf);
-    rgb_buf = (uint8_t *)malloc(disp_w * disp_h * 3);
-
     /* Create window */
     if (g_wid >= 0) sys_destroy_window(g_wid);
     int scr_w = (int)sys_fb_width();
     int scr_h = (int)sys_fb_height();
+    int scale = 1;
+    while (fb_w * (scale + 1) <= scr_w && fb_h * (scale + 1) + 18 <= scr_h)
+        scale++;
+    disp_w = fb_w * scale;
+    disp_h = fb_h * scale;
     int cx = (scr_w - disp_w) / 2;
     int cy = (scr_h - disp_h) / 2;
     if (cx < 0) cx = 0;
     if (cy < 18) cy = 18;  /* room for title bar */
-    g_wid = sys_create_window(cx, cy, disp_w, disp_h);
+    g_wid = sys_create_window_indexed(cx, cy, disp_w, disp_h);
     sys_set_window_title(g_wid, "Duke Nukem 3D");
+    if (scale > 1) sys_set_window_source(fb_w, fb_h, WSCALE_NEAREST);
+    upload_palette();  /* a new window starts with the grey ramp */
 
     vidoption = 1;
     getvalidvesamodes();
@@ -239,7 +243,6 @@ void _uninitengine(void)
 {
     if (g_wid >= 0) { sys_destroy_window(g_wid); g_wid = -1; }
     if (framebuf) { free(framebuf); framebuf = NULL; }
-    if (rgb_buf) { free(rgb_buf); rgb_buf = NULL; }
     /* On potatOS, terminate immediately — the remaining shutdown code
        (CONFIG_WriteSetup, uninitgroupfile, etc.) is not essential and
        the game loop can resume before exit() is reached otherwise. */
@@ -284,31 +287,11 @@ void _nextpage(void)
     if ((frame_counter & 0x3F) == 0) /* every 64 frames */
         dbg_int("F:", frame_counter);
 
-    if (!framebuf || !rgb_buf || g_wid < 0) return;
-
-    /* Convert 8-bit paletted framebuffer → RGB24 at 2x scale */
-    int sy, sx;
-    for (sy = 0; sy < fb_h; sy++) {
-        uint8_t *row = rgb_buf + (sy * DUKE_SCALE) * disp_w * 3;
-        uint8_t *rp = row;
-        for (sx = 0; sx < fb_w; sx++) {
-            unsigned int idx = (unsigned int)framebuf[sy * fb_w + sx] * 4u;
-            uint8_t r = palette_rgba[idx + 0];
-            uint8_t g = palette_rgba[idx + 1];
-            uint8_t b = palette_rgba[idx + 2];
-            int s;
-            for (s = 0; s < DUKE_SCALE; s++) {
-                *rp++ = r; *rp++ = g; *rp++ = b;
-            }
-        }
-        /* Duplicate row for vertical scaling */
-        int row_bytes = disp_w * 3;
-        int s;
-        for (s = 1; s < DUKE_SCALE; s++)
-            memcpy(row + s * row_bytes, row, row_bytes);
-    }
+    if (!framebuf || g_wid < 0) return;
 
-    sys_draw_pixels(rgb_buf, 0, 0, disp_w, disp_h);
+    /* 8-bit frame straight to the indexed window; the compositor applies
+       the palette. */
+    sys_draw_pixels_fmt(framebuf, 0, 0, fb_w, fb_h, PIXFMT_INDEX8, 0);
 
     ticks = getticks();
     total_render_time = (ticks - total_rendered_frames);
@@ -353,9 +336,21 @@ int VBE_setPalette(uint8_t *palettebuffer)
         palette_rgba[i * 4 + 2] = b;
         palette_rgba[i * 4 + 3] = 255;
     }
+    upload_palette();
     return 1;
 }
 
+/* Give the indexed window the current palette. */
+static void upload_palette(void)
+{
+    uint32_t colors[256];
+    int i;
+    for (i = 0; i < 256; i++)
+        colors[i] = (uint32_t)palette_rgba[i * 4] << 16 |
+                    (uint32_t)palette_rgba[i * 4 + 1] << 8 | palette_rgba[i * 4 + 2];
+    sys_set_window_palette(colors, 0, 256);
+}
+
 int VBE_getPalette(int32_t start, int32_t num, uint8_t *dapal)
 {
     uint8_t *p = dapal + (start * 4);
@@ -403,25 +398,50 @@ static int is_extended_key(int sc)
     }
 }
 
-void _handle_events(void)
+static void key_event(long ev)
 {
-    /* Poll keyboard */
-    for (;;) {
-        long ev = (g_wid >= 0) ? sys_get_window_event(g_wid) : sys_get_key_event();
-        if (ev == 0 || ev == -1) break;
+    int pressed  = (ev & 0x100) != 0;
+    int scancode = ev & 0xFF;
 
-        int pressed  = (ev & 0x100) != 0;
-        int scancode = ev & 0xFF;
+    if (is_extended_key(scancode)) {
+        /* Send E0 prefix first */
+        lastkey = 0xE0;
+        keyhandler();
+    }
 
-        if (is_extended_key(scancode)) {
-            /* Send E0 prefix first */
-            lastkey = 0xE0;
-            keyhandler();
-        }
+    lastkey = scancode;
+    if (!pressed) lastkey += 128;  /* bit 7 = released in DOS */
+    keyhandler();
+}
 
-        lastkey = scancode;
-        if (!pressed) lastkey += 128;  /* bit 7 = released in DOS */
-        keyhandler();
+void _handle_events(void)
+{
+    if (g_wid >= 0) {
+        /* Keys and mouse packets in arrival order, a queue's worth per call;
+         * the kernel has already merged runs of plain motion. */
+        uint64_t evs[64];
+        long n;
+        do {
+            n = sys_get_window_events(g_wid, evs, 64, 0, WEVF_MOUSE);
+            for (long i = 0; i < n; i++) {
+                uint64_t ev = evs[i];
+                if (!(ev & WEV_MOUSE)) { key_event((long)ev); continue; }
+                mouse_rel_x += (short)(ev & 0xFFFF);
+                mouse_rel_y += (short)((ev >> 16) & 0xFFFF);
+                mouse_btn = (int)((ev >> 32) & 1) | (int)((ev >> 33) & 1) << 1;
+            }
+        } while (n == 64);
+        sampletimer();
+        extern void DSL_PumpAudio(void);
+        DSL_PumpAudio();
+        return;
+    }
+
+    /* Poll keyboard */
+    for (;;) {
+        long ev = sys_get_key_event();
+        if (ev == -1) break;
+        key_event(ev);
     }
 
     /* Poll mouse */
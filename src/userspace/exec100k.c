@@ -0,0 +1,12 @@
+/* execbench payload: ~100 KB of file-backed .rodata so the loader has to
+ * stream real bytes from disk.  Exits immediately; the shell's execbench
+ * command times create + run + reap. */
+
+#define PAYLOAD_SIZE (96 * 1024)
+
+static const volatile unsigned char payload[PAYLOAD_SIZE] = { 1 };
+
+int main(void)
+{
+    return payload[0] == 1 ? 0 : 1;
+}
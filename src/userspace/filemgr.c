@@ -87,13 +87,14 @@ int main(void) {
     draw();
 
     while (running) {
-        long ev;
-        while ((ev = sys_get_window_event(wid)) != 0) {
-            int pressed = (ev & 0x100) != 0;
-            int sc      = (int)(ev & 0xFF);
+        /* Sleeps in the kernel until a key arrives. */
+        uint64_t evs[16];
+        long n = sys_get_window_events(wid, evs, 16, WEV_WAIT_FOREVER, 0);
+        for (long i = 0; i < n && running; i++) {
+            int pressed = (evs[i] & 0x100) != 0;
+            int sc      = (int)(evs[i] & 0xFF);
             handle_key(sc, pressed);
         }
-        sys_yield();
     }
 
     sys_destroy_window(wid);
@@ -302,7 +303,8 @@ static int prompt(const char *label, char *out, int outsz) {
         sys_fill_rect(lx + len * GLYPH_W, FOOTER_Y, GLYPH_W, GLYPH_H, COLOR_SEL_BG);
 
         long ev;
-        while ((ev = sys_get_window_event(wid)) == 0) sys_yield();
+        while ((ev = sys_get_window_event(wid)) == 0)
+            sys_get_window_events(wid, 0, 0, WEV_WAIT_FOREVER, 0);
         int pressed = (ev & 0x100) != 0;
         int sc      = (int)(ev & 0xFF);
         if (sc == 0x2A || sc == 0x36) { shift = pressed; continue; }
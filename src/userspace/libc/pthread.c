@@ -5,17 +5,17 @@
 /* ── internal constants ─────────────────────────────────────────────────── */
 
 #define PTHREAD_STACK_SIZE  (1024UL * 1024UL)  /* 1 MB per thread */
-#define MAX_PTHREAD_THREADS 32                  /* matches kernel MAX_TASKS */
+#define MAX_PTHREAD_THREADS 256                 /* unjoined threads tracked */
 
 /* ── per-thread stack registry ──────────────────────────────────────────── *
- * Indexed by (tid % MAX_PTHREAD_THREADS).  pthread_create fills these in;
- * pthread_join drains them after the thread exits so the stack can be freed.
+ * TIDs are kernel PIDs, not small indices, so entries are matched by tid.
+ * pthread_create fills a free entry in; pthread_join drains it after the
+ * thread exits so the stack can be freed.
  *
- * Note: if the kernel recycles a TID before pthread_join() is called for
- * the previous owner, a new pthread_create() will overwrite the slot,
- * leaking the old thread's stack.  With MAX_TASKS=32 this is benign in
- * practice — always join your threads.
+ * Note: with more than MAX_PTHREAD_THREADS unjoined threads the extra
+ * stacks are not registered and leak on join — always join your threads.
  */
+static uint32_t  g_thread_stack_tid[MAX_PTHREAD_THREADS];
 static void     *g_thread_stack_base[MAX_PTHREAD_THREADS];
 static uint64_t  g_thread_stack_size[MAX_PTHREAD_THREADS];
 
@@ -82,9 +82,14 @@ int pthread_create(pthread_t *tid_out, const pthread_attr_t *attr,
     }
 
     /* Register stack for deferred cleanup in pthread_join(). */
-    uint32_t idx = new_tid % MAX_PTHREAD_THREADS;
-    g_thread_stack_base[idx] = stack_base;
-    g_thread_stack_size[idx] = PTHREAD_STACK_SIZE;
+    for (uint32_t idx = 0; idx < MAX_PTHREAD_THREADS; idx++) {
+        if (!g_thread_stack_base[idx]) {
+            g_thread_stack_tid[idx]  = new_tid;
+            g_thread_stack_base[idx] = stack_base;
+            g_thread_stack_size[idx] = PTHREAD_STACK_SIZE;
+            break;
+        }
+    }
 
     if (tid_out)
         *tid_out = (pthread_t)new_tid;
@@ -104,11 +109,13 @@ int pthread_join(pthread_t tid, void **retval)
         *retval = (void *)result;
 
     /* Free the joined thread's stack now that the kernel slot is dead. */
-    uint32_t idx = (uint32_t)tid % MAX_PTHREAD_THREADS;
-    if (g_thread_stack_base[idx]) {
-        sys_munmap(g_thread_stack_base[idx], (size_t)g_thread_stack_size[idx]);
-        g_thread_stack_base[idx] = (void *)0;
-        g_thread_stack_size[idx] = 0;
+    for (uint32_t idx = 0; idx < MAX_PTHREAD_THREADS; idx++) {
+        if (g_thread_stack_base[idx] && g_thread_stack_tid[idx] == (uint32_t)tid) {
+            sys_munmap(g_thread_stack_base[idx], (size_t)g_thread_stack_size[idx]);
+            g_thread_stack_base[idx] = (void *)0;
+            g_thread_stack_size[idx] = 0;
+            break;
+        }
     }
 
     return 0;
@@ -242,7 +249,7 @@ int pthread_cond_broadcast(pthread_cond_t *c)
 {
     atomic_fetch_add(&c->seq, 1);
     if (c->waiters > 0)
-        /* Wake all waiters — MAX_PTHREAD_THREADS is an upper bound. */
-        sys_futex(FUTEX_WAKE, &c->seq, MAX_PTHREAD_THREADS);
+        /* Wake all waiters. */
+        sys_futex(FUTEX_WAKE, &c->seq, 0x7FFFFFFF);
     return 0;
 }
@@ -51,15 +51,16 @@ void SDL_ClearError(void) { sdl_error_buf[0] = '\0'; }
 struct SDL_Window {
     long   wid;         /* potatOS window ID */
     int    w, h;        /* client dimensions */
+    int    src_w, src_h; /* size the compositor scales up; 0 = drawn 1:1 */
     char   title[32];
 };
 
 struct SDL_Renderer {
     SDL_Window *window;
     Uint8  draw_r, draw_g, draw_b, draw_a;
-    /* Conversion buffer: ARGB32 → RGB24 for sys_draw_pixels */
-    unsigned char *rgb24_buf;
-    int rgb24_w, rgb24_h;
+    /* Scaled copy of a texture for sys_draw_pixels_fmt (ARGB8888) */
+    Uint32 *scale_buf;
+    int scale_w, scale_h;
 };
 
 struct SDL_Texture {
@@ -71,6 +72,7 @@ struct SDL_Texture {
 
 /* One window at a time (potatOS constraint for simple games) */
 static SDL_Window   g_window;
+static int          g_window_live = 0;  /* g_window.wid is a live window */
 static SDL_Renderer g_renderer;
 static int g_initialized = 0;
 
@@ -118,8 +120,11 @@ SDL_Window* SDL_CreateWindow(const char *title, int x, int y, int w, int h,
         return (SDL_Window*)0;
     }
     g_window.wid = wid;
+    g_window_live = 1;
     g_window.w = w;
     g_window.h = h;
+    g_window.src_w = 0;
+    g_window.src_h = 0;
     /* Copy title */
     int i = 0;
     while (title && title[i] && i < 31) { g_window.title[i] = title[i]; i++; }
@@ -132,6 +137,7 @@ SDL_Window* SDL_CreateWindow(const char *title, int x, int y, int w, int h,
 void SDL_DestroyWindow(SDL_Window *window)
 {
     if (window) sys_destroy_window(window->wid);
+    if (window == &g_window) g_window_live = 0;
 }
 
 void SDL_GetWindowSize(SDL_Window *window, int *w, int *h)
@@ -161,17 +167,17 @@ SDL_Renderer* SDL_CreateRenderer(SDL_Window *window, int index, Uint32 flags)
     g_renderer.draw_g = 0;
     g_renderer.draw_b = 0;
     g_renderer.draw_a = 255;
-    g_renderer.rgb24_buf = (unsigned char*)0;
-    g_renderer.rgb24_w = 0;
-    g_renderer.rgb24_h = 0;
+    g_renderer.scale_buf = (Uint32*)0;
+    g_renderer.scale_w = 0;
+    g_renderer.scale_h = 0;
     return &g_renderer;
 }
 
 void SDL_DestroyRenderer(SDL_Renderer *renderer)
 {
-    if (renderer && renderer->rgb24_buf) {
-        free(renderer->rgb24_buf);
-        renderer->rgb24_buf = (unsigned char*)0;
+    if (renderer && renderer->scale_buf) {
+        free(renderer->scale_buf);
+        renderer->scale_buf = (Uint32*)0;
     }
 }
 
@@ -204,19 +210,37 @@ int SDL_RenderFillRect(SDL_Renderer *renderer, const SDL_Rect *rect)
                (long)renderer->draw_b;
     if (!rect)
         sys_fill_rect(0, 0, renderer->window->w, renderer->window->h, rgb);
-    else
+    else if (renderer->window->src_w) {
+        /* The window is scaled up from a smaller source: map the rect. */
+        SDL_Window *w = renderer->window;
+        int x0 = rect->x * w->src_w / w->w, y0 = rect->y * w->src_h / w->h;
+        int x1 = (rect->x + rect->w) * w->src_w / w->w;
+        int y1 = (rect->y + rect->h) * w->src_h / w->h;
+        sys_fill_rect(x0, y0, x1 - x0, y1 - y0, rgb);
+    } else
         sys_fill_rect(rect->x, rect->y, rect->w, rect->h, rgb);
     return 0;
 }
 
-/* Ensure the RGB24 conversion buffer is large enough */
-static void ensure_rgb24_buf(SDL_Renderer *r, int w, int h)
+/* Draw the window at w x h and have the compositor stretch it to the
+ * client size (0, 0: back to 1:1).  Returns 1 if that is now the case. */
+static int set_window_source(SDL_Window *win, int w, int h)
+{
+    if (win->src_w == w && win->src_h == h) return 1;
+    if (sys_set_window_source(w, h, WSCALE_NEAREST) != 0) return 0;
+    win->src_w = w;
+    win->src_h = h;
+    return 1;
+}
+
+/* Ensure the scaling buffer is large enough */
+static void ensure_scale_buf(SDL_Renderer *r, int w, int h)
 {
-    if (r->rgb24_buf && r->rgb24_w == w && r->rgb24_h == h) return;
-    if (r->rgb24_buf) free(r->rgb24_buf);
-    r->rgb24_buf = (unsigned char*)malloc(w * h * 3);
-    r->rgb24_w = w;
-    r->rgb24_h = h;
+    if (r->scale_buf && r->scale_w == w && r->scale_h == h) return;
+    if (r->scale_buf) free(r->scale_buf);
+    r->scale_buf = (Uint32*)malloc(w * h * sizeof(Uint32));
+    r->scale_w = w;
+    r->scale_h = h;
 }
 
 int SDL_RenderCopy(SDL_Renderer *renderer, SDL_Texture *texture,
@@ -232,29 +256,44 @@ int SDL_RenderCopy(SDL_Renderer *renderer, SDL_Texture *texture,
     int dx = 0, dy = 0, dw = renderer->window->w, dh = renderer->window->h;
     if (dstrect) { dx = dstrect->x; dy = dstrect->y; dw = dstrect->w; dh = dstrect->h; }
 
-    /* For simplicity: blit src to dest without scaling if sizes match,
-       otherwise do nearest-neighbor scaling */
-    ensure_rgb24_buf(renderer, dw, dh);
-    if (!renderer->rgb24_buf) return -1;
-
     int src_pitch_px = texture->pitch / 4;
+    SDL_Window *win = renderer->window;
+
+    /* The whole texture stretched over the whole window (the usual
+       low-resolution game frame): upload it at its own size and let the
+       compositor scale it. */
+    if (sx == 0 && sy == 0 && sw == texture->w && sh == texture->h &&
+        dx == 0 && dy == 0 && dw == win->w && dh == win->h &&
+        sw <= dw && sh <= dh && (sw != dw || sh != dh) &&
+        set_window_source(win, sw, sh)) {
+        sys_draw_pixels_fmt(texture->pixels, 0, 0, sw, sh, PIXFMT_ARGB8888, texture->pitch);
+        return 0;
+    }
+    set_window_source(win, 0, 0);
 
-    for (int y = 0; y < dh; y++) {
-        int ty = sy + (sh != dh ? (y * sh / dh) : y);
-        if (ty >= texture->h) ty = texture->h - 1;
-        for (int x = 0; x < dw; x++) {
-            int tx = sx + (sw != dw ? (x * sw / dw) : x);
-            if (tx >= texture->w) tx = texture->w - 1;
-            Uint32 px = texture->pixels[ty * src_pitch_px + tx];
-            unsigned char *dst = renderer->rgb24_buf + (y * dw + x) * 3;
-            dst[0] = (px >> 16) & 0xFF;  /* R */
-            dst[1] = (px >> 8)  & 0xFF;  /* G */
-            dst[2] = px & 0xFF;          /* B */
+    if (sw == dw && sh == dh && sx >= 0 && sy >= 0 &&
+        sx + sw <= texture->w && sy + sh <= texture->h) {
+        /* Same size: the kernel copies straight out of the texture. */
+        sys_draw_pixels_fmt(texture->pixels + sy * src_pitch_px + sx, dx, dy, dw, dh,
+                            PIXFMT_ARGB8888, texture->pitch);
+    } else {
+        /* Nearest-neighbour scale into an ARGB buffer first. */
+        ensure_scale_buf(renderer, dw, dh);
+        if (!renderer->scale_buf) return -1;
+
+        for (int y = 0; y < dh; y++) {
+            int ty = sy + (sh != dh ? (y * sh / dh) : y);
+            if (ty >= texture->h) ty = texture->h - 1;
+            Uint32 *dst = renderer->scale_buf + y * dw;
+            for (int x = 0; x < dw; x++) {
+                int tx = sx + (sw != dw ? (x * sw / dw) : x);
+                if (tx >= texture->w) tx = texture->w - 1;
+                dst[x] = texture->pixels[ty * src_pitch_px + tx];
+            }
         }
+        sys_draw_pixels_fmt(renderer->scale_buf, dx, dy, dw, dh, PIXFMT_ARGB8888, 0);
     }
 
-    sys_draw_pixels(renderer->rgb24_buf, dx, dy, dw, dh);
-
     static int rc_trace = 0;
     static int rc_call = 0;
     rc_call++;
@@ -630,6 +669,131 @@ static int g_push_tail = 0;
  * in the Aulib shim. Default is a no-op so apps without audio link cleanly. */
 __attribute__((weak)) void __sdl2_audio_tick(void) { }
 
+/* Fill *event from a window-queue key event (bit 8 = pressed, bits 7:0 =
+ * PS/2 scancode) and queue the matching text input event. */
+static void key_to_event(SDL_Event *event, long kev)
+{
+#ifdef SDL_DEBUG_TRACE
+    sdl_trace("[SDL] SDL_PollEvent -> KEY %s sc=0x%x\n",
+              (kev & 0x100) ? "DOWN" : "UP", (int)(kev & 0xFF));
+#endif
+    int pressed = (kev & 0x100) != 0;
+    int ps2_sc  = (int)(kev & 0xFF);
+    SDL_Scancode sc = ps2_to_sdl_scancode(ps2_sc);
+    update_modifiers(sc, pressed);
+
+    event->type = pressed ? SDL_KEYDOWN : SDL_KEYUP;
+    event->key.timestamp = SDL_GetTicks();
+    event->key.windowID = g_window.wid;
+    event->key.state = pressed ? SDL_PRESSED : SDL_RELEASED;
+    event->key.repeat = 0;
+    event->key.keysym.scancode = sc;
+    event->key.keysym.sym = scancode_to_keycode(sc);
+    event->key.keysym.mod = g_key_modifiers;
+    /* Keep g_keyboard_state in sync for SDL_GetKeyboardState */
+    if (sc < SDL_NUM_SCANCODES)
+        g_keyboard_state[sc] = pressed ? 1 : 0;
+
+    /* Queue a text input event for printable key presses */
+    if (pressed && g_text_input_enabled
+        && !(g_key_modifiers & (KMOD_LCTRL | KMOD_RCTRL | KMOD_LALT | KMOD_RALT))) {
+        char ch = scancode_to_char(sc, g_key_modifiers);
+        if (ch) {
+            g_pending_textinput = 1;
+            g_pending_textinput_ev.type = SDL_TEXTINPUT;
+            g_pending_textinput_ev.text.timestamp = SDL_GetTicks();
+            g_pending_textinput_ev.text.windowID = g_window.wid;
+            g_pending_textinput_ev.text.text[0] = ch;
+            g_pending_textinput_ev.text.text[1] = '\0';
+        }
+    }
+}
+
+/* Compare the mouse at client (mx, my) with the last reported state and
+ * fill *event with the first difference: a button change, then motion.
+ * Returns 0 when nothing changed. */
+static int mouse_to_event(SDL_Event *event, int mx, int my, int left, int right)
+{
+    /* Button press/release takes priority */
+    if (left != g_prev_mouse_left) {
+        event->type = left ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+        event->button.timestamp = SDL_GetTicks();
+        event->button.windowID = g_window.wid;
+        event->button.button = SDL_BUTTON_LEFT;
+        event->button.state = left ? SDL_PRESSED : SDL_RELEASED;
+        event->button.clicks = 1;
+        event->button.x = mx;
+        event->button.y = my;
+        g_prev_mouse_left = left;
+        g_prev_mouse_x = mx;
+        g_prev_mouse_y = my;
+        return 1;
+    }
+
+    if (right != g_prev_mouse_right) {
+        event->type = right ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+        event->button.timestamp = SDL_GetTicks();
+        event->button.windowID = g_window.wid;
+        event->button.button = SDL_BUTTON_RIGHT;
+        event->button.state = right ? SDL_PRESSED : SDL_RELEASED;
+        event->button.clicks = 1;
+        event->button.x = mx;
+        event->button.y = my;
+        g_prev_mouse_right = right;
+        g_prev_mouse_x = mx;
+        g_prev_mouse_y = my;
+        return 1;
+    }
+
+    /* Motion event */
+    if (mx != g_prev_mouse_x || my != g_prev_mouse_y) {
+        event->type = SDL_MOUSEMOTION;
+        event->motion.timestamp = SDL_GetTicks();
+        event->motion.windowID = g_window.wid;
+        event->motion.x = mx;
+        event->motion.y = my;
+        event->motion.xrel = (g_prev_mouse_x >= 0) ? mx - g_prev_mouse_x : 0;
+        event->motion.yrel = (g_prev_mouse_y >= 0) ? my - g_prev_mouse_y : 0;
+        event->motion.state = (left ? 1 : 0) | (right ? 4 : 0);
+        g_prev_mouse_x = mx;
+        g_prev_mouse_y = my;
+        return 1;
+    }
+    return 0;
+}
+
+/* ── Window event batch ────────────────────────────────────────────────── */
+#define WEV_BATCH 64
+static uint64_t g_wev[WEV_BATCH];
+static int g_wev_x[WEV_BATCH], g_wev_y[WEV_BATCH];  /* client pos after each mouse event */
+static int g_wev_count = 0;
+static int g_wev_pos   = 0;
+
+/* Refill the batch from the window queue, blocking up to timeout_ms when
+ * it is empty.  Mouse events carry deltas only: the cursor position is read
+ * once and walked back through the batch to place each of them. */
+static void wev_fetch(long timeout_ms)
+{
+    long n = sys_get_window_events(g_window.wid, g_wev, WEV_BATCH, timeout_ms, WEVF_MOUSE);
+    g_wev_count = n > 0 ? (int)n : 0;
+    g_wev_pos = 0;
+
+    int i = g_wev_count;
+    while (i > 0 && !(g_wev[i - 1] & WEV_MOUSE)) i--;
+    if (i == 0) return;
+    long mpos = sys_get_mouse_pos();
+    int mx = (int)(short)(mpos & 0xFFFF);
+    int my = (int)(short)((mpos >> 16) & 0xFFFF);
+    screen_to_client(&mx, &my);
+    while (i-- > 0) {
+        if (!(g_wev[i] & WEV_MOUSE)) continue;
+        g_wev_x[i] = mx;
+        g_wev_y[i] = my;
+        mx -= (short)(g_wev[i] & 0xFFFF);
+        my += (short)((g_wev[i] >> 16) & 0xFFFF);   /* dy is positive up */
+    }
+}
+
 int SDL_PollEvent(SDL_Event *event)
 {
 #ifdef SDL_DEBUG_TRACE
@@ -660,49 +824,36 @@ int SDL_PollEvent(SDL_Event *event)
         return 1;
     }
 
-    /* Check keyboard events from window queue */
-    long kev = sys_get_key_event();
-#ifdef SDL_DEBUG_TRACE
-    if (kev != -1) {
-        int pressed = (kev & 0x100) != 0;
-        sdl_trace("[SDL] SDL_PollEvent -> KEY %s sc=0x%x\n", pressed ? "DOWN" : "UP", (int)(kev & 0xFF));
-    }
-#endif
-    if (kev != -1) {
-        int pressed = (kev & 0x100) != 0;
-        int ps2_sc  = (int)(kev & 0xFF);
-        SDL_Scancode sc = ps2_to_sdl_scancode(ps2_sc);
-        update_modifiers(sc, pressed);
-
-        event->type = pressed ? SDL_KEYDOWN : SDL_KEYUP;
-        event->key.timestamp = SDL_GetTicks();
-        event->key.windowID = g_window.wid;
-        event->key.state = pressed ? SDL_PRESSED : SDL_RELEASED;
-        event->key.repeat = 0;
-        event->key.keysym.scancode = sc;
-        event->key.keysym.sym = scancode_to_keycode(sc);
-        event->key.keysym.mod = g_key_modifiers;
-        /* Keep g_keyboard_state in sync for SDL_GetKeyboardState */
-        if (sc < SDL_NUM_SCANCODES)
-            g_keyboard_state[sc] = pressed ? 1 : 0;
-
-        /* Queue a text input event for printable key presses */
-        if (pressed && g_text_input_enabled
-            && !(g_key_modifiers & (KMOD_LCTRL | KMOD_RCTRL | KMOD_LALT | KMOD_RALT))) {
-            char ch = scancode_to_char(sc, g_key_modifiers);
-            if (ch) {
-                g_pending_textinput = 1;
-                g_pending_textinput_ev.type = SDL_TEXTINPUT;
-                g_pending_textinput_ev.text.timestamp = SDL_GetTicks();
-                g_pending_textinput_ev.text.windowID = g_window.wid;
-                g_pending_textinput_ev.text.text[0] = ch;
-                g_pending_textinput_ev.text.text[1] = '\0';
+    /* Window events come in batches: one syscall per drained queue rather
+     * than one per key or mouse packet. */
+    if (g_window_live) {
+        if (g_wev_pos == g_wev_count)
+            wev_fetch(0);
+        while (g_wev_pos < g_wev_count) {
+            uint64_t ev = g_wev[g_wev_pos];
+            if (ev & WEV_MOUSE) {
+                /* A packet may carry a button change and motion: emit them
+                 * one per call, staying on it until nothing is left. */
+                if (mouse_to_event(event, g_wev_x[g_wev_pos], g_wev_y[g_wev_pos],
+                                   (int)(ev >> 32) & 1, (int)(ev >> 33) & 1))
+                    return 1;
+                g_wev_pos++;
+                continue;
             }
+            g_wev_pos++;
+            key_to_event(event, (long)ev);
+            return 1;
         }
+        return 0;
+    }
+
+    /* No window: keys from the global queue, mouse from its position. */
+    long kev = sys_get_key_event();
+    if (kev != -1) {
+        key_to_event(event, kev);
         return 1;
     }
 
-    /* Check mouse — generate motion and button events from position changes */
     long mpos = sys_get_mouse_pos();
     if (mpos != -1) {
         int mx    = (int)(short)(mpos & 0xFFFF);
@@ -710,52 +861,7 @@ int SDL_PollEvent(SDL_Event *event)
         int left  = (mpos >> 32) & 1;
         int right = (mpos >> 33) & 1;
         screen_to_client(&mx, &my);
-
-        /* Button press/release takes priority */
-        if (left != g_prev_mouse_left) {
-            event->type = left ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
-            event->button.timestamp = SDL_GetTicks();
-            event->button.windowID = g_window.wid;
-            event->button.button = SDL_BUTTON_LEFT;
-            event->button.state = left ? SDL_PRESSED : SDL_RELEASED;
-            event->button.clicks = 1;
-            event->button.x = mx;
-            event->button.y = my;
-            g_prev_mouse_left = left;
-            g_prev_mouse_x = mx;
-            g_prev_mouse_y = my;
-            return 1;
-        }
-
-        if (right != g_prev_mouse_right) {
-            event->type = right ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
-            event->button.timestamp = SDL_GetTicks();
-            event->button.windowID = g_window.wid;
-            event->button.button = SDL_BUTTON_RIGHT;
-            event->button.state = right ? SDL_PRESSED : SDL_RELEASED;
-            event->button.clicks = 1;
-            event->button.x = mx;
-            event->button.y = my;
-            g_prev_mouse_right = right;
-            g_prev_mouse_x = mx;
-            g_prev_mouse_y = my;
-            return 1;
-        }
-
-        /* Motion event */
-        if (mx != g_prev_mouse_x || my != g_prev_mouse_y) {
-            event->type = SDL_MOUSEMOTION;
-            event->motion.timestamp = SDL_GetTicks();
-            event->motion.windowID = g_window.wid;
-            event->motion.x = mx;
-            event->motion.y = my;
-            event->motion.xrel = (g_prev_mouse_x >= 0) ? mx - g_prev_mouse_x : 0;
-            event->motion.yrel = (g_prev_mouse_y >= 0) ? my - g_prev_mouse_y : 0;
-            event->motion.state = (left ? 1 : 0) | (right ? 4 : 0);
-            g_prev_mouse_x = mx;
-            g_prev_mouse_y = my;
-            return 1;
-        }
+        return mouse_to_event(event, mx, my, left, right);
     }
 
     return 0;
@@ -1584,9 +1690,6 @@ int SDL_UpdateWindowSurface(SDL_Window *window)
     int w = g_window_surface->w;
     int h = g_window_surface->h;
     int total = w * h;
-    unsigned char *rgb = (unsigned char*)malloc(total * 3);
-    if (!rgb) return -1;
-
     Uint32 *src = (Uint32*)g_window_surface->pixels;
 
     if (g_update_trace_count < 20) {
@@ -1603,15 +1706,9 @@ int SDL_UpdateWindowSurface(SDL_Window *window)
                   p0, pm, non_black, total < 50000 ? total : 50000);
     }
 
-    for (int i = 0; i < total; i++) {
-        Uint32 px = src[i]; /* ARGB */
-        rgb[i * 3 + 0] = (px >> 16) & 0xFF; /* R */
-        rgb[i * 3 + 1] = (px >>  8) & 0xFF; /* G */
-        rgb[i * 3 + 2] = (px      ) & 0xFF; /* B */
-    }
-
-    sys_draw_pixels(rgb, 0, 0, w, h);
-    free(rgb);
+    /* The surface is ARGB8888 like the window buffer: no conversion. */
+    set_window_source(&g_window, 0, 0);
+    sys_draw_pixels_fmt(src, 0, 0, w, h, PIXFMT_ARGB8888, g_window_surface->pitch);
     return 0;
 }
 
@@ -2010,21 +2107,34 @@ SDL_Surface* IMG_Load_RW(SDL_RWops *src, int freesrc)
  * Task 7: Event Helpers (audio impls live in sdl2_thread.c)
  * ═══════════════════════════════════════════════════════════════════════════ */
 
+/* Idle until window input arrives or ms pass.  The window queue wakes the
+ * task itself; the slice bounds how late an SDL_PushEvent from another
+ * thread (or the audio tick) is noticed. */
+#define WAIT_SLICE_MS 100
+
+static void sdl_idle(int ms)
+{
+    if (ms > WAIT_SLICE_MS) ms = WAIT_SLICE_MS;
+    if (g_window_live)
+        sys_get_window_events(g_window.wid, (uint64_t *)0, 0, ms, WEVF_MOUSE);
+    else
+        sys_sleep_ms(ms);
+}
+
 int SDL_WaitEvent(SDL_Event *event)
 {
-    while (!SDL_PollEvent(event)) {
-        sys_sleep_ms(10);
-    }
+    while (!SDL_PollEvent(event))
+        sdl_idle(WAIT_SLICE_MS);
     return 1;
 }
 
 int SDL_WaitEventTimeout(SDL_Event *event, int timeout_ms)
 {
-    int waited = 0;
+    Uint32 start = SDL_GetTicks();
     while (!SDL_PollEvent(event)) {
-        if (waited >= timeout_ms) return 0;
-        sys_sleep_ms(10);
-        waited += 10;
+        int left = timeout_ms - (int)(SDL_GetTicks() - start);
+        if (left <= 0) return 0;
+        sdl_idle(left);
     }
     return 1;
 }
@@ -3,29 +3,44 @@
  *
  * Layered on top of SDL_OpenAudio (sdl2_thread.c → AC97 audio worker pthread).
  * Mix_OpenAudioDevice opens a single audio stream where the SDL callback
- * is mixer_callback() below; that callback runs the music hook, sums the
- * active Mix_Chunks across the channel slots, then runs the post-mix hook.
+ * is mixer_callback() below; that callback runs the music hook (or plays
+ * the loaded music), sums the active Mix_Chunks across the channel slots,
+ * then runs the post-mix hook.
  *
- * Mix_Chunks are expected to already be in the output format
- * (typically AUDIO_S16SYS, 2 ch, 44100 Hz) — Wolf4SDL's SD_PrepareSound runs
- * SDL_BuildAudioCVT/SDL_ConvertAudio at load time to guarantee that.
+ * Mix_Chunks are expected to be in the output format (AUDIO_S16SYS at the
+ * device's rate and channel count).  Mix_LoadWAV/Mix_LoadMUS get there at
+ * load time: PCM WAVs (8/16-bit, mono/stereo, any rate) are converted
+ * once, resampled with 16.16 fixed-point linear interpolation, so the
+ * callback only scales and adds.  Wolf4SDL's SD_PrepareSound does its own
+ * SDL_BuildAudioCVT/SDL_ConvertAudio and hands over raw chunks.
+ *
+ * Mixing is fixed-point: each channel keeps its volume × chunk volume × pan
+ * as a pair of Q14 gains, recomputed only when one of them changes, and
+ * chunks are added eight samples at a time with SSE2 saturating adds.
+ * This file is built at -O2 with -mstackrealign (see the Makefile).
  *
  * Limitations vs. real SDL_mixer:
- *   - no fade-in/out, no Mix_LoadWAV (decoded chunks only via QuickLoad_RAW)
+ *   - no fade-in/out; music is WAV only, played from memory
  *   - no group "newer" / "count" tracking; oldest = first active in group
  *   - timestamps used by Mix_GroupOldest are coarse (process-wide counter)
- *   - master/group volume layered as multiplicative fixed-point integers
+ *   - output must be AUDIO_S16SYS, mono or stereo
  */
 
 #include "SDL_mixer.h"
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_thread.h"
 #include "syscall.h"
+#include <emmintrin.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define MIXER_MAX_CHANNELS MIX_CHANNELS
 
+/* Gains are Q14 so unity still fits a signed 16-bit SSE2 lane. */
+#define GAIN_BITS  14
+#define GAIN_ONE   (1 << GAIN_BITS)
+#define GAINS_UNITY ((Uint32)GAIN_ONE | (Uint32)GAIN_ONE << 16)
+
 typedef struct {
     Mix_Chunk *chunk;
     Uint32 pos;            /* byte offset into chunk->abuf */
@@ -33,6 +48,7 @@ typedef struct {
     Uint8  pan_left;       /* 0..255 */
     Uint8  pan_right;      /* 0..255 */
     int    volume;         /* per-channel volume 0..MIX_MAX_VOLUME */
+    Uint32 gains;          /* Q14: left (even samples) | right << 16 */
     int    active;
     int    paused;
     int    reserved;
@@ -40,6 +56,10 @@ typedef struct {
     Uint32 start_seq;      /* ordering for Mix_GroupOldest */
 } MixerChannel;
 
+struct Mix_Music {
+    Mix_Chunk *chunk;      /* decoded WAV in the output format */
+};
+
 static int          g_mix_open = 0;
 static int          g_mix_freq = 44100;
 static Uint16       g_mix_format = AUDIO_S16SYS;
@@ -55,85 +75,295 @@ static void (*g_channel_finished)(int) = (void(*)(int))0;
 static void (*g_music_finished)(void) = (void(*)(void))0;
 
 static int          g_music_volume = MIX_MAX_VOLUME;
+static Uint32       g_music_gains = GAINS_UNITY;    /* g_music_volume, Q14 */
 static int          g_music_paused = 0;
+static Mix_Music   *g_music = (Mix_Music*)0;   /* playing, unless hooked */
+static Uint32       g_music_pos = 0;
+static int          g_music_loops = 0;
 static SDL_mutex   *g_mix_lock = (SDL_mutex*)0;
 
+/* --------------------------------------------------------------------------
+ * Fixed-point mixing
+ * -------------------------------------------------------------------------- */
+
+/* Q14 gain pair for a volume product out of `scale` and two pans.  A mono
+ * device hears the average of the two. */
+static Uint32 make_gains(Uint32 vol, Uint32 scale, Uint32 pl, Uint32 pr)
+{
+    Uint32 gl = (Uint32)((Uint64)vol * pl * GAIN_ONE / ((Uint64)scale * 255));
+    Uint32 gr = (Uint32)((Uint64)vol * pr * GAIN_ONE / ((Uint64)scale * 255));
+    if (g_mix_channels == 1) gl = gr = (gl + gr) / 2;
+    return gl | gr << 16;
+}
+
+static void update_gains(MixerChannel *c)
+{
+    int chunk_vol = (c->chunk && c->chunk->volume) ? c->chunk->volume : MIX_MAX_VOLUME;
+    c->gains = make_gains((Uint32)(c->volume * chunk_vol),
+                          MIX_MAX_VOLUME * MIX_MAX_VOLUME, c->pan_left, c->pan_right);
+}
+
+/* dst[i] += src[i] * gain >> GAIN_BITS, saturated, where even samples get
+ * the low gain of `gains` and odd ones the high gain.  Eight samples per
+ * SSE2 step: the 32-bit products come from pmullw/pmulhw, are shifted
+ * back, packed with saturation and added with paddsw. */
+static void mix_samples(Sint16 *dst, const Sint16 *src, int n, Uint32 gains)
+{
+    int i = 0;
+    if (gains == GAINS_UNITY) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(d, s));
+        }
+    } else {
+        const __m128i g = _mm_set1_epi32((int)gains);
+        for (; i + 8 <= n; i += 8) {
+            __m128i s  = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i lo = _mm_mullo_epi16(s, g);
+            __m128i hi = _mm_mulhi_epi16(s, g);
+            __m128i a  = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), GAIN_BITS);
+            __m128i b  = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), GAIN_BITS);
+            __m128i d  = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(d, _mm_packs_epi32(a, b)));
+        }
+    }
+    for (; i < n; i++) {
+        int g = (int)((i & 1) ? gains >> 16 : gains & 0xFFFF);
+        int v = (int)dst[i] + (((int)src[i] * g) >> GAIN_BITS);
+        if (v >  32767) v =  32767;
+        if (v < -32768) v = -32768;
+        dst[i] = (Sint16)v;
+    }
+}
+
+/* buf[i] = buf[i] * gain >> GAIN_BITS, one gain for every sample. */
+static void scale_samples(Sint16 *buf, int n, int gain)
+{
+    const __m128i g = _mm_set1_epi16((short)gain);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i s  = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i lo = _mm_mullo_epi16(s, g);
+        __m128i hi = _mm_mulhi_epi16(s, g);
+        __m128i a  = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), GAIN_BITS);
+        __m128i b  = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), GAIN_BITS);
+        _mm_storeu_si128((__m128i*)(buf + i), _mm_packs_epi32(a, b));
+    }
+    for (; i < n; i++)
+        buf[i] = (Sint16)(((int)buf[i] * gain) >> GAIN_BITS);
+}
+
+/* Mix `samples` output samples of `chunk` from *pos on, looping as *loops
+ * says.  Returns 0 once the chunk has played out for good.  Chunks shorter
+ * than a frame are refused at play time, so every pass makes progress. */
+static int mix_chunk(Sint16 *o, int samples, const Mix_Chunk *chunk,
+                     Uint32 *pos, int *loops, Uint32 gains)
+{
+    const Uint32 frame_bytes = 2u * (Uint32)g_mix_channels;
+    int done = 0;
+    for (;;) {
+        Uint32 n = (chunk->alen - *pos) / frame_bytes * (Uint32)g_mix_channels;
+        if (n > (Uint32)(samples - done)) n = (Uint32)(samples - done);
+        mix_samples(o + done, (const Sint16*)(chunk->abuf + *pos), (int)n, gains);
+        *pos += n * 2;
+        done += (int)n;
+        if (chunk->alen - *pos >= frame_bytes) return 1;   /* output is full */
+
+        if (*loops == 0) return 0;
+        if (*loops > 0) (*loops)--;
+        *pos = 0;
+        if (done == samples) return 1;
+    }
+}
+
 /* --------------------------------------------------------------------------
  * Audio callback — runs on the AC97 audio worker thread.
  *
- * Output buffer is `len` bytes of S16 native-endian stereo (the mixer is
+ * Output buffer is `len` bytes of S16 native-endian samples (the mixer is
  * opened that way; if a caller wanted a different format they'd be on their
  * own).  Steps:
  *   1. zero output
- *   2. music hook fills it (volume-scaled afterward)
- *   3. each active channel mixes its chunk samples on top with pan + vol
+ *   2. music hook fills it (volume-scaled afterward), or the loaded music
+ *      is mixed in
+ *   3. each active channel mixes its chunk samples on top with its gains
  *   4. post-mix hook gets the final buffer
  * -------------------------------------------------------------------------- */
 static void mixer_callback(void *udata, Uint8 *out, int out_bytes)
 {
     (void)udata;
     Sint16 *o = (Sint16*)out;
-    int frames = out_bytes / 4;  /* S16 stereo = 4 bytes/frame */
+    int samples = out_bytes / 2;
+    samples -= samples % g_mix_channels;
 
     memset(out, 0, out_bytes);
 
     /* Music hook fills the buffer, then we attenuate by music volume. */
     if (g_music_hook && !g_music_paused) {
         g_music_hook(g_music_hook_arg, out, out_bytes);
-        if (g_music_volume != MIX_MAX_VOLUME) {
-            for (int i = 0; i < frames * 2; i++) {
-                int v = (int)o[i] * g_music_volume / MIX_MAX_VOLUME;
-                o[i] = (Sint16)v;
-            }
-        }
+        if (g_music_volume != MIX_MAX_VOLUME)
+            scale_samples(o, samples, g_music_volume * GAIN_ONE / MIX_MAX_VOLUME);
     }
 
     if (g_mix_lock) SDL_LockMutex(g_mix_lock);
+    if (!g_music_hook && g_music && !g_music_paused) {
+        if (!mix_chunk(o, samples, g_music->chunk, &g_music_pos, &g_music_loops, g_music_gains)) {
+            g_music = (Mix_Music*)0;
+            if (g_music_finished) g_music_finished();
+        }
+    }
+
     for (int ch = 0; ch < MIXER_MAX_CHANNELS; ch++) {
         MixerChannel *c = &g_chans[ch];
         if (!c->active || c->paused || !c->chunk || !c->chunk->abuf) continue;
+        if (!mix_chunk(o, samples, c->chunk, &c->pos, &c->loops, c->gains)) {
+            c->active = 0;
+            if (g_channel_finished) g_channel_finished(ch);
+        }
+    }
+    if (g_mix_lock) SDL_UnlockMutex(g_mix_lock);
+
+    if (g_postmix) g_postmix(g_postmix_arg, out, out_bytes);
+}
+
+/* --------------------------------------------------------------------------
+ * WAV loading
+ *
+ * Chunks are converted once, when loaded, to what the device plays: S16 at
+ * the device's channel count and rate.  Rate conversion steps through the
+ * source in 16.16 fixed point and interpolates linearly between the two
+ * neighbouring frames.
+ * -------------------------------------------------------------------------- */
 
-        Sint16 *src = (Sint16*)(c->chunk->abuf + c->pos);
-        int avail_bytes = (int)c->chunk->alen - (int)c->pos;
-        int avail_frames = avail_bytes / 4;
-        int play_frames = (avail_frames < frames) ? avail_frames : frames;
-
-        int chunk_vol = (c->chunk->volume) ? c->chunk->volume : MIX_MAX_VOLUME;
-        int vol = c->volume * chunk_vol / MIX_MAX_VOLUME;
-        int pl  = c->pan_left;
-        int pr  = c->pan_right;
-
-        for (int f = 0; f < play_frames; f++) {
-            int l = src[f*2 + 0];
-            int r = src[f*2 + 1];
-            l = (l * pl * vol) / (255 * MIX_MAX_VOLUME);
-            r = (r * pr * vol) / (255 * MIX_MAX_VOLUME);
-            int ol = (int)o[f*2 + 0] + l;
-            int or_= (int)o[f*2 + 1] + r;
-            if (ol >  32767) ol =  32767;
-            if (ol < -32768) ol = -32768;
-            if (or_>  32767) or_=  32767;
-            if (or_< -32768) or_= -32768;
-            o[f*2 + 0] = (Sint16)ol;
-            o[f*2 + 1] = (Sint16)or_;
+typedef struct {
+    const Uint8 *data;
+    Uint32 bytes;
+    Uint32 rate;
+    int    channels;       /* 1 or 2 */
+    int    bits;           /* 8 (unsigned) or 16 (signed) */
+} WavInfo;
+
+static Uint32 rd16(const Uint8 *p) { return (Uint32)p[0] | (Uint32)p[1] << 8; }
+static Uint32 rd32(const Uint8 *p) { return rd16(p) | rd16(p + 2) << 16; }
+
+/* Find the fmt and data chunks of a PCM RIFF/WAVE image.  A data chunk
+ * cut short by the end of the file keeps what is there. */
+static int parse_wav(const Uint8 *mem, Uint32 size, WavInfo *w)
+{
+    if (size < 12 || memcmp(mem, "RIFF", 4) != 0 || memcmp(mem + 8, "WAVE", 4) != 0)
+        return 0;
+    int have_fmt = 0;
+    Uint32 pos = 12;
+    while (pos + 8 <= size) {
+        Uint32 len  = rd32(mem + pos + 4);
+        Uint32 room = size - pos - 8;
+        const Uint8 *body = mem + pos + 8;
+        if (memcmp(mem + pos, "fmt ", 4) == 0 && len >= 16 && len <= room) {
+            Uint32 tag = rd16(body);
+            if (tag == 0xFFFE && len >= 26)   /* WAVE_FORMAT_EXTENSIBLE */
+                tag = rd16(body + 24);        /* first bytes of SubFormat */
+            if (tag != 1) return 0;           /* PCM only */
+            w->channels = (int)rd16(body + 2);
+            w->rate     = rd32(body + 4);
+            w->bits     = (int)rd16(body + 14);
+            have_fmt = 1;
+        } else if (memcmp(mem + pos, "data", 4) == 0 && have_fmt) {
+            w->data  = body;
+            w->bytes = len < room ? len : room;
+            return (w->channels == 1 || w->channels == 2) &&
+                   (w->bits == 8 || w->bits == 16) && w->rate >= 1000;
         }
+        if (len > room) break;
+        pos += 8 + len + (len & 1);   /* chunks are word-aligned */
+    }
+    return 0;
+}
 
-        c->pos += (Uint32)(play_frames * 4);
-        if (c->pos >= c->chunk->alen) {
-            if (c->loops != 0) {
-                if (c->loops > 0) c->loops--;
-                c->pos = 0;
-            } else {
-                c->active = 0;
-                if (g_channel_finished) g_channel_finished(ch);
-            }
+static int raw_sample(const WavInfo *w, Uint32 frame, int ch)
+{
+    Uint32 i = frame * (Uint32)w->channels + (Uint32)ch;
+    if (w->bits == 8) return ((int)w->data[i] - 128) << 8;
+    return (Sint16)rd16(w->data + i * 2);
+}
+
+/* Sample of source frame `frame` for output channel `ch`, as S16: mono is
+ * doubled up, stereo is averaged down for a mono device. */
+static int wav_sample(const WavInfo *w, Uint32 frame, int ch)
+{
+    if (w->channels == 1) return raw_sample(w, frame, 0);
+    if (g_mix_channels == 1)
+        return (raw_sample(w, frame, 0) + raw_sample(w, frame, 1)) / 2;
+    return raw_sample(w, frame, ch);
+}
+
+/* Convert a parsed WAV into a malloc'd buffer in the output format. */
+static Uint8 *convert_wav(const WavInfo *w, Uint32 *out_bytes)
+{
+    Uint32 in_frames  = w->bytes / ((Uint32)w->channels * (Uint32)(w->bits / 8));
+    Uint64 out_frames = (Uint64)in_frames * (Uint32)g_mix_freq / w->rate;
+    Uint64 bytes      = out_frames * 2 * (Uint32)g_mix_channels;
+    if (out_frames == 0 || bytes > 0x7FFFFFFF) return (Uint8*)0;
+    Sint16 *out = (Sint16*)malloc((size_t)bytes);
+    if (!out) return (Uint8*)0;
+
+    const Uint32 step = (Uint32)(((Uint64)w->rate << 16) / (Uint32)g_mix_freq);
+    Uint64 pos = 0;                        /* source frame, 16.16 */
+    Sint16 *d = out;
+    for (Uint64 f = 0; f < out_frames; f++, pos += step) {
+        Uint32 i    = (Uint32)(pos >> 16);
+        Uint32 frac = (Uint32)pos & 0xFFFF;
+        if (i >= in_frames) i = in_frames - 1;
+        Uint32 j = (i + 1 < in_frames) ? i + 1 : i;
+        for (int ch = 0; ch < g_mix_channels; ch++) {
+            int a = wav_sample(w, i, ch);
+            int b = wav_sample(w, j, ch);
+            *d++ = (Sint16)(a + (int)(((long)(b - a) * (long)frac) >> 16));
         }
     }
-    if (g_mix_lock) SDL_UnlockMutex(g_mix_lock);
+    *out_bytes = (Uint32)bytes;
+    return (Uint8*)out;
+}
 
-    if (g_postmix) g_postmix(g_postmix_arg, out, out_bytes);
+static Mix_Chunk *chunk_from_wav(const Uint8 *mem, Uint32 size)
+{
+    WavInfo w;
+    Uint32 bytes = 0;
+    if (!parse_wav(mem, size, &w)) {
+        SDL_SetError("Mix: not a PCM WAV file");
+        return (Mix_Chunk*)0;
+    }
+    Uint8 *pcm = convert_wav(&w, &bytes);
+    Mix_Chunk *c = pcm ? (Mix_Chunk*)malloc(sizeof(Mix_Chunk)) : (Mix_Chunk*)0;
+    if (!c) {
+        free(pcm);
+        SDL_SetError("Mix: out of memory");
+        return (Mix_Chunk*)0;
+    }
+    c->allocated = 1;
+    c->abuf      = pcm;
+    c->alen      = bytes;
+    c->volume    = MIX_MAX_VOLUME;
+    return c;
 }
 
+/* The rest of `src` in a malloc'd buffer. */
+static Uint8 *read_all(SDL_RWops *src, Uint32 *size)
+{
+    Sint64 hint = SDL_RWsize(src);
+    size_t cap = (hint > 0 && hint < 0x7FFFFFFF) ? (size_t)hint : 65536;
+    size_t len = 0;
+    Uint8 *buf = (Uint8*)malloc(cap);
+    while (buf) {
+        len += SDL_RWread(src, buf + len, 1, cap - len);
+        if (len < cap || hint > 0 || cap >= 0x40000000) break;
+        Uint8 *grown = (Uint8*)realloc(buf, cap * 2);
+        if (!grown) { free(buf); buf = (Uint8*)0; break; }
+        buf = grown;
+        cap *= 2;
+    }
+    *size = (Uint32)len;
+    return buf;
+}
 /* -------------------------------------------------------------------------- */
 
 int Mix_OpenAudio(int freq, Uint16 fmt, int chans, int chunksize)
@@ -170,8 +400,10 @@ int Mix_OpenAudioDevice(int freq, Uint16 fmt, int chans, int chunksize,
         g_chans[i].pan_left  = 255;
         g_chans[i].pan_right = 255;
         g_chans[i].group     = -1;
+        update_gains(&g_chans[i]);
     }
     g_play_seq = 0;
+    g_music    = (Mix_Music*)0;
     g_mix_open = 1;
     SDL_PauseAudio(0);
     return 0;
@@ -182,6 +414,7 @@ void Mix_CloseAudio(void)
     if (!g_mix_open) return;
     SDL_CloseAudio();
     if (g_mix_lock) { SDL_DestroyMutex(g_mix_lock); g_mix_lock = (SDL_mutex*)0; }
+    g_music    = (Mix_Music*)0;
     g_mix_open = 0;
 }
 
@@ -262,6 +495,7 @@ int Mix_SetPanning(int chan, Uint8 left, Uint8 right)
     if (chan < 0 || chan >= MIXER_MAX_CHANNELS) return 0;
     g_chans[chan].pan_left = left;
     g_chans[chan].pan_right = right;
+    update_gains(&g_chans[chan]);
     return 1;
 }
 
@@ -269,9 +503,39 @@ int Mix_SetDistance(int chan, Uint8 dist) { (void)chan; (void)dist; return 0; }
 int Mix_SetPosition(int chan, Sint16 angle, Uint8 dist) { (void)chan; (void)angle; (void)dist; return 0; }
 int Mix_SetReverseStereo(int chan, int flip) { (void)chan; (void)flip; return 0; }
 
-Mix_Chunk *Mix_LoadWAV(const char *file)        { (void)file; return (Mix_Chunk*)0; }
-Mix_Chunk *Mix_LoadWAV_RW(SDL_RWops *src, int freesrc) { (void)src; (void)freesrc; return (Mix_Chunk*)0; }
-Mix_Chunk *Mix_QuickLoad_WAV(Uint8 *mem)        { (void)mem; return (Mix_Chunk*)0; }
+/* Loading converts to the open device's format, so audio must be open. */
+Mix_Chunk *Mix_LoadWAV_RW(SDL_RWops *src, int freesrc)
+{
+    if (!src) return (Mix_Chunk*)0;
+    Uint32 size = 0;
+    Uint8 *file = g_mix_open ? read_all(src, &size) : (Uint8*)0;
+    if (freesrc) SDL_RWclose(src);
+    if (!file) {
+        SDL_SetError(g_mix_open ? "Mix: out of memory" : "Mix: audio not open");
+        return (Mix_Chunk*)0;
+    }
+    Mix_Chunk *c = chunk_from_wav(file, size);
+    free(file);
+    return c;
+}
+
+Mix_Chunk *Mix_LoadWAV(const char *file)
+{
+    return Mix_LoadWAV_RW(SDL_RWFromFile(file, "rb"), 1);
+}
+
+/* A WAV image in memory.  One already in the output format is played in
+ * place, as SDL_mixer does; anything else is converted into a copy. */
+Mix_Chunk *Mix_QuickLoad_WAV(Uint8 *mem)
+{
+    if (!mem || !g_mix_open || memcmp(mem, "RIFF", 4) != 0) return (Mix_Chunk*)0;
+    Uint32 size = rd32(mem + 4) + 8;
+    WavInfo w;
+    if (!parse_wav(mem, size, &w)) return (Mix_Chunk*)0;
+    if (w.bits == 16 && w.channels == g_mix_channels && w.rate == (Uint32)g_mix_freq)
+        return Mix_QuickLoad_RAW((Uint8*)w.data, w.bytes);
+    return chunk_from_wav(mem, size);
+}
 
 Mix_Chunk *Mix_QuickLoad_RAW(Uint8 *mem, Uint32 len)
 {
@@ -301,9 +565,35 @@ void Mix_FreeChunk(Mix_Chunk *c)
     free(c);
 }
 
-Mix_Music *Mix_LoadMUS(const char *file) { (void)file; return (Mix_Music*)0; }
-Mix_Music *Mix_LoadMUS_RW(SDL_RWops *rw, int freesrc) { (void)rw; (void)freesrc; return (Mix_Music*)0; }
-void       Mix_FreeMusic(Mix_Music *m)   { (void)m; }
+/* Music is a WAV decoded up front and played like a chunk on its own
+ * slot, under the music volume. */
+Mix_Music *Mix_LoadMUS_RW(SDL_RWops *rw, int freesrc)
+{
+    Mix_Chunk *c = Mix_LoadWAV_RW(rw, freesrc);
+    if (!c) return (Mix_Music*)0;
+    Mix_Music *m = (Mix_Music*)malloc(sizeof(Mix_Music));
+    if (!m) {
+        Mix_FreeChunk(c);
+        return (Mix_Music*)0;
+    }
+    m->chunk = c;
+    return m;
+}
+
+Mix_Music *Mix_LoadMUS(const char *file)
+{
+    return Mix_LoadMUS_RW(SDL_RWFromFile(file, "rb"), 1);
+}
+
+void Mix_FreeMusic(Mix_Music *m)
+{
+    if (!m) return;
+    if (g_mix_lock) SDL_LockMutex(g_mix_lock);
+    if (g_music == m) g_music = (Mix_Music*)0;
+    if (g_mix_lock) SDL_UnlockMutex(g_mix_lock);
+    Mix_FreeChunk(m->chunk);
+    free(m);
+}
 
 int Mix_PlayChannel(int chan, Mix_Chunk *c, int loops)
 {
@@ -313,7 +603,7 @@ int Mix_PlayChannel(int chan, Mix_Chunk *c, int loops)
 int Mix_PlayChannelTimed(int chan, Mix_Chunk *c, int loops, int ticks)
 {
     (void)ticks;
-    if (!g_mix_open || !c || !c->abuf) return -1;
+    if (!g_mix_open || !c || !c->abuf || c->alen < 2u * (Uint32)g_mix_channels) return -1;
     if (g_mix_lock) SDL_LockMutex(g_mix_lock);
     if (chan < 0) {
         for (int i = 0; i < MIXER_MAX_CHANNELS; i++) {
@@ -334,6 +624,7 @@ int Mix_PlayChannelTimed(int chan, Mix_Chunk *c, int loops, int ticks)
     g_chans[chan].active    = 1;
     g_chans[chan].paused    = 0;
     g_chans[chan].start_seq = ++g_play_seq;
+    update_gains(&g_chans[chan]);
     if (g_mix_lock) SDL_UnlockMutex(g_mix_lock);
     return chan;
 }
@@ -344,8 +635,19 @@ int Mix_FadeInChannel(int chan, Mix_Chunk *c, int loops, int ms)
     return Mix_PlayChannel(chan, c, loops);
 }
 
-int Mix_PlayMusic(Mix_Music *m, int loops)        { (void)m; (void)loops; return 0; }
-int Mix_FadeInMusic(Mix_Music *m, int loops, int ms) { (void)m; (void)loops; (void)ms; return 0; }
+int Mix_PlayMusic(Mix_Music *m, int loops)
+{
+    if (!g_mix_open || !m || m->chunk->alen < 2u * (Uint32)g_mix_channels) return -1;
+    if (g_mix_lock) SDL_LockMutex(g_mix_lock);
+    g_music     = m;
+    g_music_pos = 0;
+    /* `loops` counts plays: -1 forever, 0 and 1 once. */
+    g_music_loops = loops < 0 ? -1 : (loops > 1 ? loops - 1 : 0);
+    if (g_mix_lock) SDL_UnlockMutex(g_mix_lock);
+    return 0;
+}
+
+int Mix_FadeInMusic(Mix_Music *m, int loops, int ms) { (void)ms; return Mix_PlayMusic(m, loops); }
 
 int Mix_HaltChannel(int chan)
 {
@@ -380,9 +682,18 @@ int Mix_HaltGroup(int tag)
     return 0;
 }
 
-int Mix_HaltMusic(void)                           { return 0; }
+int Mix_HaltMusic(void)
+{
+    if (g_mix_lock) SDL_LockMutex(g_mix_lock);
+    int was_playing = g_music != (Mix_Music*)0;
+    g_music = (Mix_Music*)0;
+    if (g_mix_lock) SDL_UnlockMutex(g_mix_lock);
+    if (was_playing && g_music_finished) g_music_finished();
+    return 0;
+}
+
 int Mix_FadeOutChannel(int chan, int ms)          { (void)ms; return Mix_HaltChannel(chan); }
-int Mix_FadeOutMusic(int ms)                      { (void)ms; return 0; }
+int Mix_FadeOutMusic(int ms)                      { (void)ms; return Mix_HaltMusic(); }
 
 int Mix_Playing(int chan)
 {
@@ -396,7 +707,10 @@ int Mix_Playing(int chan)
     return g_chans[chan].active ? 1 : 0;
 }
 
-int Mix_PlayingMusic(void) { return g_music_hook != (void(*)(void*,Uint8*,int))0; }
+int Mix_PlayingMusic(void)
+{
+    return g_music_hook != (void(*)(void*,Uint8*,int))0 || g_music != (Mix_Music*)0;
+}
 
 int Mix_Paused(int chan)
 {
@@ -423,7 +737,7 @@ void Mix_Resume(int chan)
 }
 void Mix_PauseMusic(void)         { g_music_paused = 1; }
 void Mix_ResumeMusic(void)        { g_music_paused = 0; }
-void Mix_RewindMusic(void)        {}
+void Mix_RewindMusic(void)        { g_music_pos = 0; }
 
 int Mix_Volume(int chan, int volume)
 {
@@ -431,15 +745,19 @@ int Mix_Volume(int chan, int volume)
         /* Apply to all channels — return previous of channel 0. */
         int prev = g_chans[0].volume;
         for (int i = 0; i < MIXER_MAX_CHANNELS; i++) {
-            if (volume >= 0)
+            if (volume >= 0) {
                 g_chans[i].volume = (volume > MIX_MAX_VOLUME) ? MIX_MAX_VOLUME : volume;
+                update_gains(&g_chans[i]);
+            }
         }
         return prev;
     }
     if (chan >= MIXER_MAX_CHANNELS) return 0;
     int prev = g_chans[chan].volume;
-    if (volume >= 0)
+    if (volume >= 0) {
         g_chans[chan].volume = (volume > MIX_MAX_VOLUME) ? MIX_MAX_VOLUME : volume;
+        update_gains(&g_chans[chan]);
+    }
     return prev;
 }
 
@@ -447,16 +765,21 @@ int Mix_VolumeChunk(Mix_Chunk *c, int volume)
 {
     if (!c) return -1;
     int prev = c->volume;
-    if (volume >= 0)
+    if (volume >= 0) {
         c->volume = (Uint8)((volume > MIX_MAX_VOLUME) ? MIX_MAX_VOLUME : volume);
+        for (int i = 0; i < MIXER_MAX_CHANNELS; i++)
+            if (g_chans[i].chunk == c) update_gains(&g_chans[i]);
+    }
     return prev;
 }
 
 int Mix_VolumeMusic(int volume)
 {
     int prev = g_music_volume;
-    if (volume >= 0)
+    if (volume >= 0) {
         g_music_volume = (volume > MIX_MAX_VOLUME) ? MIX_MAX_VOLUME : volume;
+        g_music_gains  = make_gains((Uint32)g_music_volume, MIX_MAX_VOLUME, 255, 255);
+    }
     return prev;
 }
 
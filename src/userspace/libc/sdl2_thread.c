@@ -288,8 +288,9 @@ Uint32 SDL_SemValue(SDL_sem *s)
  * Layer 2 — Audio callback subsystem
  *
  * Worker pthread loop:
- *   lock → callback (or silence if paused) → unlock → submit to AC97
- *   (busy-poll the AC97 ring with 1ms sleeps when both DMA slots are full)
+ *   wait for room in the stream's shared ring → lock → callback (or
+ *   silence if paused) straight into the ring → unlock → commit
+ *   (falls back to blocking sys_audio_write when no ring could be mapped)
  *
  * One global device — only one game at a time owns AC97.
  * SDL game contract: callback runs on worker thread. Game must
@@ -312,30 +313,57 @@ static struct AudioDevice g_audio_dev;
 static void *audio_worker(void *arg)
 {
     struct AudioDevice *dev = (struct AudioDevice *)arg;
+    struct audio_ring *ring = 0;
 
-    /* Acquire AC97. format=0 → AC97 native (S16LSB stereo). */
-    if (sys_audio_open(dev->spec.freq, dev->spec.channels, 0) >= 0)
+    /* Open a mixer stream. format=0 → S16LSB. */
+    if (sys_audio_open(dev->spec.freq, dev->spec.channels, 0) >= 0) {
         dev->ac97_open = 1;
+        /* Room for four callback buffers in shared memory the mixer reads
+           in place.  Power-of-two buffer sizes never straddle the wrap, so
+           the callback renders straight into the ring. */
+        if (4UL * dev->spec.size <= AUDIO_RING_MAX)
+            ring = sys_audio_map_ring(4UL * dev->spec.size);
+    }
 
     while (!dev->exit_requested) {
+        Uint8 *out = dev->buffer;
+        if (ring) {
+            /* Sleeps until the mixer has taken a buffer's worth, so the
+               callback runs at the playback rate. */
+            long room = sys_audio_ring_wait(dev->spec.size, 100);
+            if (room < 0) break;  /* stream closed under us */
+            if ((unsigned long)room < dev->spec.size) continue;
+            unsigned long off = (unsigned long)ring->write & (ring->size - 1);
+            if (off + dev->spec.size <= ring->size)
+                out = audio_ring_data(ring) + off;
+        }
+
         pthread_mutex_lock(&dev->lock);
         if (dev->paused || !dev->spec.callback) {
-            memset(dev->buffer, dev->spec.silence, dev->spec.size);
+            memset(out, dev->spec.silence, dev->spec.size);
         } else {
-            dev->spec.callback(dev->spec.userdata, dev->buffer, (int)dev->spec.size);
+            dev->spec.callback(dev->spec.userdata, out, (int)dev->spec.size);
         }
         pthread_mutex_unlock(&dev->lock);
 
-        if (dev->ac97_open) {
-            /* sys_audio_write: 1=ok, 0=busy (DMA slots full), -1=device gone. */
-            long rc;
-            for (;;) {
-                rc = sys_audio_write(dev->buffer, dev->spec.size, dev->spec.freq);
-                if (rc != 0) break;
-                if (dev->exit_requested) break;
-                sys_sleep_ms(1);
+        if (ring) {
+            if (out == dev->buffer) {
+                /* Odd buffer size: copy in, in two pieces at the wrap. */
+                unsigned long off = (unsigned long)ring->write & (ring->size - 1);
+                unsigned long first = ring->size - off;
+                if (first > dev->spec.size) first = dev->spec.size;
+                memcpy(audio_ring_data(ring) + off, out, first);
+                memcpy(audio_ring_data(ring), out + first, dev->spec.size - first);
             }
+            audio_ring_commit(ring, dev->spec.size);
+        } else if (dev->ac97_open) {
+            /* Sleeps in the kernel until the mixer has room in our stream,
+               so the callback runs at the playback rate.
+               0 = stream closed under us, -1 = device gone. */
+            long rc = sys_audio_write_wait(dev->buffer, dev->spec.size,
+                                           dev->spec.freq);
             if (rc < 0) break;  /* AC97 went away */
+            if (rc == 0) sys_sleep_ms(1);
         } else {
             /* No AC97 — pace the loop so we don't burn CPU. Compute the
              * approximate buffer duration in ms; sleep that long. */
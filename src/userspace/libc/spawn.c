@@ -0,0 +1,64 @@
+#include "spawn.h"
+#include "errno.h"
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa)
+{
+    fa->count = 0;
+    fa->cwd   = (const char *)0;
+    fa->actions[0].op = SPAWN_FA_END;
+    return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa)
+{
+    fa->count = 0;
+    fa->actions[0].op = SPAWN_FA_END;
+    return 0;
+}
+
+static int add_action(posix_spawn_file_actions_t *fa, int op, int fd, int newfd)
+{
+    if (fd < 0 || newfd < 0) return EINVAL;
+    if (fa->count >= SPAWN_MAX_ACTIONS) return ENOMEM;
+    struct spawn_file_action *a = &fa->actions[fa->count++];
+    a->op    = op;
+    a->fd    = fd;
+    a->newfd = newfd;
+    fa->actions[fa->count].op = SPAWN_FA_END;
+    return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd)
+{
+    return add_action(fa, SPAWN_FA_CLOSE, fd, 0);
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa,
+                                     int fd, int newfd)
+{
+    return add_action(fa, SPAWN_FA_DUP2, fd, newfd);
+}
+
+int posix_spawn_file_actions_addchdir_np(posix_spawn_file_actions_t *fa,
+                                         const char *path)
+{
+    fa->cwd = path;
+    return 0;
+}
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *fa,
+                const posix_spawnattr_t *attr,
+                char *const argv[], char *const envp[])
+{
+    (void)attr;
+    long id = sys_spawn(path, (const char *const *)argv,
+                        (const char *const *)envp,
+                        fa ? fa->actions : (const struct spawn_file_action *)0,
+                        fa ? fa->cwd : (const char *)0);
+    /* The kernel does not say why a spawn failed; a missing or unloadable
+     * image is by far the common case. */
+    if (id < 0) return ENOENT;
+    if (pid) *pid = (pid_t)id;
+    return 0;
+}
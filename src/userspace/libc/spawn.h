@@ -0,0 +1,51 @@
+#pragma once
+#include "syscall.h"
+#include "unistd.h"  /* pid_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* posix_spawn over SYS_SPAWN: the child image is loaded straight into a new
+ * address space, so nothing of the caller is copied or touched.
+ *
+ * File actions are applied to the child's copy of the caller's fd table in
+ * the order they were added.  Only close and dup2 are supported; open is
+ * not (do it in the parent and dup2 the result).  There is no per-process
+ * working directory, so addchdir_np only sets the directory a relative
+ * path is resolved against. */
+
+typedef struct {
+    struct spawn_file_action actions[SPAWN_MAX_ACTIONS + 1];  /* END-terminated */
+    int         count;
+    const char *cwd;
+} posix_spawn_file_actions_t;
+
+/* Spawn attributes (process groups, signal masks, scheduling) have no
+ * meaning here; the type exists so portable callers compile. */
+typedef struct { int flags; } posix_spawnattr_t;
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd);
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa,
+                                     int fd, int newfd);
+int posix_spawn_file_actions_addchdir_np(posix_spawn_file_actions_t *fa,
+                                         const char *path);
+
+static inline int posix_spawnattr_init(posix_spawnattr_t *a)    { a->flags = 0; return 0; }
+static inline int posix_spawnattr_destroy(posix_spawnattr_t *a) { (void)a; return 0; }
+
+/* Returns 0 and stores the child id in *pid, or an errno value. */
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *fa,
+                const posix_spawnattr_t *attr,
+                char *const argv[], char *const envp[]);
+
+/* No PATH search: same as posix_spawn. */
+#define posix_spawnp posix_spawn
+
+#ifdef __cplusplus
+}
+#endif
@@ -32,7 +32,7 @@ static inline long syscall(long nr, ...) { (void)nr; return 0; }
 #define SYS_PIPE        17  /* rdi=int[2] ptr; fills [0]=rd_fd [1]=wr_fd          */
 #define SYS_LSEEK       18  /* rdi=fd, rsi=offset, rdx=whence; returns new pos    */
 #define SYS_FB_HEIGHT   19  /* returns framebuffer height in pixels               */
-#define SYS_DRAW_PIXELS   20  /* rdi=buf, rsi=x, rdx=y, rcx=w, r8=h — blit pixels  */
+#define SYS_DRAW_PIXELS   20  /* rdi=buf, rsi=x, rdx=y, rcx=w|fmt<<32, r8=h|stride<<32 */
 /* Returns (scancode | 0x100) if pressed, scancode if released, -1 if empty. */
 #define SYS_GET_KEY_EVENT 21  /* no args                                            */
 #define SYS_CREATE        22  /* rdi=filename; create/truncate for writing; returns fd or -1 */
@@ -49,7 +49,7 @@ static inline long syscall(long nr, ...) { (void)nr; return 0; }
                                     bits[7:0]=dx(int8), bits[15:8]=dy(int8,+up),
                                     bit[16]=left_button, bit[17]=right_button          */
 #define SYS_GET_MICROS       33  /* () → microseconds since boot (uint64)              */
-#define SYS_AUDIO_WRITE      34  /* rdi=data, rsi=bytes, rdx=rate; 1=ok 0=busy -1=none */
+#define SYS_AUDIO_WRITE      34  /* rdi=data, rsi=bytes, rdx=rate|flags; bytes, 0=busy */
 #define SYS_AUDIO_PLAYING    35  /* () → 1=playing, 0=idle, -1=no AC97                 */
 #define SYS_WRITE_SERIAL     36  /* rdi=buf, rsi=len; write raw bytes to COM1 serial   */
 #define SYS_SET_WINDOW_TITLE 37  /* rdi=wid, rsi=title_ptr; set window title bar text */
@@ -75,6 +75,27 @@ static inline long syscall(long nr, ...) { (void)nr; return 0; }
 #define SYS_THREAD_EXIT     57  /* rdi=result; terminate calling thread                */
 #define SYS_FUTEX           58  /* rdi=op, rsi=addr, rdx=val; WAIT=0 WAKE=1           */
 #define SYS_THREAD_JOIN     59  /* rdi=tid; returns thread result or (uint64_t)-1     */
+#define SYS_SPAWN           60  /* rdi=path, rsi=argv, rdx=envp, rcx=actions, r8=cwd; returns child id or -1 */
+#define SYS_VFORK           61  /* borrow address space until exec/exit; child id or 0 */
+#define SYS_MAP_WINDOW_SURFACE 62 /* () → VA of own window's pixels or -1            */
+#define SYS_COMMIT_WINDOW   63  /* rdi=rects, rsi=count (0 = whole); returns 0/-1     */
+#define SYS_SET_WINDOW_PALETTE 64 /* rdi=colors, rsi=first, rdx=count; returns 0/-1   */
+#define SYS_SET_WINDOW_SOURCE 65 /* rdi=src_w, rsi=src_h, rdx=WSCALE_*; returns 0/-1  */
+#define SYS_GET_WINDOW_EVENTS 66 /* rdi=wid, rsi=out, rdx=max, rcx=timeout_ms, r8=WEVF_*; count/-1 */
+#define SYS_CREATE_SWAPCHAIN 67 /* rdi=count (2..3, 0 = remove), rsi=vas; returns 0/-1    */
+#define SYS_PRESENT          68 /* rdi=buffer, rsi=present_info*; returns next buffer/-1 */
+#define SYS_DRAW_BATCH       69 /* rdi=cmds, rsi=bytes; returns commands run or -1      */
+#define SYS_AUDIO_VOLUME     70 /* rdi=percent for the caller's stream; returns 0/-1   */
+#define SYS_AUDIO_MAP_RING   71 /* rdi=ring bytes; returns audio_ring VA or -1         */
+#define SYS_AUDIO_RING_WAIT  72 /* rdi=free bytes wanted, rsi=timeout_ms; free/-1      */
+
+/* File actions for SYS_SPAWN: an array ended by SPAWN_FA_END (mirrors
+ * SpawnFileAction in the kernel's syscall.h). */
+#define SPAWN_FA_END      0
+#define SPAWN_FA_CLOSE    1  /* close(fd)                */
+#define SPAWN_FA_DUP2     2  /* dup2(fd, newfd)          */
+#define SPAWN_MAX_ACTIONS 16
+struct spawn_file_action { int op, fd, newfd; };
 
 /* Futex operation codes (op argument to SYS_FUTEX / sys_futex). */
 #define FUTEX_WAIT 0  /* block if *addr == val; return 0 on wake, -1 if mismatch */
@@ -214,6 +235,23 @@ static inline long  sys_fb_height(void)
 static inline void  sys_draw_pixels(const void *buf, long x, long y, long w, long h)
     { __sc5(SYS_DRAW_PIXELS, (long)buf, x, y, w, h); }
 
+/* Source formats for sys_draw_pixels_fmt (mirror PIXFMT_* in the kernel's
+ * syscall.h).  XRGB8888 and ARGB8888 match the window buffer and are copied
+ * row by row without conversion; alpha is ignored. */
+#define PIXFMT_RGB24    0  /* R, G, B bytes                */
+#define PIXFMT_XRGB8888 1  /* 0x??RRGGBB                   */
+#define PIXFMT_ARGB8888 2  /* 0xAARRGGBB                   */
+#define PIXFMT_RGB565   3  /* 16-bit RRRRRGGGGGGBBBBB      */
+#define PIXFMT_INDEX8   4  /* palette index; indexed windows only */
+
+/* Blit a w x h block in `format`, rows `stride` bytes apart (0 = packed).
+ * Returns 0, or -1 for an unknown format. */
+static inline long  sys_draw_pixels_fmt(const void *buf, long x, long y, long w, long h,
+                                        int format, long stride)
+    { return __sc5(SYS_DRAW_PIXELS, (long)buf, x, y,
+                   (long)((unsigned long)(uint32_t)w | (unsigned long)format << 32),
+                   (long)((unsigned long)(uint32_t)h | (unsigned long)stride << 32)); }
+
 /* Returns (scancode | 0x100) if key pressed, bare scancode if released,
    or -1 when the event queue is empty.
    PS/2 set-1 scancodes: 0x01=Esc, 0x1C=Enter, 0x39=Space, 0x48=Up, 0x50=Down,
@@ -253,12 +291,44 @@ static inline long sys_create_window_text(long cx, long cy, long cw, long ch)
     return ret;
 }
 
+/* 8-bit palette-indexed window (WF_INDEXED8 = 4): one byte per pixel,
+   expanded through the window palette when composited.  Draw with
+   PIXFMT_INDEX8 (or a mapped surface, client_w bytes per row) and set
+   colours with sys_set_window_palette.  The palette starts as a grey ramp. */
+static inline long sys_create_window_indexed(long cx, long cy, long cw, long ch)
+    { return __sc5(SYS_CREATE_WINDOW, cx, cy, cw, ch, 4); }
+
 static inline long sys_destroy_window(long wid)
     { return __sc1(SYS_DESTROY_WINDOW, wid); }
 
 static inline long sys_get_window_event(long wid)
     { return __sc1(SYS_GET_WINDOW_EVENT, wid); }
 
+/* Batched window events.  Key events are encoded as for
+ * sys_get_window_event; with WEVF_MOUSE the window also queues mouse
+ * packets, consecutive motion merged into one event:
+ *     if (ev & WEV_MOUSE) {
+ *         int dx    = (short)(ev & 0xFFFF);
+ *         int dy    = (short)((ev >> 16) & 0xFFFF);  // positive = up
+ *         int left  = (ev >> 32) & 1;
+ *         int right = (ev >> 33) & 1;
+ *     }
+ * Once asked for, mouse events also come out of sys_get_window_event and
+ * sys_get_key_event for that window. */
+#define WEV_MOUSE        (1UL << 63)
+#define WEVF_MOUSE       1
+#define WEV_BATCH_MAX    256
+#define WEV_WAIT_FOREVER (-1L)
+
+/* Copy up to max queued events of window wid into out and return how many
+ * (-1 if wid is not the caller's window).  If the queue is empty, block
+ * for up to timeout_ms first (0 = never block, WEV_WAIT_FOREVER = until an
+ * event arrives; 20 ms resolution).  With max == 0 only wait, and return
+ * the number of events queued. */
+static inline long sys_get_window_events(long wid, uint64_t *out, long max,
+                                         long timeout_ms, long flags)
+    { return __sc5(SYS_GET_WINDOW_EVENTS, wid, (long)out, max, timeout_ms, flags); }
+
 static inline long sys_readdir(int idx, char* name, unsigned int* size)
     { return __sc5(SYS_READDIR, (long)idx, (long)name, (long)size, 0, 0); }
 
@@ -293,13 +363,23 @@ static inline long sys_get_mouse_event(void)
 static inline unsigned long long sys_get_micros(void)
     { return (unsigned long long)__sc0(SYS_GET_MICROS); }
 
-/* Submit raw 16-bit signed stereo PCM to the AC97 hardware.
-   Returns 1 if accepted and DMA started, 0 if AC97 is already playing
+/* Queue one chunk (up to 32 KB) on this task's audio stream, opening it as
+   16-bit stereo at `rate` on first use.  The kernel mixes every task's
+   stream.  Returns bytes queued, 0 if the stream already holds four chunks
    (data dropped — retry next tic), -1 if no AC97 hardware. */
 static inline long sys_audio_write(const void *data, unsigned long bytes,
                                    unsigned int rate)
     { return __sc3(SYS_AUDIO_WRITE, (long)data, (long)bytes, (long)rate); }
 
+/* sys_audio_write that sleeps until the mixer frees a chunk of the stream
+   instead of returning 0.  Returns bytes queued, 0 if the stream was
+   closed meanwhile, -1 if no AC97 hardware. */
+#define AUDIO_WRITE_BLOCK (1UL << 32)
+static inline long sys_audio_write_wait(const void *data, unsigned long bytes,
+                                        unsigned int rate)
+    { return __sc3(SYS_AUDIO_WRITE, (long)data, (long)bytes,
+                   (long)((unsigned long)rate | AUDIO_WRITE_BLOCK)); }
+
 /* Returns 1 if AC97 is currently playing, 0 if idle, -1 if absent. */
 static inline long sys_audio_is_playing(void)
     { return __sc0(SYS_AUDIO_PLAYING); }
@@ -332,17 +412,72 @@ static inline long sys_mkdir(const char *path)
 static inline long sys_open_rw(const char *filename)
     { return __sc1(SYS_OPEN_RW, (long)filename); }
 
-/* Open audio device: claim ownership, set sample rate/channels.
- * format: 0 = signed 16-bit LE.  Returns 0 on success, -1 on error. */
+/* Open (or reopen) this task's audio stream: sample rate, 1 or 2 channels,
+ * AUDIO_FMT_*.  Other tasks' streams play alongside it.
+ * Returns 0 on success, -1 on error. */
+#define AUDIO_FMT_S16 0   /* signed 16-bit LE               */
+#define AUDIO_FMT_U8  1   /* unsigned 8-bit, 0x80 = silence */
 static inline long sys_audio_open(unsigned int rate, unsigned int channels,
                                   unsigned int format)
     { return __sc3(SYS_AUDIO_OPEN, (long)rate, (long)channels, (long)format); }
 
-/* Close audio device: stop playback, release ownership.
- * Returns 0 on success, -1 if not owner. */
+/* Close this task's audio stream; queued audio is dropped.
+ * Returns 0 on success, -1 if there is no stream. */
 static inline long sys_audio_close(void)
     { return __sc0(SYS_AUDIO_CLOSE); }
 
+/* Volume of this task's stream, 0..100 (default 100).  Returns 0 or -1. */
+static inline long sys_audio_set_volume(unsigned int percent)
+    { return __sc1(SYS_AUDIO_VOLUME, (long)percent); }
+
+/* Shared ring of an audio stream (mirrors AudioRing in the kernel's
+ * syscall.h).  Positions count bytes and only grow; position p lives at
+ * audio_ring_data(r)[p & (size - 1)].  Store samples, then advance write
+ * with audio_ring_commit; the mixer takes them on its next period and
+ * advances read.  The PCM just before read reaches the DAC delay_us after
+ * stamp_us (sys_get_micros time). */
+struct audio_ring {
+    volatile uint64_t write;        /* ours: end of the PCM produced       */
+    volatile uint64_t read;         /* mixer: end of the PCM consumed      */
+    uint32_t          size;         /* ring bytes, a power of two          */
+    uint32_t          frame_bytes;
+    uint32_t          rate;
+    volatile uint32_t delay_us;
+    volatile uint64_t stamp_us;
+    volatile uint64_t starved;      /* periods in which the ring ran dry   */
+};
+#define AUDIO_RING_DATA 4096
+#define AUDIO_RING_MIN  4096
+#define AUDIO_RING_MAX  (256 * 1024)
+
+/* Feed this task's open stream from a ring of at least `bytes` (rounded up
+ * to a power of two, AUDIO_RING_MIN..AUDIO_RING_MAX) mapped into this
+ * process.  sys_audio_write then returns 0; the ring goes away with the
+ * stream.  Returns the ring, or NULL. */
+static inline struct audio_ring *sys_audio_map_ring(unsigned long bytes)
+{
+    long va = __sc1(SYS_AUDIO_MAP_RING, (long)bytes);
+    return va == -1 ? (struct audio_ring *)0 : (struct audio_ring *)va;
+}
+
+/* Sleep until `want` bytes of the ring are free, at most timeout_ms
+ * (0: just look).  Returns the free bytes, or -1 without a ring. */
+static inline long sys_audio_ring_wait(unsigned long want, unsigned long timeout_ms)
+    { return __sc2(SYS_AUDIO_RING_WAIT, (long)want, (long)timeout_ms); }
+
+static inline unsigned char *audio_ring_data(struct audio_ring *r)
+    { return (unsigned char *)r + AUDIO_RING_DATA; }
+
+static inline unsigned long audio_ring_free(const struct audio_ring *r)
+    { return r->size - (unsigned long)(r->write - r->read); }
+
+/* Publish `bytes` stored at the write position. */
+static inline void audio_ring_commit(struct audio_ring *r, unsigned long bytes)
+{
+    __asm__ volatile("" ::: "memory");   /* samples land before the position */
+    r->write = r->write + bytes;
+}
+
 /* Change page permissions.  prot: PROT_EXEC|PROT_WRITE|PROT_READ. */
 static inline long sys_mprotect(void *addr, size_t len, int prot)
     { return __sc3(SYS_MPROTECT, (long)addr, (long)len, (long)prot); }
@@ -406,6 +541,145 @@ static inline long sys_resize_window(long x, long y, long w, long h)
 static inline long sys_get_window_pos(void)
     { return __sc0(SYS_GET_WINDOW_POS); }
 
+/* Damage rect for sys_commit_window, in client-area pixels (mirrors
+ * SurfaceRect in the kernel's syscall.h).  At most SURFACE_MAX_RECTS are
+ * taken per call. */
+struct surface_rect { uint32_t x, y, w, h; };
+#define SURFACE_MAX_RECTS 32
+
+/* Map the calling task's window pixels (0x00RRGGBB, one row per source
+ * width, see sys_set_window_source) into this process.  Draw into them directly, then sys_commit_window
+ * the changed rects.  The mapping is dropped when the window is destroyed
+ * or a resize reallocates its buffer; map again after resizing.
+ * Returns the surface, or NULL. */
+static inline uint32_t *sys_map_window_surface(void)
+{
+    long va = __sc0(SYS_MAP_WINDOW_SURFACE);
+    return va == -1 ? (uint32_t *)0 : (uint32_t *)va;
+}
+
+/* Queue count rects of the mapped surface for the compositor
+ * (count == 0: the whole client area).  Returns 0 or -1. */
+static inline long sys_commit_window(const struct surface_rect *rects, long count)
+    { return __sc2(SYS_COMMIT_WINDOW, (long)rects, count); }
+
+/* Set palette entries [first, first+count) of the calling task's indexed
+ * window to colors[] (0x00RRGGBB).  The whole window is recomposited, so
+ * palette animation needs no pixel upload.  Returns 0 or -1. */
+static inline long sys_set_window_palette(const uint32_t *colors, long first, long count)
+    { return __sc3(SYS_SET_WINDOW_PALETTE, (long)colors, first, count); }
+
+/* Filters for sys_set_window_source. */
+#define WSCALE_NEAREST  0
+#define WSCALE_BILINEAR 1
+
+/* Draw the calling task's window at src_w x src_h and let the compositor
+ * stretch it over the client area (at most the client size; 0, 0 = 1:1).
+ * Drawing calls, sys_fb_width/height and the mapped surface then use the
+ * source size.  Redraw after calling.  Returns 0 or -1. */
+static inline long sys_set_window_source(long src_w, long src_h, long filter)
+    { return __sc3(SYS_SET_WINDOW_SOURCE, src_w, src_h, filter); }
+
+/* Frame feedback from sys_present (mirrors PresentInfo in the kernel's
+ * syscall.h).  Times are sys_get_micros(). */
+struct present_info {
+    uint64_t seq;          /* number of the frame just presented (1, 2, ...) */
+    uint64_t shown_seq;    /* last frame that reached the screen (0 = none)  */
+    uint64_t shown_us;     /* when it did                                    */
+    uint64_t interval_us;  /* compositor frame interval                      */
+};
+#define SWAP_MAX 3
+
+/* Give the calling task's window count (2 or 3) frame buffers, mapped into
+ * this process at vas[0..count-1].  Each holds a client-size frame in the
+ * window's format, one row per source width.  Draw into buffer 0 first.
+ * count 0 removes them; so does a resize that outgrows them.
+ * Returns 0 or -1. */
+static inline long sys_create_swapchain(long count, uint64_t *vas)
+    { return __sc2(SYS_CREATE_SWAPCHAIN, count, (long)vas); }
+
+/* Show buffer buf from the next compositor frame on, and return the buffer
+ * to draw next, blocking until one is free: with two buffers, until this
+ * frame is on screen.  A frame presented before the previous one was shown
+ * waits for it first.  info (may be NULL) says when the last frame reached
+ * the screen.  Returns -1 if buf is not the caller's to present. */
+static inline long sys_present(long buf, struct present_info *info)
+    { return __sc2(SYS_PRESENT, buf, (long)info); }
+
+/* Drawing commands for sys_draw_batch (mirror DrawCmd and friends in the
+ * kernel's syscall.h).  Commands are packed back to back; each starts with
+ * a draw_cmd whose size covers the whole command and is a multiple of 8. */
+struct draw_cmd  { uint16_t op, size; };
+#define DRAW_FILL 1   /* struct draw_fill                                 */
+#define DRAW_COPY 2   /* struct draw_copy: move pixels within the window  */
+#define DRAW_BLIT 3   /* struct draw_blit: pixels, as sys_draw_pixels_fmt */
+#define DRAW_TEXT 4   /* struct draw_text + len chars, padded to 8 bytes  */
+#define DRAW_LINE 5   /* struct draw_line, both ends included             */
+#define DRAW_TEXT_MAX  256
+#define DRAW_COORD_MAX 32767   /* |x|, |y| of a DRAW_LINE end */
+
+struct draw_fill { struct draw_cmd cmd; uint32_t x, y, w, h, color; };
+struct draw_copy { struct draw_cmd cmd; uint32_t sx, sy, w, h, dx, dy, pad; };
+struct draw_blit {
+    struct draw_cmd cmd;
+    uint32_t x, y, w, h, format, stride, pad;
+    uint64_t pixels;
+};
+struct draw_text { struct draw_cmd cmd; uint32_t x, y, fg, bg, len; };
+struct draw_line { struct draw_cmd cmd; int32_t x0, y0, x1, y1; uint32_t color; };
+
+/* Run a command list against the calling task's window in one kernel
+ * entry.  Stops at the first malformed command.  Returns the number of
+ * commands run, or -1 without a window. */
+static inline long sys_draw_batch(const void *cmds, long bytes)
+    { return __sc2(SYS_DRAW_BATCH, (long)cmds, bytes); }
+
+/* A command list under construction in an 8-byte aligned buffer. */
+struct draw_list { unsigned char *buf; unsigned long used, cap; };
+
+/* Append a command of `size` bytes (rounded up to 8) and return it with
+ * the header filled in, or NULL if the list is full. */
+static inline void *draw_list_add(struct draw_list *l, int op, unsigned long size)
+{
+    size = (size + 7) & ~7UL;
+    if (size > l->cap - l->used) return (void *)0;
+    struct draw_cmd *c = (struct draw_cmd *)(l->buf + l->used);
+    c->op = (uint16_t)op;
+    c->size = (uint16_t)size;
+    l->used += size;
+    return c;
+}
+
+static inline int draw_list_fill(struct draw_list *l, uint32_t x, uint32_t y,
+                                 uint32_t w, uint32_t h, uint32_t color)
+{
+    struct draw_fill *f = (struct draw_fill *)draw_list_add(l, DRAW_FILL, sizeof(*f));
+    if (!f) return -1;
+    f->x = x; f->y = y; f->w = w; f->h = h; f->color = color;
+    return 0;
+}
+
+static inline int draw_list_text(struct draw_list *l, uint32_t x, uint32_t y,
+                                 const char *s, uint32_t fg, uint32_t bg)
+{
+    uint32_t n = 0;
+    while (s[n] && n < DRAW_TEXT_MAX) n++;
+    struct draw_text *t = (struct draw_text *)draw_list_add(l, DRAW_TEXT, sizeof(*t) + n);
+    if (!t) return -1;
+    t->x = x; t->y = y; t->fg = fg; t->bg = bg; t->len = n;
+    char *d = (char *)(t + 1);
+    for (uint32_t i = 0; i < n; i++) d[i] = s[i];
+    return 0;
+}
+
+/* Run the list and empty it.  Returns what sys_draw_batch does. */
+static inline long draw_list_flush(struct draw_list *l)
+{
+    long r = l->used ? sys_draw_batch(l->buf, (long)l->used) : 0;
+    l->used = 0;
+    return r;
+}
+
 /* ── UDP userspace sockets ─────────────────────────────────────────────── */
 
 /* Open a UDP socket bound to a local port.  port=0 requests ephemeral.
@@ -462,3 +736,23 @@ static inline long sys_futex(int op, uint32_t *addr, uint32_t val)
  * sys_thread_exit(), or (uint64_t)-1 on error (bad tid, already joined). */
 static inline uint64_t sys_thread_join(uint32_t tid)
     { return (uint64_t)__sc1(SYS_THREAD_JOIN, (long)tid); }
+
+/* Start path as a child without copying the caller (see spawn.h for the
+ * POSIX wrapper).  argv/envp are NULL-terminated; envp == NULL inherits
+ * the caller's environment.  Returns the child id or -1. */
+static inline long sys_spawn(const char *path, const char *const *argv,
+                             const char *const *envp,
+                             const struct spawn_file_action *actions,
+                             const char *cwd)
+    { return __sc5(SYS_SPAWN, (long)path, (long)argv, (long)envp,
+                   (long)actions, (long)cwd); }
+
+/* vfork: the child runs on this very stack until it execs or exits, so the
+ * call must not leave a frame of its own behind -- force it inline even at
+ * -O0.  The child may only call sys_exec or sys_exit. */
+static inline __attribute__((always_inline)) long sys_vfork(void)
+{
+    long ret;
+    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(SYS_VFORK) : "memory");
+    return ret;
+}
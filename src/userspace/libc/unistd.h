@@ -69,6 +69,8 @@ static inline int unlink(const char *path) { return sys_remove(path); }
 static inline pid_t fork(void) { return -1; }
 static inline int execlp(const char *file, const char *arg, ...) { (void)file; (void)arg; return -1; }
 static inline int execvp(const char *file, char *const argv[]) { (void)file; (void)argv; return -1; }
+/* vfork is a macro so no wrapper frame sits on the shared stack. */
+#define vfork() ((pid_t)sys_vfork())
 static inline pid_t waitpid(pid_t pid, int *wstatus, int options)
     { (void)wstatus; (void)options; return (pid_t)sys_waitpid((int)pid, 0); }
 #define WEXITSTATUS(s) ((s) & 0xff)
@@ -45,7 +45,14 @@ int potato_readline(lua_State *L, char *buf, const char *prompt) {
     fflush(stdout);
     for (;;) {
         long ch = sys_read_key();
-        if (ch < 0) { sys_yield(); continue; }
+        if (ch < 0) {
+            /* Sleep on the window's queue until the next key arrives. */
+            if (g_lua_wid >= 0)
+                sys_get_window_events(g_lua_wid, NULL, 0, WEV_WAIT_FOREVER, 0);
+            else
+                sys_yield();
+            continue;
+        }
         if (ch == 4) {                       /* Ctrl-D = EOF */
             if (len == 0) { putchar('\n'); return 0; }
             continue;
@@ -0,0 +1,120 @@
+/* pacebench — frame pacing, the old way and with a swapchain:
+ *
+ *   sleep 20      draw into the mapped surface, commit, sleep a guessed
+ *                 20 ms (what the game shims did); only the submit times
+ *                 are known
+ *   present x2    double-buffered sys_present: blocks until the frame is
+ *                 on screen, times taken from present_info.shown_us
+ *   present x3    the same with a third buffer, so drawing overlaps the
+ *                 frame being shown
+ *
+ * For each run: mean frame time, its standard deviation, min and max.
+ * Pass a frame count as argv[1] (default 120). */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/syscall.h"
+
+#define W 320
+#define H 240
+#define MAX_FRAMES 1000
+
+static unsigned long long t[MAX_FRAMES + 1];
+
+static void draw(uint32_t *px, int i)
+{
+    int bar = (i * 4) % W;
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            px[y * W + x] = (x >= bar && x < bar + 16) ? 0xFFFFFF : 0x203040;
+}
+
+static unsigned long long isqrt(unsigned long long v)
+{
+    unsigned long long r = 0;
+    for (unsigned long long b = 1ULL << 62; b; b >>= 2) {
+        if (v >= r + b) { v -= r + b; r = (r >> 1) + b; }
+        else r >>= 1;
+    }
+    return r;
+}
+
+/* Statistics of the n intervals between n + 1 timestamps. */
+static void report(const char *name, int n)
+{
+    unsigned long long sum = 0, min = ~0ULL, max = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned long long d = t[i + 1] - t[i];
+        sum += d;
+        if (d < min) min = d;
+        if (d > max) max = d;
+    }
+    unsigned long long mean = sum / (unsigned long long)n, var = 0;
+    for (int i = 0; i < n; i++) {
+        long long e = (long long)(t[i + 1] - t[i]) - (long long)mean;
+        var += (unsigned long long)(e * e);
+    }
+    var /= (unsigned long long)n;
+    printf("  %-12s %6llu us/frame  sd %6llu us  min %6llu  max %6llu\n",
+           name, mean, isqrt(var), min, max);
+}
+
+static void run_sleep(int n)
+{
+    uint32_t *px = sys_map_window_surface();
+    if (!px) { puts("  sleep 20     FAILED (map)"); return; }
+    for (int i = 0; i <= n; i++) {
+        draw(px, i);
+        sys_commit_window(NULL, 0);
+        t[i] = sys_get_micros();
+        sys_sleep_ms(20);
+    }
+    report("sleep 20", n);
+}
+
+static void run_present(const char *name, int buffers, int n)
+{
+    uint64_t vas[SWAP_MAX];
+    if (sys_create_swapchain(buffers, vas) != 0) {
+        printf("  %-12s FAILED (swapchain)\n", name);
+        return;
+    }
+    struct present_info info;
+    long b = 0;
+    int got = 0;
+    unsigned long long last_seq = 0;
+    /* Record each frame's on-screen time as the feedback reports it; a
+     * frame reported twice (nothing new shown yet) is skipped. */
+    for (int i = 0; got <= n && i < 4 * n; i++) {
+        draw((uint32_t *)vas[b], i);
+        b = sys_present(b, &info);
+        if (b < 0) { printf("  %-12s FAILED (present)\n", name); break; }
+        if (info.shown_seq && info.shown_seq != last_seq) {
+            last_seq = info.shown_seq;
+            t[got++] = info.shown_us;
+        }
+    }
+    if (got > n) report(name, n);
+    sys_create_swapchain(0, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 120;
+    if (n <= 0) n = 120;
+    if (n > MAX_FRAMES) n = MAX_FRAMES;
+
+    long wid = sys_create_window(40, 40, W, H);
+    if (wid < 0) {
+        puts("pacebench: failed to create window");
+        return 1;
+    }
+    sys_set_window_title(wid, "pacebench");
+
+    printf("pacebench: %dx%d, %d frames per run\n", W, H, n);
+    run_sleep(n);
+    run_present("present x2", 2, n);
+    run_present("present x3", 3, n);
+    sys_destroy_window(wid);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* palbench — paletted frame streams, two ways:
+ *
+ *   RGB24     palette lookup in userspace, 3 bytes per pixel through
+ *             SYS_DRAW_PIXELS into a normal window (what the game shims
+ *             used to do)
+ *   INDEX8    the 8-bit frame itself into a WF_INDEXED8 window; the
+ *             compositor expands it through the window palette
+ *
+ * Each stream is run at 320x200 and 640x480.  A third run only rotates
+ * the palette, which recolours an indexed window without any pixel upload.
+ * Pass a frame count as argv[1] (default 100). */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/syscall.h"
+
+#define MAX_W 640
+#define MAX_H 480
+
+static unsigned char frame[MAX_W * MAX_H];
+static unsigned char rgb[MAX_W * MAX_H * 3];
+static uint32_t palette[256];
+
+static void make_frame(int w, int h, int t)
+{
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            frame[y * w + x] = (unsigned char)(x + y + t);
+}
+
+static void report(const char *name, int w, int h, int n, int bytes,
+                   unsigned long long us)
+{
+    if (us == 0) us = 1;
+    printf("  %-8s %3dx%-3d %7d B/frame  %6llu us/frame  %4llu fps\n",
+           name, w, h, bytes, us / (unsigned long long)n,
+           (unsigned long long)n * 1000000ULL / us);
+}
+
+static void run_rgb24(int w, int h, int n)
+{
+    long wid = sys_create_window(40, 40, w, h);
+    if (wid < 0) { puts("  RGB24: no window"); return; }
+    unsigned long long t0 = sys_get_micros();
+    for (int i = 0; i < n; i++) {
+        make_frame(w, h, i);
+        for (int p = 0; p < w * h; p++) {
+            uint32_t c = palette[frame[p]];
+            rgb[p * 3] = c >> 16; rgb[p * 3 + 1] = c >> 8; rgb[p * 3 + 2] = c;
+        }
+        sys_draw_pixels(rgb, 0, 0, w, h);
+    }
+    report("RGB24", w, h, n, w * h * 3, sys_get_micros() - t0);
+    sys_destroy_window(wid);
+}
+
+static void run_index8(int w, int h, int n)
+{
+    long wid = sys_create_window_indexed(40, 40, w, h);
+    if (wid < 0) { puts("  INDEX8: no window"); return; }
+    sys_set_window_palette(palette, 0, 256);
+    unsigned long long t0 = sys_get_micros();
+    for (int i = 0; i < n; i++) {
+        make_frame(w, h, i);
+        sys_draw_pixels_fmt(frame, 0, 0, w, h, PIXFMT_INDEX8, 0);
+    }
+    report("INDEX8", w, h, n, w * h, sys_get_micros() - t0);
+
+    /* Palette cycling: one 1 KB upload per frame, no pixels. */
+    t0 = sys_get_micros();
+    for (int i = 0; i < n; i++) {
+        uint32_t first = palette[0];
+        for (int k = 0; k < 255; k++) palette[k] = palette[k + 1];
+        palette[255] = first;
+        sys_set_window_palette(palette, 0, 256);
+    }
+    report("cycle", w, h, n, 256 * 4, sys_get_micros() - t0);
+    sys_destroy_window(wid);
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 100;
+    if (n <= 0) n = 100;
+    for (int i = 0; i < 256; i++)
+        palette[i] = (uint32_t)i << 16 | (uint32_t)(255 - i) << 8 | (uint32_t)(i * 3 & 0xFF);
+
+    printf("palbench: %d frames per stream\n", n);
+    run_rgb24(320, 200, n);
+    run_index8(320, 200, n);
+    run_rgb24(640, 480, n);
+    run_index8(640, 480, n);
+    return 0;
+}
@@ -37,13 +37,11 @@ static int   g_audio_fill = 0;   /* stereo frames accumulated */
 static void audio_submit(int sample_rate)
 {
     if (g_audio_fill <= 0) return;
-    /* Wait for AC97 to finish current playback before submitting.
-       This paces audio to real-time — prevents running ahead. */
-    while (sys_audio_is_playing() == 1)
-        sys_yield();
-    sys_audio_write(g_audio_buf,
-                    (unsigned long)(g_audio_fill * 4),
-                    (unsigned int)sample_rate);
+    /* Blocks until our audio stream has room.  This paces audio to
+       real-time — prevents running ahead. */
+    sys_audio_write_wait(g_audio_buf,
+                         (unsigned long)(g_audio_fill * 4),
+                         (unsigned int)sample_rate);
     g_audio_fill = 0;
 }
 
@@ -4,11 +4,15 @@
  *
  * Display pipeline:
  *   Quake 8-bit indexed frame (320×240)
- *   → palette lookup → packed RGB24
- *   → SYS_DRAW_PIXELS → windowed framebuffer
+ *   → a swapchain buffer of an indexed 640×480 window with a 320×240
+ *     source size, shown with sys_present; the compositor doubles the
+ *     pixels and expands them through the palette set by QG_SetPalette
+ *     (SYS_DRAW_PIXELS if the swapchain cannot be created)
  *
  * Timing: main loop measures real elapsed microseconds via sys_get_micros()
- *         and passes a precise dt to QG_Tick() each frame.
+ *         and passes a precise dt to QG_Tick() each frame.  sys_present
+ *         blocks until the previous frame is on screen, which paces the
+ *         loop to the compositor.
  *
  * Assets: Pass "-basedir GAMES/QUAKE" so Quake constructs
  *         "GAMES/QUAKE/id1/pak0.pak".  FAT32 resolve_path walks
@@ -33,15 +37,14 @@
 #define DISP_W  (QUAKE_W * QUAKE_SCALE)
 #define DISP_H  (QUAKE_H * QUAKE_SCALE)
 
-/* 256-entry RGB palette (set by Quake engine via QG_SetPalette) */
-static unsigned char g_palette[768];
-
-/* Packed RGB24 output buffer at display resolution (640 × 480 × 3 = 921 600 bytes) */
-static unsigned char rgb_buf[DISP_W * DISP_H * 3];
-
 /* Window ID for this Quake instance (-1 = no window yet) */
 static long g_wid = -1;
 
+/* Double-buffered frames; g_sc_buf is the one to draw next, -1 = none. */
+static uint64_t g_sc_va[2];
+static long     g_sc_buf = -1;
+static int      g_presented;   /* a frame went out during this tick */
+
 /* Leave room for the title bar (TITLE_BAR_H=16, BORDER_W=1) */
 #define MIN_CLIENT_Y 18
 
@@ -54,7 +57,10 @@ static void create_quake_window(void)
     int cy = (fb_h - DISP_H) / 2;
     if (cx < 0) cx = 0;
     if (cy < MIN_CLIENT_Y) cy = MIN_CLIENT_Y;
-    g_wid = sys_create_window(cx, cy, DISP_W, DISP_H);
+    g_wid = sys_create_window_indexed(cx, cy, DISP_W, DISP_H);
+    /* The compositor doubles the native frame onto the 640×480 window. */
+    if (g_wid >= 0) sys_set_window_source(QUAKE_W, QUAKE_H, WSCALE_NEAREST);
+    if (g_wid >= 0 && sys_create_swapchain(2, g_sc_va) == 0) g_sc_buf = 0;
 }
 
 /* ── error visibility ─────────────────────────────────────────────────────── */
@@ -117,43 +123,27 @@ void QG_Quit(void)
     sys_exit(0);
 }
 
-/* Store Quake's 768-byte (256 × RGB) palette */
+/* Hand Quake's 768-byte (256 × RGB) palette to the window */
 void QG_SetPalette(unsigned char palette[768])
 {
+    uint32_t colors[256];
     int i;
-    for (i = 0; i < 768; i++)
-        g_palette[i] = palette[i];
+    for (i = 0; i < 256; i++)
+        colors[i] = (uint32_t)palette[i * 3] << 16 |
+                    (uint32_t)palette[i * 3 + 1] << 8 | palette[i * 3 + 2];
+    sys_set_window_palette(colors, 0, 256);
 }
 
-/* Blit an 8-bit indexed 320×240 frame to the window at 2× scale (640×480) */
+/* Blit an 8-bit indexed 320×240 frame; the window shows it at 2× */
 void QG_DrawFrame(void *pixels)
 {
-    const unsigned char *src = (const unsigned char *)pixels;
-    int sy, sx;
-    for (sy = 0; sy < QUAKE_H; sy++) {
-        /* Build one scaled row (written twice for the vertical doubling) */
-        unsigned char row[DISP_W * 3];
-        unsigned char *rp = row;
-        for (sx = 0; sx < QUAKE_W; sx++) {
-            unsigned int idx = (unsigned int)(src[sy * QUAKE_W + sx]) * 3u;
-            unsigned char r = g_palette[idx + 0];
-            unsigned char g = g_palette[idx + 1];
-            unsigned char b = g_palette[idx + 2];
-            /* write pixel twice (horizontal 2×) */
-            *rp++ = r; *rp++ = g; *rp++ = b;
-            *rp++ = r; *rp++ = g; *rp++ = b;
-        }
-        /* copy row twice (vertical 2×) */
-        unsigned char *dst0 = rgb_buf + (sy * 2 + 0) * DISP_W * 3;
-        unsigned char *dst1 = rgb_buf + (sy * 2 + 1) * DISP_W * 3;
-        int i;
-        for (i = 0; i < DISP_W * 3; i++) {
-            dst0[i] = row[i];
-            dst1[i] = row[i];
-        }
+    if (g_sc_buf >= 0) {
+        memcpy((void *)g_sc_va[g_sc_buf], pixels, QUAKE_W * QUAKE_H);
+        g_sc_buf = sys_present(g_sc_buf, NULL);
+        g_presented = 1;
+        return;
     }
-    /* SYS_DRAW_PIXELS blits to (0,0) in the window client area */
-    sys_draw_pixels(rgb_buf, 0, 0, DISP_W, DISP_H);
+    sys_draw_pixels_fmt(pixels, 0, 0, QUAKE_W, QUAKE_H, PIXFMT_INDEX8, 0);
 }
 
 /* ── keyboard ────────────────────────────────────────────────────────────── */
@@ -326,9 +316,10 @@ int main(void)
     char *argv[] = { "quake", "-basedir", "GAMES/QUAKE", NULL };
     QG_Create(3, argv);
 
-    /* Main loop: measure real elapsed time in microseconds.
-     * Target ~35 fps: sleep 20 ms after each tick so the loop doesn't spin,
-     * and pass the actual elapsed dt so game speed matches real time. */
+    /* Main loop: measure real elapsed time in microseconds and pass the
+     * actual elapsed dt so game speed matches real time.  A tick that
+     * presented a frame has already waited for the display; otherwise
+     * sleep so the loop doesn't spin. */
     unsigned long long last_us = sys_get_micros();
     for (;;) {
         unsigned long long now_us = sys_get_micros();
@@ -337,10 +328,12 @@ int main(void)
         /* Cap dt to avoid spiral-of-death after long stalls */
         if (dt > 0.2) dt = 0.2;
         if (dt <= 0.0) dt = 0.000001;
+        g_presented = 0;
         QG_Tick(dt);
         /* Sleep one timer tick (~20 ms at 50 Hz) to yield CPU and
          * naturally cap the frame rate at ~50 fps. */
-        sys_sleep_ms(20);
+        if (!g_presented)
+            sys_sleep_ms(20);
     }
     return 0;
 }
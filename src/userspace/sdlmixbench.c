@@ -0,0 +1,129 @@
+/* sdlmixbench — CPU cost of the SDL_mixer shim.
+ *
+ * Loads three WAVs built in memory (11025 Hz mono U8, 22050 Hz stereo S16
+ * and one already at the device rate) through Mix_LoadWAV_RW, timing the
+ * conversion, then plays 1, 2, 4 and 8 looping channels with assorted
+ * volumes and pans.  The music hook runs just before the channels are
+ * mixed and the post-mix hook just after, so the time between them is the
+ * mixing itself.  Reports channels mixed per millisecond of CPU, one
+ * channel being one 1024-frame callback buffer.  Pass seconds per run as
+ * argv[1] (default 2). */
+
+#include "libc/SDL_mixer.h"
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/string.h"
+#include "libc/syscall.h"
+
+#define RATE    44100
+#define SAMPLES 1024
+
+static volatile unsigned long long g_t0, g_mix_us, g_callbacks;
+
+static void hook_start(void *arg, Uint8 *out, int len)
+{
+    (void)arg; (void)out; (void)len;
+    g_t0 = sys_get_micros();
+}
+
+static void hook_done(void *arg, Uint8 *out, int len)
+{
+    (void)arg; (void)out; (void)len;
+    g_mix_us += sys_get_micros() - g_t0;
+    g_callbacks++;
+}
+
+static void put16(Uint8 *p, unsigned v) { p[0] = (Uint8)v; p[1] = (Uint8)(v >> 8); }
+static void put32(Uint8 *p, unsigned v) { put16(p, v & 0xFFFF); put16(p + 2, v >> 16); }
+
+/* One second of a sawtooth as a RIFF/WAVE image. */
+static Uint8 *make_wav(unsigned rate, unsigned channels, unsigned bits, unsigned *size)
+{
+    unsigned frame = channels * bits / 8;
+    unsigned data = rate * frame;
+    Uint8 *w = (Uint8 *)malloc(44 + data);
+    if (!w) return (Uint8 *)0;
+    memcpy(w, "RIFF", 4);      put32(w + 4, 36 + data);
+    memcpy(w + 8, "WAVEfmt ", 8);
+    put32(w + 16, 16);         put16(w + 20, 1);
+    put16(w + 22, channels);   put32(w + 24, rate);
+    put32(w + 28, rate * frame); put16(w + 32, frame);
+    put16(w + 34, bits);
+    memcpy(w + 36, "data", 4); put32(w + 40, data);
+    for (unsigned i = 0; i < rate * channels; i++) {
+        int v = (int)(i * 37 % 512) * 128 - 32768;
+        if (bits == 8) w[44 + i] = (Uint8)((v >> 8) + 128);
+        else           put16(w + 44 + i * 2, (unsigned)v & 0xFFFF);
+    }
+    *size = 44 + data;
+    return w;
+}
+
+static Mix_Chunk *load(const char *name, unsigned rate, unsigned channels, unsigned bits)
+{
+    unsigned size = 0;
+    Uint8 *wav = make_wav(rate, channels, bits, &size);
+    if (!wav) return (Mix_Chunk *)0;
+    unsigned long long t0 = sys_get_micros();
+    Mix_Chunk *c = Mix_LoadWAV_RW(SDL_RWFromMem(wav, (int)size), 1);
+    unsigned long long us = sys_get_micros() - t0;
+    free(wav);
+    if (!c) {
+        printf("  %-18s load failed: %s\n", name, Mix_GetError());
+        return (Mix_Chunk *)0;
+    }
+    printf("  %-18s %6u B -> %7u B  %6llu us\n", name, size, (unsigned)c->alen, us);
+    return c;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = (argc > 1) ? atoi(argv[1]) : 2;
+    if (seconds <= 0) seconds = 2;
+
+    if (Mix_OpenAudio(RATE, AUDIO_S16SYS, 2, SAMPLES) < 0) {
+        puts("sdlmixbench: cannot open audio");
+        return 1;
+    }
+    printf("sdlmixbench: %d Hz stereo, %d-frame buffers, %d s per run\n",
+           RATE, SAMPLES, seconds);
+
+    puts("WAV load and conversion:");
+    Mix_Chunk *chunks[3];
+    chunks[0] = load("11025 Hz mono U8", 11025, 1, 8);
+    chunks[1] = load("22050 Hz stereo S16", 22050, 2, 16);
+    chunks[2] = load("44100 Hz stereo S16", RATE, 2, 16);
+    if (!chunks[0] || !chunks[1] || !chunks[2]) {
+        Mix_CloseAudio();
+        return 1;
+    }
+
+    Mix_HookMusic(hook_start, (void *)0);
+    Mix_SetPostMix(hook_done, (void *)0);
+
+    puts("Mixing:");
+    for (int n = 1; n <= MIX_CHANNELS; n *= 2) {
+        for (int ch = 0; ch < n; ch++) {
+            /* Channel 0 stays at unity gain, the rest are scaled. */
+            Mix_Volume(ch, ch ? MIX_MAX_VOLUME * 3 / 4 : MIX_MAX_VOLUME);
+            Mix_SetPanning(ch, ch ? (Uint8)(255 - ch * 20) : 255, ch ? (Uint8)(128 + ch * 10) : 255);
+            Mix_PlayChannel(ch, chunks[ch % 3], -1);
+        }
+        sys_sleep_ms(100);   /* let the worker settle into its rhythm */
+        g_mix_us = 0;
+        g_callbacks = 0;
+        sys_sleep_ms((unsigned)seconds * 1000);
+        unsigned long long us = g_mix_us, cbs = g_callbacks;
+        Mix_HaltChannel(-1);
+
+        if (us == 0) us = 1;
+        printf("  %d ch  %5llu buffers  %5llu us/buffer  %7llu channels/ms CPU\n",
+               n, cbs, cbs ? us / cbs : 0, (unsigned long long)n * cbs * 1000ULL / us);
+    }
+
+    Mix_HookMusic((void (*)(void *, Uint8 *, int))0, (void *)0);
+    Mix_SetPostMix((void (*)(void *, Uint8 *, int))0, (void *)0);
+    for (int i = 0; i < 3; i++) Mix_FreeChunk(chunks[i]);
+    Mix_CloseAudio();
+    return 0;
+}
@@ -2,13 +2,14 @@
  * sh.c — potatOS userland shell (ring-3)
  *
  * Runs in its own window, provides built-in commands, and launches
- * other ELF programs via fork + exec + waitpid.
+ * other ELF programs via posix_spawn + waitpid.
  */
 
 #include "libc/stdio.h"
 #include "libc/stdlib.h"
 #include "libc/string.h"
 #include "libc/syscall.h"
+#include "libc/spawn.h"
 
 #ifndef NULL
 #define NULL ((void*)0)
@@ -407,14 +408,15 @@ static void cmd_exec(char* argv[], int argc) {
 
     argv[0] = full;  /* argv[0] = full path */
 
-    long child = sys_fork();
-    if (child == 0) {
-        /* child */
-        int r = sys_exec(full, argc, (const char* const*)argv);
-        if (r < 0) printf("exec: not found: %s\n", full);
-        sys_exit(1);
+    (void)argc;  /* argv is NULL-terminated by tokenise() */
+
+    /* posix_spawn loads the program into a fresh address space; nothing of
+     * the shell is copied just to be thrown away by exec. */
+    pid_t child;
+    if (posix_spawn(&child, full, NULL, NULL, argv, environ) != 0) {
+        printf("exec: not found: %s\n", full);
+        return;
     }
-    /* parent */
     int code = 0;
     sys_waitpid(child, &code);
     printf("[exit %d]\n", code);
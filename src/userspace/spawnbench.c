@@ -0,0 +1,121 @@
+/* spawnbench — cost of launching a program three ways:
+ *
+ *   fork  + exec + waitpid   (copies the whole caller first)
+ *   vfork + exec + waitpid   (borrows the caller until exec)
+ *   posix_spawn  + waitpid   (loads straight into a new address space)
+ *
+ * Each launch starts BIN/EXEC100K.ELF, which exits immediately.  Pass a
+ * count as argv[1] (default 50).  Also checks that a posix_spawn dup2 file
+ * action really redirects the child's stdout into a pipe. */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/string.h"
+#include "libc/syscall.h"
+#include "libc/spawn.h"
+
+#define TARGET "BIN/EXEC100K.ELF"
+
+static char *const child_argv[] = { TARGET, NULL };
+
+/* Big enough to make fork's copy visible, as any real shell would be. */
+static char ballast[256 * 1024];
+
+static int launch_fork(void)
+{
+    long pid = sys_fork();
+    if (pid == 0) {
+        sys_exec(TARGET, 1, (const char *const *)child_argv);
+        sys_exit(127);
+    }
+    if (pid < 0) return -1;
+    int code = 0;
+    sys_waitpid(pid, &code);
+    return code;
+}
+
+static int launch_vfork(void)
+{
+    long pid = sys_vfork();
+    if (pid == 0) {
+        sys_exec(TARGET, 1, (const char *const *)child_argv);
+        sys_exit(127);
+    }
+    if (pid < 0) return -1;
+    int code = 0;
+    sys_waitpid(pid, &code);
+    return code;
+}
+
+static int launch_spawn(void)
+{
+    pid_t pid;
+    if (posix_spawn(&pid, TARGET, NULL, NULL, child_argv, environ) != 0)
+        return -1;
+    int code = 0;
+    sys_waitpid(pid, &code);
+    return code;
+}
+
+static void run(const char *name, int (*launch)(void), int n)
+{
+    unsigned long long t0 = sys_get_micros();
+    int failed = 0;
+    for (int i = 0; i < n; i++)
+        if (launch() != 0) failed++;
+    unsigned long long us = sys_get_micros() - t0;
+    if (us == 0) us = 1;
+    printf("  %-20s %4d launches  %8llu us/launch  %6llu launches/s",
+           name, n, us / (unsigned long long)n,
+           (unsigned long long)n * 1000000ULL / us);
+    if (failed) printf("  (%d FAILED)", failed);
+    printf("\n");
+}
+
+/* posix_spawn hello with stdout dup2'd onto a pipe; the greeting must come
+ * back through the pipe rather than the terminal. */
+static int check_dup2(void)
+{
+    int fds[2];
+    if (sys_pipe(fds) < 0) return 0;
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, fds[1], 1);
+    posix_spawn_file_actions_addclose(&fa, fds[1]);
+    posix_spawn_file_actions_addclose(&fa, fds[0]);
+
+    static char *const hello_argv[] = { "BIN/HELLO.ELF", NULL };
+    pid_t pid;
+    int rc = posix_spawn(&pid, "BIN/HELLO.ELF", &fa, NULL, hello_argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    sys_close(fds[1]);
+    if (rc != 0) { sys_close(fds[0]); return 0; }
+
+    char buf[64];
+    long got = 0, r;
+    while (got < (long)sizeof(buf) - 1 &&
+           (r = sys_read(fds[0], buf + got, sizeof(buf) - 1 - got)) > 0)
+        got += r;
+    buf[got] = '\0';
+    sys_close(fds[0]);
+    int code = 0;
+    sys_waitpid(pid, &code);
+    return strncmp(buf, "Hello from C userspace!", 23) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 50;
+    if (n <= 0) n = 50;
+    ballast[0] = 1;
+
+    printf("spawnbench: %d x %s\n", n, TARGET);
+    run("fork+exec+waitpid", launch_fork, n);
+    run("vfork+exec+waitpid", launch_vfork, n);
+    run("posix_spawn+waitpid", launch_spawn, n);
+
+    int ok = check_dup2();
+    printf("  posix_spawn dup2 -> pipe: %s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
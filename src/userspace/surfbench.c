@@ -0,0 +1,90 @@
+/* surfbench — full-screen fill through the two ways a client can get
+ * pixels into its window:
+ *
+ *   SYS_DRAW_PIXELS      render RGB24 into a private buffer; the kernel
+ *                        converts and copies it into the window
+ *   mapped surface       render straight into the window's pixel buffer
+ *                        (sys_map_window_surface) and commit the damage
+ *
+ * Each frame repaints every pixel with a new colour.  Pass a frame count
+ * as argv[1] (default 60).  The compositor runs as its own task, so these
+ * figures are the rate a client can submit frames, not the scan-out rate. */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/syscall.h"
+
+static unsigned int frame_color(int i)
+{
+    return ((unsigned int)(i * 7) & 0xFF) << 16 |
+           ((unsigned int)(i * 3) & 0xFF) << 8 |
+           ((unsigned int)(255 - i) & 0xFF);
+}
+
+static void report(const char *name, int n, unsigned long long us)
+{
+    if (us == 0) us = 1;
+    printf("  %-16s %4d frames  %8llu us/frame  %4llu fps\n",
+           name, n, us / (unsigned long long)n,
+           (unsigned long long)n * 1000000ULL / us);
+}
+
+static unsigned long long run_draw_pixels(int n, long w, long h)
+{
+    unsigned long bytes = (unsigned long)w * h * 3;
+    unsigned char *rgb = (unsigned char *)sys_mmap(bytes);
+    if (!rgb || (long)rgb == -1) return 0;
+
+    unsigned long long t0 = sys_get_micros();
+    for (int i = 0; i < n; i++) {
+        unsigned int c = frame_color(i);
+        unsigned char r = c >> 16, g = c >> 8, b = c;
+        for (unsigned long p = 0; p < bytes; p += 3) {
+            rgb[p] = r; rgb[p + 1] = g; rgb[p + 2] = b;
+        }
+        sys_draw_pixels(rgb, 0, 0, w, h);
+    }
+    unsigned long long us = sys_get_micros() - t0;
+    sys_munmap(rgb, bytes);
+    return us;
+}
+
+static unsigned long long run_surface(int n, long w, long h)
+{
+    uint32_t *px = sys_map_window_surface();
+    if (!px) return 0;
+
+    unsigned long count = (unsigned long)w * h;
+    unsigned long long t0 = sys_get_micros();
+    for (int i = 0; i < n; i++) {
+        uint32_t c = frame_color(i);
+        for (unsigned long p = 0; p < count; p++)
+            px[p] = c;
+        sys_commit_window(NULL, 0);
+    }
+    return sys_get_micros() - t0;
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 60;
+    if (n <= 0) n = 60;
+
+    long w = sys_fb_width(), h = sys_fb_height();
+    long wid = sys_create_window_chromeless(0, 0, w, h);
+    if (wid < 0) {
+        puts("surfbench: failed to create window");
+        return 1;
+    }
+
+    unsigned long long us_draw = run_draw_pixels(n, w, h);
+    unsigned long long us_surf = run_surface(n, w, h);
+    sys_destroy_window(wid);
+
+    printf("surfbench: %ldx%ld, %d frames\n", w, h, n);
+    if (us_draw) report("SYS_DRAW_PIXELS", n, us_draw);
+    else         puts("  SYS_DRAW_PIXELS  FAILED (no memory)");
+    if (us_surf) report("mapped surface", n, us_surf);
+    else         puts("  mapped surface   FAILED (map)");
+    return (us_draw && us_surf) ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/* uibench — a list view redrawn through the drawing syscalls, two ways:
+ *
+ *   per-call   one syscall per operation: sys_fill_rect, sys_draw_pixels_fmt
+ *              and sys_draw_text, separators as 1-pixel fills
+ *   batch      the same operations as one SYS_DRAW_BATCH list per frame,
+ *              separators as DRAW_LINE
+ *
+ * A frame is a background fill plus, for each row, a row fill, a 16x16
+ * icon blit, a label and a separator.  A third run scrolls the list: one
+ * DRAW_COPY moves the rows up and the new bottom row is drawn, all in one
+ * batch.  Reports operations per second.  Pass a frame count as argv[1]
+ * (default 200). */
+
+#include "libc/stdio.h"
+#include "libc/stdlib.h"
+#include "libc/syscall.h"
+
+#define W      480
+#define ROW_H  16
+#define ROWS   24
+#define H      (ROWS * ROW_H)
+#define ICON   16
+#define OPS_PER_FRAME (1 + ROWS * 4)
+
+static uint32_t icon[ICON * ICON];
+static uint64_t cmdbuf[4096];   /* 32 KB, 8-byte aligned */
+static char labels[ROWS + 1][24];
+
+static uint32_t row_color(int row)
+{
+    return (row & 1) ? 0x202830 : 0x181C24;
+}
+
+static void make_label(char *out, int item)
+{
+    const char *p = "item ";
+    int n = 0;
+    while (*p) out[n++] = *p++;
+    char digits[12];
+    int d = 0;
+    do { digits[d++] = (char)('0' + item % 10); item /= 10; } while (item);
+    while (d) out[n++] = digits[--d];
+    out[n] = '\0';
+}
+
+static void report(const char *name, int frames, long ops, unsigned long long us)
+{
+    if (us == 0) us = 1;
+    printf("  %-12s %6llu us/frame  %8llu ops/s  %5llu fps\n", name,
+           us / (unsigned long long)frames,
+           (unsigned long long)ops * 1000000ULL / us,
+           (unsigned long long)frames * 1000000ULL / us);
+}
+
+static void run_per_call(int n)
+{
+    unsigned long long t0 = sys_get_micros();
+    for (int f = 0; f < n; f++) {
+        sys_fill_rect(0, 0, W, H, 0x101010);
+        for (int r = 0; r < ROWS; r++) {
+            int y = r * ROW_H;
+            sys_fill_rect(0, y, W, ROW_H, row_color(r + f));
+            sys_draw_pixels_fmt(icon, 4, y, ICON, ICON, PIXFMT_XRGB8888, 0);
+            sys_draw_text(4 + ICON + 8, y, labels[r], 0xE0E0E0, row_color(r + f));
+            sys_fill_rect(0, y + ROW_H - 1, W, 1, 0x404850);
+        }
+    }
+    report("per-call", n, (long)n * OPS_PER_FRAME, sys_get_micros() - t0);
+}
+
+/* Append one row's four commands. */
+static int add_row(struct draw_list *l, int r, int y, int shade)
+{
+    if (draw_list_fill(l, 0, y, W, ROW_H, row_color(shade))) return -1;
+    struct draw_blit *b = (struct draw_blit *)draw_list_add(l, DRAW_BLIT, sizeof(*b));
+    if (!b) return -1;
+    b->x = 4; b->y = y; b->w = ICON; b->h = ICON;
+    b->format = PIXFMT_XRGB8888; b->stride = 0; b->pixels = (uint64_t)(unsigned long)icon;
+    if (draw_list_text(l, 4 + ICON + 8, y, labels[r], 0xE0E0E0, row_color(shade))) return -1;
+    struct draw_line *ln = (struct draw_line *)draw_list_add(l, DRAW_LINE, sizeof(*ln));
+    if (!ln) return -1;
+    ln->x0 = 0; ln->y0 = y + ROW_H - 1; ln->x1 = W - 1; ln->y1 = ln->y0;
+    ln->color = 0x404850;
+    return 0;
+}
+
+static int run_batch(int n)
+{
+    struct draw_list l = { (unsigned char *)cmdbuf, 0, sizeof(cmdbuf) };
+    long ops = 0;
+    unsigned long long t0 = sys_get_micros();
+    for (int f = 0; f < n; f++) {
+        draw_list_fill(&l, 0, 0, W, H, 0x101010);
+        for (int r = 0; r < ROWS; r++)
+            if (add_row(&l, r, r * ROW_H, r + f)) return 0;
+        long done = draw_list_flush(&l);
+        if (done != OPS_PER_FRAME) {
+            printf("  batch: ran %ld of %d commands: FAIL\n", done, OPS_PER_FRAME);
+            return 0;
+        }
+        ops += done;
+    }
+    report("batch", n, ops, sys_get_micros() - t0);
+    return 1;
+}
+
+static int run_scroll(int n)
+{
+    struct draw_list l = { (unsigned char *)cmdbuf, 0, sizeof(cmdbuf) };
+    long ops = 0;
+    unsigned long long t0 = sys_get_micros();
+    for (int f = 0; f < n; f++) {
+        struct draw_copy *c = (struct draw_copy *)draw_list_add(&l, DRAW_COPY, sizeof(*c));
+        c->sx = 0; c->sy = ROW_H; c->w = W; c->h = H - ROW_H; c->dx = 0; c->dy = 0;
+        make_label(labels[ROWS], ROWS + f);
+        if (add_row(&l, ROWS, H - ROW_H, ROWS + f)) return 0;
+        long done = draw_list_flush(&l);
+        if (done != 5) {
+            printf("  scroll: ran %ld of 5 commands: FAIL\n", done);
+            return 0;
+        }
+        ops += done;
+    }
+    report("batch scroll", n, ops, sys_get_micros() - t0);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 200;
+    if (n <= 0) n = 200;
+
+    for (int i = 0; i < ICON * ICON; i++)
+        icon[i] = (uint32_t)(i * 13 & 0xFF) << 16 | (uint32_t)(i * 7 & 0xFF) << 8 | 0x80;
+    for (int r = 0; r < ROWS; r++)
+        make_label(labels[r], r);
+
+    long wid = sys_create_window(40, 40, W, H);
+    if (wid < 0) {
+        puts("uibench: failed to create window");
+        return 1;
+    }
+    sys_set_window_title(wid, "uibench");
+
+    printf("uibench: %dx%d, %d rows, %d ops/frame, %d frames\n",
+           W, H, ROWS, OPS_PER_FRAME, n);
+    run_per_call(n);
+    int ok = run_batch(n);
+    ok &= run_scroll(n);
+
+    /* A malformed command ends the batch: only the fill before it runs. */
+    struct draw_list l = { (unsigned char *)cmdbuf, 0, sizeof(cmdbuf) };
+    draw_list_fill(&l, 0, 0, 8, 8, 0);
+    draw_list_add(&l, 99, 8);
+    draw_list_fill(&l, 0, 0, 8, 8, 0);
+    if (draw_list_flush(&l) != 1) {
+        puts("  unknown command not rejected: FAIL");
+        ok = 0;
+    }
+    sys_destroy_window(wid);
+    return ok ? 0 : 1;
+}